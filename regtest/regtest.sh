@@ -151,8 +151,13 @@ reg_test_filter() {
 	$PROG filter sort_long_EA 'comment=comment1' > res/filter20
 	$PROG filter sort_long_EA 'zob~.*coucou.*' > res/filter21
 	$PROG filter sort_long_EA 'zob<220' > res/filter22
+	$PROG filter filter_ipv6 "comment#test1" > res/filter23
+	$PROG filter filter_ipv6 "device=Lo0|comment=test3" > res/filter24
+	$PROG -fmt "%I/%m;%O2" filter sort_long_EA 'zob<220' > res/filter25
+	$PROG -fmt "%I/%m" filter sort_long_EA 'poule=poulet|comment=comment1' > res/filter26
+	$PROG filter missing-gw 'mask>0' > res/filter27
 
-	n=22
+	n=27
 	for i in `seq 1 $n`; do
 		output_file=filter$i
 		if [ ! -f ref/$output_file ]; then
@@ -230,6 +235,8 @@ reg_test -c st-bizarr2.conf sort bizar2.csv
 #a CSV with Extended Attributes
 reg_test sort sort_long_EA
 reg_test print sort_long_EA
+#a line without GW after a line with one
+reg_test print missing-gw
 #basic print to test fmt
 reg_test -c st-fmt.conf print route_aggipv6-2
 reg_test -c st-fmt.conf print route_aggipv4
@@ -248,6 +255,9 @@ reg_test subnetagg bigcsv
 reg_test routeagg route_aggipv6
 reg_test routeagg route_aggipv6-2
 reg_test routeagg route_aggipv4
+# multi-threaded, output must not change
+reg_test -j 4 subnetagg bigcsv
+reg_test -j 3 routeagg route_aggipv6-2
 reg_test routesimplify1 BURP
 reg_test routesimplify2 BURP
 reg_test routesimplify1 simple
@@ -258,9 +268,13 @@ reg_test sortby mask	sortme
 reg_test sortby gw	sortme
 reg_test routesimplify1 simplify1
 reg_test routesimplify2 simplify1
+reg_test -j 4 routesimplify1 simplify1
 reg_test sort aggipv6
 reg_test sort sort1
 reg_test sort sort1-ipv6
+reg_test -j 4 sort sort1-ipv6
+reg_test -mem 1M sort sort1-ipv6
+reg_test -mem 1M sort sort_long_EA
 # removal
 reg_test removesubnet subnet 10.1.1.2/16  10.1.2.0/24
 reg_test removesubnet subnet 10.1.0.0/16  10.1.0.0/28
@@ -270,6 +284,9 @@ reg_test removesubnet subnet 2001:db8::/32 2001:db8:a::/64
 reg_test removesubnet subnet 2001:db8::/32 2001:db8:ffff:ffff::/64
 reg_test removesubnet file route_aggipv6-2 2001:dbb::/64
 reg_test removesubnet file route_aggipv4 10.1.4.0/32
+reg_test removesubnet file route_aggipv4 10.1.2.128/25
+reg_test removesubnet file missing-gw 10.1.2.0/24
+reg_test removefile route_aggipv6-2 remove-ipv6
 
 reg_test split 2001:db8:1::/48 16,16,16
 reg_test split 2001:db8:1::/48 16
@@ -315,6 +332,12 @@ reg_test bgpsortby localpref bgp1
 reg_test bgpsortby gw bgp1
 
 reg_test grep mergeipv6 2001:db8::
+reg_test grep grep-log 10.1.0.0/16
+reg_test grep -f grep-prefixes grep-log
+reg_test lookup route_aggipv4 lookup-addr
+reg_test lookup route_aggipv6-2 lookup-addr
+reg_test annotate route_aggipv4 annotate-log 2
+reg_test annotate route_aggipv6-2 annotate-log 2
 #ipinfo
 
 reg_test ipinfo 2001:0000:4136:e378:8000:63bf:3fff:fdd2
@@ -0,0 +1,132 @@
+/*
+ * micro-benchmark of IPv4 longest prefix match : DIR-24-8 table vs trie
+ * rebuild time, lookup rate and memory on a random BGP-like table
+ *
+ * Copyright (C) 2015 Etienne Basset <etienne POINT basset AT ensta POINT org>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of version 2 of the GNU General Public License
+ * as published by the Free Software Foundation.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "iptools.h"
+#include "st_routes_csv.h"
+#include "st_trie.h"
+#include "st_dir248.h"
+
+#define NR_ROUTES  900000
+#define NR_LOOKUPS 10000000
+#define NR_BUILDS  5
+
+static unsigned long long rnd_state = 88172645463325252ULL;
+
+static unsigned long long rnd(void)
+{
+	rnd_state ^= rnd_state << 13;
+	rnd_state ^= rnd_state >> 7;
+	rnd_state ^= rnd_state << 17;
+	return rnd_state;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* mostly /24, then /16-/23, a few longer prefixes, like a full BGP table */
+static int rnd_mask(void)
+{
+	int r = rnd() % 100;
+
+	if (r < 60)
+		return 24;
+	if (r < 95)
+		return 16 + rnd() % 8;
+	return 25 + rnd() % 8;
+}
+
+int main(int argc, char **argv)
+{
+	struct subnet_file sf;
+	struct st_dir248 dir;
+	struct st_trie trie;
+	struct subnet s;
+	ipv4 *addrs;
+	double t0, t_build, t_trie, t_dir, t_lookup;
+	unsigned long i;
+	long a, b, acc = 0;
+	int k, errors = 0;
+
+	memset(&sf, 0, sizeof(sf));
+	sf.routes = calloc(NR_ROUTES, sizeof(struct route));
+	addrs	  = malloc(NR_LOOKUPS * sizeof(ipv4));
+	if (sf.routes == NULL || addrs == NULL || alloc_dir248(&dir) < 0)
+		return 1;
+	for (i = 0; i < NR_ROUTES; i++) {
+		sf.routes[i].subnet.ip_ver = IPV4_A;
+		sf.routes[i].subnet.mask   = rnd_mask();
+		sf.routes[i].subnet.ip	   = (rnd() & 0xFFFFFFFF) &
+			(0xFFFFFFFFU << (32 - sf.routes[i].subnet.mask));
+	}
+	sf.nr = sf.max_nr = NR_ROUTES;
+	for (i = 0; i < NR_LOOKUPS; i++)
+		addrs[i] = rnd() & 0xFFFFFFFF;
+
+	t0 = now();
+	for (k = 0; k < NR_BUILDS; k++)
+		dir248_build(&dir, &sf);
+	t_build = (now() - t0) / NR_BUILDS;
+
+	t0 = now();
+	if (alloc_trie(&trie, NR_ROUTES) < 0)
+		return 1;
+	for (i = 0; i < NR_ROUTES; i++)
+		trie_insert(&trie, &sf.routes[i].subnet, i);
+	t_trie = now() - t0;
+
+	/* cross-check */
+	s.ip_ver = IPV4_A;
+	s.mask	 = 32;
+	for (i = 0; i < NR_LOOKUPS / 10; i++) {
+		s.ip = addrs[i];
+		a = dir248_lookup(&dir, addrs[i]);
+		b = trie_longest_match(&trie, &s, 32);
+		if (a != b && (a < 0 || b < 0 ||
+				sf.routes[a].subnet.mask != sf.routes[b].subnet.mask))
+			errors++;
+	}
+	if (errors) {
+		fprintf(stderr, "%d mismatches between DIR-24-8 and trie\n", errors);
+		return 1;
+	}
+
+	t0 = now();
+	for (i = 0; i < NR_LOOKUPS; i++)
+		acc += dir248_lookup(&dir, addrs[i]);
+	t_dir = now() - t0;
+	t0 = now();
+	for (i = 0; i < NR_LOOKUPS; i++) {
+		s.ip = addrs[i];
+		acc += trie_longest_match(&trie, &s, 32);
+	}
+	t_lookup = now() - t0;
+
+	printf("%d routes, %lu tbl8 groups (checksum %ld)\n", NR_ROUTES, dir.nr_tbl8, acc);
+	printf("DIR-24-8 : build %7.1f ms, %6.1f M lookups/s, %lu KiB\n", t_build * 1e3,
+			NR_LOOKUPS / t_dir / 1e6, dir248_memory(&dir) >> 10);
+	printf("trie     : build %7.1f ms, %6.1f M lookups/s, %lu KiB\n", t_trie * 1e3,
+			NR_LOOKUPS / t_lookup / 1e6,
+			(unsigned long)(trie.max_nodes * sizeof(struct trie_node)
+				+ (trie.max_items + 1) * sizeof(long)) >> 10);
+	free_trie(&trie);
+	free_dir248(&dir);
+	free(addrs);
+	free(sf.routes);
+	return 0;
+}
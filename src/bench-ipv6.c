@@ -0,0 +1,234 @@
+/*
+ * micro-benchmark of IPv6 prefix math : 64-bit words vs the old 16-bit block bitmaps
+ *
+ * Copyright (C) 2015 Etienne Basset <etienne POINT basset AT ensta POINT org>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of version 2 of the GNU General Public License
+ * as published by the Free Software Foundation.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "iptools.h"
+#include "bitmap.h"
+
+#define NR_SUBNETS 4096
+#define NR_LOOPS   500
+
+/* the old representation : 8 blocks, block 0 is the most significant */
+struct old_subnet {
+	unsigned short n16[8];
+	int mask;
+};
+
+static int old_is_equal(const unsigned short *a, const unsigned short *b)
+{
+	return !memcmp(a, b, 8 * sizeof(unsigned short));
+}
+
+static int old_subnet_compare(const struct old_subnet *s1, const struct old_subnet *s2)
+{
+	unsigned short a[8], b[8];
+	int mask = (s1->mask < s2->mask ? s1->mask : s2->mask);
+
+	memcpy(a, s1->n16, sizeof(a));
+	memcpy(b, s2->n16, sizeof(b));
+	shift_right(a, 8, 128 - mask);
+	shift_right(b, 8, 128 - mask);
+	if (!old_is_equal(a, b))
+		return NOMATCH;
+	if (s1->mask > s2->mask)
+		return INCLUDED;
+	if (s1->mask < s2->mask)
+		return INCLUDES;
+	return EQUALS;
+}
+
+static int old_subnet_is_superior(const struct old_subnet *s1, const struct old_subnet *s2)
+{
+	if (old_is_equal(s1->n16, s2->n16))
+		return s1->mask < s2->mask;
+	return bitmap_is_inferior(s1->n16, s2->n16, 8);
+}
+
+static void old_next_subnet(struct old_subnet *s)
+{
+	shift_right(s->n16, 8, 128 - s->mask);
+	increase_bitmap(s->n16, 8);
+	shift_left(s->n16, 8, 128 - s->mask);
+}
+
+static int old_can_decrease_mask(const struct old_subnet *s)
+{
+	unsigned short b[8];
+	int i = 0;
+
+	memcpy(b, s->n16, sizeof(b));
+	shift_right(b, 8, 128 - s->mask);
+	while (i < s->mask) {
+		if (b[7] & 1)
+			break;
+		i++;
+		shift_right(b, 8, 1);
+	}
+	return i;
+}
+
+static int old_aggregate(const struct old_subnet *s1, const struct old_subnet *s2,
+		struct old_subnet *res)
+{
+	unsigned short a[8], b[8];
+
+	if (s1->mask != s2->mask)
+		return -1;
+	memcpy(a, s1->n16, sizeof(a));
+	memcpy(b, s2->n16, sizeof(b));
+	shift_right(a, 8, 128 - s1->mask);
+	shift_right(b, 8, 128 - s1->mask);
+	if (old_is_equal(a, b)) {
+		*res = *s1;
+		return 1;
+	}
+	shift_right(a, 8, 1);
+	shift_right(b, 8, 1);
+	if (!old_is_equal(a, b))
+		return -1;
+	res->mask = s1->mask - 1;
+	shift_left(a, 8, 128 - res->mask);
+	memcpy(res->n16, a, sizeof(a));
+	return 1;
+}
+
+static void to_old(struct old_subnet *o, const struct subnet *s)
+{
+	int i;
+
+	for (i = 0; i < 8; i++)
+		o->n16[i] = block(s->ip6, i);
+	o->mask = s->mask;
+}
+
+static int same_subnet(const struct old_subnet *o, const struct subnet *s)
+{
+	struct old_subnet n;
+
+	to_old(&n, s);
+	return old_is_equal(o->n16, n.n16) && o->mask == s->mask;
+}
+
+static unsigned long long rnd_state = 88172645463325252ULL;
+
+static unsigned long long rnd(void)
+{
+	rnd_state ^= rnd_state << 13;
+	rnd_state ^= rnd_state >> 7;
+	rnd_state ^= rnd_state << 17;
+	return rnd_state;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static struct subnet new_s[NR_SUBNETS];
+static struct old_subnet old_s[NR_SUBNETS];
+static volatile long sink;
+
+static void report(const char *name, double t_old, double t_new)
+{
+	double ops = (double)NR_SUBNETS * NR_LOOPS;
+
+	printf("%-18s old %7.2f ns/op   new %7.2f ns/op   x%.1f\n", name,
+			t_old * 1e9 / ops, t_new * 1e9 / ops, t_old / t_new);
+}
+
+int main(int argc, char **argv)
+{
+	struct subnet ns, nr = { 0 };
+	struct old_subnet os, orr = { {0}, 0 };
+	double t0, t_old, t_new;
+	long acc;
+	int i, j, k, errors = 0;
+
+	/* prefixes that share a few random /32 to get INCLUDES/EQUALS too */
+	for (i = 0; i < NR_SUBNETS; i++) {
+		k = rnd() % 16;
+		memset(&new_s[i], 0, sizeof(struct subnet));
+		new_s[i].ip_ver = IPV6_A;
+		new_s[i].ip6.n64[0] = (0x20010db8ULL + k) << 32 | (rnd() & 0xFFFF0000ULL);
+		new_s[i].ip6.n64[1] = rnd();
+		new_s[i].mask = 16 + rnd() % 113;
+		first_ip(&new_s[i]);
+		to_old(&old_s[i], &new_s[i]);
+	}
+
+	/* cross-check first */
+	for (i = 0; i < NR_SUBNETS; i++) {
+		j = (i * 7 + 1) % NR_SUBNETS;
+		if (old_subnet_compare(&old_s[i], &old_s[j]) != subnet_compare(&new_s[i], &new_s[j]))
+			errors++;
+		if (old_subnet_is_superior(&old_s[i], &old_s[j]) != subnet_is_superior(&new_s[i], &new_s[j]))
+			errors++;
+		if (old_can_decrease_mask(&old_s[i]) != can_decrease_mask(&new_s[i]))
+			errors++;
+		os = old_s[i];
+		ns = new_s[i];
+		old_next_subnet(&os);
+		next_subnet(&ns);
+		if (!same_subnet(&os, &ns))
+			errors++;
+		previous_subnet(&ns);
+		if (!same_subnet(&old_s[i], &ns))
+			errors++;
+		next_subnet(&ns);
+		if (old_aggregate(&old_s[i], &os, &orr) != aggregate_subnet(&new_s[i], &ns, &nr))
+			errors++;
+		if (orr.mask != nr.mask || !same_subnet(&orr, &nr))
+			errors++;
+	}
+	if (errors) {
+		fprintf(stderr, "%d mismatches between old and new IPv6 math\n", errors);
+		return 1;
+	}
+
+#define BENCH(__name, __old, __new) do { \
+	acc = 0; \
+	t0 = now(); \
+	for (k = 0; k < NR_LOOPS; k++) \
+		for (i = 0; i < NR_SUBNETS; i++) { \
+			j = (i + k) & (NR_SUBNETS - 1); \
+			__old; \
+		} \
+	t_old = now() - t0; \
+	sink = acc; \
+	acc = 0; \
+	t0 = now(); \
+	for (k = 0; k < NR_LOOPS; k++) \
+		for (i = 0; i < NR_SUBNETS; i++) { \
+			j = (i + k) & (NR_SUBNETS - 1); \
+			__new; \
+		} \
+	t_new = now() - t0; \
+	sink = acc; \
+	report(__name, t_old, t_new); \
+} while (0)
+
+	BENCH("subnet_compare", acc += old_subnet_compare(&old_s[i], &old_s[j]),
+			acc += subnet_compare(&new_s[i], &new_s[j]));
+	BENCH("subnet_is_superior", acc += old_subnet_is_superior(&old_s[i], &old_s[j]),
+			acc += subnet_is_superior(&new_s[i], &new_s[j]));
+	BENCH("next_subnet", os = old_s[i]; old_next_subnet(&os); acc += os.n16[7],
+			ns = new_s[i]; next_subnet(&ns); acc += ns.ip6.n64[1]);
+	BENCH("can_decrease_mask", acc += old_can_decrease_mask(&old_s[i]),
+			acc += can_decrease_mask(&new_s[i]));
+	BENCH("aggregate_subnet", os = old_s[i]; old_next_subnet(&os);
+			acc += old_aggregate(&old_s[i], &os, &orr),
+			ns = new_s[i]; next_subnet(&ns); acc += aggregate_subnet(&new_s[i], &ns, &nr));
+	return 0;
+}
@@ -0,0 +1,168 @@
+/*
+ * micro-benchmark of address parsing : string2addr (vector fast paths) vs string2addr_scalar
+ * both must agree on every string, valid or not
+ *
+ * Copyright (C) 2015 Etienne Basset <etienne POINT basset AT ensta POINT org>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of version 2 of the GNU General Public License
+ * as published by the Free Software Foundation.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "iptools.h"
+#include "string2ip.h"
+
+#define NR_ADDRS   2000000
+#define NR_FUZZ    4000000
+#define ADDR_LEN   48
+
+static unsigned long long rnd_state = 88172645463325252ULL;
+
+static unsigned long long rnd(void)
+{
+	rnd_state ^= rnd_state << 13;
+	rnd_state ^= rnd_state >> 7;
+	rnd_state ^= rnd_state << 17;
+	return rnd_state;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* IPv6 like they are printed : zeros compressed, some leading zeros, mixed case */
+static void rnd_ipv6(char *s)
+{
+	unsigned short b[8];
+	int i, z, nz, k = 0;
+
+	for (i = 0; i < 8; i++)
+		b[i] = (rnd() % 3 ? rnd() & (rnd() % 2 ? 0xFFFF : 0xFF) : 0);
+	z  = rnd() % 8;
+	nz = rnd() % (9 - z);
+	for (i = z; i < z + nz; i++)
+		b[i] = 0;
+	for (i = 0; i < 8; i++) {
+		if (nz > 0 && i == z) {
+			k += sprintf(s + k, "::");
+			i += nz - 1;
+			continue;
+		}
+		if (k && s[k - 1] != ':')
+			s[k++] = ':';
+		k += sprintf(s + k, rnd() % 4 ? "%x" : (rnd() % 2 ? "%04X" : "%X"), b[i]);
+	}
+	s[k] = '\0';
+}
+
+static void rnd_ipv4(char *s)
+{
+	sprintf(s, rnd() % 8 ? "%d.%d.%d.%d" : "%03d.%d.%02d.%d",
+			(int)(rnd() % 256), (int)(rnd() % 256), (int)(rnd() % 256),
+			(int)(rnd() % 256));
+}
+
+/* mutate a valid address : change, insert or remove a few chars */
+static void fuzz(char *s)
+{
+	static const char alphabet[] = "0123456789abcdefABCDEF:.:./ xg\0";
+	int i, k, len;
+
+	for (k = rnd() % 3; k >= 0; k--) {
+		len = strlen(s);
+		i = rnd() % (len + 1);
+		switch (rnd() % 3) {
+		case 0:
+			s[i] = alphabet[rnd() % (sizeof(alphabet) - 1)];
+			if (i == len)
+				s[i + 1] = '\0';
+			break;
+		case 1:
+			if (len < ADDR_LEN - 2) {
+				memmove(s + i + 1, s + i, len - i + 1);
+				s[i] = alphabet[rnd() % (sizeof(alphabet) - 1)];
+			}
+			break;
+		default:
+			if (i < len)
+				memmove(s + i, s + i + 1, len - i);
+			break;
+		}
+	}
+}
+
+static int same(const char *s, size_t len)
+{
+	struct ip_addr a, b;
+	int ra, rb;
+
+	ra = string2addr(s, &a, len);
+	rb = string2addr_scalar(s, &b, len);
+	if (ra != rb)
+		return 0;
+	if (ra == IPV4_A)
+		return a.ip == b.ip;
+	if (ra == IPV6_A)
+		return !memcmp(&a.ip6, &b.ip6, sizeof(a.ip6));
+	return 1;
+}
+
+int main(int argc, char **argv)
+{
+	char *addrs;
+	char *s;
+	struct ip_addr a;
+	double t0, t_scalar, t_vector;
+	unsigned long i, len, errors = 0;
+	long acc = 0;
+	int ver;
+
+	addrs = malloc((unsigned long)NR_ADDRS * ADDR_LEN);
+	if (addrs == NULL)
+		return 1;
+	for (ver = 0; ver < 2; ver++) {
+		/* cross-check : valid, mutated and truncated strings */
+		for (i = 0; i < NR_FUZZ; i++) {
+			s = addrs + (i % NR_ADDRS) * ADDR_LEN;
+			memset(s, 0, ADDR_LEN);
+			ver ? rnd_ipv6(s) : rnd_ipv4(s);
+			if (i & 1)
+				fuzz(s);
+			len = rnd() % 42;
+			if (!same(s, 41) || !same(s, len)) {
+				if (errors++ < 10)
+					fprintf(stderr, "mismatch on '%s' (len %lu)\n", s, len);
+			}
+		}
+		if (errors) {
+			fprintf(stderr, "%lu mismatches between string2addr and string2addr_scalar\n",
+					errors);
+			return 1;
+		}
+
+		for (i = 0; i < NR_ADDRS; i++)
+			ver ? rnd_ipv6(addrs + i * ADDR_LEN) : rnd_ipv4(addrs + i * ADDR_LEN);
+		t0 = now();
+		for (i = 0; i < NR_ADDRS; i++)
+			acc += string2addr_scalar(addrs + i * ADDR_LEN, &a, 41) + a.ip;
+		t_scalar = now() - t0;
+		t0 = now();
+		for (i = 0; i < NR_ADDRS; i++)
+			acc += string2addr(addrs + i * ADDR_LEN, &a, 41) + a.ip;
+		t_vector = now() - t0;
+		printf("%s : scalar %6.2f ns/addr   vector %6.2f ns/addr   x%.1f\n",
+				ver ? "IPv6" : "IPv4", t_scalar * 1e9 / NR_ADDRS,
+				t_vector * 1e9 / NR_ADDRS, t_scalar / t_vector);
+	}
+	printf("%d addresses, %d fuzzed strings cross-checked (checksum %ld)\n",
+			NR_ADDRS, NR_FUZZ, acc);
+	free(addrs);
+	return 0;
+}
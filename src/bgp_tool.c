@@ -13,10 +13,11 @@
 #include "string2ip.h"
 #include "utils.h"
 #include "generic_csv.h"
-#include "heap.h"
 #include "st_printf.h"
 #include "st_scanf.h"
 #include "generic_expr.h"
+#include "hash_tab.h"
+#include "radix.h"
 #include "bgp_tool.h"
 
 #define SIZE_T_MAX ((size_t)0 - 1)
@@ -60,9 +61,20 @@ void zero_bgproute(struct bgp_route *a)
 int compare_bgp_file(const struct bgp_file *sf1, const struct bgp_file *sf2, struct st_options *o)
 {
 	unsigned long i, j;
-	int found, changed, changed_j;
+	long k;
+	int found, changed, changed_j, res;
+	struct subnet_hash_table ht;
 
 	debug(BGPCMP, 6, "file1 : %ld routes, file2 : %ld routes\n", sf1->nr, sf2->nr);
+	/* index best & valid routes of sf2 by prefix; same prefix routes are kept in file order */
+	res = alloc_subnet_hash_tab(&ht, sf2->nr);
+	if (res < 0)
+		return res;
+	for (j = 0; j < sf2->nr; j++) {
+		if (sf2->routes[j].best == 0 || sf2->routes[j].valid != 1)
+			continue;
+		insert_subnet(&ht, &sf2->routes[j].subnet, j);
+	}
 	for (i = 0; i < sf1->nr; i++) {
 		st_debug(BGPCMP, 9, "testing %P via %I\n", sf1->routes[i].subnet,
 					sf1->routes[i].gw);
@@ -73,13 +85,10 @@ int compare_bgp_file(const struct bgp_file *sf1, const struct bgp_file *sf2, str
 		}
 		found   = 0;
 		changed_j = -1;
-		for (j = 0; j < sf2->nr; j++) {
+		for (k = find_subnet(&ht, &sf1->routes[i].subnet); k != -1;
+				k = next_subnet_item(&ht, k)) {
+			j = k;
 			changed = 0;
-			if (sf2->routes[j].best == 0 || sf2->routes[j].valid != 1)
-				continue;
-			if (subnet_compare(&sf1->routes[i].subnet,
-						&sf2->routes[j].subnet) != EQUALS)
-				continue;
 			found = 1;
 			if (is_equal_ip(&sf1->routes[i].gw, &sf2->routes[j].gw) == 0)
 				changed++;
@@ -118,6 +127,7 @@ int compare_bgp_file(const struct bgp_file *sf1, const struct bgp_file *sf2, str
 		fprintf(o->output_file, "WAS      ;");
 		fprint_bgp_route(o->output_file, &sf1->routes[i]);
 	}
+	free_subnet_hash_tab(&ht);
 	return 1;
 }
 
@@ -167,115 +177,119 @@ int as_path_length(const char *s)
 	return num;
 }
 
-static int __heap_subnet_is_superior(void *v1, void *v2)
-{
-	struct subnet *s1 = &((struct bgp_route *)v1)->subnet;
-	struct subnet *s2 = &((struct bgp_route *)v2)->subnet;
-
-	return subnet_is_superior(s1, s2);
-}
+/* packed sort keys, compared as big-endian numbers
+ * the route prefix (address family, address, mask) is always the tie-breaker
+ */
+struct bgp_sortkey {
+	int addr_len; /* SORTKEY_ADDR4_LEN or SORTKEY_ADDR6_LEN */
+	int aspath_len; /* longest AS_PATH in file + 1 */
+};
 
-static int __heap_gw_is_superior(void *v1, void *v2)
+static int __bgp_prefix_key(unsigned char *key, const struct bgp_route *r,
+		const struct bgp_sortkey *ks)
 {
-	struct subnet *s1 = &((struct bgp_route *)v1)->subnet;
-	struct subnet *s2 = &((struct bgp_route *)v2)->subnet;
-	struct ip_addr *gw1 = &((struct bgp_route *)v1)->gw;
-	struct ip_addr *gw2 = &((struct bgp_route *)v2)->gw;
-
-	if (is_equal_ip(gw1, gw2))
-		return subnet_is_superior(s1, s2);
-	else
-		return addr_is_superior(gw1, gw2);
+	return subnet_sortkey(key, &r->subnet, ks->addr_len);
 }
 
-static int __heap_med_is_superior(void *v1, void *v2)
+static int __bgp_gw_key(unsigned char *key, const struct bgp_route *r,
+		const struct bgp_sortkey *ks)
 {
-	struct subnet *s1 = &((struct bgp_route *)v1)->subnet;
-	struct subnet *s2 = &((struct bgp_route *)v2)->subnet;
-	int MED1 = ((struct bgp_route *)v1)->MED;
-	int MED2 = ((struct bgp_route *)v2)->MED;
-
-	if (MED1 == MED2)
-		return subnet_is_superior(s1, s2);
-	else
-		return (MED1 < MED2);
+	int len = addr_sortkey(key, &r->gw, ks->addr_len);
+
+	return len + subnet_sortkey(key + len, &r->subnet, ks->addr_len);
 }
 
-static int __heap_mask_is_superior(void *v1, void *v2)
+static int __bgp_med_key(unsigned char *key, const struct bgp_route *r,
+		const struct bgp_sortkey *ks)
 {
-	struct subnet *s1 = &((struct bgp_route *)v1)->subnet;
-	struct subnet *s2 = &((struct bgp_route *)v2)->subnet;
+	int len = int_sortkey(key, r->MED);
 
-	if (s1->mask == s2->mask)
-		return subnet_is_superior(s1, s2);
-	else
-		return (s1->mask < s2->mask);
+	return len + subnet_sortkey(key + len, &r->subnet, ks->addr_len);
 }
 
-static int __heap_localpref_is_superior(void *v1, void *v2)
+static int __bgp_mask_key(unsigned char *key, const struct bgp_route *r,
+		const struct bgp_sortkey *ks)
 {
-	struct subnet *s1 = &((struct bgp_route *)v1)->subnet;
-	struct subnet *s2 = &((struct bgp_route *)v2)->subnet;
-	int LOCAL_PREF1 = ((struct bgp_route *)v1)->LOCAL_PREF;
-	int LOCAL_PREF2 = ((struct bgp_route *)v2)->LOCAL_PREF;
-
-	if (LOCAL_PREF1 == LOCAL_PREF2)
-		return subnet_is_superior(s1, s2);
-	else
-		return (LOCAL_PREF1 > LOCAL_PREF2);
+	key[0] = r->subnet.mask;
+	return 1 + subnet_sortkey(key + 1, &r->subnet, ks->addr_len);
 }
 
-static int __heap_aspath_is_superior(void *v1, void *v2)
+static int __bgp_localpref_key(unsigned char *key, const struct bgp_route *r,
+		const struct bgp_sortkey *ks)
 {
-	char *s1 = ((struct bgp_route *)v1)->AS_PATH;
-	char *s2 = ((struct bgp_route *)v2)->AS_PATH;
-	int l1, l2;
-
-	/* if AS_PATH length is the same
-	 * we compare char by char the strings
-	 * if AS_PATh is the same, we sort by prefix
-	 */
-	l1 = as_path_length(s1);
-	l2 = as_path_length(s2);
-	if (l1 == l2) {
-		if (!strcmp(s1, s2)) {
-			struct subnet *sub1 = &((struct bgp_route *)v1)->subnet;
-			struct subnet *sub2 = &((struct bgp_route *)v2)->subnet;
-
-			return subnet_is_superior(sub1, sub2);
-		}
-		return strcmp(s1, s2);
-	}
-	return (l1 < l2);
+	int i, len;
+
+	/* higher LOCAL_PREF is better */
+	len = int_sortkey(key, r->LOCAL_PREF);
+	for (i = 0; i < len; i++)
+		key[i] = ~key[i];
+	return len + subnet_sortkey(key + len, &r->subnet, ks->addr_len);
 }
 
+static int __bgp_aspath_key(unsigned char *key, const struct bgp_route *r,
+		const struct bgp_sortkey *ks)
+{
+	int len;
+
+	/* shorter AS_PATH first, then AS_PATH string (NUL padded sorts like strcmp) */
+	len = int_sortkey(key, as_path_length(r->AS_PATH));
+	memset(key + len, 0, ks->aspath_len);
+	strxcpy((char *)key + len, r->AS_PATH, ks->aspath_len);
+	len += ks->aspath_len;
+	return len + subnet_sortkey(key + len, &r->subnet, ks->addr_len);
+}
 
-static int __bgp_sort_by(struct bgp_file *sf, int cmpfunc(void *v1, void *v2))
+/* radix sort on packed keys; the sort is stable */
+static int __bgp_sort_by(struct bgp_file *sf, int keyfunc(unsigned char *key,
+			const struct bgp_route *r, const struct bgp_sortkey *ks))
 {
-	unsigned long i;
-	TAS tas;
-	struct bgp_route *new_r, *r;
-	int res;
+	unsigned long i, *perm;
+	unsigned char *keys, *buffer;
+	struct bgp_route *new_r;
+	struct bgp_sortkey ks;
+	int res, len, key_len;
 
 	if (sf->nr == 0)
 		return 0;
-	res = alloc_tas(&tas, sf->nr, cmpfunc);
-	if (res < 0)
+	ks.addr_len   = SORTKEY_ADDR4_LEN;
+	ks.aspath_len = 1;
+	for (i = 0; i < sf->nr; i++) {
+		if (sf->routes[i].subnet.ip_ver == IPV6_A || sf->routes[i].gw.ip_ver == IPV6_A)
+			ks.addr_len = SORTKEY_ADDR6_LEN;
+		len = strlen(sf->routes[i].AS_PATH) + 1;
+		if (len > ks.aspath_len)
+			ks.aspath_len = len;
+	}
+	/* large enough for any key */
+	buffer = st_malloc(ks.aspath_len + 64, "sort key");
+	if (buffer == NULL)
+		return -1;
+	key_len = keyfunc(buffer, &sf->routes[0], &ks);
+	st_free(buffer, ks.aspath_len + 64);
+	keys = st_malloc(sf->nr * key_len, "sort keys");
+	if (keys == NULL)
+		return -1;
+	perm = st_malloc(sf->nr * sizeof(unsigned long), "sort permutation");
+	if (perm == NULL) {
+		st_free(keys, sf->nr * key_len);
+		return -1;
+	}
+	for (i = 0; i < sf->nr; i++)
+		keyfunc(keys + i * key_len, &sf->routes[i], &ks);
+	res = radix_sort(keys, key_len, sf->nr, perm);
+	st_free(keys, sf->nr * key_len);
+	if (res < 0) {
+		st_free(perm, sf->nr * sizeof(unsigned long));
 		return res;
-
+	}
 	new_r = st_malloc(sf->max_nr * sizeof(struct bgp_route), "new bgp_route");
 	if (new_r == NULL) {
-		free_tas(&tas);
+		st_free(perm, sf->nr * sizeof(unsigned long));
 		return -1;
 	}
-	/* basic heapsort */
 	for (i = 0 ; i < sf->nr; i++)
-		addTAS(&tas, &(sf->routes[i]));
-	for (i = 0 ; i < sf->nr; i++) {
-		r = popTAS(&tas);
-		copy_bgproute(&new_r[i], r);
-	}
-	free_tas(&tas);
+		copy_bgproute(&new_r[i], &sf->routes[perm[i]]);
+	st_free(perm, sf->nr * sizeof(unsigned long));
 	st_free(sf->routes, sf->max_nr * sizeof(struct bgp_route));
 	sf->routes = new_r;
 	return 0;
@@ -283,16 +297,17 @@ static int __bgp_sort_by(struct bgp_file *sf, int cmpfunc(void *v1, void *v2))
 
 struct bgpsort {
 	char *name;
-	int (*cmpfunc)(void *v1, void *v2);
+	int (*keyfunc)(unsigned char *key, const struct bgp_route *r,
+			const struct bgp_sortkey *ks);
 };
 
 static const struct bgpsort bgpsort[] = {
-	{ "prefix",	&__heap_subnet_is_superior },
-	{ "gw",		&__heap_gw_is_superior },
-	{ "med",	&__heap_med_is_superior },
-	{ "mask",	&__heap_mask_is_superior },
-	{ "localpref",	&__heap_localpref_is_superior },
-	{ "aspath",	&__heap_aspath_is_superior },
+	{ "prefix",	&__bgp_prefix_key },
+	{ "gw",		&__bgp_gw_key },
+	{ "med",	&__bgp_med_key },
+	{ "mask",	&__bgp_mask_key },
+	{ "localpref",	&__bgp_localpref_key },
+	{ "aspath",	&__bgp_aspath_key },
 	{NULL,		NULL}
 };
 
@@ -317,7 +332,7 @@ int bgp_sort_by(struct bgp_file *sf, char *name)
 			break;
 		if (!strncasecmp(name, bgpsort[i].name, strlen(name))) {
 			debug_timing_start(2);
-			res = __bgp_sort_by(sf, bgpsort[i].cmpfunc);
+			res = __bgp_sort_by(sf, bgpsort[i].keyfunc);
 			debug_timing_end(2);
 			return res;
 		}
@@ -503,29 +518,31 @@ static int bgp_route_filter(const char *s, const char *value, char op, void *obj
 int bgp_file_filter(struct bgp_file *sf, char *expr)
 {
 	unsigned long i, j;
-	int res, len;
+	int res;
 	struct generic_expr e;
 	struct bgp_route *new_r;
 
 	if (sf->nr == 0)
 		return 0;
 	init_generic_expr(&e, expr, bgp_route_filter);
+	if (compile_generic_expr(&e) < 0)
+		return -1;
 	debug_timing_start(2);
 
 	new_r = st_malloc(sf->max_nr * sizeof(struct bgp_route), "bgp_route");
 	if (new_r == NULL) {
+		free_generic_expr(&e);
 		debug_timing_end(2);
 		return -1;
 	}
 	j = 0;
-	len = strlen(expr);
 
 	for (i = 0; i < sf->nr; i++) {
-		e.object = &sf->routes[i];
-		res = run_generic_expr(expr, len, &e);
+		res = eval_generic_expr(&e, &sf->routes[i]);
 		if (res < 0) {
 			fprintf(stderr, "Invalid filter '%s'\n", expr);
 			st_free(new_r, sf->max_nr * sizeof(struct bgp_route));
+			free_generic_expr(&e);
 			debug_timing_end(2);
 			return -1;
 		}
@@ -536,9 +553,62 @@ int bgp_file_filter(struct bgp_file *sf, char *expr)
 			j++;
 		}
 	}
+	free_generic_expr(&e);
 	st_free(sf->routes, sf->max_nr * sizeof(struct bgp_route));
 	sf->routes = new_r;
 	sf->nr = j;
 	debug_timing_end(2);
 	return 0;
 }
+
+struct bgp_stream {
+	struct st_options *nof;
+	struct generic_expr e;
+	const char *expr;
+	int failed; /* the sink failed and said why */
+};
+
+static int bgp_stream_sink(struct bgp_file *sf, struct bgp_route *r, void *data)
+{
+	struct bgp_stream *bs = data;
+	int res;
+
+	if (r == NULL) {
+		fflush(bs->nof->output_file);
+		return CSV_CONTINUE;
+	}
+	res = eval_generic_expr(&bs->e, r);
+	if (res < 0) {
+		fprintf(stderr, "Invalid filter '%s'\n", bs->expr);
+		bs->failed = 1;
+		return -1;
+	}
+	if (sf->nr_streamed == 0)
+		fprint_bgproute_fmt(bs->nof->output_file, NULL, bs->nof->bgp_output_fmt);
+	if (res)
+		fprint_bgp_route(bs->nof->output_file, r);
+	return CSV_CONTINUE;
+}
+
+int bgp_file_filter_stream(char *name, char *expr, struct st_options *nof)
+{
+	struct bgp_stream bs;
+	int res;
+
+	bs.nof	  = nof;
+	bs.expr	  = expr;
+	bs.failed = 0;
+	init_generic_expr(&bs.e, expr, bgp_route_filter);
+	if (compile_generic_expr(&bs.e) < 0) {
+		fprintf(stderr, "Invalid filter '%s'\n", expr);
+		return -1;
+	}
+	res = load_bgpcsv_stream(name, nof, &bgp_stream_sink, &bs);
+	free_generic_expr(&bs.e);
+	if (res < 0) {
+		if (!bs.failed)
+			fprintf(stderr, "Invalid file %s\n", (name ? name : "<stdin>"));
+		return res;
+	}
+	return 1;
+}
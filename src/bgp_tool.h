@@ -28,6 +28,13 @@ void bgp_available_cmpfunc(FILE *out);
 
 /* filter BGP CSV files with a regular expression */
 int bgp_file_filter(struct bgp_file *sf, char *expr);
+/* bgp_file_filter_stream: print the routes of BGP file 'name' (stdin if NULL) matching
+ * 'expr' as they are parsed, after the BGP header, in constant memory
+ * returns:
+ *	positive on SUCCESS
+ *	negative on error (invalid filter or file); the error is printed
+ */
+int bgp_file_filter_stream(char *name, char *expr, struct st_options *nof);
 
 int fprint_bgpfilter_help(FILE *out);
 #else
@@ -28,6 +28,7 @@ struct debug debugs[] = {
 	{ "aggregate",	__D_AGGREGATE,	"debug subnet aggregate functions" },
 	{ "addrremove",	__D_ADDRREMOVE,	"debug address removal" },
 	{ "split",	__D_SPLIT,	"debug subnet splitting" },
+	{ "sort",	__D_SORT,	"debug external sort runs and merges" },
 	{ "configfile",	__D_CONFIGFILE,	"debug config file parsing" },
 	{ "fmt",	__D_FMT,	"debug FMT dynamic output" },
 	{ "scanf",	__D_SCANF,	"debug st_scanf" },
@@ -23,6 +23,7 @@
 #define __D_AGGREGATE	30
 #define __D_ADDRREMOVE	31
 #define __D_SPLIT	32
+#define __D_SORT	33
 #define __D_BGPCMP	40
 #define __D_GEXPR	50
 #define __D_FILTER	51
@@ -30,12 +31,15 @@
 #define __D_HASHT	56
 #define __D_MAX		100
 
+/* stderr is locked so messages of concurrent threads (-j) don't interleave */
 #define debug(__EVENT, __DEBUG_LEVEL, __FMT...) \
 	do { \
 		if (debugs_level[__D_##__EVENT] >= __DEBUG_LEVEL || \
 				debugs_level[__D_ALL] >= __DEBUG_LEVEL) { \
+			flockfile(stderr); \
 			fprintf(stderr, "%s: ", __func__); \
 			fprintf(stderr, __FMT); \
+			funlockfile(stderr); \
 		} \
 	} while (0)
 
@@ -17,6 +17,10 @@
 #include "utils.h"
 #include "st_memory.h"
 #include "st_readline.h"
+#include "st_thread.h"
+
+/* don't bother splitting a CSV body in chunks smaller than that */
+#define CSV_MIN_CHUNK_SIZE (256 * 1024)
 
 static int read_csv_header(const char *buffer, struct csv_file *cf)
 {
@@ -135,6 +139,85 @@ static int read_csv_header(const char *buffer, struct csv_file *cf)
 		return CSV_HEADER_FOUND;
 }
 
+static inline int is_delim(const unsigned int *map, unsigned char c)
+{
+	return map[c >> 5] & (1U << (c & 31));
+}
+
+/*
+ * get the next token of a line, like cf->csv_strtok_r(s, cf->delim, save_s)
+ * if 'cut' is 0, the token is not NUL-terminated, it is only stepped over;
+ * this is how fields without handler are skipped
+ */
+static inline char *csv_next_token(const struct csv_file *cf, char *s, char **save_s, int cut)
+{
+	char *start;
+
+	if (!cf->delim_map_ok)
+		return cf->csv_strtok_r(s, cf->delim, save_s);
+	if (s == NULL)
+		s = *save_s;
+	if (s == NULL)
+		return NULL;
+	start = s;
+	/* '\0' is in the map, so one test per char */
+	while (!is_delim(cf->delim_map, *s))
+		s++;
+	if (*s == '\0') {
+		*save_s = NULL;
+		return (s == start ? NULL : start);
+	}
+	if (cut)
+		*s = '\0';
+	*save_s = s + 1;
+	return start;
+}
+
+/*
+ * once the header is parsed, index the fields by pos and compute the delimiter map
+ * so the body engine doesn't have to search them on each token
+ */
+static int init_field_table(struct csv_file *cf)
+{
+	const char *d;
+	int i, pos;
+
+	cf->field_by_pos = st_malloc((cf->num_fields + 1) * sizeof(struct csv_field *),
+			"CSV field table");
+	if (cf->field_by_pos == NULL)
+		return CSV_ENOMEM;
+	memset(cf->field_by_pos, 0, (cf->num_fields + 1) * sizeof(struct csv_field *));
+	for (i = 0; ; i++) {
+		if (cf->csv_field[i].name == NULL)
+			break;
+		pos = cf->csv_field[i].pos;
+		/* on duplicate pos, the first registered field wins */
+		if (pos > 0 && pos <= cf->num_fields && cf->field_by_pos[pos] == NULL)
+			cf->field_by_pos[pos] = &cf->csv_field[i];
+	}
+	memset(cf->delim_map, 0, sizeof(cf->delim_map));
+	cf->delim_map[0] = 1; /* '\0' ends the line */
+	for (d = cf->delim; *d; d++) {
+		cf->delim_map[(unsigned char)*d >> 5] |= 1U << ((unsigned char)*d & 31);
+		/* st_strtok_r1 only looks at the first delim */
+		if (cf->csv_strtok_r == &st_strtok_r1)
+			break;
+	}
+	cf->delim_map_ok = (cf->csv_strtok_r == &st_strtok_r || cf->csv_strtok_r == &st_strtok_r1);
+	return 1;
+}
+
+static inline struct csv_field *field_at_pos(const struct csv_file *cf, int pos)
+{
+	return (pos <= cf->num_fields ? cf->field_by_pos[pos] : NULL);
+}
+
+static void free_field_table(struct csv_file *cf)
+{
+	st_free(cf->field_by_pos, (cf->num_fields + 1) * sizeof(struct csv_field *));
+	cf->field_by_pos = NULL;
+}
+
 /*
  * the CSV Body engine
  * it is a private function
@@ -151,19 +234,19 @@ static int read_csv_body(struct st_file *f, struct csv_file *cf,
 		struct csv_state *state, void *data,
 		char *init_buffer)
 {
-	char buffer[CSV_MAX_LINE_LEN];
 	struct csv_field *csv_field;
 	int i, res;
 	char *s, *save_s;
 	int pos;
 	unsigned long badlines = 0;
+	unsigned long first_line = state->line;
 
 	debug_timing_start(2);
 	if (init_buffer) {
 		s = init_buffer;
 		res = 0;
 	} else {
-		s = st_getline_truncate(f, CSV_MAX_LINE_LEN, &i, &res);
+		s = st_getline(f, CSV_MAX_LINE_LEN, &i, &res);
 		if (s == NULL) {
 			debug(LOAD_CSV, 1, "File %s doesn't have any content\n", cf->file_name);
 			return  CSV_EMPTY_FILE;
@@ -179,7 +262,7 @@ static int read_csv_body(struct st_file *f, struct csv_file *cf,
 		state->line++;
 		if (res) { /* BFB; BIG FUCKING BUFFER; try to handle that  */
 			debug(LOAD_CSV, 1, "File %s line %lu longer than %d, discarding %d chars\n",
-					cf->file_name, state->line, (int)sizeof(buffer), res);
+					cf->file_name, state->line, CSV_MAX_LINE_LEN, res);
 		}
 		debug(LOAD_CSV, 5, "Parsing line %lu : '%s'\n", state->line, s);
 		if (cf->startofline_callback) {
@@ -191,8 +274,10 @@ static int read_csv_body(struct st_file *f, struct csv_file *cf,
 				return res;
 			} 
 		}
-		s = cf->csv_strtok_r(s, cf->delim, &save_s);
 		pos  = 0;
+		/* only tokens with a handler are cut */
+		csv_field = field_at_pos(cf, 1);
+		s = csv_next_token(cf, s, &save_s, csv_field && csv_field->handle);
 		state->badline = 0;
 		while (s) {
 			pos++;
@@ -200,19 +285,11 @@ static int read_csv_body(struct st_file *f, struct csv_file *cf,
 				debug(LOAD_CSV, 1, "Line %lu too many tokens\n", state->line);
 				break;
 			}
-			csv_field    = NULL;
-			debug(LOAD_CSV, 5, "Parsing token '%s' pos %d\n", s, pos);
-			/* try to find the handler */
-			for (i = 0; ; i++) {
-				if (cf->csv_field[i].name == NULL)
-					break;
-				if (pos == cf->csv_field[i].pos) {
-					csv_field = &cf->csv_field[i];
-					state->csv_field = csv_field->name;
-					debug(LOAD_CSV, 5, "handler#%d='%s' pos=%d data='%s'\n",
-							i, csv_field->name, pos, s);
-					break;
-				}
+			if (csv_field) {
+				state->csv_field = csv_field->name;
+				debug(LOAD_CSV, 5, "handler#%d='%s' pos=%d data='%s'\n",
+						(int)(csv_field - cf->csv_field), csv_field->name,
+						pos, s);
 			}
 			if (csv_field && csv_field->handle) {
 				res = csv_field->handle(s, data, state);
@@ -233,10 +310,8 @@ static int read_csv_body(struct st_file *f, struct csv_file *cf,
 				} else if (res == CSV_VALID_FIELD_SKIP) {
 					debug(LOAD_CSV, 5, "Field '%s' told us to skip %d fields\n",
 							csv_field->name, state->skip);
-					for (i = 0; i < state->skip && s != NULL; i++) {
-						s = cf->csv_strtok_r(NULL, cf->delim, &save_s);
-						debug(LOAD_CSV, 6, "Skipping %s\n", s);
-					}
+					for (i = 0; i < state->skip && s != NULL; i++)
+						s = csv_next_token(cf, NULL, &save_s, 0);
 					if (s == NULL)
 						break;
 				} else if (res == CSV_CATASTROPHIC_FAILURE) {
@@ -247,10 +322,10 @@ static int read_csv_body(struct st_file *f, struct csv_file *cf,
 					return -2;
 				}
 			} else {/* if csv_>field */
-				debug(LOAD_CSV, 5, "No field handler for pos=%d data='%s'\n",
-						pos, s);
+				debug(LOAD_CSV, 5, "No field handler for pos=%d\n", pos);
 			}
-			s = cf->csv_strtok_r(NULL, cf->delim, &save_s);
+			csv_field = field_at_pos(cf, pos + 1);
+			s = csv_next_token(cf, NULL, &save_s, csv_field && csv_field->handle);
 		} /* while s */
 		if (pos < cf->max_mandatory_pos) {
 			state->badline++;
@@ -273,15 +348,106 @@ static int read_csv_body(struct st_file *f, struct csv_file *cf,
 		}
 		if (state->badline)
 			badlines++;
-	} while ((s = st_getline_truncate(f, sizeof(buffer), &i, &res)) != NULL);
+	} while ((s = st_getline(f, CSV_MAX_LINE_LEN, &i, &res)) != NULL);
 
-	/* end of file */
-	if (cf->endoffile_callback)
-		res = cf->endoffile_callback(state, data);
-	else
-		res = CSV_VALID_FILE;
 	debug(LOAD_CSV, 3, "Parsed %lu lines, %lu good, %lu bad\n",
-			state->line, state->line - badlines, badlines);
+			state->line - first_line, state->line - first_line - badlines, badlines);
+	debug_timing_end(2);
+	return CSV_VALID_FILE;
+}
+
+/* the body is parsed from 'f', with init_buffer as first line if set */
+struct csv_chunk {
+	struct st_file f;
+	struct csv_file *cf;
+	struct csv_state state;
+	void *data;
+	char *init_buffer;
+	unsigned long lines;
+	int res;
+};
+
+static void *csv_count_lines_thread(void *arg)
+{
+	struct csv_chunk *c = arg;
+
+	c->lines = st_count_lines(&c->f) + (c->init_buffer ? 1 : 0);
+	return NULL;
+}
+
+static void *csv_chunk_thread(void *arg)
+{
+	struct csv_chunk *c = arg;
+
+	c->res = read_csv_body(&c->f, c->cf, &c->state, c->data, c->init_buffer);
+	return NULL;
+}
+
+/*
+ * parse the body of a mapped file on cf->nr_threads threads
+ * the first chunk is parsed into 'data', the others into cf->chunk_init() objects,
+ * merged back in file order; once the lines of each chunk are counted, each chunk
+ * starts at the right line number
+ * same parameters and return values as read_csv_body
+ */
+static int read_csv_body_mt(struct st_file *f, struct csv_file *cf,
+		struct csv_state *state, void *data,
+		char *init_buffer)
+{
+	struct st_file *views;
+	struct csv_chunk *chunks;
+	int i, n, res, res2;
+	unsigned long line;
+
+	views = st_malloc(cf->nr_threads * sizeof(struct st_file), "CSV views");
+	if (views == NULL)
+		return read_csv_body(f, cf, state, data, init_buffer);
+	n = st_split(f, views, cf->nr_threads, CSV_MIN_CHUNK_SIZE);
+	chunks = NULL;
+	if (n > 1)
+		chunks = st_malloc(cf->nr_threads * sizeof(struct csv_chunk), "CSV chunks");
+	if (chunks == NULL) {
+		st_free(views, cf->nr_threads * sizeof(struct st_file));
+		return read_csv_body(f, cf, state, data, init_buffer);
+	}
+	debug(LOAD_CSV, 3, "Parsing %s in %d chunks\n", cf->file_name, n);
+	debug_timing_start(2);
+	res = CSV_VALID_FILE;
+	for (i = 0; i < n; i++) {
+		memcpy(&chunks[i].f, &views[i], sizeof(struct st_file));
+		memcpy(&chunks[i].state, state, sizeof(struct csv_state));
+		chunks[i].cf	      = cf;
+		chunks[i].init_buffer = (i == 0 ? init_buffer : NULL);
+		chunks[i].data	      = (i == 0 ? data : cf->chunk_init(data));
+		chunks[i].res	      = CSV_VALID_FILE;
+		if (chunks[i].data == NULL) {
+			res = CSV_CATASTROPHIC_FAILURE;
+			n = i;
+			break;
+		}
+	}
+	if (res == CSV_VALID_FILE) {
+		run_threads(n, csv_count_lines_thread, chunks, sizeof(struct csv_chunk));
+		line = state->line;
+		for (i = 0; i < n; i++) {
+			chunks[i].state.line = line;
+			line += chunks[i].lines;
+		}
+		run_threads(n, csv_chunk_thread, chunks, sizeof(struct csv_chunk));
+		state->line = line;
+	}
+	/* the first failing chunk gives the result, like a sequential load */
+	for (i = 0; i < n; i++) {
+		if (res == CSV_VALID_FILE && chunks[i].res != CSV_VALID_FILE)
+			res = chunks[i].res;
+		if (i == 0)
+			continue;
+		res2 = cf->chunk_merge(data, chunks[i].data);
+		if (res2 < 0 && res == CSV_VALID_FILE)
+			res = CSV_CATASTROPHIC_FAILURE;
+	}
+	st_free(chunks, cf->nr_threads * sizeof(struct csv_chunk));
+	st_free(views, cf->nr_threads * sizeof(struct st_file));
 	debug_timing_end(2);
 	return res;
 }
@@ -305,19 +471,26 @@ int generic_load_csv(const char *filename, struct csv_file *cf,
 {
 	struct st_file *f;
 	char buffer[CSV_MAX_LINE_LEN];
-	char *s;
+	char *s, *init_buffer = NULL;
 	int res, res2 = 0;
 
 	if (cf->csv_strtok_r == NULL) {
 		fprintf(stderr, "coding error:  no strtok function provided\n");
 		return -2;
 	}
-	f = st_open(filename, 128000);
+	/* regular files are mapped, pipes and stdin use the buffered reader */
+	f = st_mmap_open(filename);
+	if (f == NULL)
+		f = st_open(filename, 128000);
 	if (f == NULL) {
 		fprintf(stderr, "cannot open %s for reading\n", filename);
 		return CSV_CANNOT_OPEN_FILE;
 	}
-	s = st_getline_truncate(f, sizeof(buffer), &res2, &res);
+	if (f->map == NULL) {
+		f->before_read      = cf->before_read;
+		f->before_read_data = data;
+	}
+	s = st_getline(f, sizeof(buffer), &res2, &res);
 	if (s == NULL) {
 		fprintf(stderr, "empty file %s\n", filename ? filename : "<stdin>");
 		st_close(f);
@@ -343,14 +516,27 @@ int generic_load_csv(const char *filename, struct csv_file *cf,
 		}
 	}
 	state->line = 0;
-	if (res == CSV_HEADER_FOUND) /* first line was a header, no need to put initial_buff */
-		res = read_csv_body(f, cf, state, data, NULL);
-	else if (res == CSV_NO_HEADER) /* we need to pass initial buff */
-		res = read_csv_body(f, cf, state, data, s);
-	else {
+	if (res == CSV_NO_HEADER) /* we need to pass initial buff */
+		init_buffer = s;
+	else if (res != CSV_HEADER_FOUND) {
 		fprintf(stderr, "BUG at %s line %d, invalid res=%d\n", __FILE__, __LINE__, res);
-		res = -3;
+		free_csv_field(cf->csv_field);
+		st_close(f);
+		return -3;
+	}
+	if (init_field_table(cf) < 0) {
+		free_csv_field(cf->csv_field);
+		st_close(f);
+		return CSV_ENOMEM;
 	}
+	if (cf->nr_threads > 1 && cf->chunk_init && cf->chunk_merge && f->map)
+		res = read_csv_body_mt(f, cf, state, data, init_buffer);
+	else
+		res = read_csv_body(f, cf, state, data, init_buffer);
+	free_field_table(cf);
+	/* end of file */
+	if (res == CSV_VALID_FILE && cf->endoffile_callback)
+		res = cf->endoffile_callback(state, data);
 	free_csv_field(cf->csv_field);
 	st_close(f);
 	return res;
@@ -382,8 +568,14 @@ int init_csv_file(struct csv_file *cf, const char *file_name, int max_fields, co
 	cf->endofline_callback	 = NULL;
 	cf->startofline_callback = NULL;
 	cf->endoffile_callback	 = NULL;
+	cf->before_read		 = NULL;
 	cf->header_field_compare = generic_header_cmp;
 	cf->num_fields_registered = 0;
+	cf->nr_threads		 = 1;
+	cf->chunk_init		 = NULL;
+	cf->chunk_merge		 = NULL;
+	cf->field_by_pos	 = NULL;
+	cf->delim_map_ok	 = 0;
 	return 1;
 }
 
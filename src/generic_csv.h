@@ -78,7 +78,28 @@ struct csv_file {
 	int (*startofline_callback)(struct csv_state *state, void *data);
 	int (*endofline_callback)(struct csv_state *state, void *data);
 	int (*endoffile_callback)(struct csv_state *state, void *data);
+	/* called before the reader may block on a pipe or stdin (never on a mapped file),
+	 * so that what was printed so far can be flushed
+	 */
+	void (*before_read)(void *data);
 	char * (*csv_strtok_r)(char *s, const char *delim, char **save_ptr);
+	/* parallel body parsing, used if nr_threads > 1, chunk_init and chunk_merge are set
+	 * and the file is mapped; the body is split in newline-aligned chunks,
+	 * each one is parsed on its own thread into its own 'data' object
+	 * handlers and callbacks must then only touch 'data' and 'state',
+	 * and endofline_callback must not return CSV_END_FILE
+	 */
+	int nr_threads;
+	/* returns a new empty object to parse a chunk into, NULL on ENOMEM */
+	void *(*chunk_init)(void *data);
+	/* appends 'chunk_data' to 'data' and releases it; called in file order on each
+	 * chunk, even if the load failed; returns negative on ENOMEM
+	 */
+	int (*chunk_merge)(void *data, void *chunk_data);
+	/* private, set by generic_load_csv once the header is parsed */
+	struct csv_field **field_by_pos; /* num_fields + 1 entries, the field at each pos */
+	int delim_map_ok; /* csv_strtok_r splits like st_strtok_r, delim_map can be used */
+	unsigned int delim_map[8]; /* one bit per delimiter byte; '\0' is set too */
 };
 
 /* will only set the mandatory things (field, delim, and strtok_r function
@@ -14,6 +14,7 @@
 #include "debug.h"
 #include "generic_expr.h"
 #include "utils.h"
+#include "st_memory.h"
 
 
 static inline int is_comp(char c)
@@ -26,76 +27,104 @@ void init_generic_expr(struct generic_expr *e, const char *s,
 		int (*compare)(const char *, const char *, char, void *))
 {
 	e->pattern = s;
+	e->buffer  = NULL;
+	e->nodes   = NULL;
+	e->root    = NULL;
+	e->match   = NULL;
+	e->nr_nodes = e->max_nodes = 0;
 	if (s == NULL)
 		return;
 	e->pattern_len = strlen(s);
-	e->recursion_level = 0;
 	e->compare = compare;
 }
 
-static int simple_expr(char *pattern, int len, struct generic_expr *e)
+static struct expr_node *new_expr_node(struct generic_expr *e, int type)
 {
-	int i = 0, j = 0;
-	char operator, c;
-	int res;
+	struct expr_node *n = &e->nodes[e->nr_nodes++];
 
-	e->recursion_level++;
-	if (e->recursion_level >= GENERIC_ST_MAX_RECURSION) {
+	n->type   = type;
+	n->negate = 0;
+	n->op     = '\0';
+	n->string = n->value = NULL;
+	n->left   = n->right = NULL;
+	n->field  = 0;
+	n->ea_index  = -1;
+	n->ival      = 0;
+	n->key       = NULL;
+	n->bad_value = 0;
+	return n;
+}
+
+/*
+ * an invalid sub-expression is compiled into an EXPR_ERROR node;
+ * like the old interpreter, it makes the evaluation fail only if it is reached
+ * (the other side of '&' or '|' may shortcut it)
+ */
+static struct expr_node *expr_error(struct generic_expr *e)
+{
+	return new_expr_node(e, EXPR_ERROR);
+}
+
+/* compile a comparison 'string' OP 'value' */
+static struct expr_node *compile_simple_expr(char *pattern, int len, struct generic_expr *e,
+		int level)
+{
+	struct expr_node *n;
+	int i = 0, j;
+
+	if (level >= GENERIC_ST_MAX_RECURSION) {
 		debug(GEXPR, 1, "Invalid expr '%s', too many recursion level\n", e->pattern);
-		return -1;
+		return expr_error(e);
 	}
 	while (1) {
 		if (pattern[i] == '\0' || i == len) {
-			debug(GEXPR, 1, "Invalid expr '%s', no comparator\n", pattern);
-			e->recursion_level--;
-			return -1;
+			debug(GEXPR, 1, "Invalid expr '%s', no comparator\n", e->pattern);
+			return expr_error(e);
 		}
 		if (is_comp(pattern[i]))
 			break;
 		i++;
 	}
-	operator = pattern[i];
-	pattern[i] = '\0';
-	i++;
-	j = i;
-	while (1) {
-		if (pattern[i] == '\0' || i == len)
-			break;
+	j = i + 1;
+	for (i = j; i < len && pattern[i] != '\0'; i++) {
 		if (is_comp(pattern[i]) && pattern[i - 1] != '\\') {
-			debug(GEXPR, 1, "Invalid expr '%s', 2 x comparators\n", pattern);
-			e->recursion_level--;
-			pattern[j - 1] = operator;
-			return -1;
+			debug(GEXPR, 1, "Invalid expr '%s', 2 x comparators\n", e->pattern);
+			return expr_error(e);
 		}
-		i++;
 	}
-	c = pattern[i];
-	pattern[i] = '\0';
-	res = e->compare(pattern, pattern + j, operator, e->object);
-	debug(GEXPR, 5, "comparing '%s' against '%s', return=%d\n", pattern, pattern + j, res);
-	e->recursion_level--;
-	/* restoring pattern to its original value */
-	pattern[j - 1] = operator;
-	pattern[i]     = c;
-	return res;
+	n = new_expr_node(e, EXPR_COMPARE);
+	n->op = pattern[j - 1];
+	pattern[j - 1] = '\0';
+	pattern[i]     = '\0';
+	n->string = pattern;
+	n->value  = pattern + j;
+	debug(GEXPR, 5, "compiled '%s' %c '%s'\n", n->string, n->op, n->value);
+	return n;
 }
 
-int run_generic_expr(char *pattern, int len, struct generic_expr *e)
+static struct expr_node *compile_binary(struct generic_expr *e, char op,
+		struct expr_node *left, char *pattern, int len, int level);
+
+/*
+ * grammar (same as it always was) :
+ *   expr := ['!'] ( '(' expr ')' | comparison ) [ ('&'|'|') expr ]
+ * '&' and '|' have the same priority and are right-associative,
+ * '!' applies to the first operand only
+ * 'level' mimics the recursion depth of the old interpreter
+ */
+static struct expr_node *compile_expr(char *pattern, int len, struct generic_expr *e, int level)
 {
+	struct expr_node *left;
 	int i = 0, j;
-	char buffer[256];
-	int res1, res2;
+	char op;
 	int parenthese = 0;
 	int negate = 0;
 
-	e->recursion_level++;
-	if (e->recursion_level >= GENERIC_ST_MAX_RECURSION) {
+	if (level >= GENERIC_ST_MAX_RECURSION) {
 		debug(GEXPR, 1, "Invalid expr '%s', too many recursion level\n", e->pattern);
-		return -1;
+		return expr_error(e);
 	}
-	/* FIXME this should die once code is stabilized */
-	strxcpy(buffer, pattern, sizeof(buffer));
-	debug(GEXPR, 9, "Pattern : '%s', len=%d, recursion=%d\n", buffer, len, e->recursion_level);
+	debug(GEXPR, 9, "Pattern : '%.*s', len=%d, recursion=%d\n", len, pattern, len, level);
 
 	while (isspace(pattern[i]))
 		i++;
@@ -104,112 +133,172 @@ int run_generic_expr(char *pattern, int len, struct generic_expr *e)
 		i++;
 	}
 	if (i >= len) {
-		/* it should occur only on BUG*/
-		fprintf(stderr, "%s: BUG i=%i, len=%d\n", __FILE__, i, len);
-		return -1;
+		debug(GEXPR, 1, "Invalid expr '%s', empty expression\n", e->pattern);
+		return expr_error(e);
 	}
 	/* handle expr inside parenthesis */
 	if (pattern[i] == '(') {
-		debug(GEXPR, 5, "Found a '(', trying to split expr\n");
 		i += 1;
 		j = i;
 		parenthese++;
 		while (1) {
 			if (pattern[i] == '\0' || i == len) {
 				debug(GEXPR, 1, "Invalid pattern '%s', no closing ')'\n",
-						pattern);
-				return -1;
+						e->pattern);
+				return expr_error(e);
 			}
 			if (pattern[i] == '(')
 				parenthese++;
-			else if (pattern[i] == ')' && parenthese == 1) {
-				debug(GEXPR, 5, "Found closing '(', recursion\n");
-				res1 = run_generic_expr(pattern + j,  i - j, e);
-				e->recursion_level--;
-				if (res1 < 0)
-					return res1;
-				/*
-				 * negate applies only to the expression in parenthesis
-				 * it is stronger than '&' and '|'
-				 */
-				res1 = (negate ? !res1 : res1);
-				i++;
-				while (isspace(pattern[i]))
-					i++;
-				if (i > len) {
-					/* it should occur only on BUG*/
-					fprintf(stderr, "%s: BUG i=%i, len=%d\n", __FILE__, i, len);
-					return -1;
-				}
-				/* we reached end of string, just return */
-				if (pattern[i] == '\0' || len == i)
-					return res1;
-				/* take shortcuts to avoid evalutating second part of expr
-				 * downside is that if the other part of expr has a syntax error,
-				 * we don't catch it
-				 */
-				if (res1 && pattern[i] == '|')
-					return 1;
-				if (res1 == 0 && pattern[i] == '&')
-					return 0;
-
-				res2 = run_generic_expr(pattern + i + 1,  len - i - 1, e);
-				e->recursion_level--;
-				if (res2 < 0)
-					return res2;
-				if (pattern[i] == '|')
-					return res1 | res2;
-				else if (pattern[i] == '&')
-					return res1 & res2;
-				debug(GEXPR, 1, "A comparator is required after ) '%s'\n", buffer);
-				return -1;
-			} else if (pattern[i] == ')')
+			else if (pattern[i] == ')' && parenthese == 1)
+				break;
+			else if (pattern[i] == ')')
 				parenthese--;
 			i++;
 		}
+		left = compile_expr(pattern + j, i - j, e, level + 1);
+		/*
+		 * negate applies only to the expression in parenthesis
+		 * it is stronger than '&' and '|'
+		 */
+		left->negate ^= negate;
+		i++;
+		while (isspace(pattern[i]))
+			i++;
+		/* we reached end of string */
+		if (pattern[i] == '\0' || len <= i)
+			return left;
+		if (pattern[i] != '|' && pattern[i] != '&') {
+			debug(GEXPR, 1, "A comparator is required after ) '%s'\n", e->pattern);
+			return expr_error(e);
+		}
+		return compile_binary(e, pattern[i], left, pattern + i + 1, len - i - 1, level);
 	}
 	j = i;
-	while (1) {
-		if (i == len || pattern[i] == '\0')
-			break;
-		if (pattern[i] == '|') {
-			res1 = run_generic_expr(pattern + j, i - j, e);
-			e->recursion_level--;
-			if (res1 < 0)
-				return res1;
-			res1 = (negate ? !res1 : res1);
-			if (res1) /* shortcut, no need to evaluate other side */
-				return res1;
-			res2 = run_generic_expr(pattern + i + 1, len - i - 1, e);
-			e->recursion_level--;
-			if (res2 < 0)
-				return res2;
-			/*
-			 * negate doesnt apply to the  whole expression
-			 */
-			return  (res1 | res2);
-		}
-		if (pattern[i] == '&') {
-			res1 = run_generic_expr(pattern + j, i - j, e);
-			e->recursion_level--;
-			if (res1 < 0)
-				return res1;
-			res1 = (negate ? !res1 : res1);
-			if (res1 == 0) /* shortcut */
-				return res1;
-			res2 = run_generic_expr(pattern + i + 1, len - i - 1, e);
-			e->recursion_level--;
-			if (res2 < 0)
-				return res2;
-			return (res1 & res2);
-		}
+	while (i < len && pattern[i] != '\0' && pattern[i] != '|' && pattern[i] != '&')
 		i++;
+	if (i < len && pattern[i] != '\0') {
+		/* compiling 'left' overwrites the operator */
+		op = pattern[i];
+		left = compile_expr(pattern + j, i - j, e, level + 1);
+		left->negate ^= negate;
+		return compile_binary(e, op, left, pattern + i + 1, len - i - 1, level);
+	}
+	left = compile_simple_expr(pattern + j, i - j, e, level + 1);
+	left->negate ^= negate;
+	return left;
+}
+
+/* compile 'left' OP 'pattern' */
+static struct expr_node *compile_binary(struct generic_expr *e, char op,
+		struct expr_node *left, char *pattern, int len, int level)
+{
+	struct expr_node *n;
+
+	n = new_expr_node(e, (op == '|' ? EXPR_OR : EXPR_AND));
+	n->op    = op;
+	n->left  = left;
+	n->right = compile_expr(pattern, len, e, level);
+	return n;
+}
+
+int compile_generic_expr(struct generic_expr *e)
+{
+	size_t len = e->pattern_len;
+
+	e->buffer = st_malloc(len + 1, "expr buffer");
+	if (e->buffer == NULL)
+		return -1;
+	/* each node but the error nodes eats at least one char of the pattern */
+	e->max_nodes = 2 * len + 2;
+	e->nodes = st_malloc(e->max_nodes * sizeof(struct expr_node), "expr nodes");
+	if (e->nodes == NULL) {
+		st_free(e->buffer, len + 1);
+		e->buffer = NULL;
+		return -1;
+	}
+	memcpy(e->buffer, e->pattern, len + 1);
+	e->nr_nodes = 0;
+	e->root = compile_expr(e->buffer, len, e, 1);
+	debug(GEXPR, 4, "compiled '%s' into %d nodes\n", e->pattern, e->nr_nodes);
+	return 1;
+}
+
+void free_generic_expr(struct generic_expr *e)
+{
+	if (e->buffer)
+		st_free(e->buffer, e->pattern_len + 1);
+	if (e->nodes)
+		st_free(e->nodes, e->max_nodes * sizeof(struct expr_node));
+	e->buffer = NULL;
+	e->nodes  = NULL;
+	e->root   = NULL;
+	e->nr_nodes = e->max_nodes = 0;
+}
+
+int bind_generic_expr(struct generic_expr *e, int (*bind)(struct expr_node *n, void *ctx),
+		void *ctx, int (*match)(const struct expr_node *n, void *object))
+{
+	int i, res;
+
+	for (i = 0; i < e->nr_nodes; i++) {
+		if (e->nodes[i].type != EXPR_COMPARE)
+			continue;
+		res = bind(&e->nodes[i], ctx);
+		if (res < 0)
+			return res;
+	}
+	e->match = match;
+	return 1;
+}
+
+static int eval_expr_node(const struct generic_expr *e, const struct expr_node *n, void *object)
+{
+	int res1, res2;
+
+	switch (n->type) {
+	case EXPR_COMPARE:
+		if (e->match)
+			res1 = e->match(n, object);
+		else
+			res1 = e->compare(n->string, n->value, n->op, object);
+		debug(GEXPR, 5, "comparing '%s' against '%s', return=%d\n",
+				n->string, n->value, res1);
+		break;
+	case EXPR_OR:
+		res1 = eval_expr_node(e, n->left, object);
+		if (res1 < 0)
+			return res1;
+		if (res1) /* shortcut, no need to evaluate other side */
+			break;
+		res2 = eval_expr_node(e, n->right, object);
+		if (res2 < 0)
+			return res2;
+		res1 |= res2;
+		break;
+	case EXPR_AND:
+		res1 = eval_expr_node(e, n->left, object);
+		if (res1 < 0)
+			return res1;
+		if (res1 == 0) /* shortcut */
+			break;
+		res2 = eval_expr_node(e, n->right, object);
+		if (res2 < 0)
+			return res2;
+		res1 &= res2;
+		break;
+	default:
+		return -1;
 	}
-	res1 = simple_expr(pattern + j, i - j, e);
-	e->recursion_level--;
 	if (res1 < 0)
 		return res1;
-	return negate ? !res1 : res1;
+	return n->negate ? !res1 : res1;
+}
+
+int eval_generic_expr(struct generic_expr *e, void *object)
+{
+	if (e->root == NULL)
+		return -1;
+	return eval_expr_node(e, e->root, object);
 }
 
 /* used for testing purposes */
@@ -1,16 +1,47 @@
 #ifndef GENERIC_ST_EXPR
 #define GENERIC_ST_EXPR
 
+#include "iptools.h"
+
+#define EXPR_COMPARE	1
+#define EXPR_AND	2
+#define EXPR_OR		3
+#define EXPR_ERROR	4 /* invalid sub-expression, fails only if evaluated */
+
+/* a compiled expression is a tree of expr_node */
+struct expr_node {
+	int type;
+	int negate;
+	char op; /* comparison operator, or '&' / '|' */
+	const char *string; /* EXPR_COMPARE only, point into generic_expr->buffer */
+	const char *value;
+	struct expr_node *left;
+	struct expr_node *right;
+	/* typed form of a comparison, set by the bind callback */
+	int field; /* what to compare, defined by the caller */
+	int ea_index; /* index of the Extended Attribute, -1 if not found */
+	int ival; /* mask or int constant, or ID of the value */
+	const char *key; /* 'value' interned in the file the expression is bound to, or NULL */
+	int bad_value; /* 'value' couldn't be parsed; comparing with it fails */
+	struct subnet subnet; /* prefix or address constant */
+};
+
 struct generic_expr {
 	const char *pattern;
 	size_t pattern_len;
-	int recursion_level;
-	void *object;
 	/*
 	 * ->compare will compare 'string' (interpreted will the help of 'object') against
 	 *  'value', using operator 'op'
 	 */
 	int (*compare)(const char *string, const char *value, char operator, void *object);
+	/* if set by bind_generic_expr, used instead of ->compare */
+	int (*match)(const struct expr_node *n, void *object);
+	/* set by compile_generic_expr */
+	char *buffer; /* copy of pattern, split into NUL-terminated strings */
+	struct expr_node *nodes;
+	int nr_nodes;
+	int max_nodes;
+	struct expr_node *root;
 };
 
 
@@ -19,7 +50,32 @@ struct generic_expr {
 
 void init_generic_expr(struct generic_expr *e, const char *s,
 	int (*compare)(const char *, const char *, char, void *));
-int run_generic_expr(char *pattern, int len, struct generic_expr *e);
+/* compile_generic_expr: parse e->pattern once, before evaluating it on many objects
+ * syntax errors are not reported here; they make eval_generic_expr fail
+ * returns:
+ *	positive on SUCCESS
+ *	negative on ENOMEM
+ */
+int compile_generic_expr(struct generic_expr *e);
+void free_generic_expr(struct generic_expr *e);
+/* bind_generic_expr: call 'bind' once on each comparison of a compiled expression
+ * so it can parse constants and resolve field names to their typed form;
+ * comparisons are then evaluated with 'match'
+ * @bind  : the bind callback, a negative return value stops binding
+ * @ctx   : opaque pointer passed to bind (typically the file to filter)
+ * @match : the typed comparison function
+ * returns:
+ *	positive on SUCCESS
+ *	negative if bind failed
+ */
+int bind_generic_expr(struct generic_expr *e, int (*bind)(struct expr_node *n, void *ctx),
+		void *ctx, int (*match)(const struct expr_node *n, void *object));
+/* eval_generic_expr: evaluate a compiled expression against 'object'
+ * returns:
+ *	1 if object matches, 0 if not
+ *	negative if the expression is invalid
+ */
+int eval_generic_expr(struct generic_expr *e, void *object);
 int int_compare(const char *, const char *, char, void *);
 
 #else
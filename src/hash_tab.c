@@ -15,6 +15,7 @@
 #include "debug.h"
 #include "hash_tab.h"
 #include "st_memory.h"
+#include "iptools.h"
 
 unsigned djb_hash(void *key, int len)
 {
@@ -213,13 +214,216 @@ int stat_bucket_cmp(st_list *l1, st_list *l2)
 void sort_stat_table(struct hash_table *ht, st_list *head)
 {
 	unsigned i;
-	struct stat_bucket *sb;
 
 	for (i = 0; i < ht->max_nr; i++)
 		list_join(&ht->tab[i], head);
 	list_sort(head, &stat_bucket_cmp);
 }
 
+/*
+ * exact-prefix index
+ * key is (ip_ver, network address, mask), host bits and padding are zeroed
+ * so that keys can be hashed and compared as raw bytes
+ */
+static void subnet_key(struct subnet *key, const struct subnet *s)
+{
+	memset(key, 0, sizeof(*key));
+	key->ip_ver = s->ip_ver;
+	key->mask   = s->mask;
+	if (s->mask == 0)
+		return;
+	if (s->ip_ver == IPV4_A)
+		key->ip = s->ip;
+	else if (s->ip_ver == IPV6_A)
+		key->ip6 = s->ip6;
+	first_ip(key);
+}
+
+int alloc_subnet_hash_tab(struct subnet_hash_table *sht, unsigned long nr)
+{
+	unsigned long i;
+	int res;
+
+	/* load factor ~ 0.5 */
+	res = alloc_hash_tab(&sht->ht, 2 * nr + 1, &fnv_hash);
+	if (res < 0)
+		return res;
+	sht->buckets = st_malloc((nr + 1) * sizeof(struct subnet_bucket), "subnet buckets");
+	if (sht->buckets == NULL) {
+		st_free(sht->ht.tab, sht->ht.max_nr * sizeof(struct st_list));
+		return -1;
+	}
+	sht->next = st_malloc((nr + 1) * sizeof(long), "subnet hash items");
+	if (sht->next == NULL) {
+		st_free(sht->buckets, (nr + 1) * sizeof(struct subnet_bucket));
+		st_free(sht->ht.tab, sht->ht.max_nr * sizeof(struct st_list));
+		return -1;
+	}
+	for (i = 0; i < nr; i++)
+		sht->next[i] = -1;
+	sht->nr     = 0;
+	sht->max_nr = nr;
+	return 1;
+}
+
+void free_subnet_hash_tab(struct subnet_hash_table *sht)
+{
+	st_free(sht->ht.tab, sht->ht.max_nr * sizeof(struct st_list));
+	st_free(sht->buckets, (sht->max_nr + 1) * sizeof(struct subnet_bucket));
+	st_free(sht->next, (sht->max_nr + 1) * sizeof(long));
+	memset(sht, 0, sizeof(*sht));
+}
+
+static struct subnet_bucket *__find_subnet(struct subnet_hash_table *sht,
+		const struct subnet *key, unsigned h)
+{
+	struct subnet_bucket *b;
+
+	if (list_empty(&sht->ht.tab[h]))
+		return NULL;
+	list_for_each_entry(b, &sht->ht.tab[h], list) {
+		if (!memcmp(key, &b->key, sizeof(*key)))
+			return b;
+	}
+	return NULL;
+}
+
+int insert_subnet(struct subnet_hash_table *sht, const struct subnet *s, unsigned long n)
+{
+	struct subnet key;
+	struct subnet_bucket *b;
+	unsigned h;
+
+	if (n >= sht->max_nr) {
+		debug(HASHT, 1, "cannot insert item %lu, max %lu\n", n, sht->max_nr);
+		return -1;
+	}
+	subnet_key(&key, s);
+	h = sht->ht.hash_fn(&key, sizeof(key)) & sht->ht.table_mask;
+	b = __find_subnet(sht, &key, h);
+	if (b) {
+		sht->next[b->tail] = n;
+		b->tail = n;
+		return 1;
+	}
+	b = &sht->buckets[sht->nr++];
+	memcpy(&b->key, &key, sizeof(key));
+	b->head = b->tail = n;
+	if (!list_empty(&sht->ht.tab[h]))
+		sht->ht.collisions++;
+	list_add(&b->list, &sht->ht.tab[h]);
+	sht->ht.nr++;
+	return 1;
+}
+
+long find_subnet(struct subnet_hash_table *sht, const struct subnet *s)
+{
+	struct subnet key;
+	struct subnet_bucket *b;
+	unsigned h;
+
+	subnet_key(&key, s);
+	h = sht->ht.hash_fn(&key, sizeof(key)) & sht->ht.table_mask;
+	b = __find_subnet(sht, &key, h);
+	return (b ? b->head : -1);
+}
+
+/*
+ * string interning table
+ */
+#define STRTAB_MIN_SIZE 256
+
+void init_strtab(struct st_strtab *t)
+{
+	t->tab        = NULL;
+	t->max_nr     = 0;
+	t->table_mask = 0;
+	t->nr         = 0;
+	init_arena(&t->arena);
+}
+
+void free_strtab(struct st_strtab *t)
+{
+	st_free(t->tab, t->max_nr * sizeof(struct strtab_entry *));
+	free_arena(&t->arena);
+	init_strtab(t);
+}
+
+/* slot holding 's', or the free slot where it should be inserted */
+static struct strtab_entry **strtab_slot(const struct st_strtab *t, const char *s, unsigned h)
+{
+	struct strtab_entry **slot;
+	unsigned i = h & t->table_mask;
+
+	while (1) {
+		slot = &t->tab[i];
+		if (*slot == NULL)
+			return slot;
+		if ((*slot)->hash == h && !strcmp((*slot)->s, s))
+			return slot;
+		i = (i + 1) & t->table_mask;
+	}
+}
+
+static int strtab_grow(struct st_strtab *t)
+{
+	struct strtab_entry **old = t->tab;
+	unsigned old_nr = t->max_nr;
+	unsigned i, new_nr;
+
+	new_nr = (old_nr ? 2 * old_nr : STRTAB_MIN_SIZE);
+	t->tab = st_malloc(new_nr * sizeof(struct strtab_entry *), "string table");
+	if (t->tab == NULL) {
+		t->tab = old;
+		return -1;
+	}
+	memset(t->tab, 0, new_nr * sizeof(struct strtab_entry *));
+	t->max_nr     = new_nr;
+	t->table_mask = new_nr - 1;
+	for (i = 0; i < old_nr; i++) {
+		if (old[i] == NULL)
+			continue;
+		*strtab_slot(t, old[i]->s, old[i]->hash) = old[i];
+	}
+	st_free(old, old_nr * sizeof(struct strtab_entry *));
+	debug(HASHT, 4, "string table resized to %u slots, %u strings\n", new_nr, t->nr);
+	return 1;
+}
+
+const char *strtab_intern(struct st_strtab *t, const char *s)
+{
+	struct strtab_entry **slot, *e;
+	int len = strlen(s);
+	unsigned h = fnv_hash((void *)s, len);
+
+	if (2 * (t->nr + 1) > t->max_nr && strtab_grow(t) < 0)
+		return NULL;
+	slot = strtab_slot(t, s, h);
+	if (*slot)
+		return (*slot)->s;
+	e = arena_alloc(&t->arena, sizeof(struct strtab_entry) + len + 1);
+	if (e == NULL)
+		return NULL;
+	e->hash = h;
+	memcpy(e->s, s, len + 1);
+	*slot = e;
+	t->nr++;
+	return e->s;
+}
+
+const char *strtab_find(const struct st_strtab *t, const char *s)
+{
+	struct strtab_entry *e;
+
+	if (t->nr == 0)
+		return NULL;
+	e = *strtab_slot(t, s, fnv_hash((void *)s, strlen(s)));
+	return (e ? e->s : NULL);
+}
+
+#ifdef TEST_HASH
+#include <time.h>
+
 int main(int argc, char **argv)
 {
 	struct hash_table ht;
@@ -247,3 +451,4 @@ int main(int argc, char **argv)
 	list_for_each_entry(sb, &head, list)
 		printf("KEY: %s count:%lu\n", (char *)sb->key, sb->count);
 }
+#endif
@@ -2,6 +2,8 @@
 #define HASH_TAB_H
 
 #include "st_list.h"
+#include "iptools.h"
+#include "st_arena.h"
 
 struct st_bucket {
 	void *key;
@@ -117,5 +119,92 @@ struct stat_bucket *increase_key_stat(struct hash_table *ht, char *key, int key_
  *	NULL if not found
  */
 struct stat_bucket *get_key_stat(struct hash_table *ht, char *key, int key_len);
+
+/*
+ * exact-prefix index (ip_ver, network address, mask) ==> items
+ * items are caller-provided indexes (usually into a routes array)
+ * items with the same prefix are chained in insertion order
+ */
+struct subnet_bucket {
+	struct subnet key;
+	long head; /* first item with this prefix */
+	long tail;
+	st_list list;
+};
+
+struct subnet_hash_table {
+	struct hash_table ht;
+	struct subnet_bucket *buckets; /* bucket pool, one per distinct prefix at most */
+	long *next; /* next[i] is the next item with the same prefix as item i */
+	unsigned long nr; /* number of used buckets */
+	unsigned long max_nr; /* max number of items */
+};
+
+/* alloc_subnet_hash_tab: setup a new exact-prefix index for 'nr' items
+ * @sht : the index
+ * @nr  : the max number of items; items must be < nr
+ * returns:
+ *	>0 on SUCCESS
+ *	<0 on ENOMEM
+ */
+int alloc_subnet_hash_tab(struct subnet_hash_table *sht, unsigned long nr);
+void free_subnet_hash_tab(struct subnet_hash_table *sht);
+
+/* insert_subnet: add item 'n' under prefix 's'
+ * returns:
+ *	>0 on SUCCESS
+ *	<0 if n is too large
+ */
+int insert_subnet(struct subnet_hash_table *sht, const struct subnet *s, unsigned long n);
+
+/* find_subnet: get the items whose prefix EQUALS 's'
+ * returns:
+ *	the first inserted item, use sht->next[] to get the following ones
+ *	-1 if not found
+ */
+long find_subnet(struct subnet_hash_table *sht, const struct subnet *s);
+
+/*
+ * string interning table: equal strings share one read-only copy
+ * open addressing with linear probing, load factor <= 0.5
+ * strings are copied in the table's arena and freed all at once by free_strtab
+ * a table is NOT thread-safe; threads fill their own table
+ */
+struct strtab_entry {
+	unsigned hash;
+	char s[]; /* the interned string */
+};
+
+struct st_strtab {
+	struct strtab_entry **tab; /* NULL if the slot is free */
+	unsigned max_nr; /* power of two, 0 until the first insertion */
+	unsigned table_mask;
+	unsigned nr;
+	struct st_arena arena;
+};
+
+/* init_strtab: setup an empty table; no memory is allocated before the first insertion */
+void init_strtab(struct st_strtab *t);
+void free_strtab(struct st_strtab *t);
+
+/* strtab_intern: get the copy of 's' held by the table, copying 's' if it is new
+ * returns:
+ *	the interned string, it MUST NOT be modified or freed
+ *	NULL on ENOMEM
+ */
+const char *strtab_intern(struct st_strtab *t, const char *s);
+
+/* strtab_find: get the copy of 's' held by the table
+ * two strings of the same table are equal if and only if their pointers are equal
+ * returns:
+ *	the interned string
+ *	NULL if 's' is not in the table
+ */
+const char *strtab_find(const struct st_strtab *t, const char *s);
+
+static inline long next_subnet_item(const struct subnet_hash_table *sht, long n)
+{
+	return sht->next[n];
+}
 #else
 #endif
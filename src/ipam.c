@@ -20,6 +20,7 @@
 #include "st_routes.h"
 #include "ipam.h"
 #include "string2ip.h"
+#include "st_trie.h"
 
 int alloc_ipam_file(struct ipam_file *sf, unsigned long n, int ea_nr)
 {
@@ -35,6 +36,10 @@ int alloc_ipam_file(struct ipam_file *sf, unsigned long n, int ea_nr)
 	sf->nr     = 0;
 	sf->max_nr = n;
 	sf->ea_nr  = ea_nr;
+	sf->sink	= NULL;
+	sf->sink_data	= NULL;
+	sf->nr_streamed = 0;
+	init_strtab(&sf->ea_values);
 	sf->ea     = st_malloc(ea_nr * sizeof(struct ipam_ea), "ipam_ea");
 	if (sf->ea == NULL) {
 		sf->max_nr = 0;
@@ -64,8 +69,21 @@ static int alloc_ipam_ea(struct ipam_file *sf, unsigned long i)
 	return 0;
 }
 
+/* EA values are in the string table of the file, only the array is freed */
 static void free_ipam_ea(struct ipam_line *ipam)
 {
+	st_free(ipam->ea, sizeof(struct ipam_ea) * ipam->ea_nr);
+	ipam->ea    = NULL;
+	ipam->ea_nr = 0;
+}
+
+/* EA values of a streamed line are not interned, they are freed with the line */
+static void drop_ipam_ea(struct ipam_file *sf, struct ipam_line *ipam)
+{
+	if (sf->sink == NULL) {
+		free_ipam_ea(ipam);
+		return;
+	}
 	free_ea_array(ipam->ea, ipam->ea_nr);
 	ipam->ea    = NULL;
 	ipam->ea_nr = 0;
@@ -81,6 +99,7 @@ void free_ipam_file(struct ipam_file *sf)
 		st_free_string(sf->ea[i].name);
 	st_free(sf->ea, sizeof(struct ipam_ea) * sf->ea_nr);
 	st_free(sf->lines, sizeof(struct ipam_line) * sf->max_nr);
+	free_strtab(&sf->ea_values);
 	sf->nr     = 0;
 	sf->max_nr = 0;
 	sf->ea_nr  = 0;
@@ -132,7 +151,7 @@ static int ipam_ea_handle(char *s, void *data, struct csv_state *state)
 	}
 	debug(IPAM, 6, "Found %s = %s\n",  sf->lines[sf->nr].ea[ea_nr].name, s);
 	/* we dont care if memory failed on strdup; we continue */
-	ea_strdup(&sf->lines[sf->nr].ea[ea_nr], s);
+	ea_intern(sf->sink ? NULL : &sf->ea_values, &sf->lines[sf->nr].ea[ea_nr], s);
 	return CSV_VALID_FIELD;
 }
 
@@ -140,15 +159,23 @@ static int ipam_endofline_callback(struct csv_state *state, void *data)
 {
 	struct ipam_file *sf = data;
 	struct ipam_line *new_r;
+	int res;
 
 	if (state->badline) {
 		debug(LOAD_CSV, 1, "%s : invalid line %lu\n", state->file_name, state->line);
 		/* if too much badlines, we will loose time alloc in startofline
 		 * and freeing in endofline but whatever
 		 */
-		free_ipam_ea(&sf->lines[sf->nr]);
+		drop_ipam_ea(sf, &sf->lines[sf->nr]);
 		return -1;
 	}
+	if (sf->sink) {
+		res = sf->sink(sf, &sf->lines[sf->nr], sf->sink_data);
+		drop_ipam_ea(sf, &sf->lines[sf->nr]);
+		memset(&sf->lines[sf->nr], 0, sizeof(struct ipam_line));
+		sf->nr_streamed++;
+		return (res < 0 ? CSV_CATASTROPHIC_FAILURE : res);
+	}
 	sf->nr++;
 	if  (sf->nr == sf->max_nr) {
 		if (sf->max_nr * 2 > SIZE_T_MAX / sizeof(struct ipam_line)) {
@@ -182,7 +209,7 @@ static int ipam_endoffile_callback(struct csv_state *state, void *data)
 {
 	struct ipam_file *sf = data;
 
-	if (sf->nr == 0) {
+	if (sf->nr == 0 && sf->nr_streamed == 0) {
 		fprintf(stderr, "IPAM file %s has %lu lines, none is valid\n",
 				state->file_name, state->line);
 		return CSV_INVALID_FILE;
@@ -190,7 +217,76 @@ static int ipam_endoffile_callback(struct csv_state *state, void *data)
 	return CSV_VALID_FILE;
 }
 
-int load_ipam(char  *name, struct ipam_file *sf, struct st_options *nof)
+/* parallel load: a chunk is parsed into its own lines array, sharing the EA names of 'sf' */
+static void *ipam_chunk_init(void *data)
+{
+	struct ipam_file *sf = data;
+	struct ipam_file *chunk;
+
+	chunk = st_malloc(sizeof(struct ipam_file), "ipam_file chunk");
+	if (chunk == NULL)
+		return NULL;
+	chunk->lines = st_malloc(sizeof(struct ipam_line) * 4096, "ipam_file");
+	if (chunk->lines == NULL) {
+		st_free(chunk, sizeof(struct ipam_file));
+		return NULL;
+	}
+	chunk->nr     = 0;
+	chunk->max_nr = 4096;
+	chunk->ea     = sf->ea;
+	chunk->ea_nr  = sf->ea_nr;
+	chunk->sink   = NULL;
+	init_strtab(&chunk->ea_values);
+	memset(&chunk->lines[0], 0, sizeof(struct ipam_line));
+	return chunk;
+}
+
+static int ipam_chunk_merge(void *data, void *chunk_data)
+{
+	struct ipam_file *sf = data;
+	struct ipam_file *chunk = chunk_data;
+	struct ipam_line *new_r = NULL;
+	unsigned long i, n;
+	int j, res = 1;
+
+	n = sf->nr + chunk->nr + 1;
+	if (n > sf->max_nr) {
+		if (n <= SIZE_T_MAX / sizeof(struct ipam_line))
+			new_r = st_realloc(sf->lines, sizeof(struct ipam_line) * n,
+					sizeof(struct ipam_line) * sf->max_nr, "ipam line");
+		if (new_r == NULL) {
+			for (i = 0; i < chunk->nr; i++)
+				free_ipam_ea(&chunk->lines[i]);
+			chunk->nr = 0;
+			res = CSV_CATASTROPHIC_FAILURE;
+		} else {
+			sf->lines  = new_r;
+			sf->max_nr = n;
+		}
+	}
+	memcpy(&sf->lines[sf->nr], chunk->lines, chunk->nr * sizeof(struct ipam_line));
+	/* EA values move from the chunk string table to the one of 'sf' */
+	for (i = sf->nr; i < sf->nr + chunk->nr; i++)
+		for (j = 0; j < sf->lines[i].ea_nr; j++)
+			ea_intern(&sf->ea_values, &sf->lines[i].ea[j], sf->lines[i].ea[j].value);
+	sf->nr += chunk->nr;
+	memset(&sf->lines[sf->nr], 0, sizeof(struct ipam_line));
+	st_free(chunk->lines, chunk->max_nr * sizeof(struct ipam_line));
+	free_strtab(&chunk->ea_values);
+	st_free(chunk, sizeof(struct ipam_file));
+	return res;
+}
+
+static void ipam_stream_flush(void *data)
+{
+	struct ipam_file *sf = data;
+
+	sf->sink(sf, NULL, sf->sink_data);
+}
+
+/* load 'name' in 'sf', or stream its lines to 'sink' if set */
+static int __load_ipam(char *name, struct ipam_file *sf, struct st_options *nof,
+		int (*sink)(struct ipam_file *sf, struct ipam_line *l, void *data), void *data)
 {
 	struct csv_file cf;
 	struct csv_state state;
@@ -208,6 +304,11 @@ int load_ipam(char  *name, struct ipam_file *sf, struct st_options *nof)
 	cf.endofline_callback   = ipam_endofline_callback;
 	cf.startofline_callback = ipam_startofline_callback;
 	cf.endoffile_callback   = ipam_endoffile_callback;
+	/* a sink sees the lines in file order */
+	cf.nr_threads           = (sink ? 1 : nof->nr_threads);
+	cf.chunk_init           = ipam_chunk_init;
+	cf.chunk_merge          = ipam_chunk_merge;
+	cf.before_read          = (sink ? ipam_stream_flush : NULL);
 
 	/* register network and mask handler */
 	s = (nof->ipam_prefix_field[0] ? nof->ipam_prefix_field : "address*");
@@ -235,7 +336,7 @@ int load_ipam(char  *name, struct ipam_file *sf, struct st_options *nof)
 		return -1;
 	}
 	debug(IPAM, 5, "Collected %d Extended Attributes\n", i);
-	res = alloc_ipam_file(sf, 16192, i);
+	res = alloc_ipam_file(sf, (sink ? 1 : 16192), i);
 	if (res < 0) {
 		free_csv_file(&cf);
 		return res;
@@ -248,6 +349,8 @@ int load_ipam(char  *name, struct ipam_file *sf, struct st_options *nof)
 		}
 	}
 	memset(&sf->lines[0], 0, sizeof(struct ipam_line));
+	sf->sink      = sink;
+	sf->sink_data = data;
 	res = generic_load_csv(name, &cf, &state, sf);
 	if (res < 0) {
 		free_ipam_ea(&sf->lines[0]);
@@ -259,6 +362,24 @@ int load_ipam(char  *name, struct ipam_file *sf, struct st_options *nof)
 	return res;
 }
 
+int load_ipam(char  *name, struct ipam_file *sf, struct st_options *nof)
+{
+	return __load_ipam(name, sf, nof, NULL, NULL);
+}
+
+int load_ipam_stream(char *name, struct st_options *nof,
+		int (*sink)(struct ipam_file *sf, struct ipam_line *l, void *data), void *data)
+{
+	struct ipam_file sf;
+	int res;
+
+	res = __load_ipam(name, &sf, nof, sink, data);
+	if (res < 0)
+		return res;
+	free_ipam_file(&sf);
+	return res;
+}
+
 int fprint_ipamfilter_help(FILE *out)
 {
 	return fprintf(out, "IPAM lines can be filtered on:\n"
@@ -276,72 +397,118 @@ int fprint_ipamfilter_help(FILE *out)
 			"- '%%' (st_scanf case insensitive regular expression)\n");
 }
 
-static int ipam_filter(const char *s, const char *value, char op, void *object)
+#define IF_PREFIX	1
+#define IF_MASK		2
+#define IF_EA		3
+#define IF_EA_STR	4 /* EA of a streamed file, its values are not interned */
+
+/* parse the constant of an IPAM filter comparison once, and resolve EA names
+ * to their index in sf->ea (all lines of 'sf' share the same EA layout)
+ */
+static int ipam_filter_bind(struct expr_node *n, void *ctx)
 {
-	struct ipam_line *ipam = object;
-	struct subnet subnet;
+	struct ipam_file *sf = ctx;
 	int res;
 
-	debug(FILTER, 8, "Filtering '%s' %c '%s'\n", s, op, value);
-	if (!strcmp(s, "prefix")) {
-		res = get_subnet_or_ip(value, &subnet);
+	if (!strcmp(n->string, "prefix")) {
+		n->field = IF_PREFIX;
+		res = get_subnet_or_ip(n->value, &n->subnet);
 		if (res < 0) {
 			debug(FILTER, 1, "Filtering on prefix %c '%s',  but it is not an IP\n",
-					op, value);
-			return -1;
+					n->op, n->value);
+			n->bad_value = 1;
 		}
-		return subnet_filter(&ipam->subnet, &subnet, op);
-	} else if (!strcmp(s, "mask")) {
-		res =  string2mask(value, 42);
-		if (res < 0) {
-			debug(FILTER, 1,
-					"Filtering on mask %c '%s',  but it is not valid\n",
-					op, value);
-			return -1;
+	} else if (!strcmp(n->string, "mask")) {
+		n->field = IF_MASK;
+		n->ival  = string2mask(n->value, 42);
+		if (n->ival < 0) {
+			debug(FILTER, 1, "Filtering on mask %c '%s',  but it is not valid\n",
+					n->op, n->value);
+			n->bad_value = 1;
+		}
+	} else {
+		n->field = (sf->sink ? IF_EA_STR : IF_EA);
+		n->ea_index = find_ea_index(sf->ea, sf->ea_nr, n->string);
+		if (n->ea_index < 0)
+			debug(FILTER, 1, "Cannot filter on attribute '%s'\n", n->string);
+		if (n->field == IF_EA)
+			n->key = strtab_find(&sf->ea_values, n->value);
+		if (n->op == '<' || n->op == '>') {
+			n->ival = string2int(n->value, &res);
+			if (res < 0) {
+				debug(FILTER, 1, "Cannot interpret Field '%s' as an INT\n", n->value);
+				n->bad_value = 1;
+			}
 		}
-		switch (op) {
+	}
+	return 1;
+}
+
+static int ipam_filter(const struct expr_node *n, void *object)
+{
+	struct ipam_line *ipam = object;
+
+	switch (n->field) {
+	case IF_PREFIX:
+		if (n->bad_value)
+			return -1;
+		return subnet_filter(&ipam->subnet, &n->subnet, n->op);
+	case IF_MASK:
+		if (n->bad_value)
+			return -1;
+		switch (n->op) {
 		case '=':
-			return (ipam->subnet.mask == res);
+			return (ipam->subnet.mask == n->ival);
 		case '#':
-			return !(ipam->subnet.mask == res);
+			return !(ipam->subnet.mask == n->ival);
 		case '<':
-			return (ipam->subnet.mask < res);
+			return (ipam->subnet.mask < n->ival);
 		case '>':
-			return (ipam->subnet.mask > res);
+			return (ipam->subnet.mask > n->ival);
 		default:
-			debug(FILTER, 1, "Unsupported op '%c' for mask\n", op);
+			debug(FILTER, 1, "Unsupported op '%c' for mask\n", n->op);
 			return -1;
 		}
-	} else
-		return filter_ea(ipam->ea, ipam->ea_nr, s, value, op);
+	default:
+		if (n->ea_index < 0 || n->ea_index >= ipam->ea_nr)
+			return 0;
+		if (n->field == IF_EA_STR)
+			return filter_ea_value(ipam->ea[n->ea_index].value, n->value,
+					n->ival, n->bad_value, n->op);
+		return filter_ea_key(ipam->ea[n->ea_index].value, n->value, n->key,
+				n->ival, n->bad_value, n->op);
+	}
 }
 
 int ipam_file_filter(struct ipam_file *sf, char *expr)
 {
 	unsigned long i, j;
-	int res, len;
+	int res;
 	struct generic_expr e;
 	struct ipam_line *new_ipam;
 
 	if (sf->nr == 0)
 		return 0;
+	init_generic_expr(&e, expr, NULL);
+	if (compile_generic_expr(&e) < 0)
+		return -1;
+	bind_generic_expr(&e, ipam_filter_bind, sf, ipam_filter);
 	debug_timing_start(2);
-	init_generic_expr(&e, expr, ipam_filter);
 
 	new_ipam = st_malloc(sf->nr * sizeof(struct ipam_line), "struct ipam_line");
 	if (new_ipam == NULL) {
+		free_generic_expr(&e);
 		debug_timing_end(2);
 		return -1;
 	}
 	j = 0;
-	len = strlen(expr);
 
 	for (i = 0; i < sf->nr; i++) {
-		e.object = &sf->lines[i];
-		res = run_generic_expr(expr, len, &e);
+		res = eval_generic_expr(&e, &sf->lines[i]);
 		if (res < 0) {
 			fprintf(stderr, "Invalid filter '%s'\n", expr);
 			st_free(new_ipam, sf->nr * sizeof(struct ipam_line));
+			free_generic_expr(&e);
 			debug_timing_end(2);
 			return -1;
 		}
@@ -353,6 +520,7 @@ int ipam_file_filter(struct ipam_file *sf, char *expr)
 		} else
 			free_ipam_ea(&sf->lines[i]);
 	}
+	free_generic_expr(&e);
 	st_free(sf->lines, sf->max_nr * sizeof(struct ipam_line));
 	sf->lines  = new_ipam;
 	sf->max_nr = sf->nr;
@@ -361,13 +529,102 @@ int ipam_file_filter(struct ipam_file *sf, char *expr)
 	return 0;
 }
 
+struct ipam_stream {
+	struct st_options *nof;
+	struct ipam_printer *p;
+	struct generic_expr e;
+	const char *expr;
+	int failed; /* the sink failed and said why */
+};
+
+static int ipam_stream_sink(struct ipam_file *sf, struct ipam_line *l, void *data)
+{
+	struct ipam_stream *is = data;
+	int res;
+
+	if (l == NULL) {
+		ipam_printer_flush(is->p);
+		return CSV_CONTINUE;
+	}
+	if (sf->nr_streamed == 0) {
+		fprint_ipam_header(is->nof->output_file, l, is->nof->ipam_output_fmt);
+		bind_generic_expr(&is->e, ipam_filter_bind, sf, ipam_filter);
+	}
+	res = eval_generic_expr(&is->e, l);
+	if (res < 0) {
+		fprintf(stderr, "Invalid filter '%s'\n", is->expr);
+		is->failed = 1;
+		return -1;
+	}
+	if (res)
+		ipam_printer_print(is->p, l);
+	return CSV_CONTINUE;
+}
+
+int ipam_file_filter_stream(char *name, char *expr, struct st_options *nof)
+{
+	struct ipam_stream is;
+	int res;
+
+	is.nof	  = nof;
+	is.expr	  = expr;
+	is.failed = 0;
+	init_generic_expr(&is.e, expr, NULL);
+	if (compile_generic_expr(&is.e) < 0) {
+		fprintf(stderr, "Invalid filter '%s'\n", expr);
+		return -1;
+	}
+	is.p = alloc_ipam_printer(nof->output_file, nof->ipam_output_fmt);
+	if (is.p == NULL) {
+		free_generic_expr(&is.e);
+		return -1;
+	}
+	res = load_ipam_stream(name, nof, &ipam_stream_sink, &is);
+	free_ipam_printer(is.p);
+	free_generic_expr(&is.e);
+	if (res < 0) {
+		if (!is.failed)
+			fprintf(stderr, "Invalid file %s\n", (name ? name : "<stdin>"));
+		return res;
+	}
+	return 1;
+}
+
+/*
+ * best IPAM line for 's' : the first EQUALS line, or else the longest INCLUDED line
+ * (the last one in file order if several lines share the longest mask)
+ * 't' holds the IPAM lines inserted in reverse order, so the head of a trie node
+ * is its last line in file order
+ */
+static long ipam_best_line(const struct st_trie *t, const struct ipam_file *ipam,
+		const struct subnet *s)
+{
+	long j, next;
+
+	j = trie_lookup_exact(t, s);
+	if (j != -1) {
+		while ((next = trie_next_item(t, j)) != -1)
+			j = next;
+		st_debug(IPAM, 4, "found exact match %P\n", ipam->lines[j].subnet);
+		return j;
+	}
+	if (s->mask == 0)
+		return -1;
+	j = trie_longest_match(t, s, s->mask - 1);
+	if (j != -1)
+		st_debug(IPAM, 4, "found included match %P\n", ipam->lines[j].subnet);
+	return j;
+}
+
 int populate_sf_from_ipam(struct subnet_file *sf, struct ipam_file *ipam)
 {
-	unsigned long i, j, found_j;
-	int k, res;
-	int found_mask, mask;
+	unsigned long i, j;
+	long *found;
+	int k, res, ea_nr;
 	int has_comment = 0;
 	struct ipam_ea *new_ea;
+	struct route *r;
+	struct st_trie trie;
 
 	new_ea = realloc_ea_array(sf->ea, sf->ea_nr,  sf->ea_nr + ipam->ea_nr);
 	if (new_ea == NULL)
@@ -385,70 +642,61 @@ int populate_sf_from_ipam(struct subnet_file *sf, struct ipam_file *ipam)
 		}
 	}
 
+	debug_timing_start(2);
+	found = st_malloc((sf->nr + 1) * sizeof(long), "ipam matches");
+	if (found == NULL) {
+		debug_timing_end(2);
+		return -1;
+	}
+	res = alloc_trie(&trie, ipam->nr);
+	if (res < 0) {
+		st_free(found, (sf->nr + 1) * sizeof(long));
+		debug_timing_end(2);
+		return res;
+	}
+	for (j = ipam->nr; j > 0; j--)
+		trie_insert(&trie, &ipam->lines[j - 1].subnet, j - 1);
+	/* pass 1 : find the best IPAM line for each route */
+	for (i = 0; i < sf->nr; i++)
+		found[i] = ipam_best_line(&trie, ipam, &sf->routes[i].subnet);
+	free_trie(&trie);
+
+	/* pass 2 : set the new EA of each route; the final size of the EA array is known
+	 * so it is allocated only once
+	 * 'comment' get special treatment; it is included in struct route
+	 * by default as routes->ea[0]; so if we get 'comment' EA from ipam
+	 * we need to overwrite it with IPAM value
+	 */
 	for (i = 0; i < sf->nr; i++) {
-		/* allocating new EA and setting value to NULL */
-		res = realloc_route_ea(&sf->routes[i], sf->routes[i].ea_nr + ipam->ea_nr);
-		if (res < 0)
-			return res;
-		found_mask = -1;
-		found_j    = 0;
-		for (j = 0; j < ipam->nr; j++) {
-			res = subnet_compare(&sf->routes[i].subnet, &ipam->lines[j].subnet);
-			if (res == EQUALS) {
-				found_mask = ipam->lines[j].subnet.mask;
-				st_debug(IPAM, 4, "found exact match %P\n", ipam->lines[j].subnet);
-				found_j = j;
-				break; /* we break on exact match */
-			} else if (res == INCLUDED) {
-				st_debug(IPAM, 4, "found included match %P\n",
-						ipam->lines[j].subnet);
-				mask = ipam->lines[j].subnet.mask;
-				if (mask < found_mask)
-					continue; /* we have a better mask */
-				found_mask = mask;
-				found_j    = j;
-			}
+		r = &sf->routes[i];
+		ea_nr = r->ea_nr + ipam->ea_nr - has_comment;
+		new_ea = alloc_ea_array_arena(&sf->arena, ea_nr);
+		if (new_ea == NULL) {
+			st_free(found, (sf->nr + 1) * sizeof(long));
+			debug_timing_end(2);
+			return -1;
 		}
+		/* the old array stays in the arena */
+		memcpy(new_ea, r->ea, r->ea_nr * sizeof(struct ipam_ea));
+		r->ea    = new_ea;
+		r->ea_nr = ea_nr;
+
 		k = 1;
-		if (found_mask == -1) {
-			for (j = 0; j < ipam->ea_nr; j++) {
-				/* 'comment' get special treatment; it is included in struct route
-				 * by default as routes->ea[0]; so if we get 'comment' EA from ipam
-				 *  we need to overwrite it with IPAM value
-				 * and free some memory (we reserve 1 more struct ea)
-				 */
-				if (!strcasecmp(ipam->ea[j].name, "comment")) {
-					sf->routes[i].ea[0].name  = ipam->ea[j].name;
-					sf->routes[i].ea[0].value = NULL;
-					has_comment = 1;
-				} else {
-					sf->routes[i].ea[k].name  = ipam->ea[j].name;
-					sf->routes[i].ea[k].value = NULL;
-					k++;
-				}
+		for (j = 0; j < ipam->ea_nr; j++) {
+			if (!strcasecmp(ipam->ea[j].name, "comment")) {
+				new_ea = &r->ea[0];
+			} else {
+				new_ea = &r->ea[k];
+				k++;
 			}
-		} else {
-			for (j = 0; j < ipam->ea_nr; j++) {
-				if (!strcasecmp(ipam->ea[j].name, "comment")) {
-					sf->routes[i].ea[0].name  = ipam->ea[j].name;
-					ea_strdup(&sf->routes[i].ea[0],
-							ipam->lines[found_j].ea[j].value);
-					has_comment = 1;
-				} else {
-					sf->routes[i].ea[k].name  = ipam->ea[j].name;
-					st_free_string(sf->routes[i].ea[k].value);
-					ea_strdup(&sf->routes[i].ea[k],
-							ipam->lines[found_j].ea[j].value);
-					k++;
-				}
-			}
-		}
-		if (has_comment) {
-			sf->routes[i].ea = st_realloc_nodebug(sf->routes[i].ea,
-					(sf->routes[i].ea_nr - 1) * sizeof(struct ipam_ea),
-					sf->routes[i].ea_nr * sizeof(struct ipam_ea), "ipam ea");
-			sf->routes[i].ea_nr -= has_comment;
+			new_ea->name = ipam->ea[j].name;
+			if (found[i] == -1)
+				ea_intern(&sf->ea_values, new_ea, NULL);
+			else
+				ea_intern(&sf->ea_values, new_ea, ipam->lines[found[i]].ea[j].value);
 		}
 	}
+	st_free(found, (sf->nr + 1) * sizeof(long));
+	debug_timing_end(2);
 	return 1;
 }
@@ -24,13 +24,30 @@ struct ipam_file {
 	unsigned long max_nr; /* the number of routes that has been malloc'ed */
 	int ea_nr; /* number of Extensible Attributes */
 	struct ipam_ea *ea;
+	struct st_strtab ea_values; /* EA values of the lines, ALL interned here */
+	/* streaming (see load_ipam_stream) : each valid line is handed to 'sink',
+	 * then freed; its EA values are then NOT interned
+	 */
+	int (*sink)(struct ipam_file *sf, struct ipam_line *l, void *data);
+	void *sink_data;
+	unsigned long nr_streamed; /* number of lines handed to 'sink' */
 };
 
 int alloc_ipam_file(struct ipam_file *sf, unsigned long n, int ea_nr);
 void free_ipam_file(struct ipam_file *sf);
 int load_ipam(char  *name, struct ipam_file *sf, struct st_options *nof);
+/* load_ipam_stream: load_netcsv_stream for IPAM files */
+int load_ipam_stream(char *name, struct st_options *nof,
+		int (*sink)(struct ipam_file *sf, struct ipam_line *l, void *data), void *data);
 int fprint_ipamfilter_help(FILE *out);
 int ipam_file_filter(struct ipam_file *sf, char *expr);
+/* ipam_file_filter_stream: print the lines of IPAM file 'name' (stdin if NULL) matching
+ * 'expr' as they are parsed, after the IPAM header, in constant memory
+ * returns:
+ *	positive on SUCCESS
+ *	negative on error (invalid filter or file); the error is printed
+ */
+int ipam_file_filter_stream(char *name, char *expr, struct st_options *nof);
 int populate_sf_from_ipam(struct subnet_file *sf, struct ipam_file *ipam);
 
 #else
@@ -9,18 +9,29 @@
  */
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <ctype.h>
 #include "st_options.h"
 #include "debug.h"
 #include "iptools.h"
 #include "utils.h"
-#include "bitmap.h"
 #include "heap.h"
 #include "st_memory.h"
 #include "st_printf.h"
 
-sprint_hex(short)
-sprint_unsigned(int)
+#define M(__n) (~(uint64_t)0 << (64 - (__n)))
+const uint64_t ipv6_mask64[65] = {
+	0, M(1), M(2), M(3), M(4), M(5), M(6), M(7),
+	M(8), M(9), M(10), M(11), M(12), M(13), M(14), M(15),
+	M(16), M(17), M(18), M(19), M(20), M(21), M(22), M(23),
+	M(24), M(25), M(26), M(27), M(28), M(29), M(30), M(31),
+	M(32), M(33), M(34), M(35), M(36), M(37), M(38), M(39),
+	M(40), M(41), M(42), M(43), M(44), M(45), M(46), M(47),
+	M(48), M(49), M(50), M(51), M(52), M(53), M(54), M(55),
+	M(56), M(57), M(58), M(59), M(60), M(61), M(62), M(63),
+	M(64)
+};
+#undef M
 
 
 int is_equal_ip(struct ip_addr *ip1, struct ip_addr *ip2)
@@ -63,28 +74,13 @@ int ipv6_is_multicast(ipv6 a)
 
 static inline int subnet_compare_ipv6(ipv6 ip1, int mask1, ipv6 ip2, int mask2)
 {
-	if (mask1 > mask2) {
-		shift_ipv6_right(ip1, (128 - mask2));
-		shift_ipv6_right(ip2, (128 - mask2));
-		if (is_equal_ipv6(ip1, ip2))
-			return INCLUDED;
-		else
-			return NOMATCH;
-	} else if (mask1 < mask2) {
-		shift_ipv6_right(ip1, (128 - mask1));
-		shift_ipv6_right(ip2, (128 - mask1));
-		if (is_equal_ipv6(ip1, ip2))
-			return INCLUDES;
-		else
-			return NOMATCH;
-	} else {
-		shift_ipv6_right(ip1, (128 - mask1));
-		shift_ipv6_right(ip2, (128 - mask1));
-		if (is_equal_ipv6(ip1, ip2))
-			return EQUALS;
-		else
-			return NOMATCH;
-	}
+	if (!ipv6_prefix_equal(&ip1, &ip2, min(mask1, mask2)))
+		return NOMATCH;
+	if (mask1 > mask2)
+		return INCLUDED;
+	else if (mask1 < mask2)
+		return INCLUDES;
+	return EQUALS;
 }
 
 static inline int subnet_compare_ipv4(ipv4 prefix1, int mask1, ipv4 prefix2, int mask2)
@@ -144,6 +140,108 @@ int addr_compare(const struct ip_addr *a, const struct subnet *sub)
 	return -1;
 }
 
+/*
+ * formatting tables, filled at start-up by iptools_init
+ * dec8[n]	: decimal digits of n (0 to 255), their number in dec8[n][3]
+ * hex8[n]	: the 2 hex digits of n
+ * zero_run[m]	: longest run of zero blocks of an IPv6 address whose zero blocks
+ *		  are the bits of 'm' (bit i <=> block i); start in the low nibble,
+ *		  length in the high nibble; runs of 1 block are not compressed
+ * ddn[m]	: mask 'm' in Dot Decimal Notation, its length in ddn_len[m]
+ */
+static char dec8[256][4];
+static char hex8[256][2];
+static unsigned char zero_run[256];
+static char ddn[33][16];
+static unsigned char ddn_len[33];
+
+/* writes 4 bytes, returns the number of digits */
+static inline int put_dec8(char *s, unsigned int n)
+{
+	memcpy(s, dec8[n], 4);
+	return dec8[n][3];
+}
+
+/* writes 4 bytes, returns the number of digits (no leading zeros) */
+static inline int put_hex16(char *s, unsigned int n)
+{
+	char t[8] = { 0 };
+	int len = 1 + (n > 0xF) + (n > 0xFF) + (n > 0xFFF);
+
+	memcpy(t, hex8[n >> 8], 2);
+	memcpy(t + 2, hex8[n & 0xFF], 2);
+	memcpy(s, t + 4 - len, 4);
+	return len;
+}
+
+/* dotted IPv4, writes at most 16 bytes, not Nul-terminated */
+static inline int put_ipv4(char *s, ipv4 z)
+{
+	int i;
+
+	i = put_dec8(s, z >> 24);
+	s[i++] = '.';
+	i += put_dec8(s + i, (z >> 16) & 0xff);
+	s[i++] = '.';
+	i += put_dec8(s + i, (z >> 8) & 0xff);
+	s[i++] = '.';
+	i += put_dec8(s + i, z & 0xff);
+	return i;
+}
+
+/* bit i set if block i of z is 0 */
+static inline unsigned int ipv6_zero_blocks(ipv6 z)
+{
+	const uint64_t m = 0x7FFF7FFF7FFF7FFFULL;
+	uint64_t t;
+	unsigned int r = 0;
+	int k;
+
+	for (k = 0; k < 2; k++) {
+		/* high bit of each 16-bit lane set if the lane is 0, no carry between lanes */
+		t = ~(((z.n64[k] & m) + m) | z.n64[k] | m);
+		r |= ((t >> 63) | ((t >> 46) & 2) | ((t >> 29) & 4) | ((t >> 12) & 8)) << (4 * k);
+	}
+	return r;
+}
+
+__attribute__((constructor)) static void iptools_init(void)
+{
+	static const char hex[] = "0123456789abcdef";
+	int n, i, run, start, best, best_i;
+
+	for (n = 0; n < 256; n++) {
+		dec8[n][3] = sprintf(dec8[n], "%d", n);
+		hex8[n][0] = hex[n >> 4];
+		hex8[n][1] = hex[n & 0xf];
+	}
+	for (n = 0; n < 256; n++) {
+		run = start = best = best_i = 0;
+		for (i = 0; i <= 8; i++) {
+			if (i < 8 && (n & (1 << i))) {
+				if (run++ == 0)
+					start = i;
+				continue;
+			}
+			/* in case of egality, we prefer to replace block to the right
+			 * if you want to replace the left block change to '>'
+			 */
+			if (run && run >= best) {
+				best   = run;
+				best_i = start;
+			}
+			run = 0;
+		}
+		if (best == 1) /* do not bother to compress if there is only one block to compress */
+			best = best_i = 0;
+		zero_run[n] = best_i | (best << 4);
+	}
+	for (n = 0; n <= 32; n++) {
+		ddn_len[n] = put_ipv4(ddn[n], n ? 0xFFFFFFFFU << (32 - n) : 0);
+		ddn[n][ddn_len[n]] = '\0';
+	}
+}
+
 static inline int addrv42str(ipv4 z, char *out_buffer, size_t len)
 {
 	int i;
@@ -157,13 +255,7 @@ static inline int addrv42str(ipv4 z, char *out_buffer, size_t len)
 		out_buffer[0] = '\0';
 		return -1;
 	}
-	i = sprint_uint(out_buffer, (z >> 24) & 0xff);
-	out_buffer[i++] = '.';
-	i += sprint_uint(out_buffer + i, (z >> 16) & 0xff);
-	out_buffer[i++] = '.';
-	i += sprint_uint(out_buffer + i, (z >> 8) & 0xff);
-	out_buffer[i++] = '.';
-	i += sprint_uint(out_buffer + i, z & 0xff);
+	i = put_ipv4(out_buffer, z);
 	out_buffer[i] = '\0';
 	return i;
 }
@@ -178,9 +270,9 @@ static inline int addrv42str(ipv4 z, char *out_buffer, size_t len)
  */
 static inline int addrv62str(ipv6 z, char *out_buffer, size_t len, int compress)
 {
-	int a, i, j;
-	int skip = 0, max_skip = 0;
-	int skip_index = 0, max_skip_index = 0;
+	int i, j;
+	unsigned int b, zeros;
+	int max_skip, max_skip_index;
 
 	/*
 	 * instead of using snprint to check outbuff isnt overrun at each step,
@@ -192,70 +284,49 @@ static inline int addrv62str(ipv6 z, char *out_buffer, size_t len, int compress)
 		out_buffer[0] = '\0';
 		return -1;
 	}
+	j = 0;
 	if (compress == 0) {
-		/* no need for snprintf since we made sure len is at least 40 and
-		 * we can't print more than 40 chars here
-		 */
-		a = sprintf(out_buffer, "%04x:%04x:%04x:%04x:%04x:%04x:%04x:%04x",
-				block(z, 0), block(z, 1), block(z, 2), block(z, 3),
-				block(z, 4), block(z, 5), block(z, 6), block(z, 7));
-		return a;
+		for (i = 0; i < 8; i++) {
+			b = block(z, i);
+			memcpy(out_buffer + j, hex8[b >> 8], 2);
+			memcpy(out_buffer + j + 2, hex8[b & 0xFF], 2);
+			out_buffer[j + 4] = ':';
+			j += 5;
+		}
+		out_buffer[--j] = '\0';
+		return j;
 	} else if (compress == 1) {
-		a = sprintf(out_buffer, "%x:%x:%x:%x:%x:%x:%x:%x",
-				block(z, 0), block(z, 1), block(z, 2), block(z, 3),
-				block(z, 4), block(z, 5), block(z, 6), block(z, 7));
-		return a;
-	}
-	/* longest 0000 block sequence will be replaced */
-	for (i = 0; i < 8; i++) {
-		if (block(z, i) == 0) {
-			if (skip == 0)  {
-				debug(PARSEIPV6, 8, "possible skip index %d\n", i);
-				skip_index = i;
-			}
-			skip++;
-		} else {
-			if (skip) {
-				/* in case of egality, we prefer to replace block to the right
-				 * if you want to replace the left block change to '>'
-				 */
-				if (skip >= max_skip) {
-					debug(PARSEIPV6, 8, "skip index %d better\n", skip_index);
-					max_skip = skip;
-					max_skip_index = skip_index;
-				}
-				skip = 0;
-			}
+		for (i = 0; i < 8; i++) {
+			j += put_hex16(out_buffer + j, block(z, i));
+			out_buffer[j++] = ':';
 		}
+		out_buffer[--j] = '\0';
+		return j;
 	}
-	if (skip && (skip >= max_skip)) {
-		/* happens in case address ENDS with :0000,
-		 * we then left the loop without setting max_skip
-		 */
-		max_skip =  skip;
-		max_skip_index = skip_index;
-	}
-	if (max_skip == 1) /* do not bother to compress if there is only one block to compress */
-		max_skip = max_skip_index = 0;
+	/* longest 0000 block sequence will be replaced */
+	zeros = ipv6_zero_blocks(z);
+	max_skip       = zero_run[zeros] >> 4;
+	max_skip_index = zero_run[zeros] & 0xF;
 	debug(PARSEIPV6, 5, "can skip %d blocks at index %d\n", max_skip, max_skip_index);
-	if (compress == 3 && (skip_index == 0 && (max_skip >= 5 && max_skip < 8))) {
-		/* Mapped & Compatible IPv4 address */
+	/* Mapped & Compatible IPv4 address : only blocks 0 to 4 (5, 6) are 0 */
+	if (compress == 3 && (zeros == 0x1F || zeros == 0x3F || zeros == 0x7F)) {
 		if (block(z, 5) == 0x0) {
 			if (block(z, 6) == 0 && block(z, 7) == 1) /** the loopback address */
 				return sprintf(out_buffer, "::1");
-			else
-				return sprintf(out_buffer, "::%d.%d.%d.%d",
-						block(z, 6) >> 8, block(z, 6) & 0xff,
-						block(z, 7) >> 8, block(z, 7) & 0xff);
+			memcpy(out_buffer, "::", 2);
+			j = 2 + put_ipv4(out_buffer + 2, (ipv4)z.n64[1]);
+			out_buffer[j] = '\0';
+			return j;
+		}
+		if (block(z, 5) == 0xffff) {
+			memcpy(out_buffer, "::ffff:", 7);
+			j = 7 + put_ipv4(out_buffer + 7, (ipv4)z.n64[1]);
+			out_buffer[j] = '\0';
+			return j;
 		}
-		if (block(z, 5) == 0xffff)
-			return sprintf(out_buffer, "::ffff:%d.%d.%d.%d",
-					block(z, 6) >> 8, block(z, 6) & 0xff,
-					block(z, 7) >> 8, block(z, 7) & 0xff);
 	}
-	j = 0;
 	for (i = 0; i < max_skip_index; i++) {
-		j += sprint_hexshort(out_buffer + j, block(z, i));
+		j += put_hex16(out_buffer + j, block(z, i));
 		out_buffer[j++] = ':';
 	}
 	if (max_skip > 0) {
@@ -264,11 +335,11 @@ static inline int addrv62str(ipv6 z, char *out_buffer, size_t len, int compress)
 			out_buffer[j++] = ':';
 	}
 	for (i = max_skip_index + max_skip; i < 7; i++) {
-		j += sprint_hexshort(out_buffer + j, block(z, i));
+		j += put_hex16(out_buffer + j, block(z, i));
 		out_buffer[j++] = ':';
 	}
 	if (i < 8)
-		j += sprint_hexshort(out_buffer + j, block(z, i));
+		j += put_hex16(out_buffer + j, block(z, i));
 	out_buffer[j] = '\0';
 	return j;
 }
@@ -341,22 +412,17 @@ int addr2str(const struct ip_addr *a, char *out_buffer, size_t len, int comp_lev
 /* IPv4 only, mask to Dot Decimal Notation */
 int mask2ddn(int mask, char *out, size_t len)
 {
-	int i;
-	unsigned int s[4];
-
 	if (len < 16) {
 		fprintf(stderr, "BUG, %s needs at least a 16-bytes buffer\n", __func__);
 		out[0] = '\0';
 		return -1;
 	}
-	for (i = 0; i < mask / 8; i++)
-		s[i] = 255;
-	if (i < 4) {
-		s[i++] = 256 - (1 << (8 - (mask % 8)));
-		for ( ; i < 4; i++)
-			s[i] = 0;
+	if (mask < 0 || mask > 32) {
+		out[0] = '\0';
+		return -1;
 	}
-	return sprintf(out, "%d.%d.%d.%d", s[0], s[1], s[2], s[3]);
+	memcpy(out, ddn[mask], 16);
+	return ddn_len[mask];
 }
 
 int ipv4_get_classfull_mask(const struct subnet *s)
@@ -392,7 +458,7 @@ int addr_is_superior(const struct ip_addr *ip1, const struct ip_addr *ip2)
 
 int subnet_is_superior(const struct subnet *s1, const struct subnet *s2)
 {
-	int i, res;
+	int res;
 
 	if (s1->ip_ver != s2->ip_ver) {
 		debug(ADDRCOMP, 1, "cannot compare, different IP version\n");
@@ -419,17 +485,8 @@ int subnet_is_superior(const struct subnet *s1, const struct subnet *s2)
 				res = 1;
 			else
 				res = 0;
-		} else {
-			for (i = 0; i < 8; i++) {
-				if (block(s1->ip6, i) < block(s2->ip6, i)) {
-					res = 1;
-					break;
-				} else if (block(s1->ip6, i) > block(s2->ip6, i)) {
-					res = 0;
-					break;
-				}
-			}
-		}
+		} else
+			res = ipv6_is_inferior(&s1->ip6, &s2->ip6);
 		st_debug(ADDRCOMP, 7, "%P %c %P\n", *s1, (res ? '>' : '<'), *s2);
 		return res;
 	}
@@ -521,32 +578,24 @@ static int aggregate_subnet_ipv4(const struct subnet *s1, const struct subnet *s
 static int aggregate_subnet_ipv6(const struct subnet *s1, const struct subnet *s2,
 		struct subnet *res)
 {
-	ipv6 a, b;
-
 	if (s1->mask != s2->mask) {
 		st_debug(AGGREGATE, 5, "different masks for %P and %P, can't aggregate\n",
 				*s1, *s2);
 		return -1;
 	}
-	memcpy(&a, &s1->ip6, sizeof(a));
-	memcpy(&b, &s2->ip6, sizeof(a));
-	shift_ipv6_right(a, (128 - s1->mask));
-	shift_ipv6_right(b, (128 - s1->mask));
-	if (is_equal_ipv6(a, b)) {
+	if (ipv6_prefix_equal(&s1->ip6, &s2->ip6, s1->mask)) {
 		st_debug(AGGREGATE, 5, "same subnet %P\n", *s1);
 		copy_subnet(res, s1);
 		return 1;
 	}
-	shift_ipv6_right(a, 1);
-	shift_ipv6_right(b, 1);
-	if (!is_equal_ipv6(a, b)) {
+	if (!ipv6_prefix_equal(&s1->ip6, &s2->ip6, s1->mask - 1)) {
 		st_debug(AGGREGATE, 5, "cannot aggregate %P and %P\n", *s1, *s2);
 		return -1;
 	}
 	res->mask = s1->mask - 1;
-	shift_ipv6_left(a, 128 - res->mask);
 	res->ip_ver = IPV6_A;
-	memcpy(&res->ip6, &a, sizeof(a));
+	memcpy(&res->ip6, &s1->ip6, sizeof(ipv6));
+	ipv6_netmask(&res->ip6, res->mask);
 	st_debug(AGGREGATE, 5, "can aggregate %P and %P into : %P\n", *s1, *s2, *res);
 	return 1;
 }
@@ -572,24 +621,21 @@ void first_ip(struct subnet *s)
 		s->ip >>= (32 - s->mask);
 		s->ip <<= (32 - s->mask);
 	} else if (s->ip_ver == IPV6_A) {
-		shift_ipv6_right(s->ip6, 128 - s->mask);
-		shift_ipv6_left(s->ip6, 128 - s->mask);
+		ipv6_netmask(&s->ip6, s->mask);
 	}
 }
 
 /* broadcast address of a prefix; except broadcast doesnt exist in IPv6 :) */
 void last_ip(struct subnet *s)
 {
-	int i, j;
+	int i;
 
 	if (s->ip_ver == IPV4_A) {
 		for (i = 0; i < (32 - s->mask); i++)
 			s->ip |= (1 << i);
-	} else if (s->ip_ver == IPV6_A) { /* do you love binary math? yes you do! */
-		for (i = 0; i < (128 - s->mask) / 16; i++)
-			set_block(s->ip6, 7 - i, 0xFFFF);
-		for (j = 0; j < ((128 - s->mask) % 16); j++)
-			block_OR(s->ip6, 7 - i,  (1 << j));
+	} else if (s->ip_ver == IPV6_A) {
+		s->ip6.n64[0] |= ~ipv6_mask64[s->mask >= 64 ? 64 : s->mask];
+		s->ip6.n64[1] |= ~ipv6_mask64[s->mask >= 64 ? s->mask - 64 : 0];
 	}
 }
 
@@ -600,9 +646,9 @@ void next_subnet(struct subnet *s)
 		s->ip += 1;
 		s->ip <<= (32 - s->mask);
 	} else if (s->ip_ver == IPV6_A) {
-		shift_ipv6_right(s->ip6, 128 - s->mask);
-		increase_ipv6(s->ip6);
-		shift_ipv6_left(s->ip6, 128 - s->mask);
+		ipv6_netmask(&s->ip6, s->mask);
+		if (s->mask)
+			ipv6_add_bit(&s->ip6, s->mask - 1);
 	}
 }
 
@@ -613,42 +659,54 @@ void previous_subnet(struct subnet *s)
 		s->ip -= 1;
 		s->ip <<= (32 - s->mask);
 	} else if (s->ip_ver == IPV6_A) {
-		shift_ipv6_right(s->ip6, 128 - s->mask);
-		decrease_ipv6(s->ip6);
-		shift_ipv6_left(s->ip6, 128 - s->mask);
+		ipv6_netmask(&s->ip6, s->mask);
+		if (s->mask)
+			ipv6_sub_bit(&s->ip6, s->mask - 1);
 	}
 }
 
+/* number of trailing zero bits of the network part of 's' */
 int can_decrease_mask(const struct subnet *s)
 {
 	ipv4 a;
 	ipv6 b;
-	int i = 0;
 
+	if (s->mask == 0)
+		return 0;
 	if (s->ip_ver == IPV4_A) {
 		a = (s->ip >> (32 - s->mask));
-		while (i < s->mask) {
-			if (a & 1)
-				break;
-			i++;
-			a >>= 1;
-		}
-		return i;
+		if (a == 0)
+			return s->mask;
+		return __builtin_ctz(a);
 	}
 	if (s->ip_ver == IPV6_A) {
 		memcpy(&b, &s->ip6, sizeof(ipv6));
-		shift_ipv6_right(b, 128 - s->mask);
-		while (i < s->mask) {
-			if (block(b, 7) & 1)
-				break;
-			i++;
-			shift_ipv6_right(b, 1);
-		}
-		return i;
+		ipv6_netmask(&b, s->mask);
+		return ipv6_ctz(&b) - (128 - s->mask);
 	}
 	return 0;
 }
 
+/* 'sib' is the prefix of length 'mask' of 's', with its last bit flipped
+ * returns the value of that bit in 's'
+ */
+static int sibling_subnet(const struct subnet *s, int mask, struct subnet *sib)
+{
+	int bit;
+
+	copy_subnet(sib, s);
+	sib->mask = mask;
+	first_ip(sib);
+	if (s->ip_ver == IPV4_A) {
+		bit = (s->ip >> (32 - mask)) & 1;
+		sib->ip ^= 1U << (32 - mask);
+	} else {
+		bit = ipv6_bit(&s->ip6, mask - 1);
+		ipv6_flip_bit(&sib->ip6, mask - 1);
+	}
+	return bit;
+}
+
 /*
  * remove s2 from s1 if possible
  * alloc a new struct subnet *
@@ -659,7 +717,7 @@ struct subnet *subnet_remove(const struct subnet *s1, const struct subnet *s2, i
 	int res;
 	struct subnet *news;
 	struct subnet test;
-	int a, i;
+	int mask, i;
 
 	res = subnet_compare(s1, s2);
 	if (res == EQUALS) {
@@ -684,75 +742,22 @@ struct subnet *subnet_remove(const struct subnet *s1, const struct subnet *s2, i
 		*n = -1;
 		return NULL;
 	}
-	copy_subnet(&test, s1);
-	first_ip(&test);
+	/* s1 minus s2 is made of the siblings of the prefixes of s2 longer than s1
+	 * (one per mask); in address order, first the siblings before s2 (largest first),
+	 * then the siblings after s2 (smallest first)
+	 */
 	i = 0;
-	/* strategy is as follow :
-	* test = S1;
-	* do
-	*	do
-	*		increase test mask
-	*	until test doesn't include S2 any more
-	*
-	*	test = test + 1 (next subnet)
-	* until test != S2
-	*
-	* test = S2
-	* do
-	*	test = test +1 (next subnet)
-	*	decrease test mask as much as we can (aggregation)
-	*until test included in S1
-	*/
-	while (1) { /* getting subnet before s2*/
-		a = 0;
-		while (1) {
-			test.mask += 1;
-			st_debug(ADDRREMOVE, 3, "Loop#1 testing %P\n", test);
-			res = subnet_compare(&test, s2);
-			if (res == INCLUDES) {
-				st_debug(ADDRREMOVE, 5,
-						"Loop#1 %P too BIG, includes %P, continuing loop\n",
-						test, *s2);
-				continue;
-			} else if (res == NOMATCH) {
-				st_debug(ADDRREMOVE, 5,
-						"Loop#1 %P BIG enough, breaking loop\n", test);
-				copy_subnet(&news[i], &test);
-				i++;
-				break;
-			} else if (res == EQUALS) {
-				st_debug(ADDRREMOVE, 5,
-						"Loop#1 %P EQUALS, breaking final loop\n", test);
-				a++;
-				break;
-			}
-		}
-		if (a)
-			break;
-		next_subnet(&test);
-		st_debug(ADDRREMOVE, 5, "Loop#1 advancing to %P\n", test);
-		res = subnet_compare(&test, s2);
-		if (res == EQUALS) {
-			st_debug(ADDRREMOVE, 5, "Loop#1 finally we reached %P\n", *s2);
-			break;
+	for (mask = s1->mask + 1; mask <= s2->mask; mask++) {
+		if (sibling_subnet(s2, mask, &test) == 1) {
+			st_debug(ADDRREMOVE, 5, "%P is before %P\n", test, *s2);
+			copy_subnet(&news[i++], &test);
 		}
 	}
-	/* getting subnet after s2 */
-	copy_subnet(&test, s2);
-
-	while (1) {
-		next_subnet(&test);
-		st_debug(ADDRREMOVE, 5, "Loop#2 testing %P\n", test);
-		a = can_decrease_mask(&test);
-		test.mask -= a;
-		st_debug(ADDRREMOVE, 5, "Loop#2 increased to %P\n", test);
-		res = subnet_compare(&test, s1);
-		if (res == NOMATCH) {
-			st_debug(ADDRREMOVE, 5, "Loop#2 finally %P bigger than %P\n", test, *s1);
-			break;
+	for (mask = s2->mask; mask > s1->mask; mask--) {
+		if (sibling_subnet(s2, mask, &test) == 0) {
+			st_debug(ADDRREMOVE, 5, "%P is after %P\n", test, *s2);
+			copy_subnet(&news[i++], &test);
 		}
-		copy_subnet(&news[i], &test);
-		i++;
 	}
 	*n = i;
 	return news;
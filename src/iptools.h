@@ -24,7 +24,7 @@ typedef unsigned int ipv4;
 struct ipv6_a {
 	union {
 		/* beware of endianness issues
-		 * current version of subnet tool manipulate ->n16 only, use n32 your own risk
+		 * the address is held by n64 (see below), n16 and n32 are NOT in address order
 		 */
 		unsigned short	n16[8];
 		uint32_t	n32[4];
@@ -34,38 +34,146 @@ struct ipv6_a {
 typedef struct ipv6_a ipv6;
 
 /* due to endianness issues, ipv6 address should not be manipulated directly
- * works today, but will break the day we use something like a u128 to do the math...
  * if you change the representation of IPv6, you must redefine these macro,
  * (and only these) all code in .c file is safe
+ *
+ * an IPv6 address is a native 128-bit number split in two 64-bit words:
+ * n64[0] holds the 64 high bits (blocks 0 to 3), n64[1] the 64 low bits (blocks 4 to 7)
+ * so shifts, increments and compares are a few instructions, not loops over 16-bit blocks
  */
-#define IPV6_USHORT_ARRAY
-#ifdef IPV6_USHORT_ARRAY
 
-#define block(__ip6, __n) __ip6.n16[__n]
-#define set_block(__ip6, __n, __value) (__ip6.n16[__n] = __value)
-#define block_OR(__ip6, __n, __value) (__ip6.n16[__n] |= __value)
+/* ipv6_mask64[n] : 64-bit word with its 'n' high bits set */
+extern const uint64_t ipv6_mask64[65];
 
-#define shift_ipv6_left(__z, __len) shift_left(__z.n16, 8, __len)
-#define shift_ipv6_right(__z, __len) shift_right(__z.n16, 8, __len)
-#define increase_ipv6(__z) increase_bitmap(__z.n16, 8)
-#define decrease_ipv6(__z) decrease_bitmap(__z.n16, 8)
-#define ipv6_is_superior(__ip1, __ip2) bitmap_is_inferior(__ip1.n16, __ip2.n16, 8)
+#define block(__ip6, __n) \
+	((unsigned short)((__ip6).n64[(__n) >> 2] >> ((3 - ((__n) & 3)) * 16)))
+#define set_block(__ip6, __n, __value) ipv6_set_block(&(__ip6), __n, __value)
+#define block_OR(__ip6, __n, __value) \
+	((__ip6).n64[(__n) >> 2] |= (uint64_t)(unsigned short)(__value) << ((3 - ((__n) & 3)) * 16))
 
-#else
-/* this so you get the idea ....*/
-#define block(__ip6, __n) (u16)((__ip6 >> ((7 - __n) * 16)) & 0xFF)
-#define set_block(__ip6, __n, __value) do { \
-	u16 cur = (__ip6 >> ((7 - __n) * 16)) & 0xFF; \
-	cur ^= __value; \
-	__ip6 ^= (cur << ((7 - __n) * 16)); \
-} while (0) /* not sure about this one :) */
-#define shift_ipv6_left(__z, __len) (__z <<= __n)
-#define shift_ipv6_right(__z, __len) (__z >>= __n)
-#define increase_ipv6(__z) (__z++)
-#define decrease_ipv6(__z) (__z--)
-#define ipv6_is_superior(__ip1, __ip2) (__ip1) < (__ip2)
+/* static initializer of an IPv6 address from its 8 blocks */
+#define IPV6_INIT(__b0, __b1, __b2, __b3, __b4, __b5, __b6, __b7) { .n64 = { \
+	((uint64_t)(__b0) << 48) | ((uint64_t)(__b1) << 32) | ((uint64_t)(__b2) << 16) | (__b3), \
+	((uint64_t)(__b4) << 48) | ((uint64_t)(__b5) << 32) | ((uint64_t)(__b6) << 16) | (__b7) } }
 
-#endif
+#define shift_ipv6_left(__z, __len) ipv6_shift_left(&(__z), __len)
+#define shift_ipv6_right(__z, __len) ipv6_shift_right(&(__z), __len)
+#define increase_ipv6(__z) ipv6_add(&(__z), 0, 1)
+#define decrease_ipv6(__z) ipv6_sub(&(__z), 0, 1)
+#define ipv6_is_superior(__ip1, __ip2) ipv6_is_inferior(&(__ip1), &(__ip2))
+
+static inline void ipv6_set_block(ipv6 *a, int n, unsigned short value)
+{
+	int shift = (3 - (n & 3)) * 16;
+
+	a->n64[n >> 2] &= ~((uint64_t)0xFFFF << shift);
+	a->n64[n >> 2] |= (uint64_t)value << shift;
+}
+
+static inline void ipv6_shift_left(ipv6 *a, int len)
+{
+	if (len >= 128) {
+		a->n64[0] = a->n64[1] = 0;
+	} else if (len >= 64) {
+		a->n64[0] = a->n64[1] << (len - 64);
+		a->n64[1] = 0;
+	} else if (len > 0) {
+		a->n64[0] = (a->n64[0] << len) | (a->n64[1] >> (64 - len));
+		a->n64[1] <<= len;
+	}
+}
+
+static inline void ipv6_shift_right(ipv6 *a, int len)
+{
+	if (len >= 128) {
+		a->n64[0] = a->n64[1] = 0;
+	} else if (len >= 64) {
+		a->n64[1] = a->n64[0] >> (len - 64);
+		a->n64[0] = 0;
+	} else if (len > 0) {
+		a->n64[1] = (a->n64[1] >> len) | (a->n64[0] << (64 - len));
+		a->n64[0] >>= len;
+	}
+}
+
+/* add (resp. substract) the 128-bit number hi:lo to 'a', modulo 2^128 */
+static inline void ipv6_add(ipv6 *a, uint64_t hi, uint64_t lo)
+{
+	a->n64[1] += lo;
+	a->n64[0] += hi + (a->n64[1] < lo);
+}
+
+static inline void ipv6_sub(ipv6 *a, uint64_t hi, uint64_t lo)
+{
+	uint64_t borrow = (a->n64[1] < lo);
+
+	a->n64[1] -= lo;
+	a->n64[0] -= hi + borrow;
+}
+
+static inline int ipv6_is_inferior(const ipv6 *a, const ipv6 *b)
+{
+	if (a->n64[0] != b->n64[0])
+		return a->n64[0] < b->n64[0];
+	return a->n64[1] < b->n64[1];
+}
+
+/* ipv6_netmask: keep the 'mask' high bits of 'a' (0 <= mask <= 128) */
+static inline void ipv6_netmask(ipv6 *a, int mask)
+{
+	a->n64[0] &= ipv6_mask64[mask >= 64 ? 64 : mask];
+	a->n64[1] &= ipv6_mask64[mask >= 64 ? mask - 64 : 0];
+}
+
+/* ipv6_prefix_equal: do 'a' and 'b' share their 'mask' high bits */
+static inline int ipv6_prefix_equal(const ipv6 *a, const ipv6 *b, int mask)
+{
+	return !((a->n64[0] ^ b->n64[0]) & ipv6_mask64[mask >= 64 ? 64 : mask]) &&
+		!((a->n64[1] ^ b->n64[1]) & ipv6_mask64[mask >= 64 ? mask - 64 : 0]);
+}
+
+/* ipv6_add_bit: add 2^(127 - n) to 'a', n being a bit index (0 is the most significant) */
+static inline void ipv6_add_bit(ipv6 *a, int n)
+{
+	if (n < 64)
+		ipv6_add(a, (uint64_t)1 << (63 - n), 0);
+	else
+		ipv6_add(a, 0, (uint64_t)1 << (127 - n));
+}
+
+static inline void ipv6_sub_bit(ipv6 *a, int n)
+{
+	if (n < 64)
+		ipv6_sub(a, (uint64_t)1 << (63 - n), 0);
+	else
+		ipv6_sub(a, 0, (uint64_t)1 << (127 - n));
+}
+
+/* ipv6_bit: value of bit 'n' of 'a'; 0 is the most significant */
+static inline int ipv6_bit(const ipv6 *a, int n)
+{
+	if (n < 64)
+		return (a->n64[0] >> (63 - n)) & 1;
+	return (a->n64[1] >> (127 - n)) & 1;
+}
+
+static inline void ipv6_flip_bit(ipv6 *a, int n)
+{
+	if (n < 64)
+		a->n64[0] ^= (uint64_t)1 << (63 - n);
+	else
+		a->n64[1] ^= (uint64_t)1 << (127 - n);
+}
+
+/* ipv6_ctz: number of trailing zero bits of 'a', 128 if 'a' is zero */
+static inline int ipv6_ctz(const ipv6 *a)
+{
+	if (a->n64[1])
+		return __builtin_ctzll(a->n64[1]);
+	if (a->n64[0])
+		return 64 + __builtin_ctzll(a->n64[0]);
+	return 128;
+}
 
 struct ip_addr {
 	union {
@@ -32,6 +32,8 @@
 #include "ipam.h"
 #include "st_memory.h"
 #include "st_help.h"
+#include "st_thread.h"
+#include "st_extsort.h"
 #include "prog-main.h"
 
 
@@ -82,6 +84,8 @@ static int run_uniq(int argc, char **argv, void *st_options);
 static int run_paip(int argc, char **argv, void *st_options);
 static int run_ipam_getea(int argc, char **argv, void *st_options);
 static int run_grep(int argc, char **argv, void *st_options);
+static int run_lookup(int argc, char **argv, void *st_options);
+static int run_annotate(int argc, char **argv, void *st_options);
 static int run_convert(int argc, char **argv, void *st_options);
 static int run_routesimplify1(int argc, char **argv, void *st_options);
 static int run_routesimplify2(int argc, char **argv, void *st_options);
@@ -121,6 +125,9 @@ static int option_verbose2(int argc, char **argv, void *st_options);
 static int option_delim(int argc, char **argv, void *st_options);
 static int option_ipam_ea(int argc, char **argv, void *st_options);
 static int option_grepfield(int argc, char **argv, void *st_options);
+static int option_greptag(int argc, char **argv, void *st_options);
+static int option_threads(int argc, char **argv, void *st_options);
+static int option_mem(int argc, char **argv, void *st_options);
 static int option_output(int argc, char **argv, void *st_options);
 static int option_debug(int argc, char **argv, void *st_options);
 static int option_config(int argc, char **argv, void *st_options);
@@ -147,6 +154,8 @@ struct st_command commands[] = {
 	{ "ipam",		&run_paip,	1},
 	{ "getea",		&run_ipam_getea, 1},
 	{ "grep",		&run_grep,	2},
+	{ "lookup",		&run_lookup,	2},
+	{ "annotate",		&run_annotate,	3},
 	{ "convert",		&run_convert,	1},
 	{ "routesimplify1",	&run_routesimplify1,	1},
 	{ "routesimplify2",	&run_routesimplify2,	1},
@@ -181,6 +190,9 @@ struct st_command options[] = {
 	{"-VV",		&option_verbose2,	0},
 	{"-d",		&option_delim,		1},
 	{"-grep_field",	&option_grepfield,	1},
+	{"-grep_tag",	&option_greptag,	0},
+	{"-j",		&option_threads,	1},
+	{"-mem",	&option_mem,		1},
 	{"-o",		&option_output,		1},
 	{"-D",		&option_debug,		1},
 	{"-c",		&option_config,		1},
@@ -316,15 +328,11 @@ static int run_ipinfo(int argc, char **argv, void *st_options)
 static int run_print(int argc, char **argv, void *st_options)
 {
 	int res;
-	struct subnet_file sf;
 	struct st_options *nof = st_options;
 
-	res = load_netcsv_file(argv[2], &sf, nof);
-	DIE_ON_BAD_FILE(argv[2]);
-	if (nof->print_header)
-		fprint_route_header(nof->output_file, &sf.routes[0], nof->output_fmt);
-	fprint_subnet_file_fmt(nof->output_file, &sf, nof->output_fmt);
-	free_subnet_file(&sf);
+	res = subnet_file_stream(argv[2], NULL, NULL, nof->print_header, nof);
+	if (res < 0)
+		return res;
 	return 0;
 }
 
@@ -522,111 +530,117 @@ static int run_grep(int argc, char **argv, void *st_options)
 	struct st_options *nof = st_options;
 	int res;
 
-	res = network_grep_file(argv[2], nof, argv[3]);
+	if (!strcmp(argv[2], "-f")) {
+		if (argc < 5) {
+			fprintf(stderr, "grep -f requires a prefix file and a file\n");
+			return -1;
+		}
+		res = network_grep_prefix_file(argv[3], argv[4], nof);
+	} else
+		res = network_grep_file(argv[2], nof, argv[3]);
 	if (res < 0)
 		return res;
 	return 0;
 }
 
-static int run_filter(int argc, char **argv, void *st_options)
+static int run_lookup(int argc, char **argv, void *st_options)
 {
+	struct subnet_file sf;
+	struct st_options *nof = st_options;
 	int res;
+
+	res = load_netcsv_file(argv[2], &sf, nof);
+	DIE_ON_BAD_FILE(argv[2]);
+	res = network_lookup_file(&sf, argv[3], nof);
+	free_subnet_file(&sf);
+	if (res < 0)
+		return res;
+	return 0;
+}
+
+static int run_annotate(int argc, char **argv, void *st_options)
+{
 	struct subnet_file sf;
 	struct st_options *nof = st_options;
+	int res, field;
+
+	field = string2int(argv[4], &res);
+	if (res < 0 || field < 1) {
+		fprintf(stderr, "invalid field number %s\n", argv[4]);
+		return -1;
+	}
+	res = load_netcsv_file(argv[2], &sf, nof);
+	DIE_ON_BAD_FILE(argv[2]);
+	res = network_annotate_file(&sf, argv[3], field, nof);
+	free_subnet_file(&sf);
+	if (res < 0)
+		return res;
+	return 0;
+}
+
+static int run_filter(int argc, char **argv, void *st_options)
+{
+	int res;
+	struct st_options *nof = st_options;
 
 	if (!strcmp(argv[2], "help") && argv[3] == NULL) {
 		fprint_routefilter_help(stdout);
 		return 0;
 	}
-	if (argv[3] == NULL) { /* read from stdin */
-		res = load_netcsv_file(NULL, &sf, nof);
-		if (res < 0)
-			return res;
-		if (nof->print_header)
-			fprint_route_header(nof->output_file, &sf.routes[0], nof->output_fmt);
-		res = subnet_file_filter(&sf, argv[2]);
-	} else {
-		res = load_netcsv_file(argv[2], &sf, nof);
-		DIE_ON_BAD_FILE(argv[2]);
-		if (nof->print_header)
-			fprint_route_header(nof->output_file, &sf.routes[0], nof->output_fmt);
-		res = subnet_file_filter(&sf, argv[3]);
-	}
-	if (res < 0) {
-		free_subnet_file(&sf);
+	/* routes are filtered as they are read, so stdin can be an endless feed */
+	if (argv[3] == NULL) /* read from stdin */
+		res = subnet_file_stream(NULL, argv[2], NULL, nof->print_header, nof);
+	else
+		res = subnet_file_stream(argv[2], argv[3], NULL, nof->print_header, nof);
+	if (res < 0)
 		return res;
-	}
-	fprint_subnet_file_fmt(nof->output_file, &sf, nof->output_fmt);
-	free_subnet_file(&sf);
 	return 0;
 }
 
 static int run_bgp_filter(int argc, char **argv, void *st_options)
 {
 	int res;
-	struct bgp_file sf;
 	struct st_options *nof = st_options;
 
 	if (!strcmp(argv[2], "help") && argv[3] == NULL) {
 		fprint_bgpfilter_help(stdout);
 		return 0;
 	}
-	if (argv[3] == NULL) { /* read from stdin */
-		res = load_bgpcsv(NULL, &sf, nof);
-		if (res < 0)
-			return res;
-		res = bgp_file_filter(&sf, argv[2]);
-	} else {
-		res = load_bgpcsv(argv[2], &sf, nof);
-		DIE_ON_BAD_FILE(argv[2]);
-		res = bgp_file_filter(&sf, argv[3]);
-	}
-	if (res < 0) {
-		free_bgp_file(&sf);
+	if (argv[3] == NULL) /* read from stdin */
+		res = bgp_file_filter_stream(NULL, argv[2], nof);
+	else
+		res = bgp_file_filter_stream(argv[2], argv[3], nof);
+	if (res < 0)
 		return res;
-	}
-	fprint_bgproute_fmt(nof->output_file, NULL, nof->bgp_output_fmt);
-	fprint_bgp_file(nof->output_file, &sf);
-	free_bgp_file(&sf);
 	return 0;
 }
 
 static int run_ipam_filter(int argc, char **argv, void *st_options)
 {
 	int res;
-	struct ipam_file sf;
 	struct st_options *nof = st_options;
 
 	if (!strcmp(argv[2], "help") && argv[3] == NULL) {
 		fprint_ipamfilter_help(stdout);
 		return 0;
 	}
-	if (argv[3] == NULL) { /* read from stdin */
-		res = load_ipam(NULL, &sf, nof);
-		if (res < 0)
-			return res;
-		fprint_ipam_header(nof->output_file, &sf.lines[0], nof->ipam_output_fmt);
-		res = ipam_file_filter(&sf, argv[2]);
-	} else {
-		res = load_ipam(argv[2], &sf, nof);
-		DIE_ON_BAD_FILE(argv[2]);
-		fprint_ipam_header(nof->output_file, &sf.lines[0], nof->ipam_output_fmt);
-		res = ipam_file_filter(&sf, argv[3]);
-	}
-	if (res < 0) {
-		free_ipam_file(&sf);
+	if (argv[3] == NULL) /* read from stdin */
+		res = ipam_file_filter_stream(NULL, argv[2], nof);
+	else
+		res = ipam_file_filter_stream(argv[2], argv[3], nof);
+	if (res < 0)
 		return res;
-	}
-	fprint_ipam_file_fmt(nof->output_file, &sf, nof->ipam_output_fmt);
-	free_ipam_file(&sf);
 	return 0;
 }
 
 static int run_convert(int argc, char **argv, void *st_options)
 {
 	struct st_options *nof = st_options;
+	int res;
 
-	run_csvconverter(argv[2], argv[3], nof);
+	res = run_csvconverter(argv[2], argv[3], nof);
+	if (res < 0)
+		return res;
 	return 0;
 }
 
@@ -640,7 +654,7 @@ static int run_routesimplify1(int argc, char **argv, void *st_options)
 	res = load_netcsv_file(argv[2], &sf, nof);
 	DIE_ON_BAD_FILE(argv[2]);
 
-	res = route_file_simplify(&sf, nof->simplify_mode);
+	res = route_file_simplify(&sf, nof->simplify_mode, nof->nr_threads);
 	if (res < 0) {
 		free_subnet_file(&sf);
 		return res;
@@ -660,7 +674,7 @@ static int run_routesimplify2(int argc, char **argv, void *st_options)
 	res = load_netcsv_file(argv[2], &sf, nof);
 	DIE_ON_BAD_FILE(argv[2]);
 
-	res = route_file_simplify(&sf, nof->simplify_mode);
+	res = route_file_simplify(&sf, nof->simplify_mode, nof->nr_threads);
 	if (res < 0) {
 		free_subnet_file(&sf);
 		return res;
@@ -723,7 +737,7 @@ static int run_addfiles(int argc, char **argv, void *st_options)
 		copy_route(&sf3.routes[i + j], &sf2.routes[j]);
 	sf3.nr = i + j;
 	/* since the routes comes from different files, we wont compare the GW */
-	res = subnet_file_simplify(&sf3);
+	res = subnet_file_simplify(&sf3, nof->nr_threads);
 	if (res < 0) {
 		free_subnet_file(&sf2);
 		free_subnet_file(&sf1);
@@ -743,10 +757,17 @@ static int run_sort(int argc, char **argv, void *st_options)
 	struct subnet_file sf;
 	struct st_options *nof = st_options;
 
+	if (nof->sort_mem) {
+		res = subnet_file_extsort(argv[2], "prefix", 1, nof);
+		/* -3 : the temp file error was printed */
+		if (res < 0 && res != -3)
+			BAD_FILE(argv[2]);
+		return (res < 0 ? res : 0);
+	}
 	res = load_netcsv_file(argv[2], &sf, nof);
 	DIE_ON_BAD_FILE(argv[2]);
 
-	res = subnet_sort_by(&sf, "prefix");
+	res = subnet_sort_by(&sf, "prefix", nof->nr_threads);
 	if (res < 0) {
 		free_subnet_file(&sf);
 		return res;
@@ -768,10 +789,20 @@ static int run_sortby(int argc, char **argv, void *st_options)
 		subnet_available_cmpfunc(stderr);
 		return 0;
 	}
+	if (nof->sort_mem) {
+		res = subnet_file_extsort(argv[3], argv[2], 0, nof);
+		if (res == -1664) {
+			fprintf(stderr, "Cannot sort by '%s'\n", argv[2]);
+			fprintf(stderr, "You can sort by :\n");
+			subnet_available_cmpfunc(stderr);
+		} else if (res < 0 && res != -3)
+			BAD_FILE(argv[3]);
+		return (res < 0 ? res : 0);
+	}
 	res = load_netcsv_file(argv[3], &sf, st_options);
 	DIE_ON_BAD_FILE(argv[3]);
 
-	res = subnet_sort_by(&sf, argv[2]);
+	res = subnet_sort_by(&sf, argv[2], nof->nr_threads);
 	if (res == -1664) {
 		fprintf(stderr, "Cannot sort by '%s'\n", argv[2]);
 		fprintf(stderr, "You can sort by :\n");
@@ -810,7 +841,7 @@ static int run_subnetagg(int argc, char **argv, void *st_options)
 
 	res = load_netcsv_file(argv[2], &sf, nof);
 	DIE_ON_BAD_FILE(argv[2]);
-	res = aggregate_route_file(&sf, 0);
+	res = aggregate_route_file(&sf, 0, nof->nr_threads);
 	if (res < 0) {
 		free_subnet_file(&sf);
 		return res;
@@ -829,7 +860,7 @@ static int run_routeagg(int argc, char **argv, void *st_options)
 	res = load_netcsv_file(argv[2], &sf, nof);
 	DIE_ON_BAD_FILE(argv[2]);
 
-	res = aggregate_route_file(&sf, 1);
+	res = aggregate_route_file(&sf, 1, nof->nr_threads);
 	if (res < 0) {
 		free_subnet_file(&sf);
 		return res;
@@ -853,10 +884,9 @@ static int run_remove_file(int argc, char **argv, void *st_options)
 		free_subnet_file(&sf1);
 		return res;
 	}
-	subnet_file_remove_file(&sf1, &sf2, &sf3);
+	res = subnet_file_remove_file(&sf1, &sf2, &sf3);
 	if (res < 0) {
 		free_subnet_file(&sf1);
-		free_subnet_file(&sf2);
 		free_subnet_file(&sf3);
 		return res;
 	}
@@ -870,7 +900,6 @@ static int run_remove_file(int argc, char **argv, void *st_options)
 static int run_remove(int argc, char **argv, void *st_options)
 {
 	struct subnet subnet1, subnet2, *r;
-	struct subnet_file sf1, sf2;
 	struct st_options *nof = st_options;
 	int n, i, res;
 
@@ -894,19 +923,14 @@ static int run_remove(int argc, char **argv, void *st_options)
 		st_free(r, n * sizeof(struct subnet));
 		return 0;
 	} else  if (!strcasecmp(argv[2], "file")) {
-		res = load_netcsv_file(argv[3], &sf1, nof);
-		DIE_ON_BAD_FILE(argv[3]);
-
 		res = get_subnet_or_ip(argv[4], &subnet2);
 		if (res < 0) {
-			free_subnet_file(&sf1);
 			printf("Invalid IP %s\n", argv[4]);
 			return -1;
 		}
-		subnet_file_remove_subnet(&sf1, &sf2, &subnet2);
-		fprint_subnet_file_fmt(nof->output_file, &sf2, nof->output_fmt);
-		free_subnet_file(&sf1);
-		free_subnet_file(&sf2);
+		res = subnet_file_stream(argv[3], NULL, &subnet2, 0, nof);
+		if (res < 0)
+			return res;
 		return 0;
 	}
 	fprintf(stderr, "Invalid objet %s after %s, expecting 'subnet' or 'file'\n",
@@ -1080,7 +1104,11 @@ static int run_gen_expr(int argc, char **argv, void *st_options)
 	int res;
 
 	init_generic_expr(&e, argv[2], int_compare);
-	res = run_generic_expr(argv[2], strlen(argv[2]), &e);
+	res = compile_generic_expr(&e);
+	if (res < 0)
+		return res;
+	res = eval_generic_expr(&e, NULL);
+	free_generic_expr(&e);
 	printf("res=%d\n", res);
 	return 0;
 }
@@ -1139,6 +1167,78 @@ static int option_grepfield(int argc, char **argv, void *st_options)
 	return 0;
 }
 
+static int option_greptag(int argc, char **argv, void *st_options)
+{
+	struct st_options *nof = st_options;
+
+	nof->grep_tag = 1;
+	debug(PARSEOPTS, 3, "grep will print the matching prefix\n");
+	return 0;
+}
+
+static int option_threads(int argc, char **argv, void *st_options)
+{
+	struct st_options *nof = st_options;
+	int a, res;
+
+	debug(PARSEOPTS, 3, "using %s threads\n", argv[1]);
+	if (!isUnsignedInt(argv[1])) {
+		fprintf(stderr, "invalid number of threads %s\n", argv[1]);
+		return -1;
+	}
+	a = string2int(argv[1], &res);
+	if (res < 0)
+		return res;
+	if (a < 1 || a > ST_MAX_THREADS) {
+		fprintf(stderr, "number of threads must be between 1 and %d\n", ST_MAX_THREADS);
+		return -1;
+	}
+	nof->nr_threads = a;
+	return 0;
+}
+
+/* SIZE[k|M|G], at least EXTSORT_MIN_MEM */
+static int option_mem(int argc, char **argv, void *st_options)
+{
+	struct st_options *nof = st_options;
+	unsigned long a;
+	char *s = argv[1];
+
+	debug(PARSEOPTS, 3, "sorting with %s of memory\n", argv[1]);
+	if (!isdigit(*s)) {
+		fprintf(stderr, "invalid memory size %s\n", argv[1]);
+		return -1;
+	}
+	a = strtoul(s, &s, 10);
+	switch (*s) {
+	case 'g':
+	case 'G':
+		a <<= 10;
+		/* fall through */
+	case 'm':
+	case 'M':
+		a <<= 10;
+		/* fall through */
+	case 'k':
+	case 'K':
+		a <<= 10;
+		s++;
+		/* fall through */
+	case '\0':
+		break;
+	}
+	if (*s != '\0') {
+		fprintf(stderr, "invalid memory size %s\n", argv[1]);
+		return -1;
+	}
+	if (a < EXTSORT_MIN_MEM) {
+		fprintf(stderr, "memory size must be at least %luM\n", EXTSORT_MIN_MEM >> 20);
+		return -1;
+	}
+	nof->sort_mem = a;
+	return 0;
+}
+
 static int option_output(int argc, char **argv, void *st_options)
 {
 	struct st_options *nof = st_options;
@@ -1281,6 +1381,7 @@ int main(int argc, char **argv)
 	/* full IPv6 address compression  with IPv4 mapped/compatible support*/
 	nof.ip_compress_mode = 3;
 	nof.print_header     = 1;
+	nof.nr_threads       = 1;
 	strcpy(nof.ipam_ea, "comment");
 	allow_core_dumps();
 	res = generic_parse_options(argc, argv, PROG_NAME, &nof);
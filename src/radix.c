@@ -0,0 +1,204 @@
+/*
+ * LSD radix sort on packed keys
+ *
+ * Copyright (C) 2015 Etienne Basset <etienne POINT basset AT ensta POINT org>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of version 2 of the GNU General Public License
+ * as published by the Free Software Foundation.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "debug.h"
+#include "iptools.h"
+#include "st_memory.h"
+#include "utils.h"
+#include "st_thread.h"
+#include "radix.h"
+
+/* LSD radix sort of idx[0..n)
+ * @count : key_len * 256 counters
+ * @tmp   : n indexes of scratch space
+ */
+static void __radix_sort(const unsigned char *keys, int key_len,
+		unsigned long *idx, unsigned long n, unsigned long *count, unsigned long *tmp)
+{
+	unsigned long *src, *dst, *swap;
+	unsigned long i, c, sum;
+	const unsigned char *k;
+	int b;
+
+	if (n < 2)
+		return;
+	/* all histograms in one pass */
+	memset(count, 0, key_len * 256 * sizeof(unsigned long));
+	for (i = 0; i < n; i++) {
+		k = keys + idx[i] * key_len;
+		for (b = 0; b < key_len; b++)
+			count[b * 256 + k[b]]++;
+	}
+	src = idx;
+	dst = tmp;
+	for (b = key_len - 1; b >= 0; b--) {
+		/* all keys have the same byte, nothing to do */
+		if (count[b * 256 + keys[idx[0] * key_len + b]] == n)
+			continue;
+		sum = 0;
+		for (c = 0; c < 256; c++) {
+			i = count[b * 256 + c];
+			count[b * 256 + c] = sum;
+			sum += i;
+		}
+		for (i = 0; i < n; i++)
+			dst[count[b * 256 + keys[src[i] * key_len + b]]++] = src[i];
+		swap = src;
+		src  = dst;
+		dst  = swap;
+	}
+	if (src != idx)
+		memcpy(idx, src, n * sizeof(unsigned long));
+}
+
+int radix_sort(const unsigned char *keys, int key_len, unsigned long n, unsigned long *perm)
+{
+	unsigned long *count, *tmp;
+	unsigned long i;
+
+	for (i = 0; i < n; i++)
+		perm[i] = i;
+	if (n < 2)
+		return 1;
+	count = st_malloc(key_len * 256 * sizeof(unsigned long), "radix count");
+	if (count == NULL)
+		return -1;
+	tmp = st_malloc(n * sizeof(unsigned long), "radix perm");
+	if (tmp == NULL) {
+		st_free(count, key_len * 256 * sizeof(unsigned long));
+		return -1;
+	}
+	__radix_sort(keys, key_len, perm, n, count, tmp);
+	st_free(tmp, n * sizeof(unsigned long));
+	st_free(count, key_len * 256 * sizeof(unsigned long));
+	return 1;
+}
+
+struct radix_job {
+	const unsigned char *keys;
+	int key_len;
+	unsigned long *idx;
+	unsigned long n;
+	unsigned long *count;
+	unsigned long *tmp;
+};
+
+static void *radix_sort_thread(void *arg)
+{
+	struct radix_job *job = arg;
+
+	__radix_sort(job->keys, job->key_len, job->idx, job->n, job->count, job->tmp);
+	return NULL;
+}
+
+int radix_sort_mt(const unsigned char *keys, int key_len, unsigned long n, unsigned long *perm,
+		int nr_threads, unsigned long *bounds)
+{
+	unsigned long *count, *tmp, *top;
+	unsigned long i, sum, c;
+	struct radix_job *jobs;
+	int t, res;
+
+	if (nr_threads < 2 || key_len < 3 || n < 2) {
+		bounds[0] = 0;
+		for (t = 1; t <= max(nr_threads, 1); t++)
+			bounds[t] = n;
+		return radix_sort(keys, key_len, n, perm);
+	}
+	top   = st_malloc(65536 * sizeof(unsigned long), "radix top count");
+	count = st_malloc(nr_threads * key_len * 256 * sizeof(unsigned long), "radix count");
+	tmp   = st_malloc(n * sizeof(unsigned long), "radix perm");
+	jobs  = st_malloc(nr_threads * sizeof(struct radix_job), "radix jobs");
+	if (top == NULL || count == NULL || tmp == NULL || jobs == NULL) {
+		st_free(top, 65536 * sizeof(unsigned long));
+		st_free(count, nr_threads * key_len * 256 * sizeof(unsigned long));
+		st_free(tmp, n * sizeof(unsigned long));
+		st_free(jobs, nr_threads * sizeof(struct radix_job));
+		return -1;
+	}
+	/* stable counting sort on the 16 leading bits of the keys
+	 * (address family + 8 top bits of the address for a prefix key)
+	 * and cut the 16-bit space into ranges holding about n / nr_threads keys
+	 */
+	memset(top, 0, 65536 * sizeof(unsigned long));
+	for (i = 0; i < n; i++)
+		top[(keys[i * key_len] << 8) | keys[i * key_len + 1]]++;
+	sum = 0;
+	t = 0;
+	bounds[0] = 0;
+	for (c = 0; c < 65536; c++) {
+		i = top[c];
+		top[c] = sum;
+		sum += i;
+		while (t < nr_threads - 1 && sum >= (n * (t + 1)) / nr_threads)
+			bounds[++t] = sum;
+	}
+	while (t < nr_threads)
+		bounds[++t] = n;
+	for (i = 0; i < n; i++)
+		perm[top[(keys[i * key_len] << 8) | keys[i * key_len + 1]]++] = i;
+
+	/* each range is then sorted by its own thread */
+	for (t = 0; t < nr_threads; t++) {
+		jobs[t].keys    = keys;
+		jobs[t].key_len = key_len;
+		jobs[t].idx     = perm + bounds[t];
+		jobs[t].n       = bounds[t + 1] - bounds[t];
+		jobs[t].count   = count + t * key_len * 256;
+		jobs[t].tmp     = tmp + bounds[t];
+	}
+	res = run_threads(nr_threads, radix_sort_thread, jobs, sizeof(struct radix_job));
+
+	st_free(top, 65536 * sizeof(unsigned long));
+	st_free(count, nr_threads * key_len * 256 * sizeof(unsigned long));
+	st_free(tmp, n * sizeof(unsigned long));
+	st_free(jobs, nr_threads * sizeof(struct radix_job));
+	return (res < 0 ? res : 1);
+}
+
+int addr_sortkey(unsigned char *key, const struct ip_addr *a, int addr_len)
+{
+	int i;
+
+	memset(key, 0, addr_len);
+	key[0] = a->ip_ver;
+	if (a->ip_ver == IPV4_A) {
+		key[1] = a->ip >> 24;
+		key[2] = (a->ip >> 16) & 0xff;
+		key[3] = (a->ip >> 8) & 0xff;
+		key[4] = a->ip & 0xff;
+	} else if (a->ip_ver == IPV6_A && addr_len == SORTKEY_ADDR6_LEN) {
+		for (i = 0; i < 8; i++) {
+			key[1 + i] = a->ip6.n64[0] >> (56 - 8 * i);
+			key[9 + i] = a->ip6.n64[1] >> (56 - 8 * i);
+		}
+	}
+	return addr_len;
+}
+
+int subnet_sortkey(unsigned char *key, const struct subnet *s, int addr_len)
+{
+	addr_sortkey(key, &s->ip_addr, addr_len);
+	key[addr_len] = s->mask;
+	return addr_len + 1;
+}
+
+int int_sortkey(unsigned char *key, int v)
+{
+	unsigned u = (unsigned)v ^ 0x80000000U;
+
+	key[0] = u >> 24;
+	key[1] = (u >> 16) & 0xff;
+	key[2] = (u >> 8) & 0xff;
+	key[3] = u & 0xff;
+	return 4;
+}
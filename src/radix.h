@@ -0,0 +1,53 @@
+#ifndef RADIX_H
+#define RADIX_H
+
+#include "iptools.h"
+
+/* radix_sort: stable LSD radix sort of fixed-size keys
+ * keys are compared as big-endian unsigned numbers (memcmp order)
+ * @keys    : n keys of key_len bytes, key i is at keys + i * key_len
+ * @key_len : the size of a key in bytes
+ * @n       : the number of keys
+ * @perm    : filled with the n key indexes in sorted order; equal keys keep their order
+ * returns:
+ *	positive on SUCCESS
+ *	negative on ENOMEM
+ */
+int radix_sort(const unsigned char *keys, int key_len, unsigned long n, unsigned long *perm);
+
+/* radix_sort_mt: same as radix_sort, on 'nr_threads' threads
+ * keys are first split on their 2 leading bytes (address family and top address bits
+ * for a prefix key) into 'nr_threads' ranges of about the same size,
+ * then each range is sorted by its own thread; perm is the same as with radix_sort
+ * @nr_threads : number of threads
+ * @bounds     : filled with nr_threads + 1 indexes; range t is perm[bounds[t]..bounds[t + 1])
+ *               keys sharing their 2 leading bytes are always in the same range
+ * returns:
+ *	positive on SUCCESS
+ *	negative on ENOMEM
+ */
+int radix_sort_mt(const unsigned char *keys, int key_len, unsigned long n, unsigned long *perm,
+		int nr_threads, unsigned long *bounds);
+
+/* size of a packed address in a sort key : ip_ver byte + address bytes
+ * files with IPv4 only use the short form
+ */
+#define SORTKEY_ADDR4_LEN 5
+#define SORTKEY_ADDR6_LEN 17
+
+/* addr_sortkey, subnet_sortkey: pack an address or a subnet in a sort key
+ * address family sorts first (IPv4 before IPv6), then address, then mask
+ * @key      : where to write the key
+ * @a, @s    : the address or subnet to pack
+ * @addr_len : SORTKEY_ADDR4_LEN or SORTKEY_ADDR6_LEN
+ * returns:
+ *	the number of bytes written (addr_len, or addr_len + 1 for a subnet)
+ */
+int addr_sortkey(unsigned char *key, const struct ip_addr *a, int addr_len);
+int subnet_sortkey(unsigned char *key, const struct subnet *s, int addr_len);
+
+/* pack a signed int so that the packed keys sort like the ints */
+int int_sortkey(unsigned char *key, int v);
+
+#else
+#endif
@@ -73,7 +73,7 @@ void csvconverter_help(FILE *output)
  */
 int run_csvconverter(char *name, char *filename, struct st_options *o)
 {
-	int i = 0;
+	int i = 0, res;
 	FILE *f;
 	int (*converter)(char *, FILE *, struct st_options *);
 
@@ -105,15 +105,34 @@ int run_csvconverter(char *name, char *filename, struct st_options *o)
 		fprintf(stderr, "Error: cannot open %s for reading\n", filename);
 		return -2;
 	}
-	csvconverters[i].converter(filename, f, o);
+	res = csvconverters[i].converter(filename, f, o);
 	fclose(f);
-	return 0;
+	return (res < 0 ? res : 0);
 }
 
+/* converters scan the device name in 'device', it gets its id when the route is printed */
+#define ZERO_ROUTE \
+	do { \
+		zero_route_ea(&route); \
+		device[0] = '\0'; \
+	} while (0)
+
+#define PRINT_ROUTE \
+	do { \
+		route.device = device_id(device); \
+		if (route.device < 0) { \
+			fprintf(stderr, "%s line %lu : device table full (%d names), cannot add '%s'\n", \
+					name, line, DEVICE_MAX_NR, device); \
+			free_route(&route); \
+			return -1; \
+		} \
+		fprint_route(o->output_file, &route, 3); \
+	} while (0)
+
 #define BAD_LINE \
 	do { \
 		debug(PARSEROUTE, 1, "%s line %lu invalid : '%s'", name, line, buffer); \
-		zero_route_ea(&route); \
+		ZERO_ROUTE; \
 		badline++; \
 	} while (0)
 
@@ -145,7 +164,8 @@ int run_csvconverter(char *name, char *filename, struct st_options *o)
 #define INIT_ROUTE(____x) \
 	do { \
 		zero_route(&route); \
-		res = alloc_route_ea(&route, 1); \
+		device[0] = '\0'; \
+		res = alloc_route_ea(&route, 1, NULL); \
 		if (res < 0) \
 			return res; \
 		route.ea[0].value = st_malloc(____x, "route"); \
@@ -167,6 +187,7 @@ int palo_to_csv(char *name, FILE *f, struct st_options *o)
 	unsigned long line = 0;
 	int badline = 0;
 	struct route route;
+	char device[DEVICE_NAME_LEN + 1];
 	int ip_ver = -1;
 	int res;
 
@@ -177,9 +198,9 @@ int palo_to_csv(char *name, FILE *f, struct st_options *o)
 		if (res)
 			debug(PARSEROUTE, 1, "%s line %lu too long, discarding %d chars\n",
 					name, line, res);
-		zero_route_ea(&route);
+		ZERO_ROUTE;
 		debug(PARSEROUTE, 9, "line %lu buffer '%s'\n", line, buffer);
-		res = st_sscanf(s, "%P *%I.*$%32s", &route.subnet, &route.gw, route.device);
+		res = st_sscanf(s, "%P *%I.*$%32s", &route.subnet, &route.gw, device);
 		if (res < 1) {
 			BAD_LINE;
 			continue;
@@ -187,9 +208,9 @@ int palo_to_csv(char *name, FILE *f, struct st_options *o)
 		CHECK_IP_VER;
 		CHECK_GW_IP_VER;
 		/* on host route the last string is a flag; discard device in that case */
-		if (strlen(route.device) < 3)
-			route.device[0] = '\0';
-		fprint_route(o->output_file, &route, 3);
+		if (strlen(device) < 3)
+			device[0] = '\0';
+		PRINT_ROUTE;
 	}
 	free_route(&route);
 	return 1;
@@ -205,6 +226,7 @@ int ipso_route_to_csv(char *name, FILE *f, struct st_options *o)
 	unsigned long line = 0;
 	int badline = 0;
 	struct route route;
+	char device[DEVICE_NAME_LEN + 1];
 	int res;
 	int nhop = 0;
 	int ip_ver = -1;
@@ -221,8 +243,8 @@ int ipso_route_to_csv(char *name, FILE *f, struct st_options *o)
 		if (isspace(s[0])) /* strangely some lines are prepended with a space ....*/
 			s++;
 		if (s[0] == 'C') {/* connected route */
-			zero_route_ea(&route);
-			res = st_sscanf(s, ".*%Q.*$%32s", &route.subnet, route.device);
+			ZERO_ROUTE;
+			res = st_sscanf(s, ".*%Q.*$%32s", &route.subnet, device);
 			if (res < 2) {
 				BAD_LINE;
 				continue;
@@ -230,13 +252,13 @@ int ipso_route_to_csv(char *name, FILE *f, struct st_options *o)
 			CHECK_IP_VER;
 			type = 'C';
 			SET_COMMENT;
-			fprint_route(o->output_file, &route, 3);
+			PRINT_ROUTE;
 			continue;
 		}
 		if (isspace(s[0])) {
 			if (strstr(s, "via ")) {
 				res = st_sscanf(s, ".*(via) %I.*%32[^ ,]",
-						&route.gw, route.device);
+						&route.gw, device);
 				if (res < 2) {
 					BAD_LINE;
 					continue;
@@ -247,14 +269,14 @@ int ipso_route_to_csv(char *name, FILE *f, struct st_options *o)
 			}
 			CHECK_GW_IP_VER;
 			if (nhop == 0 || o->ecmp)
-				fprint_route(o->output_file, &route, 3);
+				PRINT_ROUTE;
 			nhop++;
 			continue;
 		}
 		nhop = 1;
-		zero_route_ea(&route);
+		ZERO_ROUTE;
 		res = st_sscanf(s, ".*%Q *(via) %I.*%32[^ ,]",
-				&route.subnet, &route.gw, route.device);
+				&route.subnet, &route.gw, device);
 		type = s[0];
 		if (res < 3) {
 			BAD_LINE;
@@ -262,7 +284,7 @@ int ipso_route_to_csv(char *name, FILE *f, struct st_options *o)
 		}
 		CHECK_IP_VER;
 		SET_COMMENT;
-		fprint_route(o->output_file, &route, 3);
+		PRINT_ROUTE;
 	}
 	free_route(&route);
 	return 1;
@@ -276,6 +298,7 @@ int cisco_nexus_to_csv(char *name, FILE *f, struct st_options *o)
 	unsigned long line = 0;
 	int badline = 0;
 	struct route route;
+	char device[DEVICE_NAME_LEN + 1];
 	int res;
 	int nhop = 0;
 	int ip_ver = -1;
@@ -296,24 +319,24 @@ int cisco_nexus_to_csv(char *name, FILE *f, struct st_options *o)
 		if (strstr(s, "*via ")) {
 			res = st_sscanf(s,
 					" *(*via) %I(, %32[][0-9/]%32s|, %32[^,], %32[^,],).*, %128[^,]",
-					 &route.gw, route.device, poubelle, route.ea[0].value);
+					 &route.gw, device, poubelle, route.ea[0].value);
 			if (res <= 0) {
 				BAD_LINE;
 				continue;
 			}
 			if (res == 1)
-				strcpy(route.device, "NA");
-			if (route.device[0] == '[') /* route without a device */
-				strcpy(route.device, "NA");
+				strcpy(device, "NA");
+			if (device[0] == '[') /* route without a device */
+				strcpy(device, "NA");
 			if (o->rt == 0)
 				route.ea[0].value[0] = '\0';
 			CHECK_GW_IP_VER;
 			if (nhop == 0 || o->ecmp)
-				fprint_route(o->output_file, &route, 3);
+				PRINT_ROUTE;
 			CHECK_IP_VER;
 			nhop++;
 		} else {
-			zero_route_ea(&route);
+			ZERO_ROUTE;
 			res = st_sscanf(s, "%P", &route.subnet);
 			if (res <= 0) {
 				BAD_LINE;
@@ -338,6 +361,7 @@ int cisco_route_to_csv(char *name, FILE *f, struct st_options *o)
 	unsigned long line = 0;
 	int badline = 0;
 	struct route route;
+	char device[DEVICE_NAME_LEN + 1];
 	int res;
 	int ip_ver = -1;
 	int find_mask;
@@ -378,9 +402,9 @@ int cisco_route_to_csv(char *name, FILE *f, struct st_options *o)
 			}
 			continue;
 		} else if (strstr(s, "is directly connected")) { /* happens only with IPv4 */
-			zero_route_ea(&route);
+			ZERO_ROUTE;
 			/* C       10.73.5.92/30 is directly connected, Vlan346 */
-			res = st_sscanf(s, ".*%P.*$%32s", &route.subnet, route.device);
+			res = st_sscanf(s, ".*%P.*$%32s", &route.subnet, device);
 			type = 'C';
 			if (res < 2) {
 				BAD_LINE;
@@ -388,8 +412,8 @@ int cisco_route_to_csv(char *name, FILE *f, struct st_options *o)
 			}
 			CHECK_IP_VER;
 			SET_COMMENT;
-			fprint_route(o->output_file, &route, 3);
-			zero_route_ea(&route);
+			PRINT_ROUTE;
+			ZERO_ROUTE;
 			continue;
 		}
 		/* handle a next hop printed on a next-line
@@ -408,19 +432,19 @@ int cisco_route_to_csv(char *name, FILE *f, struct st_options *o)
 				 */
 				if (ip_ver == IPV4_A)
 					res = st_sscanf(s, ".*(via) (%I)?.*$%32[^, \n]",
-							&route.gw, route.device);
+							&route.gw, device);
 				else
 					res = st_sscanf(s, " *(via) (%I)?.*%32[^, \n]",
-							&route.gw, route.device);
+							&route.gw, device);
 				if (res <= 0) {
 					find_hop = 0;
 					BAD_LINE;
 					continue;
 				}
 				if (res == 1)
-					strcpy(route.device, "NA");
-				if (route.device[0] == '[')
-					strcpy(route.device, "NA");
+					strcpy(device, "NA");
+				if (device[0] == '[')
+					strcpy(device, "NA");
 				if (is_subnetted) {
 					route.subnet.mask = find_mask;
 					is_subnetted--;
@@ -433,13 +457,13 @@ int cisco_route_to_csv(char *name, FILE *f, struct st_options *o)
 			if (route.gw.ip_ver != 0)
 				CHECK_GW_IP_VER;
 			if (find_hop == 1 || o->ecmp)
-				fprint_route(o->output_file, &route, 3);
+				PRINT_ROUTE;
 			find_hop++;
 			continue;
 		}
-		zero_route_ea(&route);
+		ZERO_ROUTE;
 		res = st_sscanf(s, "%c *.*%P.*(via) %I.*$%32s",
-				&type, &route.subnet, &route.gw, route.device);
+				&type, &route.subnet, &route.gw, device);
 		/* a valid route begin with a non space char */
 		if (res <= 1 || isspace(type)) {
 			BAD_LINE;
@@ -451,7 +475,7 @@ int cisco_route_to_csv(char *name, FILE *f, struct st_options *o)
 		} else  if (res == 3) {
 			st_debug(PARSEROUTE, 5, "line %lu no device found for prefix %P\n",
 					line, route.subnet);
-			strcpy(route.device, "NA");
+			strcpy(device, "NA");
 		}
 		find_hop = 0;
 		CHECK_IP_VER;
@@ -460,10 +484,10 @@ int cisco_route_to_csv(char *name, FILE *f, struct st_options *o)
 			route.subnet.mask = find_mask;
 			is_subnetted--;
 		}
-		if (isdigit(route.device[0]))
-			strcpy(route.device, "NA");
+		if (isdigit(device[0]))
+			strcpy(device, "NA");
 		SET_COMMENT;
-		fprint_route(o->output_file, &route, 3);
+		PRINT_ROUTE;
 	}
 	free_route(&route);
 	return 1;
@@ -478,6 +502,7 @@ int cisco_fw_to_csv(char *name, FILE *f, struct st_options *o)
 	unsigned long line = 0;
 	int badline = 0;
 	struct route route;
+	char device[DEVICE_NAME_LEN + 1];
 	int res;
 	char type;
 	int find_hop = 0;
@@ -492,35 +517,35 @@ int cisco_fw_to_csv(char *name, FILE *f, struct st_options *o)
 					name, line, res);
 		debug(PARSEROUTE, 9, "line %lu buffer '%s'\n", line, buffer);
 		if (find_hop) {
-			res = st_sscanf(s, ".*(via )%I.*$%32s", &route.gw, route.device);
+			res = st_sscanf(s, ".*(via )%I.*$%32s", &route.gw, device);
 			if (res < 2) {
 				BAD_LINE;
 				continue;
 			}
 			CHECK_GW_IP_VER;
 			SET_COMMENT;
-			fprint_route(o->output_file, &route, 3);
-			zero_route_ea(&route);
+			PRINT_ROUTE;
+			ZERO_ROUTE;
 			find_hop = 0;
 			continue;
 		}
 		if (s[0] == 'C' || s[0] == 'c') { /* connected route */
 			res = st_sscanf(s, "%c.*%I %M.*$%32s",
 					&type, &route.subnet.ip_addr, &route.subnet.mask,
-					route.device);
+					device);
 			if (res < 4) {
 				BAD_LINE;
 				continue;
 			}
 			CHECK_IP_VER;
 			SET_COMMENT;
-			fprint_route(o->output_file, &route, 3);
-			zero_route_ea(&route);
+			PRINT_ROUTE;
+			ZERO_ROUTE;
 			continue;
 		} else {
 			res = st_sscanf(s, "%c.*%I %M.*(via )%I.*$%32s",
 					&type, &route.subnet.ip_addr, &route.subnet.mask,
-					&route.gw, route.device);
+					&route.gw, device);
 			if (res == 3) {
 				find_hop = 1;
 				continue;
@@ -533,8 +558,8 @@ int cisco_fw_to_csv(char *name, FILE *f, struct st_options *o)
 		CHECK_IP_VER;
 		CHECK_GW_IP_VER;
 		SET_COMMENT;
-		fprint_route(o->output_file, &route, 3);
-		zero_route_ea(&route);
+		PRINT_ROUTE;
+		ZERO_ROUTE;
 	}
 	free_route(&route);
 	return 1;
@@ -550,12 +575,13 @@ int cisco_fw_conf_to_csv(char *name, FILE *f, struct st_options *o)
 	unsigned long line = 0;
 	int badline = 0;
 	struct route route;
+	char device[DEVICE_NAME_LEN + 1];
 	int res;
 	int ip_ver = -1;
 
 	INIT_ROUTE(128);
 	fprintf(o->output_file, "prefix;mask;device;GW;comment\n");
-	zero_route_ea(&route);
+	ZERO_ROUTE;
 	while ((s = fgets_truncate_buffer(buffer, sizeof(buffer), f, &res))) {
 		line++;
 		if (res)
@@ -563,7 +589,7 @@ int cisco_fw_conf_to_csv(char *name, FILE *f, struct st_options *o)
 					name, line, res);
 		debug(PARSEROUTE, 9, "line %lu buffer '%s'\n", line, buffer);
 		res = st_sscanf(s, "(ipv6 )?route *%32S *%I.%M %I",
-				route.device, &route.subnet.ip_addr,
+				device, &route.subnet.ip_addr,
 				&route.subnet.mask, &route.gw);
 		if (res < 4) {
 			BAD_LINE;
@@ -571,8 +597,8 @@ int cisco_fw_conf_to_csv(char *name, FILE *f, struct st_options *o)
 		}
 		CHECK_IP_VER;
 		CHECK_GW_IP_VER;
-		fprint_route(o->output_file, &route, 3);
-		zero_route_ea(&route);
+		PRINT_ROUTE;
+		ZERO_ROUTE;
 	}
 	free_route(&route);
 	return 1;
@@ -585,6 +611,7 @@ int cisco_routeconf_to_csv(char *name, FILE *f, struct st_options *o)
 	unsigned long line = 0;
 	int badline = 0;
 	struct route route;
+	char device[DEVICE_NAME_LEN + 1];
 	struct sto sto[10];
 	int res;
 	int ip_ver = -1;
@@ -606,15 +633,15 @@ int cisco_routeconf_to_csv(char *name, FILE *f, struct st_options *o)
 		route.subnet.mask = sto[1].s_int;
 		CHECK_IP_VER;
 		if (sto_is_string(&sto[2]))
-			strcpy(route.device, sto[2].s_char);
+			strcpy(device, sto[2].s_char);
 		if (res >= 4 && sto[3].type == 'I') {
 			copy_ipaddr(&route.gw, &sto[3].s_addr);
 			CHECK_GW_IP_VER;
 		}
 		if (res >= 5 && sto[4].type == 's')
 			strcpy(route.ea[0].value, sto[4].s_char);
-		fprint_route(o->output_file, &route, 3);
-		zero_route_ea(&route);
+		PRINT_ROUTE;
+		ZERO_ROUTE;
 		sto[1].type = sto[2].type = sto[3].type = sto[4].type = 0;
 	}
 	free_route(&route);
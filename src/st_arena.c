@@ -0,0 +1,109 @@
+/*
+ * arena (bump) allocator
+ *
+ * Copyright (C) 2015 Etienne Basset <etienne POINT basset AT ensta POINT org>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of version 2 of the GNU General Public License
+ * as published by the Free Software Foundation.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "debug.h"
+#include "st_memory.h"
+#include "st_arena.h"
+
+#define ARENA_ALIGN sizeof(void *)
+
+static inline char *chunk_data(struct arena_chunk *c)
+{
+	return (char *)(c + 1);
+}
+
+void init_arena(struct st_arena *a)
+{
+	a->chunks = NULL;
+	a->ptr    = NULL;
+	a->end    = NULL;
+	a->size   = 0;
+}
+
+void *arena_alloc(struct st_arena *a, size_t size)
+{
+	struct arena_chunk *c;
+	size_t chunk_size;
+	char *p;
+
+	size = (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+	if (a->ptr == NULL || (size_t)(a->end - a->ptr) < size) {
+		chunk_size = (size > ARENA_CHUNK_SIZE ? size : ARENA_CHUNK_SIZE);
+		c = st_malloc_nodebug(sizeof(struct arena_chunk) + chunk_size, "arena chunk");
+		if (c == NULL)
+			return NULL;
+		c->size   = chunk_size;
+		c->next   = a->chunks;
+		a->chunks = c;
+		a->ptr    = chunk_data(c);
+		a->end    = a->ptr + chunk_size;
+		a->size  += chunk_size;
+	}
+	p = a->ptr;
+	a->ptr += size;
+	return p;
+}
+
+char *arena_strdup(struct st_arena *a, const char *s)
+{
+	size_t len = strlen(s) + 1;
+	char *p;
+
+	p = arena_alloc(a, len);
+	if (p == NULL)
+		return NULL;
+	memcpy(p, s, len);
+	return p;
+}
+
+void arena_rewind(struct st_arena *a, void *ptr)
+{
+	char *p = ptr;
+
+	if (a->chunks == NULL || p == NULL)
+		return;
+	if (p >= chunk_data(a->chunks) && p < a->ptr)
+		a->ptr = p;
+}
+
+void arena_splice(struct st_arena *dst, struct st_arena *src)
+{
+	struct arena_chunk *c;
+
+	if (src->chunks == NULL)
+		return;
+	/* the chunks of 'src' go after the current chunk of 'dst', so dst keeps filling it */
+	for (c = src->chunks; c->next; c = c->next)
+		;
+	if (dst->chunks) {
+		c->next = dst->chunks->next;
+		dst->chunks->next = src->chunks;
+	} else {
+		dst->chunks = src->chunks;
+		dst->ptr    = src->ptr;
+		dst->end    = src->end;
+	}
+	dst->size += src->size;
+	init_arena(src);
+}
+
+void free_arena(struct st_arena *a)
+{
+	struct arena_chunk *c, *next;
+
+	debug(MEMORY, 5, "Freeing arena of %lu bytes\n", a->size);
+	for (c = a->chunks; c; c = next) {
+		next = c->next;
+		st_free(c, sizeof(struct arena_chunk) + c->size);
+	}
+	init_arena(a);
+}
@@ -0,0 +1,56 @@
+#ifndef ST_ARENA_H
+#define ST_ARENA_H
+
+#include <stdlib.h>
+
+/* memory is taken from the heap in chunks of at least ARENA_CHUNK_SIZE bytes */
+#define ARENA_CHUNK_SIZE (64 * 1024)
+
+struct arena_chunk {
+	struct arena_chunk *next;
+	size_t size; /* usable size, the data follows the header */
+};
+
+/* st_arena: bump allocator for lots of small objects released all at once
+ * (the EA arrays and values of the routes of a subnet_file)
+ * objects cannot be freed one by one; they live until free_arena
+ * an arena must not be used by 2 threads at the same time
+ */
+struct st_arena {
+	struct arena_chunk *chunks; /* current chunk first */
+	char *ptr; /* first free byte of the current chunk */
+	char *end; /* end of the current chunk */
+	unsigned long size; /* total size of the chunks */
+};
+
+void init_arena(struct st_arena *a);
+
+/* arena_alloc: get 'size' bytes, aligned on a pointer size
+ * returns:
+ *	a pointer to the memory on SUCCESS
+ *	NULL on ENOMEM
+ */
+void *arena_alloc(struct st_arena *a, size_t size);
+
+/* arena_strdup: copy 's' in arena 'a'
+ * returns:
+ *	a pointer to the copy on SUCCESS
+ *	NULL on ENOMEM
+ */
+char *arena_strdup(struct st_arena *a, const char *s);
+
+/* arena_rewind: give back everything allocated since 'ptr' if it is in the current chunk
+ * 'ptr' must have been returned by arena_alloc or arena_strdup
+ */
+void arena_rewind(struct st_arena *a, void *ptr);
+
+/* arena_splice: move all the memory of 'src' into 'dst'; 'src' is empty after that
+ * objects allocated in 'src' now live as long as 'dst'
+ */
+void arena_splice(struct st_arena *dst, struct st_arena *src);
+
+/* free_arena: release all memory of 'a', in O(number of chunks) */
+void free_arena(struct st_arena *a);
+
+#else
+#endif
@@ -0,0 +1,226 @@
+/*
+ * DIR-24-8 IPv4 longest prefix match table
+ *
+ * Copyright (C) 2015 Etienne Basset <etienne POINT basset AT ensta POINT org>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of version 2 of the GNU General Public License
+ * as published by the Free Software Foundation.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "debug.h"
+#include "iptools.h"
+#include "st_memory.h"
+#include "utils.h"
+#include "st_routes_csv.h"
+#include "st_dir248.h"
+
+#define TBL24_SIZE	(1UL << 24)
+#define TBL8_GROUP	256
+#define TBL8_MIN	64 /* minimum number of tbl8 groups */
+
+/* the tables are allocated by dir248_build, once there are IPv4 routes to put in */
+int alloc_dir248(struct st_dir248 *d)
+{
+	d->tbl24     = NULL;
+	d->tbl8      = NULL;
+	d->max_tbl8  = 0;
+	d->nr_tbl8   = 0;
+	d->nr_routes = 0;
+	return 1;
+}
+
+void free_dir248(struct st_dir248 *d)
+{
+	st_free(d->tbl24, TBL24_SIZE * sizeof(uint32_t));
+	st_free(d->tbl8, d->max_tbl8 * TBL8_GROUP * sizeof(uint32_t));
+	d->tbl24 = NULL;
+	d->tbl8  = NULL;
+	d->nr_tbl8 = d->max_tbl8 = d->nr_routes = 0;
+}
+
+unsigned long dir248_memory(const struct st_dir248 *d)
+{
+	return ((d->tbl24 ? TBL24_SIZE : 0) + d->max_tbl8 * TBL8_GROUP) * sizeof(uint32_t);
+}
+
+/* tbl8 group of the /24 covering 'ip'; created from the tbl24 entry if needed */
+static long dir248_tbl8_group(struct st_dir248 *d, ipv4 ip)
+{
+	uint32_t e = d->tbl24[ip >> 8];
+	unsigned long g;
+	int i;
+
+	if (e & DIR248_TBL8)
+		return e & ~DIR248_TBL8;
+	/* tbl8 was sized by dir248_size_tbl8 */
+	if (d->nr_tbl8 == d->max_tbl8) {
+		debug(ADDRCOMP, 1, "BUG, no tbl8 group left\n");
+		return -1;
+	}
+	g = d->nr_tbl8++;
+	/* the /32s of the group inherit the route covering the /24 */
+	for (i = 0; i < TBL8_GROUP; i++)
+		d->tbl8[g * TBL8_GROUP + i] = e;
+	d->tbl24[ip >> 8] = DIR248_TBL8 | g;
+	return g;
+}
+
+/*
+ * is entry 'e' a route of mask 'mask' ? at the first slot of a prefix, such a
+ * route can only be the same prefix, inserted earlier in this mask pass
+ */
+static int dir248_dup(const struct subnet_file *sf, uint32_t e, int mask)
+{
+	if (e == 0 || (e & DIR248_TBL8))
+		return 0;
+	return sf->routes[e - 1].subnet.mask == mask;
+}
+
+/*
+ * routes are inserted by increasing mask, so a route overwrites the entries of
+ * the shorter routes covering it, and tbl8 groups only exist once all routes
+ * with mask <= 24 are in
+ * a duplicate prefix is skipped, so a short prefix present many times is
+ * written once
+ */
+static int dir248_insert(struct st_dir248 *d, const struct subnet_file *sf,
+		ipv4 ip, int mask, uint32_t v)
+{
+	unsigned long first, n, k;
+	long g;
+
+	if (mask <= 24) {
+		first = ip >> 8;
+		if (dir248_dup(sf, d->tbl24[first], mask))
+			return 0;
+		n = 1UL << (24 - mask);
+		for (k = first; k < first + n; k++)
+			d->tbl24[k] = v;
+		return 1;
+	}
+	g = dir248_tbl8_group(d, ip);
+	if (g < 0)
+		return -1;
+	first = g * TBL8_GROUP + (ip & 0xFF);
+	if (dir248_dup(sf, d->tbl8[first], mask))
+		return 0;
+	n = 1UL << (32 - mask);
+	for (k = first; k < first + n; k++)
+		d->tbl8[k] = v;
+	return 1;
+}
+
+/*
+ * size tbl8 for the routes order[first..n) (all with mask > 24) :
+ * one group per distinct /24, so the table is exactly 64 MiB + 1 KiB per group
+ */
+static int dir248_size_tbl8(struct st_dir248 *d, const struct subnet_file *sf,
+		const unsigned long *order, unsigned long first, unsigned long n)
+{
+	unsigned char *seen;
+	unsigned long i, groups = 0, new_max;
+	uint32_t *new_t;
+	ipv4 ip;
+
+	seen = st_malloc(TBL24_SIZE / 8, "dir248 seen");
+	if (seen == NULL)
+		return -1;
+	memset(seen, 0, TBL24_SIZE / 8);
+	for (i = first; i < n; i++) {
+		ip = sf->routes[order[i]].subnet.ip >> 8;
+		if (seen[ip >> 3] & (1 << (ip & 7)))
+			continue;
+		seen[ip >> 3] |= (1 << (ip & 7));
+		groups++;
+	}
+	st_free(seen, TBL24_SIZE / 8);
+	new_max = max(groups, (unsigned long)TBL8_MIN);
+	if (new_max == d->max_tbl8)
+		return 1;
+	new_t = st_realloc(d->tbl8, new_max * TBL8_GROUP * sizeof(uint32_t),
+			d->max_tbl8 * TBL8_GROUP * sizeof(uint32_t), "dir248 tbl8");
+	if (new_t == NULL)
+		return -1;
+	d->tbl8 = new_t;
+	d->max_tbl8 = new_max;
+	return 1;
+}
+
+int dir248_build(struct st_dir248 *d, const struct subnet_file *sf)
+{
+	unsigned long count[33 + 1];
+	unsigned long *order;
+	unsigned long i, k, start, n4 = 0;
+	const struct subnet *s;
+	ipv4 ip;
+	int m;
+
+	if (sf->nr > (unsigned long)(DIR248_TBL8 - 2)) {
+		debug(ADDRCOMP, 1, "too many routes for a DIR-24-8 table: %lu\n", sf->nr);
+		return -1;
+	}
+	debug_timing_start(2);
+	d->nr_tbl8 = 0;
+	/* counting sort of the IPv4 routes by mask */
+	memset(count, 0, sizeof(count));
+	for (i = 0; i < sf->nr; i++) {
+		if (sf->routes[i].subnet.ip_ver == IPV4_A) {
+			count[sf->routes[i].subnet.mask + 1]++;
+			n4++;
+		}
+	}
+	if (n4 == 0) {
+		/* no IPv4 route, no need for 64 MiB of tbl24 */
+		free_dir248(d);
+		debug_timing_end(2);
+		return 1;
+	}
+	if (d->tbl24 == NULL) {
+		d->tbl24 = st_malloc(TBL24_SIZE * sizeof(uint32_t), "dir248 tbl24");
+		if (d->tbl24 == NULL) {
+			debug_timing_end(2);
+			return -1;
+		}
+	}
+	memset(d->tbl24, 0, TBL24_SIZE * sizeof(uint32_t));
+	d->nr_routes = n4;
+	for (m = 1; m <= 33; m++)
+		count[m] += count[m - 1];
+	order = st_malloc(n4 * sizeof(unsigned long), "dir248 order");
+	if (order == NULL) {
+		debug_timing_end(2);
+		return -1;
+	}
+	for (i = 0; i < sf->nr; i++)
+		if (sf->routes[i].subnet.ip_ver == IPV4_A)
+			order[count[sf->routes[i].subnet.mask]++] = i;
+	if (dir248_size_tbl8(d, sf, order, count[24], n4) < 0) {
+		st_free(order, n4 * sizeof(unsigned long));
+		debug_timing_end(2);
+		return -1;
+	}
+	/* count[m] is now the end of mask 'm' routes; they are inserted in sf
+	 * order, so among equal prefixes the first route of sf is kept
+	 */
+	start = 0;
+	for (m = 0; m <= 32; m++) {
+		for (k = start; k < count[m]; k++) {
+			s  = &sf->routes[order[k]].subnet;
+			ip = (m ? s->ip & (0xFFFFFFFFU << (32 - m)) : 0);
+			if (dir248_insert(d, sf, ip, m, order[k] + 1) < 0) {
+				st_free(order, n4 * sizeof(unsigned long));
+				debug_timing_end(2);
+				return -1;
+			}
+		}
+		start = count[m];
+	}
+	st_free(order, n4 * sizeof(unsigned long));
+	debug(ADDRCOMP, 3, "DIR-24-8: %lu IPv4 routes, %lu tbl8 groups, %lu KiB\n",
+			n4, d->nr_tbl8, dir248_memory(d) >> 10);
+	debug_timing_end(2);
+	return 1;
+}
@@ -0,0 +1,62 @@
+#ifndef ST_DIR248_H
+#define ST_DIR248_H
+
+#include <stdint.h>
+#include "st_routes_csv.h"
+
+/*
+ * DIR-24-8 IPv4 forwarding table: longest prefix match in one or two memory reads
+ * tbl24 has one entry per /24; an entry holds 0 (no route), route index + 1,
+ * or if DIR248_TBL8 is set the number of a tbl8 group of 256 entries (one per /32)
+ * for the /24 it covers, because that /24 holds a prefix longer than 24
+ *
+ * memory budget : nothing for a table without IPv4 routes, else tbl24 is 64 MiB,
+ * plus 1 KiB per /24 holding a prefix longer than /24 (tbl8 is sized exactly at build),
+ * plus 2 MiB and 8 bytes per IPv4 route, freed at the end of the build
+ */
+#define DIR248_TBL8	0x80000000U
+
+struct st_dir248 {
+	uint32_t *tbl24;	/* 1 << 24 entries */
+	uint32_t *tbl8;		/* max_tbl8 groups of 256 entries */
+	unsigned long nr_tbl8;
+	unsigned long max_tbl8;
+	unsigned long nr_routes; /* number of IPv4 routes in the table */
+};
+
+/* alloc_dir248: init an empty table; its tables are allocated by dir248_build
+ * returns:
+ *	positive on SUCCESS
+ *	negative on ENOMEM
+ */
+int alloc_dir248(struct st_dir248 *d);
+void free_dir248(struct st_dir248 *d);
+
+/* dir248_build: (re)build 'd' from the IPv4 routes of 'sf'; other routes are ignored
+ * among routes with the same prefix, the first one in sf wins
+ * returns:
+ *	positive on SUCCESS
+ *	negative on ENOMEM or if sf has more than 2^31 - 2 routes
+ */
+int dir248_build(struct st_dir248 *d, const struct subnet_file *sf);
+
+/* dir248_memory: size in bytes of the tables of 'd' */
+unsigned long dir248_memory(const struct st_dir248 *d);
+
+/* dir248_lookup: longest prefix match of IPv4 address 'ip'
+ * the table must hold IPv4 routes (nr_routes != 0)
+ * returns:
+ *	the index of the best route in the subnet_file the table was built from
+ *	-1 if no match
+ */
+static inline long dir248_lookup(const struct st_dir248 *d, uint32_t ip)
+{
+	uint32_t e = d->tbl24[ip >> 8];
+
+	if (e & DIR248_TBL8)
+		e = d->tbl8[((unsigned long)(e & ~DIR248_TBL8) << 8) | (ip & 0xFF)];
+	return (long)e - 1;
+}
+
+#else
+#endif
@@ -41,12 +41,30 @@ int ea_strdup(struct ipam_ea *ea, const char *value)
 	strcpy(ea->value, value);
 #ifdef DEBUG_ST_MEMORY
 	debug_memory(7, "Allocating %d bytes for EA_value '%s'\n", len, value);
-	total_memory += len;
+	add_total_memory(len);
 #endif
 	ea->len = len;
 	return 1;
 }
 
+int ea_intern(struct st_strtab *t, struct ipam_ea *ea, const char *value)
+{
+	if (t == NULL)
+		return ea_strdup(ea, value);
+	if (value == NULL) {
+		ea->len   = 0;
+		ea->value = NULL;
+		return 1;
+	}
+	ea->value = (char *)strtab_intern(t, value);
+	if (ea->value == NULL) {
+		ea->len = 0;
+		return -1;
+	}
+	ea->len = strlen(ea->value) + 1;
+	return 1;
+}
+
 void free_ea_array(struct ipam_ea *ea, int n)
 {
 	int i;
@@ -84,6 +102,28 @@ struct ipam_ea *alloc_ea_array(int n)
 	return ea;
 }
 
+struct ipam_ea *alloc_ea_array_arena(struct st_arena *a, int n)
+{
+	int j;
+	struct ipam_ea *ea;
+
+	if (a == NULL)
+		return alloc_ea_array(n);
+	if (n <= 0) {
+		fprintf(stderr, "BUG, alloc_ea_array_arena called with %d size\n", n);
+		return NULL;
+	}
+	ea = arena_alloc(a, n * sizeof(struct ipam_ea));
+	if (ea == NULL)
+		return NULL;
+	for (j = 0; j < n; j++) {
+		ea[j].name  = NULL;
+		ea[j].value = NULL;
+		ea[j].len   = 0;
+	}
+	return ea;
+}
+
 struct ipam_ea *realloc_ea_array(struct ipam_ea *ea, int old_n, int new_n)
 {
 	int j;
@@ -107,32 +147,27 @@ struct ipam_ea *realloc_ea_array(struct ipam_ea *ea, int old_n, int new_n)
 	return new_ea;
 }
 
-int filter_ea(const struct ipam_ea *ea, int ea_nr, const char *ea_name,
-		const char *value, char op)
+int find_ea_index(const struct ipam_ea *ea, int ea_nr, const char *name)
 {
-	int j, a, b, res, err;
-	int found = 0;
-	char *s;
-
-	for (j = 0; j < ea_nr; j++) {
-		if (!strcmp(ea_name, ea[j].name)) {
-			found = 1;
-			break;
-		}
-	}
-	if (found == 0) {
-		debug(FILTER, 1, "Cannot filter on attribute '%s'\n", ea_name);
-		return 0;
-	}
-	debug(IPAM, 5, "We will filter on EA: '%s'\n", ea[j].name);
-	s = ea[j].value;
+	int j;
+
+	for (j = 0; j < ea_nr; j++)
+		if (!strcmp(name, ea[j].name))
+			return j;
+	return -1;
+}
+
+int filter_ea_value(const char *s, const char *value, int ival, int bad_ival, char op)
+{
+	int a, res, err;
+
 	if (s == NULL) /* EA Value has not been set */
 		return 0;
 	switch (op) {
 	case '=':
 		return (!strcmp(s, value));
 	case '#':
-		return strcmp(s, value);
+		return !!strcmp(s, value);
 	case '~':
 		res = st_sscanf(s, value);
 		return (res < 0 ? 0 : 1);
@@ -141,11 +176,8 @@ int filter_ea(const struct ipam_ea *ea, int ea_nr, const char *ea_name,
 		return (res < 0 ? 0 : 1);
 	case '<':
 	case '>':
-		b = string2int(value, &err);
-		if (err < 0) {
-			debug(FILTER, 1, "Cannot interpret Field '%s' as an INT\n", value);
+		if (bad_ival)
 			return -1;
-		}
 		a = string2int(s, &err);
 		/* if Extended Attribute is not Int we don't return an error, just no match
 		*/
@@ -154,10 +186,22 @@ int filter_ea(const struct ipam_ea *ea, int ea_nr, const char *ea_name,
 			return 0;
 		}
 		if (op == '>')
-			return (a > b);
-		return (b > a);
+			return (a > ival);
+		return (ival > a);
 	default:
 		debug(FILTER, 1, "Unsupported op '%c' for Extended Attribute\n", op);
 		return -1;
 	}
 }
+
+int filter_ea_key(const char *s, const char *value, const char *key,
+		int ival, int bad_ival, char op)
+{
+	if (s == NULL) /* EA Value has not been set */
+		return 0;
+	if (op == '=')
+		return (s == key);
+	if (op == '#')
+		return (s != key);
+	return filter_ea_value(s, value, ival, bad_ival, op);
+}
@@ -1,9 +1,12 @@
 #ifndef IPAM_EA_H
 #define IPAM_EA_H
 
+#include "st_arena.h"
+#include "hash_tab.h"
+
 struct  ipam_ea {
 	char *name;
-	char *value; /* value of EA; MUST be malloc'ed*/
+	char *value; /* value of EA; malloc'ed, or interned (see ea_intern) */
 	int len;
 };
 
@@ -19,6 +22,11 @@ int ea_strdup(struct ipam_ea *ea, const char *value);
 
 void free_ea_array(struct ipam_ea *ea, int n);
 
+/* ea_intern: same as ea_strdup, but 'value' is interned in 't'
+ * such a value is shared, it MUST NOT be modified or freed; if 't' is NULL, this is ea_strdup
+ */
+int ea_intern(struct st_strtab *t, struct ipam_ea *ea, const char *value);
+
 /*  alloc_ea_array
  *  alloc an array of Extended Attributes
  *	@n : number of Extended Attributes
@@ -28,6 +36,11 @@ void free_ea_array(struct ipam_ea *ea, int n);
  */
 struct ipam_ea *alloc_ea_array(int n);
 
+/* alloc_ea_array_arena: same as alloc_ea_array, in arena 'a' (on the heap if 'a' is NULL)
+ * such an array MUST NOT be freed with free_ea_array
+ */
+struct ipam_ea *alloc_ea_array_arena(struct st_arena *a, int n);
+
 /*
  *  realloc_ea_array
  *  increase size of an EA array; set new members to NULL
@@ -40,19 +53,33 @@ struct ipam_ea *alloc_ea_array(int n);
  */
 struct ipam_ea *realloc_ea_array(struct ipam_ea *ea, int old_n, int new_n);
 
+/* find_ea_index: index of the EA named 'name' in 'ea'
+ * returns:
+ *	the index of the first EA with that name
+ *	-1 if not found
+ */
+int find_ea_index(const struct ipam_ea *ea, int ea_nr, const char *name);
+
 /*
- * filter ea array to see if EA with name 'ea_name' matches 'value' using operator 'op'
- * @ea      : the EA array
- * @ea_nr   : length of  EA array
- * @ea_name : the name of the EA to filter on
- * @value   : the value to match
- * @op      : the operator (=, #, <, >, ~)
+ * filter_ea_value: see if the value of an EA matches 'value' using operator 'op'
+ * @s        : the EA value, NULL if it has not been set
+ * @value    : the value to match
+ * @ival     : 'value' as an int, for '<' and '>'
+ * @bad_ival : 'value' is not an int
+ * @op       : the operator (=, #, <, >, ~, %)
  * returns:
  *	1  if match
  *	0  if no match
  *	-1 on error
  */
-int filter_ea(const struct ipam_ea *ea, int ea_nr, const char *ea_name,
-		const char *value, char op);
+int filter_ea_value(const char *s, const char *value, int ival, int bad_ival, char op);
+
+/*
+ * filter_ea_key: same as filter_ea_value, for an interned EA value 's'
+ * @key : 'value' interned in the table of 's', NULL if it is not there
+ * '=' and '#' compare pointers instead of strings
+ */
+int filter_ea_key(const char *s, const char *value, const char *key,
+		int ival, int bad_ival, char op);
 #else
 #endif
@@ -0,0 +1,784 @@
+/*
+ * external merge sort of route files, see st_extsort.h
+ *
+ * Copyright (C) 2015 Etienne Basset <etienne POINT basset AT ensta POINT org>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of version 2 of the GNU General Public License
+ * as published by the Free Software Foundation.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <unistd.h>
+#include "debug.h"
+#include "iptools.h"
+#include "utils.h"
+#include "st_memory.h"
+#include "st_routes.h"
+#include "st_thread.h"
+#include "radix.h"
+#include "generic_csv.h"
+#include "st_routes_csv.h"
+#include "st_extsort.h"
+
+#define EXTSORT_KEY_MAX		64
+#define EXTSORT_IOBUF_MIN	(64 * 1024)
+#define EXTSORT_IOBUF_MAX	(1024 * 1024)
+#define EXTSORT_MAX_FANIN	128
+#define EXTSORT_BUF_MIN		(64 * 1024)
+#define EXTSORT_NR_MIN		4096
+
+/*
+ * packed route, in the run buffer and in the run files where it follows its length
+ * (4 bytes, host order) :
+ * ip_ver, address (4 or 16 bytes), mask, GW ip_ver, GW address (0, 4 or 16 bytes),
+ * device (2 bytes), then for each EA its length including the NUL (1 byte, or 0xFF
+ * and 4 bytes) and its value; a length of 0 is a NULL value
+ */
+static int addr_bytes(int ip_ver)
+{
+	if (ip_ver == IPV4_A)
+		return 4;
+	if (ip_ver == IPV6_A)
+		return 16;
+	return 0;
+}
+
+static size_t packed_route_size(const struct route *r)
+{
+	size_t len, n = 2 + addr_bytes(r->subnet.ip_ver) + 1 + addr_bytes(r->gw.ip_ver) + 2;
+	int i;
+
+	for (i = 0; i < r->ea_nr; i++) {
+		len = (r->ea[i].value ? strlen(r->ea[i].value) + 1 : 0);
+		n += len + (len < 0xFF ? 1 : 5);
+	}
+	return n;
+}
+
+static unsigned char *pack_addr(unsigned char *p, const struct ip_addr *a)
+{
+	int n = addr_bytes(a->ip_ver);
+
+	*p++ = a->ip_ver;
+	if (n == 4)
+		memcpy(p, &a->ip, 4);
+	else if (n == 16)
+		memcpy(p, &a->ip6, 16);
+	return p + n;
+}
+
+static const unsigned char *unpack_addr(const unsigned char *p, struct ip_addr *a)
+{
+	int n;
+
+	memset(a, 0, sizeof(*a));
+	a->ip_ver = *p++;
+	n = addr_bytes(a->ip_ver);
+	if (n == 4)
+		memcpy(&a->ip, p, 4);
+	else if (n == 16)
+		memcpy(&a->ip6, p, 16);
+	return p + n;
+}
+
+/* returns the size of the packed route */
+static size_t pack_route(unsigned char *buf, const struct route *r)
+{
+	unsigned char *p = buf;
+	uint32_t len;
+	int i;
+
+	p = pack_addr(p, &r->subnet.ip_addr);
+	*p++ = r->subnet.mask;
+	p = pack_addr(p, &r->gw);
+	*p++ = r->device >> 8;
+	*p++ = r->device & 0xFF;
+	for (i = 0; i < r->ea_nr; i++) {
+		len = (r->ea[i].value ? strlen(r->ea[i].value) + 1 : 0);
+		if (len < 0xFF) {
+			*p++ = len;
+		} else {
+			*p++ = 0xFF;
+			memcpy(p, &len, 4);
+			p += 4;
+		}
+		if (len)
+			memcpy(p, r->ea[i].value, len);
+		p += len;
+	}
+	return p - buf;
+}
+
+/* unpack a route; its EA values are set in 'ea' if not NULL, and point into 'buf' */
+static void unpack_route(struct route *r, const unsigned char *buf, struct ipam_ea *ea, int ea_nr)
+{
+	const unsigned char *p = buf;
+	uint32_t len;
+	int i;
+
+	p = unpack_addr(p, &r->subnet.ip_addr);
+	r->subnet.mask = *p++;
+	p = unpack_addr(p, &r->gw);
+	r->device = (p[0] << 8) | p[1];
+	p += 2;
+	r->ea    = ea;
+	r->ea_nr = (ea ? ea_nr : 0);
+	if (ea == NULL)
+		return;
+	for (i = 0; i < ea_nr; i++) {
+		len = *p++;
+		if (len == 0xFF) {
+			memcpy(&len, p, 4);
+			p += 4;
+		}
+		ea[i].value = (len ? (char *)p : NULL);
+		ea[i].len   = len;
+		p += len;
+	}
+}
+
+struct run {
+	int fd;
+	int level; /* number of merges it went through */
+};
+
+struct extsort {
+	struct st_options *nof;
+	unsigned long mem;
+	int (*keyfunc)(unsigned char *key, const struct route *r, int addr_len);
+	int (*ea_used)(struct subnet_file *sf, int ea_num, void *data);
+	int (*out)(const struct route *r, void *data);
+	void *data;
+	int key_len;
+	int fanin;
+	/* EA names of the file, for the routes handed to 'out' */
+	char **ea_names;
+	int ea_nr;
+	/* the run being filled : packed routes, back to back */
+	unsigned char *buf;
+	size_t buf_len, buf_size;
+	size_t *offs;
+	unsigned long nr, max_nr;
+	/* spilled runs, oldest first */
+	struct run *runs;
+	int nr_runs, max_runs;
+	unsigned long nr_routes;
+	int failed; /* the error was reported */
+};
+
+/* a run in memory costs its packed routes, plus an offset, a key and a perm entry each */
+static size_t run_cost(const struct extsort *ex, size_t buf_len, unsigned long nr)
+{
+	return buf_len + nr * (sizeof(size_t) + ex->key_len + sizeof(unsigned long));
+}
+
+static void extsort_error(struct extsort *ex, const char *what)
+{
+	fprintf(stderr, "external sort: %s: %s\n", what, strerror(errno));
+	ex->failed = 1;
+}
+
+/* temp files are unlinked at once, they go away with the process */
+static int extsort_tmpfile(struct extsort *ex)
+{
+	char path[512];
+	const char *dir = getenv("TMPDIR");
+	int fd;
+
+	if (dir == NULL || dir[0] == '\0')
+		dir = "/tmp";
+	snprintf(path, sizeof(path), "%s/subnet-tools-XXXXXX", dir);
+	fd = mkstemp(path);
+	if (fd < 0) {
+		extsort_error(ex, "cannot create a temp file");
+		return -1;
+	}
+	unlink(path);
+	return fd;
+}
+
+static int write_all(int fd, const unsigned char *p, size_t n)
+{
+	ssize_t res;
+
+	while (n) {
+		res = write(fd, p, n);
+		if (res < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		p += res;
+		n -= res;
+	}
+	return 1;
+}
+
+/* buffered writes of packed routes to a run file */
+struct run_writer {
+	int fd;
+	unsigned char *buf;
+	size_t len, size;
+};
+
+static int writer_flush(struct run_writer *w)
+{
+	if (write_all(w->fd, w->buf, w->len) < 0)
+		return -1;
+	w->len = 0;
+	return 1;
+}
+
+static int writer_put(struct run_writer *w, const unsigned char *rec, uint32_t len)
+{
+	if (w->len + len + 4 > w->size) {
+		if (writer_flush(w) < 0)
+			return -1;
+		/* a route larger than the buffer is written as is */
+		if (len + 4 > w->size) {
+			if (write_all(w->fd, (unsigned char *)&len, 4) < 0)
+				return -1;
+			return write_all(w->fd, rec, len);
+		}
+	}
+	memcpy(w->buf + w->len, &len, 4);
+	memcpy(w->buf + w->len + 4, rec, len);
+	w->len += len + 4;
+	return 1;
+}
+
+static size_t iobuf_size(const struct extsort *ex, int k)
+{
+	size_t n = ex->mem / (k + 1);
+
+	return max(min(n, (size_t)EXTSORT_IOBUF_MAX), (size_t)EXTSORT_IOBUF_MIN);
+}
+
+static int extsort_add_run(struct extsort *ex, int fd, int level)
+{
+	struct run *new_runs;
+	int new_max;
+
+	if (ex->nr_runs == ex->max_runs) {
+		new_max = (ex->max_runs ? 2 * ex->max_runs : 16);
+		new_runs = st_realloc(ex->runs, new_max * sizeof(struct run),
+				ex->max_runs * sizeof(struct run), "extsort runs");
+		if (new_runs == NULL)
+			return -1;
+		ex->runs = new_runs;
+		ex->max_runs = new_max;
+	}
+	ex->runs[ex->nr_runs].fd    = fd;
+	ex->runs[ex->nr_runs].level = level;
+	ex->nr_runs++;
+	return 1;
+}
+
+static void extsort_free_buf(struct extsort *ex)
+{
+	st_free(ex->buf, ex->buf_size);
+	st_free(ex->offs, ex->max_nr * sizeof(size_t));
+	ex->buf  = NULL;
+	ex->offs = NULL;
+	ex->buf_len = ex->buf_size = 0;
+	ex->nr = ex->max_nr = 0;
+}
+
+/* sort the run being filled; returns its permutation, or NULL on ENOMEM */
+static unsigned long *extsort_sort_run(struct extsort *ex)
+{
+	unsigned long i, *perm, bounds[ST_MAX_THREADS + 1];
+	unsigned char *keys;
+	struct route r;
+	int res;
+
+	keys = st_malloc(ex->nr * ex->key_len, "extsort keys");
+	if (keys == NULL)
+		return NULL;
+	perm = st_malloc(ex->nr * sizeof(unsigned long), "extsort permutation");
+	if (perm == NULL) {
+		st_free(keys, ex->nr * ex->key_len);
+		return NULL;
+	}
+	for (i = 0; i < ex->nr; i++) {
+		unpack_route(&r, ex->buf + ex->offs[i], NULL, 0);
+		ex->keyfunc(keys + i * ex->key_len, &r, SORTKEY_ADDR6_LEN);
+	}
+	if (ex->nof->nr_threads > 1)
+		res = radix_sort_mt(keys, ex->key_len, ex->nr, perm, ex->nof->nr_threads, bounds);
+	else
+		res = radix_sort(keys, ex->key_len, ex->nr, perm);
+	st_free(keys, ex->nr * ex->key_len);
+	if (res < 0) {
+		st_free(perm, ex->nr * sizeof(unsigned long));
+		return NULL;
+	}
+	return perm;
+}
+
+static int extsort_merge(struct extsort *ex, int first, int k, int to);
+
+/*
+ * merge the newest runs while 'fanin' of them went through the same number of merges;
+ * merged runs are contiguous, so ties still go to the earliest route of the file,
+ * and each route is merged about log(nr_runs) / log(fanin) times
+ */
+static int extsort_cascade(struct extsort *ex)
+{
+	int fd, first, level;
+
+	while (ex->nr_runs >= ex->fanin) {
+		first = ex->nr_runs - ex->fanin;
+		level = ex->runs[ex->nr_runs - 1].level;
+		if (ex->runs[first].level != level)
+			break;
+		/* the run buffer is empty, give its memory to the merge */
+		extsort_free_buf(ex);
+		fd = extsort_tmpfile(ex);
+		if (fd < 0)
+			return -1;
+		if (extsort_merge(ex, first, ex->fanin, fd) < 0) {
+			close(fd);
+			return -1;
+		}
+		ex->nr_runs = first;
+		extsort_add_run(ex, fd, level + 1); /* cannot fail, a run was removed */
+	}
+	return 1;
+}
+
+/* sort the run being filled and write it to a new run file */
+static int extsort_spill(struct extsort *ex)
+{
+	struct run_writer w;
+	unsigned long i, nr = ex->nr, *perm;
+	size_t end;
+	int res = -1;
+
+	debug_timing_start(3);
+	perm = extsort_sort_run(ex);
+	if (perm == NULL) {
+		debug_timing_end(3);
+		return -1;
+	}
+	w.len  = 0;
+	w.size = max(min(ex->mem / 16, (unsigned long)EXTSORT_IOBUF_MAX),
+			(unsigned long)EXTSORT_IOBUF_MIN);
+	w.buf  = st_malloc(w.size, "extsort write buffer");
+	w.fd   = (w.buf ? extsort_tmpfile(ex) : -1);
+	if (w.fd < 0)
+		goto out;
+	for (i = 0; i < ex->nr; i++) {
+		end = (perm[i] + 1 < ex->nr ? ex->offs[perm[i] + 1] : ex->buf_len);
+		if (writer_put(&w, ex->buf + ex->offs[perm[i]], end - ex->offs[perm[i]]) < 0)
+			break;
+	}
+	if (i < ex->nr || writer_flush(&w) < 0) {
+		extsort_error(ex, "cannot write a temp file");
+		close(w.fd);
+		goto out;
+	}
+	if (extsort_add_run(ex, w.fd, 0) < 0) {
+		close(w.fd);
+		goto out;
+	}
+	debug(SORT, 3, "run %d : %lu routes, %lu bytes\n", ex->nr_runs - 1, ex->nr,
+			(unsigned long)ex->buf_len);
+	ex->nr = 0;
+	ex->buf_len = 0;
+	res = 1;
+out:
+	st_free(w.buf, w.size);
+	st_free(perm, nr * sizeof(unsigned long));
+	debug_timing_end(3);
+	return (res < 0 ? res : extsort_cascade(ex));
+}
+
+/* make room for a packed route of 'len' bytes in the run buffer */
+static int extsort_reserve(struct extsort *ex, size_t len)
+{
+	unsigned char *new_buf;
+	size_t *new_offs;
+	size_t new_size;
+	unsigned long new_max;
+
+	if (ex->buf_len + len > ex->buf_size) {
+		new_size = max(2 * ex->buf_size, (size_t)EXTSORT_BUF_MIN);
+		new_size = min(new_size, (size_t)ex->mem);
+		new_size = max(new_size, ex->buf_len + len);
+		new_buf = st_realloc(ex->buf, new_size, ex->buf_size, "extsort run buffer");
+		if (new_buf == NULL)
+			return -1;
+		ex->buf = new_buf;
+		ex->buf_size = new_size;
+	}
+	if (ex->nr == ex->max_nr) {
+		new_max = (ex->max_nr ? 2 * ex->max_nr : EXTSORT_NR_MIN);
+		new_offs = st_realloc(ex->offs, new_max * sizeof(size_t),
+				ex->max_nr * sizeof(size_t), "extsort offsets");
+		if (new_offs == NULL)
+			return -1;
+		ex->offs = new_offs;
+		ex->max_nr = new_max;
+	}
+	return 1;
+}
+
+static int extsort_sink(struct subnet_file *sf, struct route *r, void *data)
+{
+	struct extsort *ex = data;
+	size_t len = packed_route_size(r);
+
+	if (ex->nr && run_cost(ex, ex->buf_len + len, ex->nr + 1) > ex->mem) {
+		if (extsort_spill(ex) < 0)
+			return -1;
+	}
+	if (extsort_reserve(ex, len) < 0)
+		return -1;
+	ex->offs[ex->nr++] = ex->buf_len;
+	ex->buf_len += pack_route(ex->buf + ex->buf_len, r);
+	ex->nr_routes++;
+	return CSV_CONTINUE;
+}
+
+static int extsort_bind(struct subnet_file *sf, void *data)
+{
+	struct extsort *ex = data;
+	int i;
+
+	ex->ea_names = st_malloc(sf->ea_nr * sizeof(char *), "extsort EA names");
+	if (ex->ea_names == NULL)
+		return -1;
+	/* the names belong to 'sf', they must outlive it */
+	for (i = 0; i < sf->ea_nr; i++) {
+		ex->ea_names[i] = st_strdup(sf->ea[i].name);
+		if (ex->ea_names[i] == NULL)
+			break;
+	}
+	ex->ea_nr = i;
+	return (i == sf->ea_nr ? 1 : -1);
+}
+
+static int extsort_ea_used(struct subnet_file *sf, int ea_num, void *data)
+{
+	struct extsort *ex = data;
+
+	return (ex->ea_used ? ex->ea_used(sf, ea_num, ex->data) : 1);
+}
+
+static const struct netcsv_pushdown extsort_pushdown = {
+	&extsort_bind, &extsort_ea_used, NULL
+};
+
+/* EA array for the routes handed to 'out' */
+static struct ipam_ea *extsort_alloc_ea(struct extsort *ex)
+{
+	struct ipam_ea *ea;
+	int i;
+
+	ea = st_malloc(ex->ea_nr * sizeof(struct ipam_ea), "extsort EA");
+	if (ea == NULL)
+		return NULL;
+	for (i = 0; i < ex->ea_nr; i++)
+		ea[i].name = ex->ea_names[i];
+	return ea;
+}
+
+/* all routes fit in memory : sort them and hand them to 'out' at once */
+static int extsort_output_run(struct extsort *ex)
+{
+	struct ipam_ea *ea;
+	struct route r;
+	unsigned long i, *perm;
+	int res = 1;
+
+	perm = extsort_sort_run(ex);
+	if (perm == NULL)
+		return -1;
+	ea = extsort_alloc_ea(ex);
+	if (ea == NULL) {
+		st_free(perm, ex->nr * sizeof(unsigned long));
+		return -1;
+	}
+	for (i = 0; i < ex->nr; i++) {
+		unpack_route(&r, ex->buf + ex->offs[perm[i]], ea, ex->ea_nr);
+		res = ex->out(&r, ex->data);
+		if (res < 0)
+			break;
+	}
+	st_free(ea, ex->ea_nr * sizeof(struct ipam_ea));
+	st_free(perm, ex->nr * sizeof(unsigned long));
+	return res;
+}
+
+/* buffered reads of the packed routes of a run file */
+struct run_reader {
+	int fd;
+	unsigned char *iobuf;
+	size_t pos, len;
+	unsigned char *rec; /* the current route */
+	uint32_t rec_len;
+	size_t rec_size;
+	unsigned char key[EXTSORT_KEY_MAX];
+	int eof;
+};
+
+static ssize_t reader_read(struct run_reader *rd, size_t iobuf_size, void *dst, size_t n)
+{
+	size_t done = 0, c;
+	ssize_t res;
+
+	while (done < n) {
+		if (rd->pos == rd->len) {
+			res = read(rd->fd, rd->iobuf, iobuf_size);
+			if (res < 0) {
+				if (errno == EINTR)
+					continue;
+				return -1;
+			}
+			if (res == 0)
+				break;
+			rd->pos = 0;
+			rd->len = res;
+		}
+		c = min(n - done, rd->len - rd->pos);
+		memcpy((unsigned char *)dst + done, rd->iobuf + rd->pos, c);
+		rd->pos += c;
+		done += c;
+	}
+	return done;
+}
+
+/* read the next route of a run and its key; returns 0 at the end of the run */
+static int reader_next(struct extsort *ex, struct run_reader *rd, size_t iobuf_size)
+{
+	unsigned char *new_rec;
+	struct route r;
+	uint32_t len;
+	ssize_t res;
+
+	errno = EIO; /* a short read is a truncated temp file */
+	res = reader_read(rd, iobuf_size, &len, 4);
+	if (res == 0) {
+		rd->eof = 1;
+		return 0;
+	}
+	if (res != 4)
+		goto bad;
+	if (len > rd->rec_size) {
+		new_rec = st_realloc_nodebug(rd->rec, len, rd->rec_size, "extsort route");
+		if (new_rec == NULL)
+			return -1;
+		rd->rec = new_rec;
+		rd->rec_size = len;
+	}
+	if (reader_read(rd, iobuf_size, rd->rec, len) != (ssize_t)len)
+		goto bad;
+	rd->rec_len = len;
+	unpack_route(&r, rd->rec, NULL, 0);
+	ex->keyfunc(rd->key, &r, SORTKEY_ADDR6_LEN);
+	return 1;
+bad:
+	extsort_error(ex, "cannot read a temp file");
+	return -1;
+}
+
+struct merge {
+	struct run_reader *rd;
+	int *tree; /* tree[0] is the winner, tree[1..k) the losers of each match */
+	int k;
+	int key_len;
+};
+
+/* does run 'a' come before run 'b'; ended runs come last, ties go to the earliest run */
+static int run_before(const struct merge *m, int a, int b)
+{
+	int res;
+
+	if (m->rd[a].eof || m->rd[b].eof)
+		return m->rd[b].eof && (!m->rd[a].eof || a < b);
+	res = memcmp(m->rd[a].key, m->rd[b].key, m->key_len);
+	return res < 0 || (res == 0 && a < b);
+}
+
+/*
+ * loser tree (Knuth TAOCP 5.4.1) : replay the matches of leaf 's' up to the root
+ * while the tree is built, an empty node (-1) keeps the first leaf that reaches it
+ */
+static void loser_tree_replay(struct merge *m, int s)
+{
+	int t, tmp;
+
+	for (t = (s + m->k) / 2; t > 0; t /= 2) {
+		if (m->tree[t] == -1) {
+			m->tree[t] = s;
+			return;
+		}
+		if (run_before(m, m->tree[t], s)) {
+			tmp = m->tree[t];
+			m->tree[t] = s;
+			s = tmp;
+		}
+	}
+	m->tree[0] = s;
+}
+
+/* merge runs [first, first + k) into run file 'to', or to 'out' if 'to' is negative */
+static int extsort_merge(struct extsort *ex, int first, int k, int to)
+{
+	struct merge m;
+	struct run_writer w;
+	struct ipam_ea *ea = NULL;
+	struct route r;
+	size_t io_size = iobuf_size(ex, k);
+	int i, s, res = 1;
+
+	debug_timing_start(3);
+	debug(SORT, 3, "merging runs %d to %d into %s\n", first, first + k - 1,
+			(to < 0 ? "the output" : "a new run"));
+	m.k = k;
+	m.key_len = ex->key_len;
+	m.rd   = st_malloc(k * sizeof(struct run_reader), "extsort readers");
+	m.tree = st_malloc(k * sizeof(int), "extsort loser tree");
+	w.fd   = to;
+	w.len  = 0;
+	w.size = io_size;
+	w.buf  = (to < 0 ? NULL : st_malloc(w.size, "extsort write buffer"));
+	if (to < 0)
+		ea = extsort_alloc_ea(ex);
+	if (m.rd == NULL || m.tree == NULL || (to >= 0 && w.buf == NULL) || (to < 0 && ea == NULL)) {
+		st_free(m.rd, k * sizeof(struct run_reader));
+		st_free(m.tree, k * sizeof(int));
+		st_free(w.buf, w.size);
+		st_free(ea, ex->ea_nr * sizeof(struct ipam_ea));
+		debug_timing_end(3);
+		return -1;
+	}
+	memset(m.rd, 0, k * sizeof(struct run_reader));
+	for (i = 0; i < k; i++) {
+		m.rd[i].fd = ex->runs[first + i].fd;
+		m.tree[i]  = -1;
+		if (lseek(m.rd[i].fd, 0, SEEK_SET) < 0) {
+			extsort_error(ex, "cannot read a temp file");
+			res = -1;
+			break;
+		}
+		m.rd[i].iobuf = st_malloc(io_size, "extsort read buffer");
+		if (m.rd[i].iobuf == NULL) {
+			res = -1;
+			break;
+		}
+		res = reader_next(ex, &m.rd[i], io_size);
+		if (res < 0)
+			break;
+	}
+	if (res >= 0) {
+		for (i = 0; i < k; i++)
+			loser_tree_replay(&m, i);
+		while (!m.rd[s = m.tree[0]].eof) {
+			if (to < 0) {
+				unpack_route(&r, m.rd[s].rec, ea, ex->ea_nr);
+				res = ex->out(&r, ex->data);
+			} else {
+				res = writer_put(&w, m.rd[s].rec, m.rd[s].rec_len);
+				if (res < 0)
+					extsort_error(ex, "cannot write a temp file");
+			}
+			if (res < 0)
+				break;
+			res = reader_next(ex, &m.rd[s], io_size);
+			if (res < 0)
+				break;
+			loser_tree_replay(&m, s);
+		}
+	}
+	if (res >= 0 && to >= 0 && writer_flush(&w) < 0) {
+		extsort_error(ex, "cannot write a temp file");
+		res = -1;
+	}
+	for (i = 0; i < k; i++) {
+		st_free(m.rd[i].iobuf, io_size);
+		st_free(m.rd[i].rec, m.rd[i].rec_size);
+		/* merged runs are not needed anymore */
+		if (to >= 0)
+			close(m.rd[i].fd);
+	}
+	st_free(m.rd, k * sizeof(struct run_reader));
+	st_free(m.tree, k * sizeof(int));
+	st_free(w.buf, w.size);
+	st_free(ea, ex->ea_nr * sizeof(struct ipam_ea));
+	debug_timing_end(3);
+	return (res < 0 ? -1 : 1);
+}
+
+int extsort_routes(char *name, struct st_options *nof, unsigned long mem,
+		int (*keyfunc)(unsigned char *key, const struct route *r, int addr_len),
+		int (*ea_used)(struct subnet_file *sf, int ea_num, void *data),
+		int (*out)(const struct route *r, void *data), void *data)
+{
+	struct extsort ex;
+	unsigned char key[EXTSORT_KEY_MAX];
+	struct route r;
+	int i, fd, res;
+
+	memset(&ex, 0, sizeof(ex));
+	memset(&r, 0, sizeof(r));
+	ex.nof	   = nof;
+	ex.mem	   = max(mem, EXTSORT_MIN_MEM);
+	ex.keyfunc = keyfunc;
+	ex.ea_used = ea_used;
+	ex.out	   = out;
+	ex.data	   = data;
+	r.subnet.ip_ver = r.gw.ip_ver = IPV6_A;
+	ex.key_len = keyfunc(key, &r, SORTKEY_ADDR6_LEN);
+	/* each run being merged needs a read buffer */
+	ex.fanin   = min(ex.mem / EXTSORT_IOBUF_MIN - 1, (unsigned long)EXTSORT_MAX_FANIN);
+	debug_timing_start(2);
+	res = load_netcsv_stream(name, nof, &extsort_pushdown, &extsort_sink, &ex);
+	if (res < 0)
+		goto out;
+	if (ex.nr_runs == 0) {
+		res = extsort_output_run(&ex);
+		goto out;
+	}
+	if (ex.nr) {
+		res = extsort_spill(&ex);
+		if (res < 0)
+			goto out;
+	}
+	extsort_free_buf(&ex);
+	/* the last merge must be able to read all runs at once */
+	while (ex.nr_runs > ex.fanin) {
+		fd = extsort_tmpfile(&ex);
+		if (fd < 0) {
+			res = -1;
+			goto out;
+		}
+		i = ex.nr_runs - ex.fanin;
+		res = extsort_merge(&ex, i, ex.fanin, fd);
+		if (res < 0) {
+			close(fd);
+			goto out;
+		}
+		ex.nr_runs = i;
+		extsort_add_run(&ex, fd, ex.runs[i].level + 1); /* cannot fail */
+	}
+	debug(SORT, 2, "%lu routes sorted in %d runs\n", ex.nr_routes, ex.nr_runs);
+	res = extsort_merge(&ex, 0, ex.nr_runs, -1);
+out:
+	for (i = 0; i < ex.nr_runs; i++)
+		close(ex.runs[i].fd);
+	st_free(ex.runs, ex.max_runs * sizeof(struct run));
+	extsort_free_buf(&ex);
+	for (i = 0; i < ex.ea_nr; i++)
+		st_free_string(ex.ea_names[i]);
+	st_free(ex.ea_names, ex.ea_nr * sizeof(char *));
+	debug_timing_end(2);
+	if (res < 0 && ex.failed)
+		return -3;
+	return res;
+}
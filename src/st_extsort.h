@@ -0,0 +1,37 @@
+#ifndef ST_EXTSORT_H
+#define ST_EXTSORT_H
+
+#include "st_options.h"
+#include "st_routes_csv.h"
+
+/*
+ * external merge sort of route files that don't fit in memory
+ * routes are streamed from the file and packed into a run buffer; when the buffer
+ * is full it is radix sorted (on nr_threads threads) and spilled to a temp file
+ * ($TMPDIR or /tmp, unlinked at once), then the runs are merged with a loser tree
+ * runs are stable and ties go to the earliest run, so the order is the same as
+ * __subnet_sort_by's
+ *
+ * memory budget : 'mem' bytes for the run buffer, its sort keys and permutation,
+ * then for the read buffers of the runs being merged; if there are more runs
+ * than the budget can read at once, they are merged in several passes
+ */
+#define EXTSORT_MIN_MEM	(1UL << 20)
+
+/* extsort_routes: sort the routes of file 'name' (stdin if NULL)
+ * @nof     : options; nof->nr_threads threads sort each run
+ * @mem     : memory budget in bytes, at least EXTSORT_MIN_MEM
+ * @keyfunc : packs the sort key of a route, it is called with SORTKEY_ADDR6_LEN
+ * @ea_used : EA number 'ea_num' is kept only if it returns non-zero; NULL keeps all EA
+ * @out     : called on each route in sorted order with 'data'; negative aborts
+ * returns:
+ *	positive on SUCCESS
+ *	negative if the file is invalid, on ENOMEM, on I/O error or if 'out' failed
+ */
+int extsort_routes(char *name, struct st_options *nof, unsigned long mem,
+		int (*keyfunc)(unsigned char *key, const struct route *r, int addr_len),
+		int (*ea_used)(struct subnet_file *sf, int ea_num, void *data),
+		int (*out)(const struct route *r, void *data), void *data);
+
+#else
+#endif
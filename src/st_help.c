@@ -51,6 +51,9 @@ void usage_en_routecompare(void)
 	printf("common FILE1 FILE2  : merge FILE1 & FILE2; prints common routes only; GW isn't checked\n");
 	printf("addfiles FILE1 FILE2: merge FILE1 & FILE2; prints the sum of both files\n");
 	printf("grep FILE prefix    : grep FILE for prefix/mask\n");
+	printf("grep -f PFILE FILE  : grep FILE for any prefix/mask of PFILE\n");
+	printf("lookup FILE ADDRS   : print the longest matching route of FILE for each address in ADDRS\n");
+	printf("annotate FILE LOG N : append to each LOG line the EA of the FILE route matching its field N\n");
 	printf("filter FILE EXPR    : grep netcsv   FILE using regexp EXPR\n");
 	printf("filter help         : prints help about bgp filters\n");
 }
@@ -117,6 +120,9 @@ void usage_en_options(void)
 	printf("-ecmp         : when converting routing table, print all routes in case of ECMP\n");
 	printf("-noheader|-nh : dont print netcsv header file\n");
 	printf("-grep_field N : grep field N only\n");
+	printf("-grep_tag     : grep -f prints the matching prefix first\n");
+	printf("-j N          : use N threads to load, sort, simplify, aggregate and grep big files\n");
+	printf("-mem SIZE     : sort/sortby with at most SIZE (k, M, G) of memory, spilling to temp files\n");
 	printf("-D <debug>    : DEBUG MODE ; use '%s -D help' for more info\n", PROG_NAME);
 	printf("-fmt          : change the output format (default :%s)\n", default_fmt);
 	printf("-V            : verbose mode; same as '-D all:1'\n");
@@ -33,7 +33,7 @@ void *__st_malloc_nodebug(unsigned long n, const char *s,
 			fprintf(stderr, "%s:%s line %d Unable to allocate %lu bytes for %s\n",
 					file, func, line, n,  s);
 	}
-	total_memory += n;
+	add_total_memory(n);
 	return ptr;
 }
 
@@ -55,7 +55,7 @@ void *__st_malloc(unsigned long n, const char *s,
 					file, func, line, n, s);
 		return NULL;
 	}
-	total_memory += n;
+	add_total_memory(n);
 	if (n > 10 * 1024 * 1024) {
 		debug_memory(3, "%s:%s line %d Allocated %lu Mbytes for %s\n",
 				file, func, line, n / (1024 * 1024), s);
@@ -87,7 +87,7 @@ void *__st_realloc(void *ptr, unsigned long new, unsigned long old, const char *
 					file, func, line, new, s);
 		return  NULL;
 	}
-	total_memory += (new - old);
+	add_total_memory(new - old);
 	if (new > 10 * 1024 * 1024) {
 		debug_memory(3, "%s:%s line %d Reallocated %lu Mbytes for %s\n",
 				file, func, line, new / (1024 * 1024), s);
@@ -119,7 +119,7 @@ void *__st_realloc_nodebug(void *ptr, unsigned long new, unsigned long old, cons
 					file, func, line, new, s);
 		return  NULL;
 	}
-	total_memory += (new - old);
+	add_total_memory(new - old);
 	return new_ptr;
 }
 
@@ -138,7 +138,7 @@ char *__st_strdup(const char *s,
 				file, func, line, n, s);
 		return NULL;
 	}
-	total_memory += n;
+	add_total_memory(n);
 	strcpy(broumf, s);
 	debug_memory(5, "%s:%s line %d Allocated %d bytes for '%s'\n",
 			file, func, line, n, s);
@@ -149,7 +149,7 @@ void st_free_string(char *s)
 {
 	if (s == NULL)
 		return;
-	total_memory -= (strlen(s) + 1);
+	sub_total_memory(strlen(s) + 1);
 	debug(MEMORY, 6, "Freeing string '%s', %d bytes\n", s, (int)(strlen(s) + 1));
 	free(s);
 }
@@ -158,7 +158,7 @@ void st_free(void *ptr, unsigned long len)
 {
 	if (ptr == NULL)
 		return;
-	total_memory -= len;
+	sub_total_memory(len);
 	debug(MEMORY, 6, "Freeing %lu bytes\n", len);
 	free(ptr);
 }
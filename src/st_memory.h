@@ -2,6 +2,9 @@
 #define ST_MEMORY_H
 
 extern unsigned long total_memory;
+/* allocations can happen on several threads (see st_thread.h) */
+#define add_total_memory(__n) __sync_fetch_and_add(&total_memory, (__n))
+#define sub_total_memory(__n) __sync_fetch_and_sub(&total_memory, (__n))
 #include "st_options.h"
 
 /* this option is set in st_options.h */
@@ -22,6 +22,9 @@ struct st_options {
 	int subnet_off;
 	int print_header;
 	int grep_field; /* when grepping, grep only on this field **/
+	int grep_tag; /* when grepping a prefix file, print the matching prefix first */
+	int nr_threads; /* number of threads for sort/simplify/aggregate */
+	unsigned long sort_mem; /* memory budget of sort/sortby with -mem, 0 sorts in memory */
 	int simplify_mode; /* == 0 means we print the simplified routes,
 			    * == 1 print the routes we can discard
 			    */
@@ -17,6 +17,7 @@
 #include "st_routes.h"
 #include "bitmap.h"
 #include "utils.h"
+#include "st_memory.h"
 #include "st_object.h"
 #include "bgp_tool.h"
 #include "ipam.h"
@@ -36,11 +37,7 @@ sprint_unsigned(short)
 sprint_unsigned(int)
 sprint_unsigned(long)
 
-/* we define a few MACRO to lessen the code duplication between :
- *  - fprint_route_fmt
- *  - fprint_bgproute_fmt
- *  - st_vsprintf
- */
+/* a few MACRO to keep st_vsnprintf readable */
 #define SET_IP_COMPRESSION_LEVEL(__c) do { \
 	if (__c >= '0' && __c <= '4') { \
 		compression_level = __c - '0'; \
@@ -104,19 +101,6 @@ sprint_unsigned(long)
 		i = i2 - 1; \
 	} while (0)
 
-/* if fprint_route_fmt or fprint_bgp_route_fmt are called with route == NULL
- * it will print a subnet_file or bgp_file HEADER
- */
-#define PRINT_FILE_HEADER(__val) ({ \
-	if (r == NULL) { \
-		strcpy(buffer, #__val); \
-		res = strlen(buffer); \
-		res = pad_buffer_out(outbuf + j, sizeof(outbuf) - j, buffer, \
-				res, field_width, pad_left, pad_value); \
-		j += res; \
-		break; \
-	} })
-
 void fprint_route(FILE *output, const struct route *r, int compress_level)
 {
 	char buffer[130];
@@ -126,7 +110,7 @@ void fprint_route(FILE *output, const struct route *r, int compress_level)
 	subnet2str(&r->subnet, buffer, sizeof(buffer), compress_level);
 	addr2str(&r->gw, buffer2, sizeof(buffer2), 2);
 	fprintf(output, "%s;%d;%s;%s;%s\n",
-			buffer, r->subnet.mask, r->device, buffer2, r->ea[0].value);
+			buffer, r->subnet.mask, device_name(r->device), buffer2, r->ea[0].value);
 	for (i = 1; i < r->ea_nr; i++)
 		fprintf(output, "%s%c", r->ea[i].value, (i == r->ea_nr - 1 ? '\n' : ';'));
 }
@@ -170,7 +154,7 @@ static inline int pad_buffer_out(char *out, size_t len, const char *buffer, size
 			res = len - 1;
 			memcpy(out, buffer, res);
 		} else {
-			strcpy(out, buffer);
+			memcpy(out, buffer, buff_size);
 			res = min(field_width, len - 1);
 			pad_n(out + buff_size, res - buff_size, c);
 		}
@@ -181,417 +165,594 @@ static inline int pad_buffer_out(char *out, size_t len, const char *buffer, size
 		} else {
 			pad_n(out, field_width - buff_size, c);
 			res = min(field_width, len - 1);
-			memcpy(out + field_width - buff_size, buffer, res);
+			memcpy(out + field_width - buff_size, buffer, res - (field_width - buff_size));
 		}
 	}
 	return res;
 }
 
 /*
- * helper to print Extended Attributes
- * @outbuf, @buffer_len : the output buffer and its length
- * @fmt, @i  : the Format Buffer and its index
- * @field_width, @pad_left : how to pad
- * @ea, @ea_nr : pointer to Extended Attributes and number
- * @header : do we want to print EA or EA names
- * returns :
- *	number of printed chars in outbuf
+ * -fmt strings are compiled once into a list of ops, then each route, BGP route
+ * or IPAM line is rendered from that list straight into a large output buffer
+ * a rendered line can't be longer than FMT_LINE_SIZE (including the '\n')
  */
-static int __print_ea(char *outbuf, size_t buffer_len,
-			const char *fmt, int *i,
-			int field_width, int pad_left,
-			struct ipam_ea *ea, int ea_nr,
-			int header) {
-	int k, res;
-	char sep;
-	char buffer[ST_PRINTF_MAX_STRING_SIZE];
+#define FMT_LINE_SIZE   1024
+#define FMT_OUTBUF_SIZE (256 * 1024)
+
+enum {
+	FMT_LITERAL,
+	FMT_ADDR,	/* %I, %B, %N, %L, %U */
+	FMT_PREFIX,	/* %P */
+	FMT_MASK,	/* %m */
+	FMT_MASK_DDN,	/* %M (routes, IPAM) */
+	FMT_GW,		/* %G */
+	FMT_DEVICE,	/* %D */
+	FMT_COMMENT,	/* %C */
+	FMT_EA,		/* %Onn */
+	FMT_EA_ALL,	/* %O# */
+	FMT_WEIGHT,	/* BGP %w */
+	FMT_LOCAL_PREF,	/* BGP %L */
+	FMT_AS_PATH,	/* BGP %A */
+	FMT_MED,	/* BGP %M */
+	FMT_ORIGIN,	/* BGP %o */
+	FMT_BEST01,	/* BGP %b */
+	FMT_BEST,	/* BGP %B */
+	FMT_VALID,	/* BGP %v */
+	FMT_PROTO,	/* BGP %T */
+};
+
+struct fmt_conv {
+	char c;
+	int type;
+	const char *header;
+	int comp; /* conversion takes an optional compression level */
+};
+
+static const struct fmt_conv route_fmt_convs[] = {
+	{ 'M', FMT_MASK_DDN,	"mask",		0 },
+	{ 'm', FMT_MASK,	"mask",		0 },
+	{ 'D', FMT_DEVICE,	"device",	0 },
+	{ 'C', FMT_COMMENT,	"comment",	0 },
+	{ 'U', FMT_ADDR,	"prefix",	1 },
+	{ 'L', FMT_ADDR,	"prefix",	1 },
+	{ 'I', FMT_ADDR,	"prefix",	1 },
+	{ 'B', FMT_ADDR,	"prefix",	1 },
+	{ 'N', FMT_ADDR,	"prefix",	1 },
+	{ 'P', FMT_PREFIX,	"prefix",	1 },
+	{ 'G', FMT_GW,		"GW",		1 },
+	{ 'O', FMT_EA,		NULL,		0 },
+	{ '\0' }
+};
+
+static const struct fmt_conv ipam_fmt_convs[] = {
+	{ 'M', FMT_MASK_DDN,	"mask",		0 },
+	{ 'm', FMT_MASK,	"mask",		0 },
+	{ 'I', FMT_ADDR,	"address",	1 },
+	{ 'P', FMT_PREFIX,	"prefix",	1 },
+	{ 'O', FMT_EA,		NULL,		0 },
+	{ '\0' }
+};
+
+static const struct fmt_conv bgp_fmt_convs[] = {
+	{ 'w', FMT_WEIGHT,	"WEIGHT",	0 },
+	{ 'L', FMT_LOCAL_PREF,	"LOCAL_PREF",	0 },
+	{ 'A', FMT_AS_PATH,	"AS_PATH",	0 },
+	{ 'M', FMT_MED,		"MED",		0 },
+	{ 'o', FMT_ORIGIN,	"ORIGIN",	0 },
+	{ 'b', FMT_BEST01,	"BEST",		0 },
+	{ 'B', FMT_BEST,	"BEST",		0 },
+	{ 'v', FMT_VALID,	"V",		0 },
+	{ 'T', FMT_PROTO,	"Proto",	0 },
+	{ 'm', FMT_MASK,	"Mask",		0 },
+	{ 'I', FMT_ADDR,	"IP",		1 },
+	{ 'P', FMT_PREFIX,	"prefix",	1 },
+	{ 'G', FMT_GW,		"GW",		1 },
+	{ '\0' }
+};
+
+struct fmt_op {
+	int type;
+	int field_width;
+	int pad_left;
+	int comp_level;
+	char conv;	/* the conversion char, or the separator for FMT_EA_ALL */
 	int ea_num;
-	int j = 0;
+	const char *s;	/* literal chars or header name */
+	int len;
+};
 
-	/* print all extended attributes */
-	if (fmt[*i + 2] == '#') {
-		sep = fmt[*i + 3];
-		if (sep == '\0') /* set the default separator */
-			sep = ';';
-		for (k = 0; k < ea_nr; k++) {
-			if (header)
-				res = strxcpy(buffer, ea[k].name,
-						sizeof(buffer));
-			else {
-				if (ea[k].value == NULL) {
-					buffer[0] = '\0';
-					res = 0;
-				} else
-					res = strxcpy(buffer, ea[k].value,
-							sizeof(buffer));
-			}
-			if (res >= sizeof(buffer)) {
-				debug(FMT, 1, "Warning, '%s' is truncated\n",
-						buffer);
-				res = sizeof(buffer);
-			}
-			res = pad_buffer_out(outbuf + j, buffer_len - j,
-					buffer, res, field_width, pad_left, ' ');
-			j += res;
-			if (j == buffer_len - 1) {
-				debug(FMT, 1, "Stopping after %d Extended Attributes\n", k + 1);
-				break;
-			} else if (j >= buffer_len) {
-				fprintf(stderr, "BUG in %s, buffer overflow %d > %d\n", __func__,
-					j, (int)buffer_len);
-				break;
-			}
-			if (k != ea_nr - 1) {
-				outbuf[j] = sep;
-				j++;
-			}
-		}
-		*i += 1;
-		return j;
-	} else if (isdigit(fmt[*i + 2])) {
-		/* print just One Extended Attribute */
-		ea_num = fmt[*i + 2] - '0';
-		*i += 1;
-		while (isdigit(fmt[*i + 2])) {
-			ea_num *= 10;
-			ea_num += fmt[*i + 2] - '0';
-			*i += 1;
-		}
-		if (ea_num >= ea_nr) {
-			debug(FMT, 2, "Invalid Extended Attribute number #%d, max %d\n",
-					ea_num, ea_nr);
-			return 0;
-		}
-		if (header)
-			res = strxcpy(buffer, ea[ea_num].name, sizeof(buffer));
-		else {
-			if (ea[ea_num].value == NULL) {
-				buffer[0] = '\0';
-				res = 0;
-			} else
-				res = strxcpy(buffer, ea[ea_num].value,
-						sizeof(buffer));
-		}
-		if (res >= sizeof(buffer)) {
-			debug(FMT, 1, "Warning, '%s' is truncated\n", buffer);
-			res = sizeof(buffer);
-		}
-		res = pad_buffer_out(outbuf,  buffer_len, buffer,
-				res, field_width, pad_left, ' ');
-		return res;
+struct st_fmt {
+	int header;
+	int nr_ops;
+	int max_ops;
+	struct fmt_op *ops;
+	char *literals;
+	int literals_size;
+};
+
+/* the fields of a route, bgp_route or ipam_line the ops can print */
+struct fmt_object {
+	const struct subnet *subnet;
+	const struct ip_addr *gw;
+	const char *device;
+	const struct ipam_ea *ea;
+	int ea_nr;
+	const struct bgp_route *bgp;
+};
+
+static void fmt_add_char(struct st_fmt *f, char **lit, char c)
+{
+	struct fmt_op *op;
+
+	/* literal chars are contiguous, just extend the last literal op */
+	op = (f->nr_ops ? &f->ops[f->nr_ops - 1] : NULL);
+	if (op == NULL || op->type != FMT_LITERAL) {
+		op = &f->ops[f->nr_ops++];
+		op->type = FMT_LITERAL;
+		op->s    = *lit;
+		op->len  = 0;
 	}
-	debug(FMT, 1, "Invalid char '%c' after %%O\n", fmt[*i + 2]);
-	return 0;
+	*(*lit)++ = c;
+	op->len++;
 }
 
-#define IPAM_HEADER(__val) ({ \
-	if (header) { \
-		strcpy(buffer, __val); \
-		res = strlen(buffer); \
-		res = pad_buffer_out(outbuf + j, sizeof(outbuf) - j, buffer, \
-				res, field_width, pad_left, pad_value); \
-		j += res; \
-		break; \
-	} \
-	})
-
-/* a very specialized function to print a struct route */
-static int __fprint_route_fmt(FILE *output, const struct route *r, const char *fmt, int header)
+static void free_fmt(struct st_fmt *f)
 {
-	int i, j, i2, compression_level;
-	int res, pad_left;
-	char c;
-	char outbuf[1024];
-	char buffer[ST_PRINTF_MAX_STRING_SIZE];
-	char buffer2[ST_PRINTF_MAX_STRING_SIZE];
-	struct subnet sub;
-	int field_width;
-	struct subnet v_sub;
-	char pad_value;
-	/* %I for IP */
-	/* %m for mask */
-	/* %D for device */
-	/* %g for gateway */
-	/* %C for comment */
+	st_free(f->ops, f->max_ops * sizeof(struct fmt_op));
+	st_free(f->literals, f->literals_size);
+	f->ops = NULL;
+	f->literals = NULL;
+}
+
+/*
+ * compile_fmt: compile 'fmt' into f->ops
+ * @f      : the compiled format
+ * @fmt    : the format string
+ * @convs  : the conversions known by the object type
+ * @header : compile for a header line (field names instead of values)
+ * returns:
+ *	positive on SUCCESS
+ *	negative on ENOMEM
+ */
+static int compile_fmt(struct st_fmt *f, const char *fmt, const struct fmt_conv *convs,
+		int header)
+{
+	int i, i2, k, len = strlen(fmt);
+	int pad_left, field_width;
+	struct fmt_op *op;
+	char *lit;
+
+	f->header  = header;
+	f->nr_ops  = 0;
+	f->max_ops = len + 1;
+	/* a trailing '%' is printed twice */
+	f->literals_size = len + 2;
+	f->ops = st_malloc(f->max_ops * sizeof(struct fmt_op), "fmt ops");
+	if (f->ops == NULL)
+		return -1;
+	f->literals = st_malloc(f->literals_size, "fmt literals");
+	if (f->literals == NULL) {
+		st_free(f->ops, f->max_ops * sizeof(struct fmt_op));
+		return -1;
+	}
+	lit = f->literals;
 	i = 0;
-	j = 0; /* index in outbuf */
-	while (1) {
-		c = fmt[i];
-		debug(FMT, 5, "Still to parse : '%s'\n", fmt + i);
-		if (j >= sizeof(outbuf) - 1) {
-			fprintf(stderr, "BUG in %s, buffer overrun, j=%d len=%d\n",
-					__func__, j,
-					 (int)sizeof(outbuf));
-			break;
-		/* must reserve one byte for '\n', one byte for '\0' */
-		} else if (j == sizeof(outbuf) - 2) {
-			debug(FMT, 2, "Output buffer is full, stopping\n");
-			break;
-		}
-		if (c == '\0')
-			break;
-		if (c == '%') {
-			BLOCK_FIELD_WIDTH;
-			pad_value = ' '; /*in fprint_route, pad value is alwys a space */
-			switch (fmt[i2]) {
+	while (fmt[i] != '\0') {
+		if (fmt[i] == '\\') {
+			switch (fmt[i + 1]) {
 			case '\0':
-				outbuf[j] = '%';
-				debug(FMT, 2, "End of String after a %c\n", '%');
-				j++;
+				debug(FMT, 2, "End of String after a %c\n", '\\');
+				fmt_add_char(f, &lit, '\\');
 				i--;
 				break;
-			case 'M':
-				IPAM_HEADER("mask");
-				if (r->subnet.ip_ver == IPV4_A)
-					res = mask2ddn(r->subnet.mask, buffer, sizeof(buffer));
-				else if (r->subnet.ip_ver == IPV6_A)
-					res = sprint_uint(buffer, r->subnet.mask);
-				else {
-					strcpy(buffer, "<Invalid mask>");
-					res = strlen(buffer);
-				}
-				res = pad_buffer_out(outbuf + j, sizeof(outbuf) - j - 1,
-						buffer, res, field_width, pad_left, pad_value);
-				j += res;
+			case 'n':
+				fmt_add_char(f, &lit, '\n');
 				break;
-			case 'm':
-				IPAM_HEADER("mask");
-				if (r->subnet.ip_ver == IPV4_A || r->subnet.ip_ver == IPV6_A)
-					res = sprint_uint(buffer, r->subnet.mask);
-				else {
-					strcpy(buffer, "<Invalid mask>");
-					res = strlen(buffer);
-				}
-				res = pad_buffer_out(outbuf + j, sizeof(outbuf) - j - 1,
-						buffer, res, field_width, pad_left, ' ');
-				j += res;
-				break;
-			case 'D':
-				IPAM_HEADER("device");
-				res = strlen(r->device);
-				res = pad_buffer_out(outbuf + j, sizeof(outbuf) - j - 1,
-						r->device,
-						res, field_width, pad_left, ' ');
-				j += res;
+			case 't':
+				fmt_add_char(f, &lit, '\t');
 				break;
-			case 'C':
-				IPAM_HEADER("comment");
-				if (r->ea[0].value == NULL) {
-					buffer[0] = '\0';
-					res = pad_buffer_out(outbuf + j, sizeof(outbuf) - j - 1,
-							buffer,
-							0, field_width, pad_left, ' ');
-				} else {
-					res = strlen(r->ea[0].value);
-					res = pad_buffer_out(outbuf + j, sizeof(outbuf) - j - 1,
-							r->ea[0].value,
-							res, field_width, pad_left, ' ');
-				}
-				j += res;
-				break;
-			case 'U': /* upper subnet */
-			case 'L': /* lower subnet */
-			case 'I': /* IP address */
-			case 'B': /* last IP Address of the subnet */
-			case 'N': /* network adress of the subnet */
-				IPAM_HEADER("prefix");
-				SET_IP_COMPRESSION_LEVEL(fmt[i2 + 1]);
-				copy_subnet(&v_sub, &r->subnet);
-				if (fmt[i2] == 'B')
-					last_ip(&v_sub);
-				else if (fmt[i2] == 'N')
-					first_ip(&v_sub);
-				else if (fmt[i2] == 'L')
-					previous_subnet(&v_sub);
-				else if (fmt[i2] == 'U')
-					next_subnet(&v_sub);
-				res = subnet2str(&v_sub, buffer, sizeof(buffer), compression_level);
-				res = pad_buffer_out(outbuf + j, sizeof(outbuf) - j - 1, buffer,
-						res, field_width, pad_left, ' ');
-				j += res;
-				break;
-			case 'P': /* Prefix */
-				IPAM_HEADER("prefix");
-				SET_IP_COMPRESSION_LEVEL(fmt[i2 + 1]);
-				subnet2str(&r->subnet, buffer2, sizeof(buffer2), compression_level);
-				res = sprintf(buffer, "%s/%d", buffer2, (int)r->subnet.mask);
-				res = pad_buffer_out(outbuf + j, sizeof(outbuf) - j - 1, buffer,
-						res, field_width, pad_left, ' ');
-				j += res;
-				break;
-			case 'G':
-				IPAM_HEADER("GW");
-				SET_IP_COMPRESSION_LEVEL(fmt[i2 + 1]);
-				copy_ipaddr(&sub.ip_addr, &r->gw);
-				sub.ip_ver = r->subnet.ip_ver;
-				res = subnet2str(&sub, buffer, sizeof(buffer), compression_level);
-				res = pad_buffer_out(outbuf + j, sizeof(outbuf) - j - 1, buffer,
-						res, field_width, pad_left, ' ');
-				j += res;
-				break;
-			case 'O': /* Extended Attribute */
-				res = __print_ea(outbuf + j, sizeof(outbuf) - j - 1,
-						fmt, &i,
-						field_width, pad_left,
-						r->ea, r->ea_nr,
-						header);
-				j += res;
+			case ' ':
+				fmt_add_char(f, &lit, ' ');
 				break;
 			default:
-				debug(FMT, 2, "%c is not a valid char after a %c\n", fmt[i2], '%');
-				outbuf[j++] = '%';
-				if (j < sizeof(outbuf) - 2)
-					outbuf[j++] = fmt[i2];
+				debug(FMT, 2, "%c is not a valid char after a %c\n", fmt[i + 1], '\\');
+				fmt_add_char(f, &lit, fmt[i + 1]);
 				break;
-			} /* switch */
+			}
 			i += 2;
-		} else if (c == '\\') {
-			BLOCK_ESCAPE_CHAR;
-		} else {
-			outbuf[j++] = c;
+			continue;
+		} else if (fmt[i] != '%') {
+			fmt_add_char(f, &lit, fmt[i]);
 			i++;
+			continue;
+		}
+		i2 = i + 1;
+		pad_left = 0;
+		field_width = 0;
+		if (fmt[i2] == '\0') {
+			debug(FMT, 2, "End of String after a '%c'\n", '%');
+			fmt_add_char(f, &lit, '%');
+			fmt_add_char(f, &lit, '%');
+			break;
+		} else if (fmt[i2] == '-') {
+			pad_left = 1;
+			i2++;
+		}
+		/* the pad value is always a space */
+		if (fmt[i2] == '0')
+			i2++;
+		while (isdigit(fmt[i2])) {
+			field_width *= 10;
+			field_width += fmt[i2] - '0';
+			i2++;
+		}
+		debug(FMT, 6, "Field width Int is '%d', padding is %s\n", field_width,
+				(pad_left ? "left" : "right"));
+		if (fmt[i2] == '\0') {
+			debug(FMT, 2, "End of String after a %c\n", '%');
+			fmt_add_char(f, &lit, '%');
+			break;
+		}
+		for (k = 0; convs[k].c != '\0'; k++)
+			if (convs[k].c == fmt[i2])
+				break;
+		if (convs[k].c == '\0') {
+			debug(FMT, 2, "%c is not a valid char after a %%\n", fmt[i2]);
+			fmt_add_char(f, &lit, '%');
+			fmt_add_char(f, &lit, fmt[i2]);
+			i = i2 + 1;
+			continue;
 		}
+		i = i2 + 1;
+		op = &f->ops[f->nr_ops];
+		op->type	= convs[k].type;
+		op->conv	= convs[k].c;
+		op->field_width = field_width;
+		op->pad_left	= pad_left;
+		op->comp_level	= 3;
+		op->s		= convs[k].header;
+		op->len		= (op->s ? strlen(op->s) : 0);
+		/* on a header line, the compression level is not parsed */
+		if (convs[k].comp && !header && fmt[i] >= '0' && fmt[i] <= '4')
+			op->comp_level = fmt[i++] - '0';
+		if (op->type == FMT_EA) {
+			if (fmt[i] == '#') {
+				/* the separator is printed once more after the last EA */
+				op->type = FMT_EA_ALL;
+				op->conv = (fmt[i + 1] == '\0' ? ';' : fmt[i + 1]);
+				i++;
+			} else if (isdigit(fmt[i])) {
+				op->ea_num = 0;
+				while (isdigit(fmt[i])) {
+					op->ea_num *= 10;
+					op->ea_num += fmt[i] - '0';
+					i++;
+				}
+			} else {
+				debug(FMT, 1, "Invalid char '%c' after %%O\n", fmt[i]);
+				continue;
+			}
+		}
+		f->nr_ops++;
 	}
-	outbuf[j++] = '\n';
-	outbuf[j] = '\0';
-	return fputs(outbuf, output);
+	return 1;
 }
 
-int fprint_route_fmt(FILE *output, const struct route *r, const char *fmt)
+/*
+ * render Extended Attributes
+ * @outbuf, @buffer_len : the output buffer and its length
+ * @op : the FMT_EA or FMT_EA_ALL op
+ * @ea, @ea_nr : pointer to Extended Attributes and number
+ * @header : do we want to print EA or EA names
+ * returns :
+ *	number of printed chars in outbuf
+ */
+static int __print_ea(char *outbuf, size_t buffer_len, const struct fmt_op *op,
+		const struct ipam_ea *ea, int ea_nr, int header)
 {
-	return __fprint_route_fmt(output, r, fmt, 0);
-}
+	int k, res;
+	int j = 0;
+	const char *s;
 
-int fprint_route_header(FILE *output, const struct route *r, const char *fmt)
-{
-	return __fprint_route_fmt(output, r, fmt, 1);
+	for (k = (op->type == FMT_EA_ALL ? 0 : op->ea_num); k < ea_nr; k++) {
+		s = (header ? ea[k].name : ea[k].value);
+		if (s == NULL)
+			s = "";
+		res = strlen(s);
+		if (res >= ST_PRINTF_MAX_STRING_SIZE) {
+			debug(FMT, 1, "Warning, '%s' is truncated\n", s);
+			res = ST_PRINTF_MAX_STRING_SIZE - 1;
+		}
+		res = pad_buffer_out(outbuf + j, buffer_len - j,
+				s, res, op->field_width, op->pad_left, ' ');
+		j += res;
+		if (op->type == FMT_EA)
+			return j;
+		if (j == buffer_len - 1) {
+			debug(FMT, 1, "Stopping after %d Extended Attributes\n", k + 1);
+			break;
+		} else if (j >= buffer_len) {
+			fprintf(stderr, "BUG in %s, buffer overflow %d > %d\n", __func__,
+				j, (int)buffer_len);
+			break;
+		}
+		if (k != ea_nr - 1) {
+			outbuf[j] = op->conv;
+			j++;
+		}
+	}
+	if (op->type == FMT_EA)
+		debug(FMT, 2, "Invalid Extended Attribute number #%d, max %d\n",
+				op->ea_num, ea_nr);
+	return j;
 }
 
-static int __fprint_ipam_fmt(FILE *output, const struct ipam_line *r,
-		const char *fmt, int header)
+/*
+ * render one line of 'o' in outbuf, which must be FMT_LINE_SIZE bytes
+ * returns :
+ *	number of chars in outbuf, including the final '\n'
+ *	0 if an address of 'o' can't be printed, the line is then skipped
+ */
+static int fmt_render(char *outbuf, const struct st_fmt *f, const struct fmt_object *o)
 {
-	int i, j, i2, compression_level;
-	int res, pad_left;
-	char c;
-	char outbuf[1024];
+	int i, j, res, len;
 	char buffer[ST_PRINTF_MAX_STRING_SIZE];
-	char buffer2[ST_PRINTF_MAX_STRING_SIZE];
-	int field_width;
+	char *b;
+	const char *s;
+	const struct fmt_op *op;
 	struct subnet v_sub;
-	char pad_value;
-	/* %I for IP */
-	/* %m for mask */
-	/* %00....9 for extanded attributes */
-	i = 0;
+
 	j = 0; /* index in outbuf */
-	while (1) {
-		c = fmt[i];
-		debug(FMT, 5, "Still to parse : '%s'\n", fmt + i);
-		if (j >= sizeof(outbuf) - 1) {
+	for (i = 0; i < f->nr_ops; i++) {
+		if (j >= FMT_LINE_SIZE - 1) {
 			fprintf(stderr, "BUG in %s, buffer overrun, j=%d len=%d\n",
-					__func__, j,
-					 (int)sizeof(outbuf));
+					__func__, j, FMT_LINE_SIZE);
+			j = FMT_LINE_SIZE - 1;
 			break;
-		} else if (j == sizeof(outbuf) - 2) {
+		/* must reserve one byte for '\n' */
+		} else if (j == FMT_LINE_SIZE - 2) {
 			debug(FMT, 2, "Output buffer is full, stopping\n");
 			break;
 		}
-		if (c == '\0')
+		op = &f->ops[i];
+		len = FMT_LINE_SIZE - j - 1;
+		if (op->type == FMT_LITERAL) {
+			res = min(op->len, FMT_LINE_SIZE - 2 - j);
+			memcpy(outbuf + j, op->s, res);
+			j += res;
+			continue;
+		}
+		if (op->type == FMT_EA || op->type == FMT_EA_ALL) {
+			j += __print_ea(outbuf + j, len, op, o->ea, o->ea_nr, f->header);
+			continue;
+		}
+		if (f->header) {
+			j += pad_buffer_out(outbuf + j, len + 1, op->s, op->len,
+					op->field_width, op->pad_left, ' ');
+			continue;
+		}
+		/* without padding and with room left, values are rendered in place */
+		if (op->field_width == 0 && len > ST_PRINTF_MAX_STRING_SIZE)
+			b = outbuf + j;
+		else
+			b = buffer;
+		s = b;
+		switch (op->type) {
+		case FMT_ADDR:
+			copy_subnet(&v_sub, o->subnet);
+			if (op->conv == 'B')
+				last_ip(&v_sub);
+			else if (op->conv == 'N')
+				first_ip(&v_sub);
+			else if (op->conv == 'L')
+				previous_subnet(&v_sub);
+			else if (op->conv == 'U')
+				next_subnet(&v_sub);
+			res = subnet2str(&v_sub, b, sizeof(buffer), op->comp_level);
 			break;
-		if (c == '%') {
-			BLOCK_FIELD_WIDTH;
-			pad_value = ' '; /*in fprint_route, pad value is alwys a space */
-			switch (fmt[i2]) {
-			case '\0':
-				outbuf[j] = '%';
-				debug(FMT, 2, "End of String after a %c\n", '%');
-				j++;
-				i--;
-				break;
-			case 'M':
-				IPAM_HEADER("mask");
-				if (r->subnet.ip_ver == IPV4_A)
-					res = mask2ddn(r->subnet.mask, buffer, sizeof(buffer));
-				else if (r->subnet.ip_ver == IPV6_A)
-					res = sprint_uint(buffer, r->subnet.mask);
-				else {
-					strcpy(buffer, "<Invalid mask>");
-					res = strlen(buffer);
-				}
-				res = pad_buffer_out(outbuf + j, sizeof(outbuf) - j - 1,
-						buffer,
-						res, field_width, pad_left, pad_value);
-				j += res;
-				break;
-			case 'm':
-				IPAM_HEADER("mask");
-				if (r->subnet.ip_ver == IPV4_A || r->subnet.ip_ver == IPV6_A)
-					res = sprint_uint(buffer, r->subnet.mask);
-				else {
-					strcpy(buffer, "<Invalid mask>");
-					res = strlen(buffer);
-				}
-				res = pad_buffer_out(outbuf + j, sizeof(outbuf) - j - 1,
-						buffer,
-						res, field_width, pad_left, ' ');
-				j += res;
-				break;
-			case 'I': /* IP address */
-				IPAM_HEADER("address");
-				SET_IP_COMPRESSION_LEVEL(fmt[i2 + 1]);
-				copy_subnet(&v_sub, &r->subnet);
-				res = subnet2str(&v_sub, buffer, sizeof(buffer), compression_level);
-				res = pad_buffer_out(outbuf + j, sizeof(outbuf) - j - 1,
-						buffer,
-						res, field_width, pad_left, ' ');
-				j += res;
-				break;
-			case 'P': /* Prefix */
-				IPAM_HEADER("prefix");
-				SET_IP_COMPRESSION_LEVEL(fmt[i2 + 1]);
-				copy_subnet(&v_sub, &r->subnet);
-				subnet2str(&v_sub, buffer2, sizeof(buffer2), compression_level);
-				res = sprintf(buffer, "%s/%d", buffer2, (int)v_sub.mask);
-				res = pad_buffer_out(outbuf + j, sizeof(outbuf) - j - 1,
-						buffer,
-						res, field_width, pad_left, ' ');
-				j += res;
-				break;
-			case 'O': /* Extended Attribute */
-				res = __print_ea(outbuf + j, sizeof(outbuf) - j - 1,
-						fmt, &i,
-						field_width, pad_left,
-						r->ea, r->ea_nr,
-						header);
-				j += res;
-				break;
-			default:
-				debug(FMT, 2, "%c is not a valid char after a %%\n", fmt[i2]);
-				outbuf[j++] = '%';
-				if (j < sizeof(outbuf) - 2)
-					outbuf[j++] = fmt[i2];
+		case FMT_PREFIX:
+			res = max(subnet2str(o->subnet, b, sizeof(buffer), op->comp_level), 0);
+			b[res++] = '/';
+			res += sprint_int(b + res, o->subnet->mask);
+			break;
+		case FMT_GW:
+			copy_ipaddr(&v_sub.ip_addr, o->gw);
+			v_sub.ip_ver = o->subnet->ip_ver;
+			res = subnet2str(&v_sub, b, sizeof(buffer), op->comp_level);
+			break;
+		case FMT_MASK_DDN:
+			if (o->subnet->ip_ver == IPV4_A) {
+				res = mask2ddn(o->subnet->mask, b, sizeof(buffer));
 				break;
-			} /* switch */
-			i += 2;
-		} else if (c == '\\') {
-			BLOCK_ESCAPE_CHAR;
-		} else {
-			outbuf[j++] = c;
-			i++;
+			}
+			/* fallthrough */
+		case FMT_MASK:
+			if (o->subnet->ip_ver == IPV4_A || o->subnet->ip_ver == IPV6_A)
+				res = sprint_uint(b, o->subnet->mask);
+			else {
+				s = "<Invalid mask>";
+				res = strlen(s);
+			}
+			break;
+		case FMT_DEVICE:
+			s = o->device;
+			res = strlen(s);
+			break;
+		case FMT_COMMENT:
+			s = (o->ea[0].value == NULL ? "" : o->ea[0].value);
+			res = strlen(s);
+			break;
+		case FMT_WEIGHT:
+			res = sprint_uint(b, o->bgp->weight);
+			break;
+		case FMT_LOCAL_PREF:
+			res = sprint_uint(b, o->bgp->LOCAL_PREF);
+			break;
+		case FMT_MED:
+			res = sprint_uint(b, o->bgp->MED);
+			break;
+		case FMT_AS_PATH:
+			s = o->bgp->AS_PATH;
+			res = strlen(s);
+			break;
+		case FMT_ORIGIN:
+			b[0] = o->bgp->origin;
+			res = 1;
+			break;
+		case FMT_BEST01:
+			s = (o->bgp->best ? "1" : "0");
+			res = 1;
+			break;
+		case FMT_BEST:
+			s = (o->bgp->best ? "Best" : "No");
+			res = strlen(s);
+			break;
+		case FMT_VALID:
+			/* never padded */
+			outbuf[j++] = (o->bgp->valid ? '1' : '0');
+			continue;
+		case FMT_PROTO:
+			s = (o->bgp->type == 'i' ? "iBGP" : "eBGP");
+			res = 4;
+			break;
+		default:
+			res = 0;
+			break;
+		}
+		if (res < 0) {
+			debug(FMT, 2, "Invalid IP version %d, line not printed\n", o->subnet->ip_ver);
+			return 0;
 		}
+		if (s == outbuf + j) {
+			j += res;
+			continue;
+		}
+		j += pad_buffer_out(outbuf + j, len, s, res,
+				op->field_width, op->pad_left, ' ');
 	}
 	outbuf[j++] = '\n';
-	outbuf[j] = '\0';
-	return fputs(outbuf, output);
+	return j;
+}
+
+static void route_fmt_object(struct fmt_object *o, const struct route *r)
+{
+	o->subnet = &r->subnet;
+	o->gw	  = &r->gw;
+	o->device = device_name(r->device);
+	o->ea	  = r->ea;
+	o->ea_nr  = r->ea_nr;
+	o->bgp	  = NULL;
+}
+
+static void ipam_fmt_object(struct fmt_object *o, const struct ipam_line *r)
+{
+	o->subnet = &r->subnet;
+	o->gw	  = NULL;
+	o->device = NULL;
+	o->ea	  = r->ea;
+	o->ea_nr  = r->ea_nr;
+	o->bgp	  = NULL;
+}
+
+static void bgp_fmt_object(struct fmt_object *o, const struct bgp_route *r)
+{
+	o->subnet = (r ? &r->subnet : NULL);
+	o->gw	  = (r ? &r->gw : NULL);
+	o->device = NULL;
+	o->ea	  = NULL;
+	o->ea_nr  = 0;
+	o->bgp	  = r;
+}
+
+/*
+ * large output buffer, lines are rendered in place and written by big chunks
+ */
+struct fmt_outbuf {
+	FILE *output;
+	char *buf;
+	size_t size;
+	size_t len;
+	char line[FMT_LINE_SIZE]; /* used if 'buf' can't be allocated */
+};
+
+static void init_fmt_outbuf(struct fmt_outbuf *ob, FILE *output)
+{
+	ob->output = output;
+	ob->len	   = 0;
+	ob->size   = FMT_OUTBUF_SIZE;
+	ob->buf	   = st_malloc(ob->size, "fmt outbuf");
+	if (ob->buf == NULL) {
+		ob->buf  = ob->line;
+		ob->size = sizeof(ob->line);
+	}
+}
+
+static void flush_fmt_outbuf(struct fmt_outbuf *ob)
+{
+	if (ob->len)
+		fwrite(ob->buf, 1, ob->len, ob->output);
+	ob->len = 0;
+}
+
+static void free_fmt_outbuf(struct fmt_outbuf *ob)
+{
+	flush_fmt_outbuf(ob);
+	if (ob->buf != ob->line)
+		st_free(ob->buf, ob->size);
+	ob->buf = NULL;
+}
+
+/* render one line at the end of 'ob', flushing it first if it has no room left */
+static inline void fmt_outbuf_render(struct fmt_outbuf *ob, const struct st_fmt *f,
+		const struct fmt_object *o)
+{
+	if (ob->size - ob->len < FMT_LINE_SIZE)
+		flush_fmt_outbuf(ob);
+	ob->len += fmt_render(ob->buf + ob->len, f, o);
+}
+
+/* print a single line with a throw away compiled fmt */
+static int fprint_fmt_line(FILE *output, const struct fmt_object *o, const char *fmt,
+		const struct fmt_conv *convs, int header)
+{
+	struct st_fmt f;
+	char outbuf[FMT_LINE_SIZE];
+	int res;
+
+	if (compile_fmt(&f, fmt, convs, header) < 0)
+		return -1;
+	res = fmt_render(outbuf, &f, o);
+	free_fmt(&f);
+	return fwrite(outbuf, 1, res, output);
+}
+
+int fprint_route_fmt(FILE *output, const struct route *r, const char *fmt)
+{
+	struct fmt_object o;
+
+	route_fmt_object(&o, r);
+	return fprint_fmt_line(output, &o, fmt, route_fmt_convs, 0);
+}
+
+int fprint_route_header(FILE *output, const struct route *r, const char *fmt)
+{
+	struct fmt_object o;
+
+	route_fmt_object(&o, r);
+	return fprint_fmt_line(output, &o, fmt, route_fmt_convs, 1);
 }
 
 int fprint_ipam_fmt(FILE *output, const struct ipam_line *r, const char *fmt)
 {
-	return __fprint_ipam_fmt(output, r, fmt, 0);
+	struct fmt_object o;
+
+	ipam_fmt_object(&o, r);
+	return fprint_fmt_line(output, &o, fmt, ipam_fmt_convs, 0);
 }
 
 int fprint_ipam_header(FILE *output, const struct ipam_line *r, const char *fmt)
 {
+	struct fmt_object o;
 	int i, a = 0;
 
 	if (strlen(fmt) < 2) {
@@ -601,191 +762,21 @@ int fprint_ipam_header(FILE *output, const struct ipam_line *r, const char *fmt)
 		a += fprintf(output, "\n");
 		return a;
 	}
-	return __fprint_ipam_fmt(output, r, fmt, 1);
+	ipam_fmt_object(&o, r);
+	return fprint_fmt_line(output, &o, fmt, ipam_fmt_convs, 1);
 }
 
-/* a very specialized function to print a struct bgp_route */
 int fprint_bgproute_fmt(FILE *output, const struct bgp_route *r, const char *fmt)
 {
-	int i, j, i2, compression_level;
-	int res, pad_left;
-	char c;
-	char outbuf[1024];
-	char buffer[ST_PRINTF_MAX_STRING_SIZE];
-	char buffer2[ST_PRINTF_MAX_STRING_SIZE];
-	struct subnet sub;
-	int field_width;
-	struct subnet v_sub;
-	char pad_value;
-	char *truc;
-	/* %P for prefix
-	 * %I for IP
-	 * %m for mask
-	 * %G for gateway
-	 * %M for MED
-	 * %L for LOCAL_PREF
-	 * %A for AS_PATH
-	 * %w for weight
-	 * %o for origin
-	 * %T for TYPE ('e' for eBGP, 'i' for iBGP)
-	 * %B for "Best/No"
-	 * %v for valid
-	 */
-	i = 0;
-	j = 0; /* index in outbuf */
-	while (1) {
-		c = fmt[i];
-		debug(FMT, 5, "Still to parse : '%s'\n", fmt + i);
-		if (j >= sizeof(outbuf) - 1) {
-			fprintf(stderr, "BUG in %s, buffer overrun, j=%d len=%d\n",
-					__func__, j,
-					 (int)sizeof(outbuf));
-			break;
-		} else if (j == sizeof(outbuf) - 2) {
-			debug(FMT, 2, "Output buffer is full, stopping\n");
-			break;
-		}
-		if (c == '\0')
-			break;
-		if (c == '%') {
-			BLOCK_FIELD_WIDTH;
-			pad_value = ' '; /*in fprint_bgp_route, pad value is alwys a space */
-			switch (fmt[i2]) {
-			case '\0':
-				outbuf[j] = '%';
-				debug(FMT, 2, "End of String after a %c\n", '%');
-				j++;
-				i--;
-				break;
-			case 'w':
-				PRINT_FILE_HEADER(WEIGHT);
-				res = sprint_uint(buffer, r->weight);
-				res = pad_buffer_out(outbuf + j, sizeof(outbuf) - j - 1, buffer,
-						res, field_width, pad_left, pad_value);
-				j += res;
-				break;
-			case 'L':
-				PRINT_FILE_HEADER(LOCAL_PREF);
-				res = sprint_uint(buffer, r->LOCAL_PREF);
-				res = pad_buffer_out(outbuf + j, sizeof(outbuf) - j - 1, buffer,
-						res, field_width, pad_left, pad_value);
-				j += res;
-				break;
-			case 'A':
-				PRINT_FILE_HEADER(AS_PATH);
-				res = strlen(r->AS_PATH);
-				res = pad_buffer_out(outbuf + j, sizeof(outbuf) - j - 1,
-						r->AS_PATH,
-						res, field_width, pad_left, ' ');
-				j += res;
-				break;
-			case 'M':
-				PRINT_FILE_HEADER(MED);
-				res = sprint_uint(buffer, r->MED);
-				res = pad_buffer_out(outbuf + j, sizeof(outbuf) - j - 1, buffer,
-						res, field_width, pad_left, pad_value);
-				j += res;
-				break;
-			case 'o':
-				PRINT_FILE_HEADER(ORIGIN);
-				buffer[0] = r->origin;
-				buffer[1] = '\0';
-				res = pad_buffer_out(outbuf + j, sizeof(outbuf) - j - 1, buffer,
-						1, field_width, pad_left, pad_value);
-				j += res;
-				break;
-			case 'b':
-				PRINT_FILE_HEADER(BEST);
-				truc = (r->best ? "1" : "0");
-				res = strlen(truc);
-				res = pad_buffer_out(outbuf + j, sizeof(outbuf) - j - 1, truc,
-						res, field_width, pad_left, ' ');
-				j += res;
-				break;
-			case 'B':
-				PRINT_FILE_HEADER(BEST);
-				truc = (r->best ? "Best" : "No");
-				res = strlen(truc);
-				res = pad_buffer_out(outbuf + j, sizeof(outbuf) - j - 1, truc,
-						res, field_width, pad_left, ' ');
-				j += res;
-				break;
-			case 'v':
-				PRINT_FILE_HEADER(V);
-					outbuf[j] = (r->valid ? '1' : '0');
-				j++;
-				break;
-			case 'T':
-				PRINT_FILE_HEADER(Proto);
-				truc = (r->type == 'i' ? "iBGP" : "eBGP");
-				res = strlen(truc);
-				res = pad_buffer_out(outbuf + j, sizeof(outbuf) - j - 1, truc,
-						res, field_width, pad_left, ' ');
-				j += res;
-				break;
-			case 'm':
-				PRINT_FILE_HEADER(Mask);
-				if (r->subnet.ip_ver == IPV4_A || r->subnet.ip_ver == IPV6_A)
-					res = sprint_uint(buffer, r->subnet.mask);
-				else {
-					strcpy(buffer, "<Invalid mask>");
-					res = strlen(buffer);
-				}
-				res = pad_buffer_out(outbuf + j, sizeof(outbuf) - j - 1, buffer,
-						res, field_width, pad_left, ' ');
-				j += res;
-				break;
-			case 'I': /* IP address */
-				PRINT_FILE_HEADER(IP);
-				SET_IP_COMPRESSION_LEVEL(fmt[i2 + 1]);
-				copy_subnet(&v_sub, &r->subnet);
-				res = subnet2str(&v_sub, buffer, sizeof(buffer), compression_level);
-				res = pad_buffer_out(outbuf + j, sizeof(outbuf) - j - 1, buffer,
-						res, field_width, pad_left, ' ');
-				j += res;
-				break;
-			case 'P': /* Prefix */
-				PRINT_FILE_HEADER(prefix);
-				SET_IP_COMPRESSION_LEVEL(fmt[i2 + 1]);
-				copy_subnet(&v_sub, &r->subnet);
-				subnet2str(&v_sub, buffer2, sizeof(buffer2), compression_level);
-				res = sprintf(buffer, "%s/%d", buffer2, (int)v_sub.mask);
-				res = pad_buffer_out(outbuf + j, sizeof(outbuf) - j - 1, buffer,
-						res, field_width, pad_left, ' ');
-				j += res;
-				break;
-			case 'G':
-				PRINT_FILE_HEADER(GW);
-				SET_IP_COMPRESSION_LEVEL(fmt[i2 + 1]);
-				copy_ipaddr(&sub.ip_addr, &r->gw);
-				sub.ip_ver = r->subnet.ip_ver;
-				res = subnet2str(&sub, buffer, sizeof(buffer), compression_level);
-				res = pad_buffer_out(outbuf + j, sizeof(outbuf) - j - 1, buffer,
-						res, field_width, pad_left, ' ');
-				j += res;
-				break;
-			default:
-				debug(FMT, 2, "%c is not a valid char after a %c\n", fmt[i2], '%');
-				outbuf[j++] = '%';
-				if (j < sizeof(outbuf) - 2)
-					outbuf[j++] = fmt[i2];
-				break;
-			} /* switch */
-			i += 2;
-		} else if (c == '\\') {
-			BLOCK_ESCAPE_CHAR;
-		} else {
-			outbuf[j++] = c;
-			i++;
-		}
-	}
-	outbuf[j++] = '\n';
-	outbuf[j] = '\0';
-	return fputs(outbuf, output);
+	struct fmt_object o;
+
+	bgp_fmt_object(&o, r);
+	return fprint_fmt_line(output, &o, fmt, bgp_fmt_convs, r == NULL);
 }
 
+
 /*
- * sadly a lot of code if common with fprint_route_fmt
+ * sadly a lot of code if common with compile_fmt/fmt_render
  * But this cannot really be avoided
  */
 static int st_vsnprintf(char *outbuf, size_t len, const char *fmt, va_list ap,
@@ -795,7 +786,6 @@ static int st_vsnprintf(char *outbuf, size_t len, const char *fmt, va_list ap,
 	int res;
 	char c;
 	char buffer[ST_PRINTF_MAX_STRING_SIZE];
-	char buffer2[ST_PRINTF_MAX_STRING_SIZE];
 	int field_width;
 	int pad_left, pad_value;
 	int o_num;
@@ -989,9 +979,10 @@ static int st_vsnprintf(char *outbuf, size_t len, const char *fmt, va_list ap,
 				SET_IP_COMPRESSION_LEVEL(fmt[i2 + 1]);
 
 				if (v_sub.ip_ver == IPV4_A || v_sub.ip_ver == IPV6_A) {
-					subnet2str(&v_sub, buffer2,
-							sizeof(buffer2), compression_level);
-					res = sprintf(buffer, "%s/%d", buffer2, (int)v_sub.mask);
+					res = max(subnet2str(&v_sub, buffer,
+							sizeof(buffer), compression_level), 0);
+					buffer[res++] = '/';
+					res += sprint_uint(buffer + res, v_sub.mask);
 				} else {
 					strcpy(buffer, "<Invalid IP/mask>");
 					res = strlen(buffer);
@@ -1124,9 +1115,111 @@ void fprint_subnet_file(FILE *output, const struct subnet_file *sf, int compress
 void fprint_subnet_file_fmt(FILE *output, const struct subnet_file *sf, const char *fmt)
 {
 	unsigned long i;
+	struct st_fmt f;
+	struct fmt_outbuf ob;
+	struct fmt_object o;
 
-	for (i = 0; i < sf->nr; i++)
-		fprint_route_fmt(output, &sf->routes[i], fmt);
+	if (compile_fmt(&f, fmt, route_fmt_convs, 0) < 0)
+		return;
+	init_fmt_outbuf(&ob, output);
+	for (i = 0; i < sf->nr; i++) {
+		route_fmt_object(&o, &sf->routes[i]);
+		fmt_outbuf_render(&ob, &f, &o);
+	}
+	free_fmt_outbuf(&ob);
+	free_fmt(&f);
+}
+
+struct route_printer {
+	struct st_fmt f;
+	struct fmt_outbuf ob;
+};
+
+struct route_printer *alloc_route_printer(FILE *output, const char *fmt)
+{
+	struct route_printer *p;
+
+	p = st_malloc(sizeof(struct route_printer), "route printer");
+	if (p == NULL)
+		return NULL;
+	if (compile_fmt(&p->f, fmt, route_fmt_convs, 0) < 0) {
+		st_free(p, sizeof(struct route_printer));
+		return NULL;
+	}
+	init_fmt_outbuf(&p->ob, output);
+	return p;
+}
+
+int route_printer_uses_ea(const struct route_printer *p, int ea_num)
+{
+	const struct fmt_op *op;
+	int i;
+
+	for (i = 0; i < p->f.nr_ops; i++) {
+		op = &p->f.ops[i];
+		if (op->type == FMT_EA_ALL)
+			return 1;
+		if (op->type == FMT_EA && op->ea_num == ea_num)
+			return 1;
+		if (op->type == FMT_COMMENT && ea_num == 0)
+			return 1;
+	}
+	return 0;
+}
+
+void route_printer_print(struct route_printer *p, const char *lead, size_t lead_len,
+		const struct route *r)
+{
+	struct fmt_outbuf *ob = &p->ob;
+	struct fmt_object o;
+	int res;
+
+	if (ob->size - ob->len < FMT_LINE_SIZE + lead_len)
+		flush_fmt_outbuf(ob);
+	/* 'lead' doesn't fit in a fallback line buffer */
+	if (ob->size < FMT_LINE_SIZE + lead_len) {
+		fwrite(lead, 1, lead_len, ob->output);
+		lead_len = 0;
+	}
+	if (lead_len)
+		memcpy(ob->buf + ob->len, lead, lead_len);
+	if (r == NULL) {
+		ob->buf[ob->len + lead_len] = '\n';
+		ob->len += lead_len + 1;
+		return;
+	}
+	route_fmt_object(&o, r);
+	res = fmt_render(ob->buf + ob->len + lead_len, &p->f, &o);
+	/* a skipped line is skipped with its lead */
+	if (res)
+		ob->len += lead_len + res;
+}
+
+void route_printer_puts(struct route_printer *p, const char *s, size_t len)
+{
+	struct fmt_outbuf *ob = &p->ob;
+
+	if (ob->size - ob->len < len)
+		flush_fmt_outbuf(ob);
+	if (ob->size < len) {
+		fwrite(s, 1, len, ob->output);
+		return;
+	}
+	memcpy(ob->buf + ob->len, s, len);
+	ob->len += len;
+}
+
+void route_printer_flush(struct route_printer *p)
+{
+	flush_fmt_outbuf(&p->ob);
+	fflush(p->ob.output);
+}
+
+void free_route_printer(struct route_printer *p)
+{
+	free_fmt_outbuf(&p->ob);
+	free_fmt(&p->f);
+	st_free(p, sizeof(struct route_printer));
 }
 
 void print_subnet_file(const struct subnet_file *sf, int compress_level)
@@ -1137,9 +1230,19 @@ void print_subnet_file(const struct subnet_file *sf, int compress_level)
 void fprint_bgp_file_fmt(FILE *output, const struct bgp_file *sf, const char *fmt)
 {
 	unsigned long i;
+	struct st_fmt f;
+	struct fmt_outbuf ob;
+	struct fmt_object o;
 
-	for (i = 0; i < sf->nr; i++)
-		fprint_bgproute_fmt(output, &sf->routes[i], fmt);
+	if (compile_fmt(&f, fmt, bgp_fmt_convs, 0) < 0)
+		return;
+	init_fmt_outbuf(&ob, output);
+	for (i = 0; i < sf->nr; i++) {
+		bgp_fmt_object(&o, &sf->routes[i]);
+		fmt_outbuf_render(&ob, &f, &o);
+	}
+	free_fmt_outbuf(&ob);
+	free_fmt(&f);
 }
 
 void print_bgp_file_fmt(const struct bgp_file *sf, const char *fmt)
@@ -1147,30 +1250,94 @@ void print_bgp_file_fmt(const struct bgp_file *sf, const char *fmt)
 	fprint_bgp_file_fmt(stdout, sf, fmt);
 }
 
+static void fprint_ipam_line(FILE *out, const struct ipam_line *l)
+{
+	int j;
+
+	st_fprintf(out, "%P;", l->subnet);
+	for (j = 0; j < l->ea_nr; j++)
+		fprintf(out, "%s;", l->ea[j].value);
+	fprintf(out, "\n");
+}
+
 static void fprint_ipam_file(FILE *out, const struct ipam_file *sf)
 {
-	unsigned long i, j;
+	unsigned long i;
 
-	for (i = 0; i < sf->nr; i++) {
-		st_fprintf(out, "%P;", sf->lines[i].subnet);
-		for (j = 0; j < sf->ea_nr; j++)
-			fprintf(out, "%s;", sf->lines[i].ea[j].value);
-		fprintf(out, "\n");
-	}
+	for (i = 0; i < sf->nr; i++)
+		fprint_ipam_line(out, &sf->lines[i]);
 }
 
 void fprint_ipam_file_fmt(FILE *output, const struct ipam_file *sf, const char *fmt)
 {
 	unsigned long i;
+	struct st_fmt f;
+	struct fmt_outbuf ob;
+	struct fmt_object o;
 
 	/* if user didnt provide a fmt, just use the simple fprint_ipam_file */
 	if (strlen(fmt) < 2)
 		return fprint_ipam_file(output, sf);
-	for (i = 0; i < sf->nr; i++)
-		fprint_ipam_fmt(output, &sf->lines[i], fmt);
+	if (compile_fmt(&f, fmt, ipam_fmt_convs, 0) < 0)
+		return;
+	init_fmt_outbuf(&ob, output);
+	for (i = 0; i < sf->nr; i++) {
+		ipam_fmt_object(&o, &sf->lines[i]);
+		fmt_outbuf_render(&ob, &f, &o);
+	}
+	free_fmt_outbuf(&ob);
+	free_fmt(&f);
 }
 
 void print_ipam_file_fmt(const struct ipam_file *sf, const char *fmt)
 {
 	fprint_ipam_file_fmt(stdout, sf, fmt);
 }
+
+struct ipam_printer {
+	struct st_fmt f;
+	struct fmt_outbuf ob;
+	int plain; /* no fmt, like fprint_ipam_file_fmt */
+};
+
+struct ipam_printer *alloc_ipam_printer(FILE *output, const char *fmt)
+{
+	struct ipam_printer *p;
+
+	p = st_malloc(sizeof(struct ipam_printer), "ipam printer");
+	if (p == NULL)
+		return NULL;
+	p->plain = (strlen(fmt) < 2);
+	if (!p->plain && compile_fmt(&p->f, fmt, ipam_fmt_convs, 0) < 0) {
+		st_free(p, sizeof(struct ipam_printer));
+		return NULL;
+	}
+	init_fmt_outbuf(&p->ob, output);
+	return p;
+}
+
+void ipam_printer_print(struct ipam_printer *p, const struct ipam_line *l)
+{
+	struct fmt_object o;
+
+	if (p->plain) {
+		fprint_ipam_line(p->ob.output, l);
+		return;
+	}
+	ipam_fmt_object(&o, l);
+	fmt_outbuf_render(&p->ob, &p->f, &o);
+}
+
+void ipam_printer_flush(struct ipam_printer *p)
+{
+	flush_fmt_outbuf(&p->ob);
+	fflush(p->ob.output);
+}
+
+void free_ipam_printer(struct ipam_printer *p)
+{
+	free_fmt_outbuf(&p->ob);
+	if (!p->plain)
+		free_fmt(&p->f);
+	st_free(p, sizeof(struct ipam_printer));
+}
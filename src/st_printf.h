@@ -46,18 +46,47 @@ void print_subnet_file(const struct subnet_file *sf, int comp_level);
 void fprint_subnet_file(FILE *output, const struct subnet_file *sf, int comp_level);
 void fprint_subnet_file_fmt(FILE *output, const struct subnet_file *sf, const char *fmt);
 
+/* route_printer: print many routes, one at a time, with the same -fmt 'fmt'
+ * the fmt is compiled once and lines are written to 'output' by big chunks
+ * route_printer_print prints 'lead_len' chars of 'lead', then 'r' with the fmt
+ * if r is NULL, only 'lead' and a newline are printed
+ * route_printer_puts prints 'len' chars of 's' as is
+ * route_printer_uses_ea tells if Extended Attribute number 'ea_num' is printed
+ * route_printer_flush writes what is buffered to 'output' now
+ * alloc_route_printer returns NULL on ENOMEM or bad fmt
+ * free_route_printer flushes what is left
+ */
+struct route_printer;
+struct route_printer *alloc_route_printer(FILE *output, const char *fmt);
+void route_printer_print(struct route_printer *p, const char *lead, size_t lead_len,
+		const struct route *r);
+void route_printer_puts(struct route_printer *p, const char *s, size_t len);
+int route_printer_uses_ea(const struct route_printer *p, int ea_num);
+void route_printer_flush(struct route_printer *p);
+void free_route_printer(struct route_printer *p);
+
 void fprint_bgp_file_fmt(FILE *output, const struct bgp_file *sf, const char *fmt);
 void print_bgp_file_fmt(const struct bgp_file *sf, const char *fmt);
 
 void fprint_ipam_file_fmt(FILE *output, const struct ipam_file *sf, const char *fmt);
 void print_ipam_file_fmt(const struct ipam_file *sf, const char *fmt);
+/* ipam_printer: route_printer for IPAM lines; a 'fmt' shorter than 2 chars prints
+ * the prefix and the EA values, like fprint_ipam_file_fmt
+ */
+struct ipam_printer;
+struct ipam_printer *alloc_ipam_printer(FILE *output, const char *fmt);
+void ipam_printer_print(struct ipam_printer *p, const struct ipam_line *l);
+void ipam_printer_flush(struct ipam_printer *p);
+void free_ipam_printer(struct ipam_printer *p);
 #define st_debug(__EVENT, __DEBUG_LEVEL, __FMT...) \
 	do { \
 		int ___x = (__D_##__EVENT); \
 		if (debugs_level[___x] >= __DEBUG_LEVEL || \
 				debugs_level[__D_ALL] >= __DEBUG_LEVEL) { \
+			flockfile(stderr); \
 			st_fprintf(stderr, "%s : ", __func__); \
 			st_fprintf(stderr, __FMT); \
+			funlockfile(stderr); \
 		} \
 	} while (0)
 
@@ -14,6 +14,9 @@
 #include <string.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
 #include "st_readline.h"
 
 //#define DEBUG_READ
@@ -61,6 +64,62 @@ struct st_file *st_open(const char *name, int buffer_size)
 	f->bp           = f->buffer;
 	f->fileno       = a;
 	f->bytes        = 0;
+	f->map          = NULL;
+	f->before_read  = NULL;
+	f->before_read_data = NULL;
+	return f;
+}
+
+struct st_file *st_mmap_open(const char *name)
+{
+	int a;
+	struct stat st;
+	struct st_file *f;
+	void *map;
+
+	if (name == NULL)
+		return NULL;
+	a = open(name, O_RDONLY);
+	if (a < 0)
+		return NULL;
+	if (fstat(a, &st) < 0 || !S_ISREG(st.st_mode) || st.st_size == 0) {
+		close(a);
+		return NULL;
+	}
+	f = malloc(sizeof(struct st_file));
+	if (f == NULL) {
+		close(a);
+		return NULL;
+	}
+	/* private writable mapping : lines are NUL-terminated in place
+	 * one more zeroed byte is reserved after the file data, so that an
+	 * unterminated last line is also NUL-terminated
+	 */
+	map = mmap(NULL, st.st_size + 1, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+	if (map != MAP_FAILED && mmap(map, st.st_size, PROT_READ | PROT_WRITE,
+				MAP_PRIVATE | MAP_FIXED, a, 0) == MAP_FAILED) {
+		munmap(map, st.st_size + 1);
+		map = MAP_FAILED;
+	}
+	if (map == MAP_FAILED) {
+		debug_read(1, "cannot mmap %s\n", name);
+		free(f);
+		close(a);
+		return NULL;
+	}
+	madvise(map, st.st_size, MADV_SEQUENTIAL);
+	f->map          = map;
+	f->map_size     = st.st_size;
+	f->end          = f->map + f->map_size;
+	f->bp           = f->map;
+	f->buffer       = NULL;
+	f->buffer_size  = 0;
+	f->endoffile    = 0;
+	f->need_discard = 0;
+	f->fileno       = a;
+	f->bytes        = 0;
+	f->before_read  = NULL;
+	f->before_read_data = NULL;
 	return f;
 }
 
@@ -68,10 +127,92 @@ void st_close(struct st_file *f)
 {
 	if (f->fileno) /* don't 'close' stdin */
 		close(f->fileno);
+	if (f->map)
+		munmap(f->map, f->map_size + 1);
 	free(f->buffer);
 	free(f);
 }
 
+/* next line of a mapped file */
+static char *mmap_getline(struct st_file *f, int *read)
+{
+	char *p, *t;
+
+	p = f->bp;
+	if (p >= f->end) {
+		f->endoffile = 1;
+		*read = 0;
+		return NULL;
+	}
+	t = memchr(p, '\n', f->end - p);
+	/* an unterminated last line is followed by the reserved zeroed byte */
+	if (t == NULL)
+		t = f->end;
+	*t = '\0';
+	f->bp = t + 1;
+	*read = t - p + 1;
+	return p;
+}
+
+char *st_getline(struct st_file *f, size_t size, int *read, int *discarded)
+{
+	if (f->map == NULL)
+		return st_getline_truncate(f, size, read, discarded);
+	*discarded = 0;
+	return mmap_getline(f, read);
+}
+
+int st_split(struct st_file *f, struct st_file *views, int n, size_t min_size)
+{
+	char *start, *cut, *t;
+	size_t len;
+	int i, k;
+
+	if (f->map == NULL || n < 1)
+		return 0;
+	len = f->end - f->bp;
+	if (min_size && len / min_size < n)
+		n = len / min_size;
+	if (n < 1)
+		n = 1;
+	start = f->bp;
+	i = 0;
+	for (k = 1; k <= n && start < f->end; k++) {
+		cut = f->end;
+		if (k < n) {
+			t = f->bp + len / n * k;
+			if (t < start) /* the previous view went past this cut */
+				continue;
+			t = memchr(t, '\n', f->end - t);
+			if (t != NULL)
+				cut = t + 1;
+		}
+		memcpy(&views[i], f, sizeof(struct st_file));
+		views[i].fileno = 0;
+		views[i].buffer = NULL;
+		views[i].bp     = start;
+		views[i].end    = cut;
+		start = cut;
+		i++;
+	}
+	return i;
+}
+
+unsigned long st_count_lines(const struct st_file *f)
+{
+	unsigned long n = 0;
+	const char *p = f->bp, *t;
+
+	while (p < f->end) {
+		t = memchr(p, '\n', f->end - p);
+		n++;
+		if (t == NULL)
+			break;
+		p = t + 1;
+	}
+	return n;
+}
+
 /* refill: refill a struct file internal buffer
  * @f  : a pointer to a struct file
  * returns:
@@ -89,6 +230,8 @@ static int refill(struct st_file *f)
 		memcpy(f->buffer, f->bp, f->bytes);
 		f->bp = f->buffer;
 	}
+	if (f->before_read)
+		f->before_read(f->before_read_data);
 	i = read(f->fileno, f->bp + f->bytes, size);
 	if (i < 0)
 		return i;
@@ -145,8 +288,10 @@ char *st_getline_truncate(struct st_file *f, size_t size, int *read, int *discar
 		discard_bytes(f);
 		f->need_discard = 0;
 	}
-	/** need to refill buffer or not **/
-	if (f->bytes <= size) {
+	/** need to refill buffer or not; a full line is returned without waiting
+	 * for more input on a pipe
+	 **/
+	if (f->bytes <= size && memchr(f->bp, '\n', f->bytes) == NULL) {
 		i = refill(f);
 		if (i < 0)
 			return NULL;
@@ -213,8 +358,10 @@ char *st_gets_truncate(struct st_file *f, char *buffer, size_t size,
 		return NULL;
 	}
 	size--; /* for NUL char */
-	/** need to refill buffer or not **/
-	if (f->bytes <= size) {
+	/** need to refill buffer or not; a full line is returned without waiting
+	 * for more input on a pipe
+	 **/
+	if (f->bytes <= size && memchr(f->bp, '\n', f->bytes) == NULL) {
 		i = refill(f);
 		if (i < 0)
 			return NULL;
@@ -9,6 +9,12 @@ struct st_file {
 	char *buffer; /* dynamic pointer (malloc'ed) */
 	char *bp; /* current pointer */
 	int buffer_size;
+	char *map; /* whole file mapping (st_mmap_open), NULL for buffered reads */
+	size_t map_size;
+	char *end; /* end of the mapping */
+	/* buffered reads : called before read(), that may block on a pipe or stdin */
+	void (*before_read)(void *data);
+	void *before_read_data;
 };
 
 
@@ -21,6 +27,16 @@ struct st_file {
  */
 struct st_file *st_open(const char *name, int buffer_size);
 
+/* st_mmap_open: open a regular file R/O and map it in memory
+ * lines are then returned in place, without copy or length limit
+ * @name : name of the file
+ * returns:
+ *	pointer to malloc struct on SUCCESS
+ *	NULL if name is NULL, is not a regular file, is empty, or on error;
+ *	callers should then use st_open
+ */
+struct st_file *st_mmap_open(const char *name);
+
 /* st_close: release resources attached to a st_file
  * @f : a pointer to a struct st_file
  */
@@ -53,5 +69,36 @@ char *st_getline_truncate(struct st_file *f, size_t size, int *read, int *discar
  */
 char *st_gets_truncate(struct st_file *f, char *buffer, size_t size,
 		int *read, int *discarded);
+
+/* st_getline: read one line from a file
+ * on a mapped file, the line is returned whole and 'size' is ignored,
+ * otherwise it is the same as st_getline_truncate
+ * @f         : struct file
+ * @size      : read at most size char on each line (buffered reads only)
+ * @read      : pointer to the number of char read (equals to strlen(s) + 1)
+ * @discarded : number of discarded chars (always 0 on a mapped file)
+ * returns:
+ *	pointer to the line
+ *	NULL on error or EOF
+ */
+char *st_getline(struct st_file *f, size_t size, int *read, int *discarded);
+
+/* st_split: split the unread part of a mapped file into views ending on a newline
+ * a view is read with st_getline like the file it comes from, and is not closed;
+ * it is valid until the file is closed
+ * @f        : a file opened with st_mmap_open
+ * @views    : an array of at least 'n' struct st_file
+ * @n        : max number of views
+ * @min_size : min size of a view, in bytes
+ * returns:
+ *	the number of views (1 if the file is too small to split)
+ *	0 if 'f' is not mapped
+ */
+int st_split(struct st_file *f, struct st_file *views, int n, size_t min_size);
+
+/* st_count_lines: count the unread lines of a mapped file or view
+ * an unterminated last line is counted
+ */
+unsigned long st_count_lines(const struct st_file *f);
 #else
 #endif
@@ -11,10 +11,78 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <pthread.h>
 #include "debug.h"
+#include "utils.h"
 #include "st_memory.h"
+#include "hash_tab.h"
 #include "st_routes.h"
 
+/* the device table never shrinks and lives as long as the process,
+ * so it is static and out of the memory accounting
+ * device_index is an open addressing index on the names, 0 is a free slot
+ */
+static char device_names[DEVICE_MAX_NR][DEVICE_NAME_LEN];
+static int device_nr = 1;
+static int device_index[2 * DEVICE_MAX_NR];
+static pthread_mutex_t device_lock = PTHREAD_MUTEX_INITIALIZER;
+
+int device_id(const char *name)
+{
+	char buffer[DEVICE_NAME_LEN];
+	unsigned h;
+	int len, id;
+
+	if (name[0] == '\0')
+		return 0;
+	len = strxcpy(buffer, name, sizeof(buffer));
+	len = min(len, (int)sizeof(buffer) - 1);
+	h = fnv_hash(buffer, len) & (2 * DEVICE_MAX_NR - 1);
+	pthread_mutex_lock(&device_lock);
+	while ((id = device_index[h]) != 0) {
+		if (!strcmp(device_names[id], buffer))
+			break;
+		h = (h + 1) & (2 * DEVICE_MAX_NR - 1);
+	}
+	if (id == 0) {
+		if (device_nr == DEVICE_MAX_NR) {
+			id = -1;
+		} else {
+			id = device_nr++;
+			strcpy(device_names[id], buffer);
+			device_index[h] = id;
+		}
+	}
+	pthread_mutex_unlock(&device_lock);
+	return id;
+}
+
+int device_find(const char *name)
+{
+	unsigned h;
+	int len, id;
+
+	if (name[0] == '\0')
+		return 0;
+	len = strlen(name);
+	if (len >= DEVICE_NAME_LEN)
+		return -1;
+	h = fnv_hash((void *)name, len) & (2 * DEVICE_MAX_NR - 1);
+	pthread_mutex_lock(&device_lock);
+	while ((id = device_index[h]) != 0) {
+		if (!strcmp(device_names[id], name))
+			break;
+		h = (h + 1) & (2 * DEVICE_MAX_NR - 1);
+	}
+	pthread_mutex_unlock(&device_lock);
+	return (id ? id : -1);
+}
+
+const char *device_name(int id)
+{
+	return device_names[id];
+}
+
 void zero_route_ea(struct route *a)
 {
 	int i;
@@ -28,9 +96,9 @@ void zero_route_ea(struct route *a)
 	a->ea_nr = ea_nr;
 }
 
-int alloc_route_ea(struct route *r, int n)
+int alloc_route_ea(struct route *r, int n, struct st_arena *a)
 {
-	r->ea = alloc_ea_array(n);
+	r->ea = alloc_ea_array_arena(a, n);
 	if (r->ea == NULL) {
 		r->ea_nr = 0;
 		return -1;
@@ -39,13 +107,21 @@ int alloc_route_ea(struct route *r, int n)
 	return 1;
 }
 
-int realloc_route_ea(struct route *r, int new_n)
+int realloc_route_ea(struct route *r, int new_n, struct st_arena *a)
 {
 	struct ipam_ea *new_ea;
 
-	new_ea = realloc_ea_array(r->ea, r->ea_nr, new_n);
-	if (new_ea == NULL) /* we don't free original ea, caller should */
-		return -1;
+	if (a) {
+		/* the old array stays in the arena */
+		new_ea = alloc_ea_array_arena(a, new_n);
+		if (new_ea == NULL)
+			return -1;
+		memcpy(new_ea, r->ea, r->ea_nr * sizeof(struct ipam_ea));
+	} else {
+		new_ea = realloc_ea_array(r->ea, r->ea_nr, new_n);
+		if (new_ea == NULL) /* we don't free original ea, caller should */
+			return -1;
+	}
 	r->ea    = new_ea;
 	r->ea_nr = new_n;
 	return 1;
@@ -57,7 +133,7 @@ int clone_route(struct route *dest, const struct route *src)
 
 	free_route(dest);
 	copy_route(dest, src);
-	res = alloc_route_ea(dest, src->ea_nr);
+	res = alloc_route_ea(dest, src->ea_nr, NULL);
 	if (res < 0)
 		return res;
 	for (i = 0; i <	dest->ea_nr; i++) {
@@ -68,17 +144,18 @@ int clone_route(struct route *dest, const struct route *src)
 	return 1;
 }
 
-int clone_route_nofree(struct route *dest, const struct route *src)
+int clone_route_nofree(struct route *dest, const struct route *src, struct st_arena *a,
+		struct st_strtab *t)
 {
 	int i, res;
 
 	copy_route(dest, src);
-	res = alloc_route_ea(dest, src->ea_nr);
+	res = alloc_route_ea(dest, src->ea_nr, a);
 	if (res < 0)
 		return res;
 	for (i = 0; i <	dest->ea_nr; i++) {
 		dest->ea[i].name  = src->ea[i].name;
-		ea_strdup(&dest->ea[i], src->ea[i].value);
+		ea_intern(t, &dest->ea[i], src->ea[i].value);
 	}
 	return 1;
 }
@@ -104,7 +181,7 @@ int is_equal_gw(struct route *r1, struct route *r2)
 		if (!ipv6_is_link_local(r1->gw.ip6))
 			return 1;
 		/* if link local adress, we must check if the device is the same */
-		return !strcmp(r1->device, r2->device);
+		return r1->device == r2->device;
 	}
 	return 0;
 }
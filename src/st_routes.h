@@ -4,29 +4,54 @@
 #include "iptools.h"
 #include "st_ea.h"
 
+/* device names are few and shared by many routes, so a route only stores
+ * the index of its device in a process-wide table; index 0 is the empty name
+ * names longer than DEVICE_NAME_LEN - 1 chars are truncated
+ */
+#define DEVICE_NAME_LEN 32
+#define DEVICE_MAX_NR   65536
+
 struct route {
 	struct subnet subnet;
-	char device[32];
 	struct ip_addr gw;
+	int device; /* index in the device table, see device_name() */
 	int ea_nr; /* number of EA */
-	struct ipam_ea *ea; /* Extended Attributes */
+	struct ipam_ea *ea; /* Extended Attributes (cold data, not in the routes array) */
 };
 
+/* device_id: get the index of device 'name', adding it to the table if needed
+ * can be called from several threads
+ * returns:
+ *	the index of 'name'
+ *	-1 if the table is full
+ */
+int device_id(const char *name);
+
+/* device_find: same as device_id, without adding 'name'
+ * returns:
+ *	the index of 'name'
+ *	-1 if there is no such device
+ */
+int device_find(const char *name);
+
+/* device_name: the name of device 'id' */
+const char *device_name(int id);
+
 
 static inline void zero_route(struct route *a)
 {
 	memset(a, 0, sizeof(struct route));
 }
 
-/* __init_route: set only required fields to zero
+/* __init_route: set the subnet, GW and device to zero, not the EA
+ * the GW is printed even if the line had none, so it is fully cleared
  * @a  : the route to init
  */
 static inline void __init_route(struct route *a)
 {
-	a->subnet.ip_ver = 0;
-	a->subnet.mask   = 0;
-	a->gw.ip_ver     = 0;
-	a->device[0]     = '\0';
+	memset(&a->subnet, 0, sizeof(a->subnet));
+	memset(&a->gw, 0, sizeof(a->gw));
+	a->device        = 0;
 }
 /* copy_route can be used if it is just moving route from one container to another
  * clone_route MUST BE used if the src route is still referenced
@@ -45,11 +70,14 @@ int clone_route(struct route *dst, const struct route *src);
 
 /* clone src into dest
  * doesnt free dest buffers, so make sure it hasnt
+ * the EA array is allocated in arena 'a' and the EA values interned in 't'
+ * (the arena and string table of dst subnet_file), or on the heap if both are NULL
  * returns:
  *	1  on success
  *	-1 on failure (ENOMEM)
  */
-int clone_route_nofree(struct route *dst, const struct route *src);
+int clone_route_nofree(struct route *dst, const struct route *src, struct st_arena *a,
+		struct st_strtab *t);
 
 void zero_route_ea(struct route *a);
 
@@ -58,22 +86,28 @@ void zero_route_ea(struct route *a);
  * Alloc memory for a route Extended Attributes
  * @r	: the route
  * @n	: the number of Extended Attributes to alloc
+ * @a	: the arena to alloc from, the heap if NULL
  * returns:
  *	1  on SUCCESS
  *	-1 on failure (ENOMEM)
  */
-int alloc_route_ea(struct route *r, int n);
+int alloc_route_ea(struct route *r, int n, struct st_arena *a);
 
 /*
  * realloc_route_ea
  * realloc memory for a route Extended Attributes
  * @r	: the route
  * @n	: the new number of Extended Attributes to alloc
+ * @a	: the arena the EA of 'r' were allocated from, the heap if NULL
  * returns:
  *	1  on SUCCESS
  *	-1 onf failure (ENOME)
  */
-int realloc_route_ea(struct route *r, int new_n);
+int realloc_route_ea(struct route *r, int new_n, struct st_arena *a);
+
+/* free_route: free the EA of a route allocated on the heap
+ * routes of a subnet_file have their EA in the file arena, they are freed with the file
+ */
 void free_route(struct route *r);
 int is_equal_gw(struct route *r1, struct route *r2);
 
@@ -36,6 +36,8 @@ int alloc_subnet_file(struct subnet_file *sf, unsigned long n)
 	}
 	sf->nr     = 0;
 	sf->max_nr = n;
+	init_arena(&sf->arena);
+	init_strtab(&sf->ea_values);
 	sf->ea	   = alloc_ea_array(1);
 	if (sf->ea == NULL) {
 		st_free(sf->routes, sf->max_nr * sizeof(struct route));
@@ -44,6 +46,11 @@ int alloc_subnet_file(struct subnet_file *sf, unsigned long n)
 	}
 	sf->ea[0].name = st_strdup("comment");
 	sf->ea_nr = 1;
+	sf->sink	= NULL;
+	sf->sink_data	= NULL;
+	sf->pushdown	= NULL;
+	sf->nr_scanned  = 0;
+	sf->nr_streamed = 0;
 	return 0;
 }
 
@@ -51,8 +58,9 @@ void free_subnet_file(struct subnet_file *sf)
 {
 	unsigned long i;
 
-	for (i = 0; i < sf->nr; i++)
-		free_route(&sf->routes[i]);
+	/* all EA of the routes are in the arena and the string table */
+	free_arena(&sf->arena);
+	free_strtab(&sf->ea_values);
 	for (i = 0; i < sf->ea_nr; i++)
 		st_free_string(sf->ea[i].name);
 	st_free(sf->routes, sf->max_nr * sizeof(struct route));
@@ -76,7 +84,7 @@ static int sf_init_route(struct subnet_file *sf, unsigned long n)
 	int res, i;
 
 	__init_route(&sf->routes[n]);
-	res = alloc_route_ea(&sf->routes[n], sf->ea_nr);
+	res = alloc_route_ea(&sf->routes[n], sf->ea_nr, &sf->arena);
 	if (res < 0) /* routes->ea will be set to NULL, and ea_nr to zero */
 		return res;
 	for (i = 0; i < sf->ea_nr; i++)
@@ -84,6 +92,31 @@ static int sf_init_route(struct subnet_file *sf, unsigned long n)
 	return 1;
 }
 
+/* set the value of 'ea'; a streamed route is dropped before the next line is read,
+ * so its values are not copied, they point into the line being parsed
+ */
+static int sf_ea_set(struct subnet_file *sf, struct ipam_ea *ea, char *s)
+{
+	if (sf->sink == NULL)
+		return ea_intern(&sf->ea_values, ea, s);
+	ea->value = s;
+	ea->len   = strlen(s) + 1;
+	return 1;
+}
+
+/* a streamed route is reused for each line : its EA array is kept, its values reset */
+static void sf_reset_stream_route(struct subnet_file *sf)
+{
+	struct route *r = &sf->routes[0];
+	int i;
+
+	__init_route(r);
+	for (i = 0; i < r->ea_nr; i++) {
+		r->ea[i].value = NULL;
+		r->ea[i].len   = 0;
+	}
+}
+
 static int netcsv_prefix_handle(char *s, void *data, struct csv_state *state)
 {
 	struct subnet_file *sf = data;
@@ -119,12 +152,23 @@ static int netcsv_mask_handle(char *s, void *data, struct csv_state *state)
 static int netcsv_device_handle(char *s, void *data, struct csv_state *state)
 {
 	struct subnet_file *sf = data;
-	int res;
+	int id;
 
-	res = strxcpy(sf->routes[sf->nr].device, s, sizeof(sf->routes[sf->nr].device));
-	if (res >= sizeof(sf->routes[sf->nr].device))
+	/* routes usually come in runs on the same device, don't look it up again */
+	if (sf->nr && !strcmp(device_name(sf->routes[sf->nr - 1].device), s)) {
+		sf->routes[sf->nr].device = sf->routes[sf->nr - 1].device;
+		return CSV_VALID_FIELD;
+	}
+	id = device_id(s);
+	if (id < 0) {
+		debug(LOAD_CSV, 1, "line %lu cannot register device '%s', more than %d devices\n",
+				state->line, s, DEVICE_MAX_NR);
+		return CSV_INVALID_FIELD_BREAK;
+	}
+	sf->routes[sf->nr].device = id;
+	if (strlen(s) >= DEVICE_NAME_LEN)
 		debug(LOAD_CSV, 2, "line %lu STRING device '%s'  too long, truncating to '%s'\n",
-				state->line, s, sf->routes[sf->nr].device);
+				state->line, s, device_name(id));
 	return CSV_VALID_FIELD;
 }
 
@@ -138,7 +182,7 @@ static int netcsv_GW_handle(char *s, void *data, struct csv_state *state)
 	/* we accept that there's no gateway but we treat it has a comment instead */
 	if (res != IPV4_A && res != IPV6_A && s[0] != '\0') {
 		/* we dont care if memory alloc failed here */
-		ea_strdup(&sf->routes[sf->nr].ea[0], s);
+		sf_ea_set(sf, &sf->routes[sf->nr].ea[0], s);
 	} else {
 		if (res == sf->routes[sf->nr].subnet.ip_ver) {/* does the gw have same IPversion*/
 			copy_ipaddr(&sf->routes[sf->nr].gw, &addr);
@@ -154,8 +198,7 @@ static int netcsv_comment_handle(char *s, void *data, struct csv_state *state)
 {
 	struct subnet_file *sf = data;
 
-	st_free_string(sf->routes[sf->nr].ea[0].value);
-	ea_strdup(&sf->routes[sf->nr].ea[0], s);
+	sf_ea_set(sf, &sf->routes[sf->nr].ea[0], s);
 	return CSV_VALID_FIELD;
 }
 
@@ -177,7 +220,7 @@ static int netcsv_ea_handler(char *s, void *data, struct csv_state *state)
 		return CSV_INVALID_FIELD_BREAK;
 	}
 	/* we dont care if memory failed on strdup; we continue */
-	ea_strdup(&sf->routes[sf->nr].ea[ea_nr], s);
+	sf_ea_set(sf, &sf->routes[sf->nr].ea[ea_nr], s);
 	debug(LOAD_CSV, 6, "Found %s = %s\n",  sf->routes[sf->nr].ea[ea_nr].name, s);
 
 	return CSV_VALID_FIELD;
@@ -196,6 +239,10 @@ static int netcsv_startofline_callback(struct csv_state *state, void *data)
 	struct subnet_file *sf = data;
 	int res;
 
+	if (sf->sink) {
+		sf_reset_stream_route(sf);
+		return 1;
+	}
 	res = sf_init_route(sf, sf->nr);
 	if (res < 0)
 		return CSV_CATASTROPHIC_FAILURE;
@@ -206,12 +253,27 @@ static int netcsv_endofline_callback(struct csv_state *state, void *data)
 {
 	struct subnet_file *sf = data;
 	struct route *new_r;
+	int res;
 
 	if (state->badline) {
 		debug(LOAD_CSV, 1, "%s : invalid line %lu\n", state->file_name, state->line);
-		free_route(&sf->routes[sf->nr]);
+		/* the EA of the line are the last objects of the arena */
+		if (sf->sink == NULL)
+			arena_rewind(&sf->arena, sf->routes[sf->nr].ea);
 		return -1;
 	}
+	if (sf->sink) {
+		state->state[0] = 0;
+		sf->nr_scanned++;
+		if (sf->pushdown && sf->pushdown->filter) {
+			res = sf->pushdown->filter(sf, &sf->routes[0], sf->sink_data);
+			if (res <= 0)
+				return (res < 0 ? CSV_CATASTROPHIC_FAILURE : CSV_CONTINUE);
+		}
+		res = sf->sink(sf, &sf->routes[0], sf->sink_data);
+		sf->nr_streamed++;
+		return (res < 0 ? CSV_CATASTROPHIC_FAILURE : res);
+	}
 	sf->nr++;
 	if  (sf->nr == sf->max_nr) {
 		if (sf->max_nr * 2 > SIZE_T_MAX / sizeof(struct route)) {
@@ -256,45 +318,137 @@ static int netcsv_validate_header(struct csv_file *cf, void *data)
 				return -1;
 		}
 	}
-	/* alloc EA for routes[0] */
+	if (sf->sink == NULL)
+		return 1;
+	/* the only route of a stream gets its EA array once */
+	if (sf_init_route(sf, 0) < 0)
+		return -1;
+	if (sf->pushdown == NULL)
+		return 1;
+	if (sf->pushdown->bind && sf->pushdown->bind(sf, sf->sink_data) < 0)
+		return -1;
+	if (sf->pushdown->ea_used == NULL)
+		return 1;
+	/* comment is field #4 and EA #0, the other EA follow */
+	for (i = 4; i < cf->num_fields_registered; i++) {
+		if (sf->pushdown->ea_used(sf, i - 4, sf->sink_data))
+			continue;
+		debug(LOAD_CSV, 3, "EA '%s' is not used, not storing it\n", sf->ea[i - 4].name);
+		cf->csv_field[i].handle = NULL;
+	}
 	return 1;
 }
 
-int load_netcsv_file(char *name, struct subnet_file *sf, struct st_options *nof)
+/* parallel load: a chunk is parsed into its own routes array, sharing the EA names of 'sf' */
+static void *netcsv_chunk_init(void *data)
+{
+	struct subnet_file *sf = data;
+	struct subnet_file *chunk;
+
+	chunk = st_malloc(sizeof(struct subnet_file), "subnet_file chunk");
+	if (chunk == NULL)
+		return NULL;
+	chunk->routes = st_malloc(sizeof(struct route) * 4096, "subnet_file");
+	if (chunk->routes == NULL) {
+		st_free(chunk, sizeof(struct subnet_file));
+		return NULL;
+	}
+	chunk->nr     = 0;
+	chunk->max_nr = 4096;
+	chunk->ea     = sf->ea;
+	chunk->ea_nr  = sf->ea_nr;
+	chunk->sink   = NULL;
+	init_arena(&chunk->arena);
+	init_strtab(&chunk->ea_values);
+	return chunk;
+}
+
+static int netcsv_chunk_merge(void *data, void *chunk_data)
+{
+	struct subnet_file *sf = data;
+	struct subnet_file *chunk = chunk_data;
+	struct route *new_r = NULL, *r;
+	unsigned long i, n;
+	int j, res = 1;
+
+	/* keep one free slot, like netcsv_endofline_callback */
+	n = sf->nr + chunk->nr + 1;
+	if (n > sf->max_nr) {
+		if (n <= SIZE_T_MAX / sizeof(struct route))
+			new_r = st_realloc(sf->routes, sizeof(struct route) * n,
+					sizeof(struct route) * sf->max_nr, "struct route");
+		if (new_r == NULL) {
+			chunk->nr = 0;
+			res = CSV_CATASTROPHIC_FAILURE;
+		} else {
+			sf->routes = new_r;
+			sf->max_nr = n;
+		}
+	}
+	memcpy(&sf->routes[sf->nr], chunk->routes, chunk->nr * sizeof(struct route));
+	/* EA values move from the chunk string table to the one of 'sf' */
+	for (i = 0; i < chunk->nr; i++) {
+		r = &sf->routes[sf->nr + i];
+		for (j = 0; j < r->ea_nr; j++)
+			ea_intern(&sf->ea_values, &r->ea[j], r->ea[j].value);
+	}
+	sf->nr += chunk->nr;
+	arena_splice(&sf->arena, &chunk->arena);
+	free_strtab(&chunk->ea_values);
+	st_free(chunk->routes, chunk->max_nr * sizeof(struct route));
+	st_free(chunk, sizeof(struct subnet_file));
+	return res;
+}
+
+/* setup 'cf' to parse a route file; 'cf' is released on error */
+static int init_netcsv_file(struct csv_file *cf, char *name, struct st_options *nof)
 {
-	struct csv_file cf;
-	struct csv_state state;
 	int res;
 	char *s;
 
 	if (nof->delim[1] == '\0')
-		res = init_csv_file(&cf, name, 20 + 1, nof->delim, &st_strtok_r1);
+		res = init_csv_file(cf, name, 20 + 1, nof->delim, &st_strtok_r1);
 	else
-		res = init_csv_file(&cf, name, 20 + 1, nof->delim, &st_strtok_r);
+		res = init_csv_file(cf, name, 20 + 1, nof->delim, &st_strtok_r);
 	if (res < 0)
 		return res;
-	init_csv_state(&state, name);
-	cf.is_header            = &netcsv_is_header;
-	cf.endofline_callback   = &netcsv_endofline_callback;
-	cf.startofline_callback = &netcsv_startofline_callback;
-	cf.validate_header      = &netcsv_validate_header;
-	cf.default_handler      = &netcsv_ea_handler;
+	cf->is_header            = &netcsv_is_header;
+	cf->endofline_callback   = &netcsv_endofline_callback;
+	cf->startofline_callback = &netcsv_startofline_callback;
+	cf->validate_header      = &netcsv_validate_header;
+	cf->default_handler      = &netcsv_ea_handler;
+	cf->nr_threads           = nof->nr_threads;
+	cf->chunk_init           = &netcsv_chunk_init;
+	cf->chunk_merge          = &netcsv_chunk_merge;
 	/* netcsv field may have been set by conf file */
 	s = (nof->netcsv_prefix_field[0] ? nof->netcsv_prefix_field : "prefix");
-	register_csv_field(&cf, s, 0, 1, 1, &netcsv_prefix_handle);
+	register_csv_field(cf, s, 0, 1, 1, &netcsv_prefix_handle);
 	s = (nof->netcsv_mask[0] ? nof->netcsv_mask : "mask");
-	register_csv_field(&cf, s, 0, 0, 2, &netcsv_mask_handle);
+	register_csv_field(cf, s, 0, 0, 2, &netcsv_mask_handle);
 	s = (nof->netcsv_device[0] ? nof->netcsv_device : "device");
-	register_csv_field(&cf, s, 0, 0, 0, &netcsv_device_handle);
+	register_csv_field(cf, s, 0, 0, 0, &netcsv_device_handle);
 	s = (nof->netcsv_gw[0] ? nof->netcsv_gw : "GW");
-	register_csv_field(&cf, s, 0, 0, 3, &netcsv_GW_handle);
+	register_csv_field(cf, s, 0, 0, 3, &netcsv_GW_handle);
 	s = (nof->netcsv_comment[0] ? nof->netcsv_comment : "comment");
-	register_csv_field(&cf, s, 0, 0, 4, &netcsv_comment_handle);
+	register_csv_field(cf, s, 0, 0, 4, &netcsv_comment_handle);
 
-	if (cf.csv_field == NULL) {/* failed malloc of csv_field name */
-		free_csv_file(&cf);
+	if (cf->csv_field == NULL) {/* failed malloc of csv_field name */
+		free_csv_file(cf);
 		return -2;
 	}
+	return 1;
+}
+
+int load_netcsv_file(char *name, struct subnet_file *sf, struct st_options *nof)
+{
+	struct csv_file cf;
+	struct csv_state state;
+	int res;
+
+	res = init_netcsv_file(&cf, name, nof);
+	if (res < 0)
+		return res;
+	init_csv_state(&state, name);
 	if (alloc_subnet_file(sf, 4096) < 0) {
 		free_csv_file(&cf);
 		return -2;
@@ -315,12 +469,55 @@ int load_netcsv_file(char *name, struct subnet_file *sf, struct st_options *nof)
 	return res;
 }
 
+/* a streaming sink flushes its output before the loader waits on a pipe */
+static void netcsv_stream_flush(void *data)
+{
+	struct subnet_file *sf = data;
+
+	sf->sink(sf, NULL, sf->sink_data);
+}
+
+int load_netcsv_stream(char *name, struct st_options *nof, const struct netcsv_pushdown *pd,
+		int (*sink)(struct subnet_file *sf, struct route *r, void *data), void *data)
+{
+	struct csv_file cf;
+	struct csv_state state;
+	struct subnet_file sf;
+	int res;
+
+	res = init_netcsv_file(&cf, name, nof);
+	if (res < 0)
+		return res;
+	/* the sink sees the routes in file order */
+	cf.nr_threads  = 1;
+	cf.before_read = netcsv_stream_flush;
+	init_csv_state(&state, name);
+	/* routes[0] is the only route, it is reused for each line */
+	if (alloc_subnet_file(&sf, 1) < 0) {
+		free_csv_file(&cf);
+		return -2;
+	}
+	sf.sink      = sink;
+	sf.sink_data = data;
+	sf.pushdown  = pd;
+	res = generic_load_csv(name, &cf, &state, &sf);
+	debug(TIMING, 2, "%s : %lu lines scanned, %lu valid, %lu materialized\n",
+			(name ? name : "<stdin>"), state.line, sf.nr_scanned, sf.nr_streamed);
+	if (res >= 0 && sf.nr_scanned == 0) {
+		debug(LOAD_CSV, 3, "Not a single valid line in %s", name);
+		res = -2;
+	}
+	free_subnet_file(&sf);
+	free_csv_file(&cf);
+	return res;
+}
+
 static int ipam_comment_handle(char *s, void *data, struct csv_state *state)
 {
 	struct  subnet_file *sf = data;
 
 	if (strlen(s) > 2)/* sometimes comment are fucked and a better one is in EA-Name */
-		ea_strdup(&sf->routes[sf->nr].ea[0], s);
+		sf_ea_set(sf, &sf->routes[sf->nr].ea[0], s);
 	return CSV_VALID_FIELD;
 }
 
@@ -364,21 +561,12 @@ int load_ipam_no_EA(char  *name, struct subnet_file *sf, struct st_options *nof)
 		free_csv_file(&cf);
 		return -2;
 	}
-	zero_route(&sf->routes[0]);
-	res = alloc_route_ea(&sf->routes[0], 1);
-	if (res < 0) {
-		free_subnet_file(sf);
-		free_csv_file(&cf);
-		return res;
-	}
 	res = generic_load_csv(name, &cf, &state, sf);
 	if (res < 0) {
 		free_subnet_file(sf);
 		free_csv_file(&cf);
 		return res;
 	}
-	/* we allocated one more route */
-	free_route(&sf->routes[sf->nr]);
 	free_csv_file(&cf);
 	return res;
 }
@@ -396,6 +584,9 @@ int alloc_bgp_file(struct bgp_file *sf, unsigned long n)
 	}
 	sf->nr     = 0;
 	sf->max_nr = n;
+	sf->sink	= NULL;
+	sf->sink_data	= NULL;
+	sf->nr_streamed = 0;
 	return 0;
 }
 
@@ -572,11 +763,18 @@ static int bgpcsv_endofline_callback(struct csv_state *state, void *data)
 {
 	struct bgp_file *sf = data;
 	struct bgp_route *new_r;
+	int res;
 
 	if (state->badline) {
 		debug(LOAD_CSV, 1, "%s : invalid line %lu\n", state->file_name, state->line);
 		return -1;
 	}
+	if (sf->sink) {
+		res = sf->sink(sf, &sf->routes[sf->nr], sf->sink_data);
+		sf->nr_streamed++;
+		zero_bgproute(&sf->routes[sf->nr]);
+		return (res < 0 ? CSV_CATASTROPHIC_FAILURE : res);
+	}
 	sf->nr++;
 	if  (sf->nr == sf->max_nr) {
 		if (sf->max_nr * 2 > SIZE_T_MAX / sizeof(struct bgp_route)) {
@@ -595,6 +793,49 @@ static int bgpcsv_endofline_callback(struct csv_state *state, void *data)
 	return CSV_CONTINUE;
 }
 
+static void *bgpcsv_chunk_init(void *data)
+{
+	struct bgp_file *chunk;
+
+	chunk = st_malloc(sizeof(struct bgp_file), "bgp_file chunk");
+	if (chunk == NULL)
+		return NULL;
+	if (alloc_bgp_file(chunk, 4096) < 0) {
+		st_free(chunk, sizeof(struct bgp_file));
+		return NULL;
+	}
+	zero_bgproute(&chunk->routes[0]);
+	return chunk;
+}
+
+static int bgpcsv_chunk_merge(void *data, void *chunk_data)
+{
+	struct bgp_file *sf = data;
+	struct bgp_file *chunk = chunk_data;
+	struct bgp_route *new_r = NULL;
+	unsigned long n;
+	int res = 1;
+
+	n = sf->nr + chunk->nr + 1;
+	if (n > sf->max_nr) {
+		if (n <= SIZE_T_MAX / sizeof(struct bgp_route))
+			new_r = st_realloc(sf->routes, sizeof(struct bgp_route) * n,
+					sizeof(struct bgp_route) * sf->max_nr, "bgp_route");
+		if (new_r == NULL) {
+			chunk->nr = 0;
+			res = CSV_CATASTROPHIC_FAILURE;
+		} else {
+			sf->routes = new_r;
+			sf->max_nr = n;
+		}
+	}
+	memcpy(&sf->routes[sf->nr], chunk->routes, chunk->nr * sizeof(struct bgp_route));
+	sf->nr += chunk->nr;
+	free_bgp_file(chunk);
+	st_free(chunk, sizeof(struct bgp_file));
+	return res;
+}
+
 static int bgp_field_compare(const char *s1, const char *s2)
 {
 	int i = 0;
@@ -604,34 +845,48 @@ static int bgp_field_compare(const char *s1, const char *s2)
 	return strcmp(s1 + i, s2);
 }
 
+/* setup 'cf' to parse a BGP file; 'cf' is released on error */
+static int init_bgpcsv_file(struct csv_file *cf, char *name, struct st_options *nof)
+{
+	int res;
+
+	cf->is_header = NULL;
+	res = init_csv_file(cf, name, 12, nof->delim, &st_strtok_r);
+	if (res < 0)
+		return res;
+	cf->endofline_callback   = bgpcsv_endofline_callback;
+	cf->header_field_compare = bgp_field_compare;
+	cf->nr_threads           = nof->nr_threads;
+	cf->chunk_init           = bgpcsv_chunk_init;
+	cf->chunk_merge          = bgpcsv_chunk_merge;
+	register_csv_field(cf, "prefix", 0, 0, 1, &bgpcsv_prefix_handle);
+	register_csv_field(cf, "GW", 0, 0, 1, &bgpcsv_GW_handle);
+	register_csv_field(cf, "LOCAL_PREF", 0, 0, 1, &bgpcsv_localpref_handle);
+	register_csv_field(cf, "MED", 0, 0, 1, &bgpcsv_med_handle);
+	register_csv_field(cf, "WEIGHT", 0, 0, 1, &bgpcsv_weight_handle);
+	register_csv_field(cf, "AS_PATH", 0, 0, 0, &bgpcsv_aspath_handle);
+	register_csv_field(cf, "WEIGHT", 0, 0, 1, &bgpcsv_weight_handle);
+	register_csv_field(cf, "BEST", 0, 0, 1, &bgpcsv_best_handle);
+	register_csv_field(cf, "ORIGIN", 0, 0, 1, &bgpcsv_origin_handle);
+	register_csv_field(cf, "V", 0, 0, 1, &bgpcsv_valid_handle);
+	register_csv_field(cf, "Proto", 0, 0, 1, &bgpcsv_type_handle);
+	if (cf->csv_field == NULL) {/* failed malloc of csv_field name */
+		free_csv_file(cf);
+		return -2;
+	}
+	return 1;
+}
+
 int load_bgpcsv(char  *name, struct bgp_file *sf, struct st_options *nof)
 {
 	struct csv_file cf;
 	struct csv_state state;
 	int res;
 
-	cf.is_header = NULL;
-	res = init_csv_file(&cf, name, 12, nof->delim, &st_strtok_r);
+	res = init_bgpcsv_file(&cf, name, nof);
 	if (res < 0)
 		return res;
-	cf.endofline_callback   = bgpcsv_endofline_callback;
-	cf.header_field_compare = bgp_field_compare;
 	init_csv_state(&state, name);
-	register_csv_field(&cf, "prefix", 0, 0, 1, &bgpcsv_prefix_handle);
-	register_csv_field(&cf, "GW", 0, 0, 1, &bgpcsv_GW_handle);
-	register_csv_field(&cf, "LOCAL_PREF", 0, 0, 1, &bgpcsv_localpref_handle);
-	register_csv_field(&cf, "MED", 0, 0, 1, &bgpcsv_med_handle);
-	register_csv_field(&cf, "WEIGHT", 0, 0, 1, &bgpcsv_weight_handle);
-	register_csv_field(&cf, "AS_PATH", 0, 0, 0, &bgpcsv_aspath_handle);
-	register_csv_field(&cf, "WEIGHT", 0, 0, 1, &bgpcsv_weight_handle);
-	register_csv_field(&cf, "BEST", 0, 0, 1, &bgpcsv_best_handle);
-	register_csv_field(&cf, "ORIGIN", 0, 0, 1, &bgpcsv_origin_handle);
-	register_csv_field(&cf, "V", 0, 0, 1, &bgpcsv_valid_handle);
-	register_csv_field(&cf, "Proto", 0, 0, 1, &bgpcsv_type_handle);
-	if (cf.csv_field == NULL) {/* failed malloc of csv_field name */
-		free_csv_file(&cf);
-		return -2;
-	}
 	if (alloc_bgp_file(sf, 16192) < 0) {
 		free_csv_file(&cf);
 		return -2;
@@ -649,3 +904,41 @@ int load_bgpcsv(char  *name, struct bgp_file *sf, struct st_options *nof)
 	free_csv_file(&cf);
 	return res;
 }
+
+static void bgpcsv_stream_flush(void *data)
+{
+	struct bgp_file *sf = data;
+
+	sf->sink(sf, NULL, sf->sink_data);
+}
+
+int load_bgpcsv_stream(char *name, struct st_options *nof,
+		int (*sink)(struct bgp_file *sf, struct bgp_route *r, void *data), void *data)
+{
+	struct csv_file cf;
+	struct csv_state state;
+	struct bgp_file sf;
+	int res;
+
+	res = init_bgpcsv_file(&cf, name, nof);
+	if (res < 0)
+		return res;
+	cf.nr_threads  = 1;
+	cf.before_read = bgpcsv_stream_flush;
+	init_csv_state(&state, name);
+	if (alloc_bgp_file(&sf, 1) < 0) {
+		free_csv_file(&cf);
+		return -2;
+	}
+	zero_bgproute(&sf.routes[0]);
+	sf.sink      = sink;
+	sf.sink_data = data;
+	res = generic_load_csv(name, &cf, &state, &sf);
+	if (res >= 0 && sf.nr_streamed == 0) {
+		debug(LOAD_CSV, 3, "Not a single valid line in %s", name);
+		res = -2;
+	}
+	free_bgp_file(&sf);
+	free_csv_file(&cf);
+	return res;
+}
@@ -4,29 +4,84 @@
 #include "st_options.h"
 #include "st_routes.h"
 
+struct subnet_file;
+
+/* what a streaming command tells the loader about the routes it wants
+ * (see load_netcsv_stream); all callbacks get the 'data' of the sink, and may be NULL
+ * @bind    : called once the EA of the file are known, before the first line
+ * @ea_used : EA number 'ea_num' is stored only if it returns non-zero; the columns
+ *            of the other EA are not even cut
+ * @filter  : called on each valid route before the sink; 0 drops the route,
+ *            negative aborts the load
+ */
+struct netcsv_pushdown {
+	int (*bind)(struct subnet_file *sf, void *data);
+	int (*ea_used)(struct subnet_file *sf, int ea_num, void *data);
+	int (*filter)(struct subnet_file *sf, struct route *r, void *data);
+};
+
 struct subnet_file {
 	struct route *routes;
 	unsigned long nr;
 	unsigned long max_nr; /* the number of routes that has been malloced */
 	int ea_nr;
 	struct ipam_ea *ea;
+	/* EA arrays of the routes; routes can't be freed one by one,
+	 * use sf->arena when adding EA to routes (see alloc_route_ea)
+	 */
+	struct st_arena arena;
+	/* EA values of the routes, ALL interned in this table so that they can
+	 * be compared by pointer (see ea_intern)
+	 */
+	struct st_strtab ea_values;
+	/* streaming (see load_netcsv_stream) : each valid route is handed to 'sink'
+	 * in routes[0], then dropped; its EA values then point into the line
+	 * being parsed, they are NOT interned
+	 */
+	int (*sink)(struct subnet_file *sf, struct route *r, void *data);
+	void *sink_data;
+	const struct netcsv_pushdown *pushdown;
+	unsigned long nr_scanned;  /* number of valid routes parsed */
+	unsigned long nr_streamed; /* number of routes handed to 'sink' */
 };
 
 struct bgp_file {
 	struct bgp_route *routes;
 	unsigned long nr;
 	unsigned long max_nr; /* the number of routes that has been malloced */
+	/* streaming (see load_bgpcsv_stream), like subnet_file */
+	int (*sink)(struct bgp_file *sf, struct bgp_route *r, void *data);
+	void *sink_data;
+	unsigned long nr_streamed;
 };
 
 int alloc_subnet_file(struct subnet_file *sf, unsigned long n);
 void free_subnet_file(struct subnet_file *sf);
 
 int load_netcsv_file(char *name, struct subnet_file *sf, struct st_options *nof);
+/* load_netcsv_stream: parse route file 'name' (stdin if NULL) like load_netcsv_file,
+ * but hand each valid route to 'sink' as soon as it is parsed instead of keeping it,
+ * so memory does not grow with the file; routes come in file order, on one thread
+ * 'sink' gets a subnet_file holding the EA names, and 'data'; it returns
+ * CSV_CONTINUE, CSV_END_FILE to stop reading, or negative to abort the load
+ * when 'name' is a pipe or stdin, 'sink' is also called with a NULL route before the
+ * loader waits for more input : it must then flush what it printed, and return CSV_CONTINUE
+ * 'pd' (may be NULL) filters the routes and drops unused EA before they reach the sink;
+ * with '-D timing', lines scanned and routes handed to the sink are reported
+ * returns:
+ *	positive on SUCCESS
+ *	negative if the file is invalid, has no valid route, or 'sink' failed
+ */
+int load_netcsv_stream(char *name, struct st_options *nof, const struct netcsv_pushdown *pd,
+		int (*sink)(struct subnet_file *sf, struct route *r, void *data), void *data);
 int load_ipam_no_EA(char  *name, struct subnet_file *sf, struct st_options *nof);
 
 int alloc_bgp_file(struct bgp_file *sf, unsigned long n);
 void free_bgp_file(struct bgp_file *sf);
 int load_bgpcsv(char  *name, struct bgp_file *sf, struct st_options *nof);
+/* load_bgpcsv_stream: load_netcsv_stream for BGP files */
+int load_bgpcsv_stream(char *name, struct st_options *nof,
+		int (*sink)(struct bgp_file *sf, struct bgp_route *r, void *data), void *data);
 
 #else
 #endif
@@ -0,0 +1,39 @@
+/*
+ * minimal thread helpers
+ *
+ * Copyright (C) 2015 Etienne Basset <etienne POINT basset AT ensta POINT org>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of version 2 of the GNU General Public License
+ * as published by the Free Software Foundation.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "debug.h"
+#include "st_thread.h"
+
+int run_threads(int n, void *(*fn)(void *), void *args, size_t arg_size)
+{
+	pthread_t tid[ST_MAX_THREADS];
+	char started[ST_MAX_THREADS];
+	int i, res = 0;
+
+	/* job 0 and jobs above ST_MAX_THREADS run in the calling thread */
+	started[0] = 0;
+	for (i = 1; i < n && i < ST_MAX_THREADS; i++) {
+		started[i] = 0;
+		if (pthread_create(&tid[i], NULL, fn, (char *)args + i * arg_size) == 0) {
+			started[i] = 1;
+			res++;
+		} else
+			debug(TIMING, 1, "cannot create thread %d, running its job inline\n", i);
+	}
+	for (i = 0; i < n; i++)
+		if (i >= ST_MAX_THREADS || !started[i])
+			fn((char *)args + i * arg_size);
+	for (i = 1; i < n && i < ST_MAX_THREADS; i++)
+		if (started[i])
+			pthread_join(tid[i], NULL);
+	return res;
+}
@@ -0,0 +1,20 @@
+#ifndef ST_THREAD_H
+#define ST_THREAD_H
+
+/* max number of threads accepted by option '-j' */
+#define ST_MAX_THREADS 64
+
+/* run_threads: run fn(args[i]) for i in [0, n) on n threads and wait for all of them
+ * jobs that could not get a thread are run in the calling thread
+ * jobs can call st_malloc/st_free, memory tracking is atomic (see st_memory.h)
+ * @n        : the number of jobs
+ * @fn       : the job function
+ * @args     : array of n job arguments
+ * @arg_size : sizeof one job argument
+ * returns:
+ *	the number of jobs that ran on their own thread
+ */
+int run_threads(int n, void *(*fn)(void *), void *args, size_t arg_size);
+
+#else
+#endif
@@ -0,0 +1,243 @@
+/*
+ * path-compressed binary trie on IPv4/IPv6 prefixes
+ *
+ * Copyright (C) 2015 Etienne Basset <etienne POINT basset AT ensta POINT org>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of version 2 of the GNU General Public License
+ * as published by the Free Software Foundation.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "debug.h"
+#include "iptools.h"
+#include "st_memory.h"
+#include "utils.h"
+#include "st_trie.h"
+
+/* value of bit 'n' of s; bit 0 is the most significant */
+static inline int subnet_bit(const struct subnet *s, int n)
+{
+	if (s->ip_ver == IPV4_A)
+		return (s->ip >> (31 - n)) & 1;
+	return ipv6_bit(&s->ip6, n);
+}
+
+/* number of leading bits a & b have in common, capped to 'max' */
+static inline int common_prefix_len(const struct subnet *a, const struct subnet *b, int max)
+{
+	int len;
+	unsigned x;
+	uint64_t x64;
+
+	if (a->ip_ver == IPV4_A) {
+		x = a->ip ^ b->ip;
+		len = (x ? __builtin_clz(x) : 32);
+	} else if ((x64 = a->ip6.n64[0] ^ b->ip6.n64[0]))
+		len = __builtin_clzll(x64);
+	else if ((x64 = a->ip6.n64[1] ^ b->ip6.n64[1]))
+		len = 64 + __builtin_clzll(x64);
+	else
+		len = 128;
+	return (len < max ? len : max);
+}
+
+static inline struct trie_node **trie_root(struct st_trie *t, int ip_ver)
+{
+	if (ip_ver == IPV4_A)
+		return &t->root_v4;
+	else if (ip_ver == IPV6_A)
+		return &t->root_v6;
+	return NULL;
+}
+
+int alloc_trie(struct st_trie *t, unsigned long n)
+{
+	unsigned long i;
+
+	t->root_v4 = t->root_v6 = NULL;
+	t->nr_nodes  = 0;
+	/* each insertion creates at most 2 nodes */
+	t->max_nodes = 2 * n + 1;
+	t->max_items = n;
+	t->nodes = st_malloc(t->max_nodes * sizeof(struct trie_node), "trie nodes");
+	if (t->nodes == NULL)
+		return -1;
+	t->next = st_malloc((n + 1) * sizeof(long), "trie items");
+	if (t->next == NULL) {
+		st_free(t->nodes, t->max_nodes * sizeof(struct trie_node));
+		return -1;
+	}
+	for (i = 0; i < n; i++)
+		t->next[i] = -1;
+	return 1;
+}
+
+void free_trie(struct st_trie *t)
+{
+	st_free(t->nodes, t->max_nodes * sizeof(struct trie_node));
+	st_free(t->next, (t->max_items + 1) * sizeof(long));
+	t->nodes = NULL;
+	t->next  = NULL;
+	t->root_v4 = t->root_v6 = NULL;
+	t->nr_nodes = t->max_nodes = t->max_items = 0;
+}
+
+static struct trie_node *new_trie_node(struct st_trie *t, const struct subnet *s, int mask)
+{
+	struct trie_node *node = &t->nodes[t->nr_nodes++];
+
+	copy_subnet(&node->prefix, s);
+	node->prefix.mask = mask;
+	node->child[0] = node->child[1] = NULL;
+	node->head = node->tail = -1;
+	return node;
+}
+
+static void trie_node_add_item(struct st_trie *t, struct trie_node *node, unsigned long item)
+{
+	if (node->head == -1)
+		node->head = item;
+	else
+		t->next[node->tail] = item;
+	node->tail = item;
+}
+
+int trie_insert(struct st_trie *t, const struct subnet *s, unsigned long item)
+{
+	struct trie_node **link, *node, *leaf, *glue;
+	int len = 0, mask = s->mask;
+
+	link = trie_root(t, s->ip_ver);
+	if (link == NULL || item >= t->max_items) {
+		debug(ADDRCOMP, 1, "cannot insert item %lu, ip_ver %d\n", item, s->ip_ver);
+		return -1;
+	}
+	while ((node = *link) != NULL) {
+		len = common_prefix_len(&node->prefix, s, min_t(int, node->prefix.mask, mask));
+		if (len < node->prefix.mask)
+			break;
+		if (node->prefix.mask == mask) {
+			trie_node_add_item(t, node, item);
+			return 1;
+		}
+		link = &node->child[subnet_bit(s, node->prefix.mask)];
+	}
+	leaf = new_trie_node(t, s, mask);
+	trie_node_add_item(t, leaf, item);
+	if (node == NULL) {
+		*link = leaf;
+	} else if (len == mask) {
+		/* 's' includes node */
+		leaf->child[subnet_bit(&node->prefix, mask)] = node;
+		*link = leaf;
+	} else {
+		/* node and 's' diverge at bit 'len' */
+		glue = new_trie_node(t, s, len);
+		glue->child[subnet_bit(s, len)] = leaf;
+		glue->child[subnet_bit(&node->prefix, len)] = node;
+		*link = glue;
+	}
+	return 1;
+}
+
+long trie_longest_match(const struct st_trie *t, const struct subnet *s, int max_mask)
+{
+	const struct trie_node *node;
+	long found = -1;
+
+	if (s->ip_ver == IPV4_A)
+		node = t->root_v4;
+	else if (s->ip_ver == IPV6_A)
+		node = t->root_v6;
+	else
+		return -1;
+	while (node) {
+		if (node->prefix.mask > s->mask)
+			break;
+		if (common_prefix_len(&node->prefix, s, node->prefix.mask) < node->prefix.mask)
+			break;
+		if (node->head != -1 && (int)node->prefix.mask <= max_mask)
+			found = node->head;
+		if (node->prefix.mask == s->mask)
+			break;
+		node = node->child[subnet_bit(s, node->prefix.mask)];
+	}
+	return found;
+}
+
+/* topmost node whose prefix is EQUAL to or INCLUDED in 's' */
+static const struct trie_node *trie_find_subtree(const struct st_trie *t, const struct subnet *s)
+{
+	const struct trie_node *node;
+
+	if (s->ip_ver == IPV4_A)
+		node = t->root_v4;
+	else if (s->ip_ver == IPV6_A)
+		node = t->root_v6;
+	else
+		return NULL;
+	while (node) {
+		if (node->prefix.mask >= s->mask) {
+			if (common_prefix_len(&node->prefix, s, s->mask) < s->mask)
+				return NULL;
+			return node;
+		}
+		if (common_prefix_len(&node->prefix, s, node->prefix.mask) < node->prefix.mask)
+			return NULL;
+		node = node->child[subnet_bit(s, node->prefix.mask)];
+	}
+	return NULL;
+}
+
+long trie_lookup_exact(const struct st_trie *t, const struct subnet *s)
+{
+	const struct trie_node *node = trie_find_subtree(t, s);
+
+	if (node == NULL || node->prefix.mask != s->mask)
+		return -1;
+	return node->head;
+}
+
+long trie_first_included(const struct st_trie *t, const struct subnet *s)
+{
+	const struct trie_node *node = trie_find_subtree(t, s);
+
+	/* glue nodes have two children, so an item is always found below */
+	while (node && node->head == -1)
+		node = (node->child[0] ? node->child[0] : node->child[1]);
+	return (node ? node->head : -1);
+}
+
+static long __trie_walk(const struct st_trie *t, const struct trie_node *node,
+		int (*fn)(long item, void *data), void *data)
+{
+	long item, n = 0, res;
+	int i;
+
+	for (item = node->head; item != -1; item = t->next[item]) {
+		if (fn(item, data) < 0)
+			return -1;
+		n++;
+	}
+	for (i = 0; i < 2; i++) {
+		if (node->child[i] == NULL)
+			continue;
+		res = __trie_walk(t, node->child[i], fn, data);
+		if (res < 0)
+			return res;
+		n += res;
+	}
+	return n;
+}
+
+long trie_for_each_included(const struct st_trie *t, const struct subnet *s,
+		int (*fn)(long item, void *data), void *data)
+{
+	const struct trie_node *node = trie_find_subtree(t, s);
+
+	if (node == NULL)
+		return 0;
+	return __trie_walk(t, node, fn, data);
+}
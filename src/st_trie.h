@@ -0,0 +1,98 @@
+#ifndef ST_TRIE_H
+#define ST_TRIE_H
+
+#include "iptools.h"
+
+/*
+ * path-compressed binary trie (Patricia) over struct subnet
+ * items are caller-provided indexes (usually into a subnet_file routes array)
+ * one root per address family; a node exists for each distinct prefix stored
+ * plus at most one 'glue' node per insertion (glue nodes hold no items)
+ */
+struct trie_node {
+	struct subnet prefix; /* only the first prefix.mask bits are meaningful */
+	struct trie_node *child[2];
+	long head; /* first item stored with this exact prefix, -1 if none */
+	long tail;
+};
+
+struct st_trie {
+	struct trie_node *root_v4;
+	struct trie_node *root_v6;
+	struct trie_node *nodes; /* node pool, never reallocated */
+	unsigned long nr_nodes;
+	unsigned long max_nodes;
+	long *next; /* next[i] is the next item with the same prefix as item i */
+	unsigned long max_items;
+};
+
+/* alloc_trie: setup a new trie able to hold 'n' items
+ * @t : the trie to initialize
+ * @n : the max number of items; item indexes must be < n
+ * returns:
+ *	positive on SUCCESS
+ *	negative on ENOMEM
+ */
+int alloc_trie(struct st_trie *t, unsigned long n);
+void free_trie(struct st_trie *t);
+
+/* trie_insert: store 'item' under prefix 's'
+ * items sharing a prefix are chained in insertion order
+ * @t    : the trie
+ * @s    : the prefix
+ * @item : the item index
+ * returns:
+ *	positive on SUCCESS
+ *	negative on bad item or unknown address family
+ */
+int trie_insert(struct st_trie *t, const struct subnet *s, unsigned long item);
+
+/* trie_next_item: next item sharing the same prefix as 'item'
+ * returns:
+ *	the next item, -1 if none
+ */
+static inline long trie_next_item(const struct st_trie *t, long item)
+{
+	return t->next[item];
+}
+
+/* trie_longest_match: find the longest stored prefix that EQUALS or INCLUDES 's'
+ * @t        : the trie
+ * @s        : the subnet to look up
+ * @max_mask : only consider stored prefixes with mask <= max_mask
+ *             (s->mask for EQUALS or INCLUDED, s->mask - 1 for strictly INCLUDED)
+ * returns:
+ *	the first item stored under the best prefix
+ *	-1 if no match
+ */
+long trie_longest_match(const struct st_trie *t, const struct subnet *s, int max_mask);
+
+/* trie_lookup_exact: find items whose prefix EQUALS 's'
+ * returns:
+ *	the first item stored under 's'
+ *	-1 if no match
+ */
+long trie_lookup_exact(const struct st_trie *t, const struct subnet *s);
+
+/* trie_first_included: find an item whose prefix is EQUAL to or INCLUDED in 's'
+ * returns:
+ *	the first item stored under the shortest such prefix
+ *	-1 if no match
+ */
+long trie_first_included(const struct st_trie *t, const struct subnet *s);
+
+/* trie_for_each_included: call 'fn' on each item whose prefix is EQUAL to or INCLUDED in 's'
+ * items are visited in trie order (not item order)
+ * @t    : the trie
+ * @s    : the covering subnet
+ * @fn   : the callback; a negative return value stops the walk
+ * @data : opaque pointer passed to fn
+ * returns:
+ *	number of visited items
+ *	negative if fn returned negative
+ */
+long trie_for_each_included(const struct st_trie *t, const struct subnet *s,
+		int (*fn)(long item, void *data), void *data);
+
+#else
+#endif
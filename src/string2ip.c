@@ -27,6 +27,13 @@
 #include "utils.h"
 #include "string2ip.h"
 
+/* vector parsing needs SSSE3, checked at run-time; define ST_NO_SIMD to disable */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && !defined(ST_NO_SIMD)
+#define ST_SIMD_PARSE
+#include <stdint.h>
+#include <immintrin.h>
+#endif
+
 /* used to speed-up DDN mask to int */
 static const int mask_tab[] = { [0] = 0, [128] = 1, [192] = 2, [224] = 3,
 		[240] = 4, [248] = 5, [252] = 6, [254] = 7, [255] = 8 };
@@ -775,7 +782,7 @@ try_ipv4_loop2:
 		debug(PARSEIPV6, 3,
 				"Invalid IPv6 '%s', need 6 blocks before IPv4\n",
 				s);
-		return IPV4_A;
+		return BAD_IP;
 	}
 	j = string2addrv4(s, &embedded, s_max - s);
 	if (j < 0)
@@ -801,7 +808,7 @@ end_ipv6:
 	return IPV6_A;
 }
 
-int string2addr(const char *s, struct ip_addr *addr, size_t len)
+int string2addr_scalar(const char *s, struct ip_addr *addr, size_t len)
 {
 	const char *p = s;
 	char c1, c2, c3, c4;
@@ -849,6 +856,226 @@ int string2addr(const char *s, struct ip_addr *addr, size_t len)
 	return BAD_IP;
 }
 
+#ifdef ST_SIMD_PARSE
+/*
+ * vector fast paths: they only accept the common shapes below and return 0 on
+ * anything else, even if valid, so string2addr_scalar rules stay the only rules
+ *  - IPv4 : 4 blocks of 1 to 3 digits <= 255 separated by '.'
+ *  - IPv6 : 8 blocks of 1 to 4 xdigits separated by ':', or at most 7 with one '::'
+ * the address must end at 'len' or on a '\0'
+ * strings are read 16 bytes at a time and may be read past their end, but never
+ * across a page boundary
+ */
+#define SIMD_PAGE_SIZE 4096
+#define simd_can_read(__s, __n) \
+	(((uintptr_t)(__s) & (SIMD_PAGE_SIZE - 1)) <= SIMD_PAGE_SIZE - (__n))
+
+/* pshufb control putting the digits of block i right-aligned in 32-bit lane i,
+ * for block lengths (a, b, c, d) in [1, 3]
+ */
+#define V4_B(__start, __l, __k) ((__k) >= 4 - (__l) ? (__start) + (__k) - (4 - (__l)) : 0x80)
+#define V4_LANE(__start, __l) 0x80, V4_B(__start, __l, 1), V4_B(__start, __l, 2), \
+	V4_B(__start, __l, 3)
+#define V4_CTRL(a, b, c, d) { V4_LANE(0, a), V4_LANE(a + 1, b), V4_LANE(a + b + 2, c), \
+	V4_LANE(a + b + c + 3, d) }
+#define V4_CTRL4(a, b, c) V4_CTRL(a, b, c, 1), V4_CTRL(a, b, c, 2), V4_CTRL(a, b, c, 3)
+#define V4_CTRL3(a, b) V4_CTRL4(a, b, 1), V4_CTRL4(a, b, 2), V4_CTRL4(a, b, 3)
+#define V4_CTRL2(a) V4_CTRL3(a, 1), V4_CTRL3(a, 2), V4_CTRL3(a, 3)
+
+static const unsigned char v4_shuffle[81][16] __attribute__((aligned(16))) = {
+	V4_CTRL2(1), V4_CTRL2(2), V4_CTRL2(3)
+};
+
+static int have_ssse3;
+
+__attribute__((constructor)) static void string2ip_init(void)
+{
+	__builtin_cpu_init();
+	have_ssse3 = __builtin_cpu_supports("ssse3");
+}
+
+/*
+ * classify 16 chars : masks of decimal digits, xdigits, '.' and ':'
+ * and xdigit values stored in nib (garbage for other chars)
+ */
+struct simd_class {
+	unsigned int digits, xdigits, dots, colons;
+};
+
+__attribute__((target("ssse3")))
+static inline void simd_classify(__m128i v, unsigned char *nib, struct simd_class *c)
+{
+	__m128i lo, dig, alpha;
+
+	lo    = _mm_or_si128(v, _mm_set1_epi8(0x20));
+	dig   = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)),
+			_mm_cmplt_epi8(v, _mm_set1_epi8('9' + 1)));
+	alpha = _mm_and_si128(_mm_cmpgt_epi8(lo, _mm_set1_epi8('a' - 1)),
+			_mm_cmplt_epi8(lo, _mm_set1_epi8('f' + 1)));
+	_mm_storeu_si128((__m128i *)nib, _mm_or_si128(
+				_mm_and_si128(dig, _mm_sub_epi8(v, _mm_set1_epi8('0'))),
+				_mm_andnot_si128(dig, _mm_sub_epi8(lo, _mm_set1_epi8('a' - 10)))));
+	c->digits  = _mm_movemask_epi8(dig);
+	c->xdigits = _mm_movemask_epi8(_mm_or_si128(dig, alpha));
+	c->dots    = _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('.')));
+	c->colons  = _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8(':')));
+}
+
+/* 'v' holds the first 16 chars of s */
+__attribute__((target("ssse3")))
+static int string2addrv4_simd(const char *s, struct ip_addr *addr, size_t len,
+		__m128i v, const struct simd_class *cl)
+{
+	__m128i x;
+	unsigned int mdot, n, p1, p2, p3, l1, l2, l3, l4;
+
+	mdot = cl->dots;
+	/* length of the [0-9.] run */
+	n = __builtin_ctz(~(cl->digits | mdot));
+	if (n > len)
+		n = len;
+	if (n < 7 || n > 15 || (n < len && s[n] != '\0'))
+		return 0;
+	mdot &= (1U << n) - 1;
+	if (__builtin_popcount(mdot) != 3)
+		return 0;
+	p1 = __builtin_ctz(mdot);
+	mdot &= mdot - 1;
+	p2 = __builtin_ctz(mdot);
+	mdot &= mdot - 1;
+	p3 = __builtin_ctz(mdot);
+	l1 = p1;
+	l2 = p2 - p1 - 1;
+	l3 = p3 - p2 - 1;
+	l4 = n - p3 - 1;
+	/* unsigned, so an empty block fails too */
+	if (l1 - 1 > 2 || l2 - 1 > 2 || l3 - 1 > 2 || l4 - 1 > 2)
+		return 0;
+	x = _mm_sub_epi8(v, _mm_set1_epi8('0'));
+	x = _mm_shuffle_epi8(x, _mm_load_si128((const __m128i *)
+				v4_shuffle[(l1 - 1) * 27 + (l2 - 1) * 9 + (l3 - 1) * 3 + l4 - 1]));
+	/* lane i is now 0, hundreds, tens, units of block i */
+	x = _mm_maddubs_epi16(x, _mm_setr_epi8(0, 100, 10, 1, 0, 100, 10, 1,
+				0, 100, 10, 1, 0, 100, 10, 1));
+	x = _mm_madd_epi16(x, _mm_set1_epi16(1));
+	if (_mm_movemask_epi8(_mm_cmpgt_epi32(x, _mm_set1_epi32(255))))
+		return 0;
+	x = _mm_shuffle_epi8(x, _mm_setr_epi8(12, 8, 4, 0, -1, -1, -1, -1,
+				-1, -1, -1, -1, -1, -1, -1, -1));
+	addr->ip     = _mm_cvtsi128_si32(x);
+	addr->ip_ver = IPV4_A;
+	return IPV4_A;
+}
+
+/* 'cl' and nib[4..20) describe the first 16 chars of s */
+__attribute__((target("ssse3"), no_sanitize_address))
+static int string2addrv6_simd(const char *s, struct ip_addr *addr, size_t len,
+		unsigned char *nib, const struct simd_class *cl)
+{
+	struct simd_class cl2;
+	unsigned short block[8];
+	uint64_t mcol, mx, mdbl;
+	unsigned int n, pos, c, k, l, w, nr = 0, left = 8;
+
+	mcol = cl->colons;
+	mx   = cl->xdigits;
+	/* longer addresses need the next 16 or 32 chars */
+	for (k = 16; k < 48 && ((mcol | mx) >> (k - 16)) == 0xFFFF; k += 16) {
+		if (!simd_can_read(s, k + 16))
+			return 0;
+		simd_classify(_mm_loadu_si128((const __m128i *)(s + k)), nib + 4 + k, &cl2);
+		mcol |= (uint64_t)cl2.colons << k;
+		mx   |= (uint64_t)cl2.xdigits << k;
+	}
+	/* length of the [0-9a-fA-F:] run */
+	n = __builtin_ctzll(~(mcol | mx));
+	if (n > len)
+		n = len;
+	if (n < 2 || n > 39 || (n < len && s[n] != '\0'))
+		return 0;
+	mcol &= ((uint64_t)1 << n) - 1;
+	/* bit i is set if s[i] and s[i + 1] are ':' */
+	mdbl = mcol & (mcol >> 1);
+	if (mdbl & (mdbl - 1))
+		return 0; /* ':::' or 2 '::' */
+	if ((mcol & 1) && !(mdbl & 1))
+		return 0; /* starts with a single ':' */
+	if ((mcol >> (n - 1)) & 1 && !((mdbl >> (n - 2)) & 1))
+		return 0; /* ends with a single ':' */
+	pos = 0;
+	if (mdbl & 1) {
+		left = 0;
+		pos  = 2;
+	}
+	while (pos < n) {
+		c = (mcol >> pos ? pos + __builtin_ctzll(mcol >> pos) : n);
+		l = c - pos;
+		if (l - 1 > 3 || nr == 8)
+			return 0;
+		/* the 4 nibbles ending the block, those before the block cleared */
+		memcpy(&w, nib + c, 4);
+		w &= 0xFFFFFFFFU << (8 * (4 - l));
+		block[nr++] = ((w & 0xF) << 12) | (w & 0xF00) | ((w >> 12) & 0xF0) | (w >> 24);
+		if ((mdbl >> c) & 1 && c < n) {
+			left = nr;
+			pos  = c + 2;
+		} else
+			pos = c + 1;
+	}
+	if (mdbl ? nr > 7 : nr != 8)
+		return 0;
+	/* '::' followed by 7 blocks is left to string2addr_scalar, which refuses it */
+	if (left == 0 && nr == 7)
+		return 0;
+	/* blocks right of '::' go to the end */
+	for (k = 8; nr > left; )
+		block[--k] = block[--nr];
+	while (k > left)
+		block[--k] = 0;
+	addr->ip6.n64[0] = ((uint64_t)block[0] << 48) | ((uint64_t)block[1] << 32) |
+		((uint64_t)block[2] << 16) | block[3];
+	addr->ip6.n64[1] = ((uint64_t)block[4] << 48) | ((uint64_t)block[5] << 32) |
+		((uint64_t)block[6] << 16) | block[7];
+	addr->ip_ver = IPV6_A;
+	return IPV6_A;
+}
+
+/* the first block tells IPv4 from IPv6, like in string2addr_scalar */
+__attribute__((target("ssse3"), no_sanitize_address))
+static int string2addr_simd(const char *s, struct ip_addr *addr, size_t len)
+{
+	/* nib[4 + i] is the value of s[i], nib[0..4) pads the first block */
+	unsigned char nib[4 + 48];
+	struct simd_class cl;
+	__m128i v;
+	unsigned int k;
+
+	if (!simd_can_read(s, 16))
+		return 0;
+	v = _mm_loadu_si128((const __m128i *)s);
+	simd_classify(v, nib + 4, &cl);
+	k = __builtin_ctz(~cl.digits);
+	if ((cl.dots >> k) & 1)
+		return string2addrv4_simd(s, addr, len, v, &cl);
+	memset(nib, 0, 4);
+	return string2addrv6_simd(s, addr, len, nib, &cl);
+}
+#endif
+
+int string2addr(const char *s, struct ip_addr *addr, size_t len)
+{
+#ifdef ST_SIMD_PARSE
+	int res;
+
+	if (have_ssse3) {
+		res = string2addr_simd(s, addr, len);
+		if (res)
+			return res;
+	}
+#endif
+	return string2addr_scalar(s, addr, len);
+}
+
 /*
  * returns :
  *    IPV4_A : IPv4 without mask
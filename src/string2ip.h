@@ -11,6 +11,11 @@
  **/
 int string2addr(const char *s, struct ip_addr *addr, size_t len);
 
+/* string2addr without the vector fast paths (SSSE3 on x86), same parameters and result
+ * used to cross-check and benchmark them
+ */
+int string2addr_scalar(const char *s, struct ip_addr *addr, size_t len);
+
 /* read len chars from 's' and try to convert to a subnet mask length
  * s doesnt need to be '\0' ended
  * returns :
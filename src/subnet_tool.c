@@ -18,65 +18,110 @@
 #include "utils.h"
 #include "generic_csv.h"
 #include "heap.h"
+#include "st_trie.h"
+#include "st_dir248.h"
+#include "hash_tab.h"
+#include "radix.h"
+#include "st_thread.h"
 #include "st_memory.h"
 #include "st_printf.h"
 #include "generic_expr.h"
 #include "st_scanf.h"
 #include "st_routes_csv.h"
+#include "st_extsort.h"
+#include "st_readline.h"
 #include "subnet_tool.h"
 
+static int __heap_route_index_is_superior(void *v1, void *v2)
+{
+	/* routes come from the same array, lower address means lower index */
+	return v1 < v2;
+}
+
+struct compare_walk {
+	TAS *tas;
+	struct route *routes;
+};
+
+static int compare_add_included(long j, void *data)
+{
+	struct compare_walk *cw = data;
+
+	return addTAS_may_fail(cw->tas, &cw->routes[j]);
+}
+
 /*
  * compare 2 CSV files sf1 and sf1
  * prints sf1 subnets, and subnet from sf2 that are equals or included
+ * sf2 is indexed in a prefix trie, so each sf1 route costs O(prefix length + matches)
  */
 void compare_files(struct subnet_file *sf1, struct subnet_file *sf2, struct st_options *nof)
 {
-	unsigned long i, j, found_j;
+	unsigned long i, j;
+	long found_j;
 	int res;
-	int find = 0, mask, found_mask;
+	struct st_trie trie;
+	struct compare_walk cw;
+	TAS tas;
+	struct route *r;
+
+	debug_timing_start(2);
+	res = alloc_trie(&trie, sf2->nr);
+	if (res < 0)
+		return;
+	res = alloc_tas(&tas, 64, __heap_route_index_is_superior);
+	if (res < 0) {
+		free_trie(&trie);
+		return;
+	}
+	for (j = 0; j < sf2->nr; j++)
+		trie_insert(&trie, &sf2->routes[j].subnet, j);
+	cw.tas    = &tas;
+	cw.routes = sf2->routes;
 
 	for (i = 0; i < sf1->nr; i++) {
-		find = 0;
-		found_mask = -1;
-		for (j = 0; j < sf2->nr; j++) {
-			res = subnet_compare(&sf1->routes[i].subnet, &sf2->routes[j].subnet);
-			if (res == INCLUDES) {
-				st_fprintf(nof->output_file, "%I;%m;INCLUDES;%I;%m\n",
-						sf1->routes[i].subnet, sf1->routes[i].subnet,
-						sf2->routes[j].subnet,  sf2->routes[j].subnet);
-				find = 1;
-			} else if (res == EQUALS) {
-				st_fprintf(nof->output_file, "%I;%m;EQUALS;%I;%m\n",
-						sf1->routes[i].subnet, sf1->routes[i].subnet,
-						sf2->routes[j].subnet,  sf2->routes[j].subnet);
-				find = 2;
-			} else if (res == INCLUDED) {
-				find = 1;
-				mask = sf2->routes[j].subnet.mask;
-				if (mask > found_mask) {
-					found_mask = mask;
-					found_j = j;
-				}
-			}
+		/* EQUALS and INCLUDES routes are printed in sf2 order */
+		res = trie_for_each_included(&trie, &sf1->routes[i].subnet,
+				compare_add_included, &cw);
+		if (res < 0) {
+			fprintf(stderr, "%s : no memory\n", __func__);
+			break;
 		}
-		if (find == 0)
-			st_fprintf(nof->output_file, "%I;%m;;;\n",
-					sf1->routes[i].subnet, sf1->routes[i].subnet);
-		else if (found_mask > 0)
+		while ((r = popTAS(&tas)) != NULL) {
+			st_fprintf(nof->output_file, "%I;%m;%s;%I;%m\n",
+					sf1->routes[i].subnet, sf1->routes[i].subnet,
+					(r->subnet.mask == sf1->routes[i].subnet.mask ?
+						"EQUALS" : "INCLUDES"),
+					r->subnet, r->subnet);
+		}
+		/* longest strictly including route; the first one in sf2 order wins a tie */
+		found_j = -1;
+		if (sf1->routes[i].subnet.mask > 0)
+			found_j = trie_longest_match(&trie, &sf1->routes[i].subnet,
+					sf1->routes[i].subnet.mask - 1);
+		if (found_j != -1 && sf2->routes[found_j].subnet.mask > 0)
 			st_fprintf(nof->output_file, "%I;%m;INCLUDED;%I;%m\n",
 					sf1->routes[i].subnet, sf1->routes[i].subnet,
 					sf2->routes[found_j].subnet, sf2->routes[found_j].subnet);
+		else if (res == 0 && found_j == -1)
+			st_fprintf(nof->output_file, "%I;%m;;;\n",
+					sf1->routes[i].subnet, sf1->routes[i].subnet);
 	}
+	free_tas(&tas);
+	free_trie(&trie);
+	debug_timing_end(2);
 }
 
 int subnet_file_cmp(const struct subnet_file *before, const struct subnet_file *after,
 			struct subnet_file *sf)
 {
 	unsigned long i, j, k;
+	long found_j;
 	int res, found;
 	int ea_nr;
 	char buffer[128];
 	struct ipam_ea *new_ea;
+	struct subnet_hash_table ht_before, ht_after;
 
 	k = 0;
 	res = alloc_subnet_file(sf, before->nr + after->nr);
@@ -93,70 +138,79 @@ int subnet_file_cmp(const struct subnet_file *before, const struct subnet_file *
 	if (sf->ea[sf->ea_nr - 1].name == NULL || sf->ea[sf->ea_nr - 2].name == NULL)
 		return -1;
 
+	/* hash join on the exact prefix, both ways */
+	res = alloc_subnet_hash_tab(&ht_before, before->nr);
+	if (res < 0)
+		return res;
+	res = alloc_subnet_hash_tab(&ht_after, after->nr);
+	if (res < 0) {
+		free_subnet_hash_tab(&ht_before);
+		return res;
+	}
+	for (i = 0; i < before->nr; i++)
+		insert_subnet(&ht_before, &before->routes[i].subnet, i);
+	for (j = 0; j < after->nr; j++)
+		insert_subnet(&ht_after, &after->routes[j].subnet, j);
+
 	for (i = 0; i < before->nr; i++) {
-		found = 0;
-		for (j = 0; j < after->nr; j++) {
-			res = subnet_compare(&after->routes[j].subnet, &before->routes[i].subnet);
-			if (res == EQUALS) {
-				found = 1;
-				break;
-			}
-		}
-		clone_route_nofree(&sf->routes[k], &before->routes[i]);
+		found_j = find_subnet(&ht_after, &before->routes[i].subnet);
+		found = (found_j != -1);
+		j = found_j;
+		clone_route_nofree(&sf->routes[k], &before->routes[i], &sf->arena, &sf->ea_values);
 		ea_nr = sf->routes[k].ea_nr;
-		res = realloc_route_ea(&sf->routes[k], sf->routes[k].ea_nr + 2);
+		res = realloc_route_ea(&sf->routes[k], sf->routes[k].ea_nr + 2, &sf->arena);
 		if (res < 0) {
 			sf->nr = k + 1;
-			return -1;
+			res = -1;
+			goto out;
 		}
 		sf->routes[k].ea[ea_nr].name = "status";
 		sf->routes[k].ea[ea_nr + 1].name = "change";
 		if (found == 0) {
-			ea_strdup(&sf->routes[k].ea[ea_nr], "removed");
-			ea_strdup(&sf->routes[k].ea[ea_nr + 1], "removed");
+			ea_intern(&sf->ea_values, &sf->routes[k].ea[ea_nr], "removed");
+			ea_intern(&sf->ea_values, &sf->routes[k].ea[ea_nr + 1], "removed");
 		} else {
 			if (!is_equal_gw(&after->routes[j], &before->routes[i]) &&
-					strcmp(after->routes[j].device, before->routes[i].device)) {
-				ea_strdup(&sf->routes[k].ea[ea_nr], "changed");
+					after->routes[j].device != before->routes[i].device) {
+				ea_intern(&sf->ea_values, &sf->routes[k].ea[ea_nr], "changed");
 				st_snprintf(buffer, sizeof(buffer), "new Device/GW: %s/%a",
-						after->routes[j].device, after->routes[j].gw);
-				ea_strdup(&sf->routes[k].ea[ea_nr + 1], buffer);
+						device_name(after->routes[j].device), after->routes[j].gw);
+				ea_intern(&sf->ea_values, &sf->routes[k].ea[ea_nr + 1], buffer);
 			} else if (!is_equal_gw(&after->routes[j], &before->routes[i])) {
-				ea_strdup(&sf->routes[k].ea[ea_nr], "changed");
+				ea_intern(&sf->ea_values, &sf->routes[k].ea[ea_nr], "changed");
 				st_snprintf(buffer, sizeof(buffer), "new GW: %a",
 						after->routes[j].gw);
-				ea_strdup(&sf->routes[k].ea[ea_nr + 1], buffer);
-			} else if (strcmp(after->routes[j].device, before->routes[i].device)) {
-				ea_strdup(&sf->routes[k].ea[ea_nr], "changed");
-				ea_strdup(&sf->routes[k].ea[ea_nr + 1], "new device");
+				ea_intern(&sf->ea_values, &sf->routes[k].ea[ea_nr + 1], buffer);
+			} else if (after->routes[j].device != before->routes[i].device) {
+				ea_intern(&sf->ea_values, &sf->routes[k].ea[ea_nr], "changed");
+				ea_intern(&sf->ea_values, &sf->routes[k].ea[ea_nr + 1], "new device");
 			}
 		}
 		k++;
 	}
 	for (j = 0; j < after->nr; j++) {
-		found = 0;
-		for (i = 0; i < before->nr; i++) {
-			res = subnet_compare(&after->routes[j].subnet, &before->routes[i].subnet);
-			if (res == EQUALS) {
-				found = 1;
-				break;
-			}
-		}
+		found = (find_subnet(&ht_before, &after->routes[j].subnet) != -1);
 		if (found == 0) {
-			clone_route_nofree(&sf->routes[k], &after->routes[j]);
+			clone_route_nofree(&sf->routes[k], &after->routes[j], &sf->arena,
+					&sf->ea_values);
 			ea_nr = sf->routes[k].ea_nr;
-			res = realloc_route_ea(&sf->routes[k], sf->routes[k].ea_nr + 2);
+			res = realloc_route_ea(&sf->routes[k], sf->routes[k].ea_nr + 2, &sf->arena);
 			if (res < 0) {
 				sf->nr = k + 1;
-				return -1;
+				res = -1;
+				goto out;
 			}
 			sf->routes[k].ea[ea_nr].name = "status";
-			ea_strdup(&sf->routes[k].ea[ea_nr], "new");
+			ea_intern(&sf->ea_values, &sf->routes[k].ea[ea_nr], "new");
 			k++;
 		}
 	}
 	sf->nr = k;
-	return 1;
+	res = 1;
+out:
+	free_subnet_hash_tab(&ht_before);
+	free_subnet_hash_tab(&ht_after);
+	return res;
 }
 
 static int __heap_subnet_is_superior(void *v1, void *v2)
@@ -167,12 +221,259 @@ static int __heap_subnet_is_superior(void *v1, void *v2)
 	return subnet_is_superior(s1, s2);
 }
 
-static void __heap_print_subnet(void *v)
+/* packed sort keys, compared as big-endian numbers
+ * prefix : address family, address, mask
+ * gw     : GW, then prefix
+ * mask   : mask, then prefix
+ */
+static int __route_prefix_key(unsigned char *key, const struct route *r, int addr_len)
+{
+	return subnet_sortkey(key, &r->subnet, addr_len);
+}
+
+static int __route_gw_key(unsigned char *key, const struct route *r, int addr_len)
+{
+	int len = addr_sortkey(key, &r->gw, addr_len);
+
+	return len + subnet_sortkey(key + len, &r->subnet, addr_len);
+}
+
+static int __route_mask_key(unsigned char *key, const struct route *r, int addr_len)
 {
-	struct subnet *s = &((struct route *)v)->subnet;
+	key[0] = r->subnet.mask;
+	return 1 + subnet_sortkey(key + 1, &r->subnet, addr_len);
+}
+
+#define SORTKEY_MAX_LEN 64
 
-	st_printf("%P", *s);
+/* sort a subnet file 'sf' by a packed key
+ * keys are radix sorted, so the sort is stable; equal routes keep their file order
+ * with nr_threads > 1, the sort runs on nr_threads threads and 'bounds' (if not NULL)
+ * receives the nr_threads + 1 limits of the partitions, see radix_sort_mt
+ */
+static int __subnet_sort_by(struct subnet_file *sf,
+		int keyfunc(unsigned char *key, const struct route *r, int addr_len),
+		int nr_threads, unsigned long *bounds)
+{
+	unsigned long i, *perm, local_bounds[ST_MAX_THREADS + 1];
+	unsigned char *keys, buffer[SORTKEY_MAX_LEN];
+	int res, key_len, addr_len;
+	struct route *new_r;
+
+	if (sf->nr == 0)
+		return 0;
+	debug_timing_start(2);
+	addr_len = SORTKEY_ADDR4_LEN;
+	for (i = 0; i < sf->nr; i++) {
+		if (sf->routes[i].subnet.ip_ver == IPV6_A || sf->routes[i].gw.ip_ver == IPV6_A) {
+			addr_len = SORTKEY_ADDR6_LEN;
+			break;
+		}
+	}
+	key_len = keyfunc(buffer, &sf->routes[0], addr_len);
+	keys = st_malloc(sf->nr * key_len, "sort keys");
+	if (keys == NULL) {
+		debug_timing_end(2);
+		return -1;
+	}
+	perm = st_malloc(sf->nr * sizeof(unsigned long), "sort permutation");
+	if (perm == NULL) {
+		st_free(keys, sf->nr * key_len);
+		debug_timing_end(2);
+		return -1;
+	}
+	for (i = 0; i < sf->nr; i++)
+		keyfunc(keys + i * key_len, &sf->routes[i], addr_len);
+	if (nr_threads > 1)
+		res = radix_sort_mt(keys, key_len, sf->nr, perm, nr_threads,
+				(bounds ? bounds : local_bounds));
+	else
+		res = radix_sort(keys, key_len, sf->nr, perm);
+	st_free(keys, sf->nr * key_len);
+	if (res < 0) {
+		st_free(perm, sf->nr * sizeof(unsigned long));
+		debug_timing_end(2);
+		return res;
+	}
+	new_r = st_malloc(sf->max_nr * sizeof(struct route), "struct route");
+	if (new_r == NULL) {
+		st_free(perm, sf->nr * sizeof(unsigned long));
+		debug_timing_end(2);
+		return -1;
+	}
+	for (i = 0 ; i < sf->nr; i++)
+		copy_route(&new_r[i], &sf->routes[perm[i]]);
+	st_free(perm, sf->nr * sizeof(unsigned long));
+	st_free(sf->routes, sizeof(struct route) * sf->max_nr);
+	sf->routes = new_r;
+	debug_timing_end(2);
+	return 0;
 }
+
+/*
+ * relation of a route with the routes of the other file, computed by subnet_file_relations
+ * REL_EQUALS   : the other file has an EQUAL route
+ * REL_INCLUDED : the route is strictly INCLUDED in a route of the other file
+ * REL_INCLUDES : the route INCLUDES a route of the other file
+ */
+#define REL_EQUALS	1
+#define REL_INCLUDED	2
+#define REL_INCLUDES	4
+
+struct sweep_key {
+	struct subnet subnet; /* network address of the route */
+	unsigned long n;      /* index in its subnet_file */
+	int file;             /* 0 for sf1, 1 for sf2 */
+};
+
+/* a group of routes with the same prefix, nested in the previous stack entries */
+struct sweep_group {
+	struct subnet subnet;
+	unsigned long start, end; /* range in the sorted key array */
+	int has[2];  /* routes from sf1/sf2 in this group */
+	int anc[2];  /* routes from sf1/sf2 in this group or an including group */
+	int desc[2]; /* routes from sf1/sf2 strictly included in this group */
+};
+
+static int __heap_sweep_key_is_superior(void *v1, void *v2)
+{
+	struct sweep_key *k1 = v1;
+	struct sweep_key *k2 = v2;
+
+	if (k1->subnet.ip_ver != k2->subnet.ip_ver)
+		return k1->subnet.ip_ver < k2->subnet.ip_ver;
+	return subnet_is_superior(&k1->subnet, &k2->subnet);
+}
+
+/* does s1 include or equal s2 ; both are network addresses */
+static int sweep_subnet_covers(const struct subnet *s1, const struct subnet *s2)
+{
+	int res;
+
+	if (s1->ip_ver != s2->ip_ver || s1->mask > s2->mask)
+		return 0;
+	if (s1->mask == 0)
+		return 1;
+	res = subnet_compare(s1, s2);
+	return (res == INCLUDES || res == EQUALS);
+}
+
+static void sweep_pop_group(struct sweep_group *stack, int *depth,
+		const struct sweep_key *keys, char **rel)
+{
+	struct sweep_group *g = &stack[*depth - 1];
+	unsigned long k;
+	int f, o;
+
+	for (k = g->start; k < g->end; k++) {
+		f = keys[k].file;
+		o = 1 - f;
+		if (g->has[o])
+			rel[f][keys[k].n] |= REL_EQUALS;
+		if (*depth > 1 && stack[*depth - 2].anc[o])
+			rel[f][keys[k].n] |= REL_INCLUDED;
+		if (g->desc[o])
+			rel[f][keys[k].n] |= REL_INCLUDES;
+	}
+	(*depth)--;
+	if (*depth == 0)
+		return;
+	for (f = 0; f < 2; f++)
+		stack[*depth - 1].desc[f] |= (g->has[f] | g->desc[f]);
+}
+
+/*
+ * subnet_file_relations: compute how each route of sf1 relates to sf2 and vice versa
+ * both files are sorted once by (address family, network address, mask), then swept
+ * linearly with a stack of open including prefixes
+ * @sf1, @sf2  : the subnet files
+ * @rel1, rel2 : arrays of sf1->nr and sf2->nr char, filled with REL_* flags
+ * returns:
+ *	positive on SUCCESS
+ *	negative on ENOMEM
+ */
+static int subnet_file_relations(const struct subnet_file *sf1, const struct subnet_file *sf2,
+		char *rel1, char *rel2)
+{
+	unsigned long i, n, nr = sf1->nr + sf2->nr;
+	struct sweep_key *keys, *sorted, *k;
+	struct sweep_group *stack;
+	char *rel[2];
+	int depth, res;
+	TAS tas;
+
+	memset(rel1, 0, sf1->nr);
+	memset(rel2, 0, sf2->nr);
+	if (sf1->nr == 0 || sf2->nr == 0)
+		return 1;
+	rel[0] = rel1;
+	rel[1] = rel2;
+	debug_timing_start(3);
+	keys = st_malloc(2 * nr * sizeof(struct sweep_key), "sweep keys");
+	if (keys == NULL) {
+		debug_timing_end(3);
+		return -1;
+	}
+	/* a group is at most 129 bits deep, one per bit + the /0 */
+	stack = st_malloc(130 * sizeof(struct sweep_group), "sweep stack");
+	if (stack == NULL) {
+		st_free(keys, 2 * nr * sizeof(struct sweep_key));
+		debug_timing_end(3);
+		return -1;
+	}
+	res = alloc_tas(&tas, nr, __heap_sweep_key_is_superior);
+	if (res < 0) {
+		st_free(keys, 2 * nr * sizeof(struct sweep_key));
+		st_free(stack, 130 * sizeof(struct sweep_group));
+		debug_timing_end(3);
+		return res;
+	}
+	for (i = 0; i < nr; i++) {
+		k = &keys[i];
+		k->file = (i < sf1->nr ? 0 : 1);
+		k->n    = (i < sf1->nr ? i : i - sf1->nr);
+		copy_subnet(&k->subnet, (k->file ? &sf2->routes[k->n].subnet :
+					&sf1->routes[k->n].subnet));
+		if (k->subnet.mask == 0)
+			memset(&k->subnet.ip6, 0, sizeof(k->subnet.ip6));
+		else
+			first_ip(&k->subnet);
+		addTAS(&tas, k);
+	}
+	sorted = keys + nr;
+	for (i = 0; i < nr; i++)
+		memcpy(&sorted[i], popTAS(&tas), sizeof(struct sweep_key));
+	free_tas(&tas);
+
+	depth = 0;
+	for (i = 0; i < nr; i = n) {
+		/* group all routes with the same prefix */
+		for (n = i + 1; n < nr; n++)
+			if (sorted[n].subnet.ip_ver != sorted[i].subnet.ip_ver ||
+					sorted[n].subnet.mask != sorted[i].subnet.mask ||
+					subnet_compare(&sorted[n].subnet, &sorted[i].subnet) != EQUALS)
+				break;
+		while (depth && !sweep_subnet_covers(&stack[depth - 1].subnet, &sorted[i].subnet))
+			sweep_pop_group(stack, &depth, sorted, rel);
+		copy_subnet(&stack[depth].subnet, &sorted[i].subnet);
+		stack[depth].start = i;
+		stack[depth].end   = n;
+		stack[depth].has[0] = stack[depth].has[1] = 0;
+		stack[depth].desc[0] = stack[depth].desc[1] = 0;
+		for (; i < n; i++)
+			stack[depth].has[sorted[i].file] = 1;
+		stack[depth].anc[0] = stack[depth].has[0] | (depth ? stack[depth - 1].anc[0] : 0);
+		stack[depth].anc[1] = stack[depth].has[1] | (depth ? stack[depth - 1].anc[1] : 0);
+		depth++;
+	}
+	while (depth)
+		sweep_pop_group(stack, &depth, sorted, rel);
+	st_free(keys, 2 * nr * sizeof(struct sweep_key));
+	st_free(stack, 130 * sizeof(struct sweep_group));
+	debug_timing_end(3);
+	return 1;
+}
+
 /*
  * get uniques routes from sf1 and sf2 INTO sf3
  **/
@@ -180,9 +481,10 @@ int uniq_routes(const struct subnet_file *sf1, const struct subnet_file *sf2,
 		struct subnet_file *sf3)
 {
 	unsigned long i, j;
-	int res, find;
+	int res;
 	TAS tas;
 	struct route *r;
+	char *rel1, *rel2;
 
 	res = alloc_subnet_file(sf3, sf2->nr + sf1->nr);
 	if (res < 0)
@@ -192,43 +494,44 @@ int uniq_routes(const struct subnet_file *sf1, const struct subnet_file *sf2,
 		free_subnet_file(sf3);
 		return res;
 	}
+	rel1 = st_malloc(sf1->nr + sf2->nr + 1, "route relations");
+	if (rel1 == NULL) {
+		free_tas(&tas);
+		free_subnet_file(sf3);
+		return -1;
+	}
+	rel2 = rel1 + sf1->nr;
+	res = subnet_file_relations(sf1, sf2, rel1, rel2);
+	if (res < 0) {
+		st_free(rel1, sf1->nr + sf2->nr + 1);
+		free_tas(&tas);
+		free_subnet_file(sf3);
+		return res;
+	}
 
 	for (i = 0; i < sf1->nr; i++) {
-		find = 0;
-		for (j = 0; j < sf2->nr; j++) {
-			res = subnet_compare(&sf1->routes[i].subnet, &sf2->routes[j].subnet);
-			if (res != NOMATCH) {
-				st_debug(ADDRCOMP, 4, "skipping %P, related with %P\n",
-						sf1->routes[i].subnet,
-						sf2->routes[j].subnet);
-				find = 1;
-				break;
-			}
+		if (rel1[i]) {
+			st_debug(ADDRCOMP, 4, "skipping %P, related with sf2\n",
+					sf1->routes[i].subnet);
+			continue;
 		}
-		if (find == 0)
-			addTAS(&tas, &sf1->routes[i]);
+		addTAS(&tas, &sf1->routes[i]);
 	}
 	for (j = 0; j < sf2->nr; j++) {
-		find = 0;
-		for (i = 0; i < sf1->nr; i++) {
-			res = subnet_compare(&sf2->routes[j].subnet, &sf1->routes[i].subnet);
-			if (res != NOMATCH) {
-				st_debug(ADDRCOMP, 4, "skipping %P related with %P\n",
-						sf2->routes[j].subnet,
-						sf1->routes[i].subnet);
-				find = 1;
-				break;
-			}
+		if (rel2[j]) {
+			st_debug(ADDRCOMP, 4, "skipping %P related with sf1\n",
+					sf2->routes[j].subnet);
+			continue;
 		}
-		if (find == 0)
-			addTAS(&tas, &sf2->routes[j]);
+		addTAS(&tas, &sf2->routes[j]);
 	}
+	st_free(rel1, sf1->nr + sf2->nr + 1);
 	for (i = 0; ; i++) {
 		r = popTAS(&tas);
 		if (r == NULL)
 			break;
 		/* sf3 had not EA alloced, so dont use clone_route */
-		clone_route_nofree(&sf3->routes[i], r);
+		clone_route_nofree(&sf3->routes[i], r, &sf3->arena, &sf3->ea_values);
 	}
 	sf3->nr = i;
 	free_tas(&tas);
@@ -241,31 +544,36 @@ int uniq_routes(const struct subnet_file *sf1, const struct subnet_file *sf2,
 int missing_routes(const struct subnet_file *sf1, const struct subnet_file *sf2,
 		struct subnet_file *sf3)
 {
-	unsigned long i, j, k;
-	int res, find;
+	unsigned long i, k;
+	int res;
+	char *rel1;
 
 	res = alloc_subnet_file(sf3, sf1->max_nr);
 	if (res < 0)
 		return res;
+	rel1 = st_malloc(sf1->nr + sf2->nr + 1, "route relations");
+	if (rel1 == NULL) {
+		free_subnet_file(sf3);
+		return -1;
+	}
+	res = subnet_file_relations(sf1, sf2, rel1, rel1 + sf1->nr);
+	if (res < 0) {
+		st_free(rel1, sf1->nr + sf2->nr + 1);
+		free_subnet_file(sf3);
+		return res;
+	}
 	k = 0;
 	for (i = 0; i < sf1->nr; i++) {
-		find = 0;
-		for (j = 0; j < sf2->nr; j++) {
-			res = subnet_compare(&sf1->routes[i].subnet, &sf2->routes[j].subnet);
-			if (res == INCLUDED || res == EQUALS) {
-				st_debug(ADDRCOMP, 2, "skipping %P, included in %P\n",
-						sf1->routes[i].subnet,
-						sf2->routes[j].subnet);
-				find = 1;
-				break;
-			}
-		}
-		if (find == 0) {
-			clone_route_nofree(&sf3->routes[k], &sf1->routes[i]);
-			k++;
+		if (rel1[i] & (REL_EQUALS|REL_INCLUDED)) {
+			st_debug(ADDRCOMP, 2, "skipping %P, included in sf2\n",
+					sf1->routes[i].subnet);
+			continue;
 		}
+		clone_route_nofree(&sf3->routes[k], &sf1->routes[i], &sf3->arena, &sf3->ea_values);
+		k++;
 	}
 	sf3->nr = k;
+	st_free(rel1, sf1->nr + sf2->nr + 1);
 	return 1;
 }
 
@@ -288,8 +596,8 @@ void print_file_against_paip(struct subnet_file *sf1, const struct subnet_file *
 		for (j = 0;  j < paip->nr; j++) {
 			res = subnet_compare(&sf1->routes[i].subnet, &paip->routes[j].subnet);
 			if (res == EQUALS) {
-				st_free_string(sf1->routes[i].ea[0].value);
-				ea_strdup(&sf1->routes[i].ea[0], paip->routes[j].ea[0].value);
+				ea_intern(&sf1->ea_values, &sf1->routes[i].ea[0],
+						paip->routes[j].ea[0].value);
 				fprint_route_fmt(nof->output_file, &sf1->routes[i],
 						nof->output_fmt);
 				find_equals = 1;
@@ -302,8 +610,7 @@ void print_file_against_paip(struct subnet_file *sf1, const struct subnet_file *
 		find_included = 0;
 		includes = 0;
 		find_mask = 0;
-		st_free_string(sf1->routes[i].ea[0].value);
-		ea_strdup(&sf1->routes[i].ea[0], "NOT FOUND");
+		ea_intern(&sf1->ea_values, &sf1->routes[i].ea[0], "NOT FOUND");
 		fprint_route_fmt(nof->output_file, &sf1->routes[i], nof->output_fmt);
 
 		/* we look a second time for a non-equal match */
@@ -338,136 +645,671 @@ void print_file_against_paip(struct subnet_file *sf1, const struct subnet_file *
 	debug_timing_end(2);
 }
 
-int network_grep_file(char *name, struct st_options *nof, char *ip)
+/*
+ * longest prefix match of each address of file 'name' against the routes of sf
+ * prints the address, then the matching route with -fmt, or LOOKUP_MISS
+ */
+#define LOOKUP_MISS "NOT FOUND"
+
+/* open an address or log file; regular files are mapped, pipes and stdin ("-") are read */
+static struct st_file *open_lookup_file(const char *name)
 {
-	char *s;
-	char buffer[1024];
-	char save_buffer[1024];
-	FILE *f;
-	struct subnet subnet, subnet1;
-	int i, res, find_ip, do_compare, reevaluate;
-	unsigned long line = 0;
+	struct st_file *f;
+
+	if (!strcmp(name, "-"))
+		name = NULL;
+	f = (name ? st_mmap_open(name) : NULL);
+	if (f == NULL)
+		f = st_open(name, 128000);
+	if (f == NULL)
+		fprintf(stderr, "cannot open %s for reading\n", name ? name : "<stdin>");
+	return f;
+}
 
-	if (name == NULL)
+/*
+ * longest match of 's' among the routes of 'dir' and 'trie'
+ * IPv4 addresses are looked up in the DIR-24-8 table, prefixes and IPv6 in the trie
+ */
+static long route_longest_match(const struct st_dir248 *dir, const struct st_trie *trie,
+		const struct subnet *s)
+{
+	if (s->ip_ver == IPV4_A && s->mask == 32)
+		return (dir->nr_routes ? dir248_lookup(dir, s->ip) : -1);
+	return trie_longest_match(trie, s, s->mask);
+}
+
+int network_lookup_file(const struct subnet_file *sf, const char *name, struct st_options *nof)
+{
+	struct st_dir248 dir;
+	struct st_trie trie;
+	struct st_file *f;
+	struct route_printer *p;
+	struct subnet subnet;
+	char miss[128];
+	char *s, *e;
+	int res, len, discarded;
+	unsigned long i, line = 0, found = 0, missed = 0;
+	long j;
+
+	alloc_dir248(&dir);
+	if (dir248_build(&dir, sf) < 0 || alloc_trie(&trie, max(sf->nr, 1UL)) < 0) {
+		free_dir248(&dir);
 		return -1;
-	f = fopen(name, "r");
+	}
+	debug_timing_start(2);
+	for (i = 0; i < sf->nr; i++)
+		trie_insert(&trie, &sf->routes[i].subnet, i);
+	f = open_lookup_file(name);
 	if (f == NULL) {
-		fprintf(stderr, "error: cannot open %s for reading\n", name);
+		free_trie(&trie);
+		free_dir248(&dir);
+		debug_timing_end(2);
+		return -2;
+	}
+	p = alloc_route_printer(nof->output_file, nof->output_fmt);
+	if (p == NULL) {
+		st_close(f);
+		free_trie(&trie);
+		free_dir248(&dir);
+		debug_timing_end(2);
+		return -1;
+	}
+	if (nof->print_header && sf->nr) {
+		fprintf(nof->output_file, "address;");
+		fprint_route_header(nof->output_file, &sf->routes[0], nof->output_fmt);
+	}
+	while ((s = st_getline(f, 1024, &len, &discarded))) {
+		line++;
+		while (*s == ' ' || *s == '\t')
+			s++;
+		if (*s == '\0' || *s == '#')
+			continue;
+		e = s + strlen(s);
+		while (e > s && isspace((unsigned char)e[-1]))
+			e--;
+		*e = '\0';
+		res = get_subnet_or_ip(s, &subnet);
+		if (res < 0) {
+			debug(GREP, 2, "invalid IP %s line %lu\n", s, line);
+			continue;
+		}
+		j = route_longest_match(&dir, &trie, &subnet);
+		if (j >= 0) {
+			/* the address is followed by the route, in place */
+			*e = ';';
+			route_printer_print(p, s, e - s + 1, &sf->routes[j]);
+			found++;
+		} else {
+			len = snprintf(miss, sizeof(miss), "%s;%s", s, LOOKUP_MISS);
+			route_printer_print(p, miss, min(len, (int)sizeof(miss) - 1), NULL);
+			missed++;
+		}
+	}
+	debug(GREP, 3, "%lu addresses found, %lu not found\n", found, missed);
+	free_route_printer(p);
+	st_close(f);
+	free_trie(&trie);
+	free_dir248(&dir);
+	debug_timing_end(2);
+	return 1;
+}
+
+/*
+ * field 'n' (starting at 1) of line 's', fields are separated by any char of 'delim'
+ * like with strtok and -grep_field, consecutive delimiters count as one
+ */
+static const char *line_field(const char *s, const char *delim, int n, size_t *len)
+{
+	s += strspn(s, delim);
+	while (--n > 0 && *s) {
+		s += strcspn(s, delim);
+		s += strspn(s, delim);
+	}
+	if (*s == '\0')
+		return NULL;
+	*len = strcspn(s, delim);
+	return s;
+}
+
+/*
+ * append to each line of file 'name' the EA of the route matching its field 'field'
+ * IPv4 addresses are looked up in a DIR-24-8 table, IPv6 ones in a trie
+ */
+int network_annotate_file(const struct subnet_file *sf, const char *name, int field,
+		struct st_options *nof)
+{
+	struct st_dir248 dir;
+	struct st_trie trie;
+	struct st_file *f;
+	struct route_printer *p;
+	struct subnet subnet;
+	char buffer[128];
+	const char *t;
+	char *s;
+	size_t len, flen;
+	int res, read, discarded;
+	unsigned long i, line = 0, found = 0, missed = 0;
+	long j;
+
+	if (alloc_dir248(&dir) < 0)
+		return -1;
+	if (dir248_build(&dir, sf) < 0 || alloc_trie(&trie, max(sf->nr, 1UL)) < 0) {
+		free_dir248(&dir);
+		return -1;
+	}
+	for (i = 0; i < sf->nr; i++)
+		trie_insert(&trie, &sf->routes[i].subnet, i);
+	f = open_lookup_file(name);
+	/* all EA of the route */
+	p = (f ? alloc_route_printer(nof->output_file, "%O#") : NULL);
+	if (p == NULL) {
+		if (f)
+			st_close(f);
+		free_trie(&trie);
+		free_dir248(&dir);
+		return (f ? -1 : -2);
+	}
+	debug_timing_start(2);
+	while ((s = st_getline(f, 1024, &read, &discarded))) {
+		line++;
+		len = strlen(s);
+		if (len && s[len - 1] == '\r')
+			len--;
+		s[len] = '\0';
+		j = -1;
+		res = BAD_IP;
+		t = line_field(s, nof->delim, field, &flen);
+		while (t && flen && isspace((unsigned char)*t)) {
+			t++;
+			flen--;
+		}
+		while (t && flen && isspace((unsigned char)t[flen - 1]))
+			flen--;
+		if (t && flen && flen < sizeof(buffer)) {
+			memcpy(buffer, t, flen);
+			buffer[flen] = '\0';
+			res = get_subnet_or_ip(buffer, &subnet);
+			if (res == IPV4_A || res == IPV4_N || res == IPV6_A || res == IPV6_N)
+				j = route_longest_match(&dir, &trie, &subnet);
+			else {
+				debug(GREP, 2, "field %d line %lu is not an IP\n", field, line);
+				res = BAD_IP;
+			}
+		} else
+			debug(GREP, 2, "no field %d line %lu\n", field, line);
+		if (res == BAD_IP) {
+			/* comments, headers... are left as is */
+			s[len] = '\n';
+			route_printer_puts(p, s, len + 1);
+			continue;
+		}
+		/* the line is followed by a delimiter and the EA, in place */
+		s[len] = nof->delim[0];
+		if (j >= 0) {
+			route_printer_print(p, s, len + 1, &sf->routes[j]);
+			found++;
+		} else {
+			route_printer_puts(p, s, len + 1);
+			route_printer_print(p, LOOKUP_MISS, strlen(LOOKUP_MISS), NULL);
+			missed++;
+		}
+	}
+	debug(GREP, 3, "%lu lines annotated, %lu not found\n", found, missed);
+	free_route_printer(p);
+	st_close(f);
+	free_trie(&trie);
+	free_dir248(&dir);
+	debug_timing_end(2);
+	return 1;
+}
+
+/* the pattern of the first IP token of a line related to a prefix of 't' */
+static long grep_probe(const struct st_trie *t, const struct subnet *subnet)
+{
+	long j;
+
+	/* a pattern EQUALS or INCLUDES the token */
+	j = trie_longest_match(t, subnet, subnet->mask);
+	if (j >= 0)
+		return j;
+	/* the token INCLUDES a pattern */
+	return trie_first_included(t, subnet);
+}
+
+/*
+ * find the IP tokens of line 's' and probe them; an IP followed by a mask token
+ * is a prefix, an IP without a mask is a host
+ * returns the first matching pattern, -1 if none
+ */
+static long grep_line(const char *s, unsigned long line, const struct st_trie *t,
+		struct st_options *nof)
+{
+	struct subnet subnet;
+	char token[128];
+	size_t len;
+	int res, lmask, find_ip = 0;
+	long j;
+
+	if (nof->grep_field > 0) {
+		/* we grep on only one field */
+		s = line_field(s, nof->delim, nof->grep_field, &len);
+		if (s == NULL) {
+			debug(GREP, 3, "no token at offset %d line %lu\n", nof->grep_field, line);
+			return -1;
+		}
+	} else
+		s += strspn(s, nof->delim);
+	while (*s) {
+		len = strcspn(s, nof->delim);
+		/* a token that long is neither an IP nor a mask */
+		if (len < sizeof(token)) {
+			memcpy(token, s, len);
+			token[len] = '\0';
+		} else
+			token[0] = '\0';
+		s += len;
+		s += strspn(s, nof->delim);
+		/* previous token was an IP without a mask,
+		 * try to get a mask on this field
+		 */
+		if (find_ip) {
+			find_ip = 0;
+			lmask = string2mask(token, 21);
+			/* if no mask found, we assume the found IP was a host */
+			if (lmask == BAD_MASK)
+				subnet.mask = (subnet.ip_ver == IPV4_A ? 32 : 128);
+			else
+				subnet.mask = lmask;
+			j = grep_probe(t, &subnet);
+			if (j >= 0 || nof->grep_field)
+				return j;
+			if (lmask != BAD_MASK)
+				continue;
+			/* we need to reevaluate the token, it could be an IP */
+		}
+		res = get_subnet_or_ip(token, &subnet);
+		if (res < 0) {
+			debug(GREP, 5, "field %s line %lu not an IP\n", token, line);
+			if (nof->grep_field)
+				return -1;
+			continue;
+		}
+		if (res == IPV4_A || res == IPV6_A) {
+			debug(GREP, 5, "field %s line %lu IS an IP\n", token, line);
+			find_ip = 1;
+			continue;
+		}
+		debug(GREP, 5, "field %s line %lu IS a IP/mask\n", token, line);
+		j = grep_probe(t, &subnet);
+		if (j >= 0 || nof->grep_field)
+			return j;
+	}
+	/* the line ends with an IP without a mask */
+	if (find_ip) {
+		subnet.mask = (subnet.ip_ver == IPV4_A ? 32 : 128);
+		return grep_probe(t, &subnet);
+	}
+	return -1;
+}
+
+/*
+ * a part of the file to grep; matching lines are appended to 'out'
+ * with -j, chunks are grepped GREP_ROUND_CHUNKS at a time, each on its thread,
+ * then their output is written in file order, so memory is bounded by the output
+ * of GREP_CHUNK_SIZE bytes of input per thread
+ */
+#define GREP_CHUNK_SIZE		(64 * 1024 * 1024)
+#define GREP_MIN_CHUNK_SIZE	(256 * 1024)
+#define GREP_OUT_FLUSH		(64 * 1024)
+
+struct grep_chunk {
+	struct st_file *f;
+	const struct subnet *patterns;
+	const struct st_trie *t;
+	struct st_options *nof;
+	FILE *flush; /* if set, 'out' is written there every GREP_OUT_FLUSH bytes */
+	char *out;
+	size_t out_len;
+	size_t out_max;
+	unsigned long lines;
+	unsigned long found;
+	int res;
+};
+
+static int grep_out(struct grep_chunk *c, const char *s, size_t len)
+{
+	size_t new_max;
+	char *new_out;
+
+	if (c->out_len + len > c->out_max) {
+		new_max = max(max(2 * c->out_max, c->out_len + len), (size_t)GREP_OUT_FLUSH);
+		new_out = st_realloc(c->out, new_max, c->out_max, "grep output");
+		if (new_out == NULL)
+			return -1;
+		c->out	   = new_out;
+		c->out_max = new_max;
+	}
+	memcpy(c->out + c->out_len, s, len);
+	c->out_len += len;
+	return 1;
+}
+
+/* line numbers are relative to the chunk */
+static void *grep_chunk_thread(void *arg)
+{
+	struct grep_chunk *c = arg;
+	char tag[64 + 8];
+	char *s;
+	size_t len;
+	int res, read, discarded;
+	long j;
+
+	c->res = 1;
+	while ((s = st_getline(c->f, 1024, &read, &discarded))) {
+		c->lines++;
+		debug(GREP, 9, "grepping line %lu : %s\n", c->lines, s);
+		j = grep_line(s, c->lines, c->t, c->nof);
+		if (j < 0)
+			continue;
+		c->found++;
+		if (c->nof->grep_tag) {
+			subnet2str(&c->patterns[j], tag, sizeof(tag) - 8, c->nof->ip_compress_mode);
+			len = strlen(tag);
+			len += sprintf(tag + len, "/%d%c", c->patterns[j].mask, c->nof->delim[0]);
+			if (grep_out(c, tag, len) < 0)
+				break;
+		}
+		len = strlen(s);
+		s[len] = '\n';
+		res = grep_out(c, s, len + 1);
+		s[len] = '\0';
+		if (res < 0)
+			break;
+		if (c->flush && c->out_len >= GREP_OUT_FLUSH) {
+			fwrite(c->out, 1, c->out_len, c->flush);
+			c->out_len = 0;
+		}
+	}
+	if (s)
+		c->res = -1;
+	return NULL;
+}
+
+/* grep a mapped file with nof->nr_threads threads */
+static int grep_scan_mt(struct st_file *f, const struct subnet *patterns,
+		const struct st_trie *t, struct st_options *nof)
+{
+	struct st_file *views;
+	struct grep_chunk *chunks;
+	unsigned long lines = 0, found = 0;
+	size_t len;
+	int i, r, k, n, n_views, nr, res = 1;
+
+	len = f->end - f->bp;
+	n_views = max((size_t)nof->nr_threads, len / GREP_CHUNK_SIZE + 1);
+	views = st_malloc(n_views * sizeof(struct st_file), "grep views");
+	if (views == NULL)
+		return -1;
+	chunks = st_malloc(n_views * sizeof(struct grep_chunk), "grep chunks");
+	if (chunks == NULL) {
+		st_free(views, n_views * sizeof(struct st_file));
+		return -1;
+	}
+	n = st_split(f, views, n_views, GREP_MIN_CHUNK_SIZE);
+	debug(GREP, 3, "grepping in %d chunks, %d threads\n", n, nof->nr_threads);
+	memset(chunks, 0, n_views * sizeof(struct grep_chunk));
+	for (i = 0; i < n; i++) {
+		chunks[i].f	   = &views[i];
+		chunks[i].patterns = patterns;
+		chunks[i].t	   = t;
+		chunks[i].nof	   = nof;
+	}
+	nr = nof->nr_threads;
+	for (r = 0; r < n && res > 0; r += nr) {
+		k = min(n - r, nr);
+		run_threads(k, grep_chunk_thread, chunks + r, sizeof(struct grep_chunk));
+		for (i = r; i < r + k; i++)
+			if (chunks[i].res < 0)
+				res = -1;
+		/* output in file order; the chunk on the same thread next round reuses the buffer */
+		for (i = r; i < r + k; i++) {
+			if (res > 0)
+				fwrite(chunks[i].out, 1, chunks[i].out_len, nof->output_file);
+			lines += chunks[i].lines;
+			found += chunks[i].found;
+			if (res > 0 && i + nr < n) {
+				chunks[i + nr].out     = chunks[i].out;
+				chunks[i + nr].out_max = chunks[i].out_max;
+			} else
+				st_free(chunks[i].out, chunks[i].out_max);
+		}
+	}
+	debug(GREP, 3, "%lu lines of %lu match\n", found, lines);
+	st_free(chunks, n_views * sizeof(struct grep_chunk));
+	st_free(views, n_views * sizeof(struct st_file));
+	return res;
+}
+
+/* print each line of file 'name' related to one of the patterns indexed in 't' */
+static int grep_scan(const char *name, const struct subnet *patterns, const struct st_trie *t,
+		struct st_options *nof)
+{
+	struct st_file *f;
+	struct grep_chunk c;
+	int res;
+
+	f = open_lookup_file(name);
+	if (f == NULL)
 		return -2;
+	debug_timing_start(2);
+	if (f->map && nof->nr_threads > 1) {
+		res = grep_scan_mt(f, patterns, t, nof);
+	} else {
+		memset(&c, 0, sizeof(c));
+		c.f	   = f;
+		c.patterns = patterns;
+		c.t	   = t;
+		c.nof	   = nof;
+		c.flush	   = nof->output_file;
+		grep_chunk_thread(&c);
+		fwrite(c.out, 1, c.out_len, nof->output_file);
+		st_free(c.out, c.out_max);
+		debug(GREP, 3, "%lu lines of %lu match\n", c.found, c.lines);
+		res = c.res;
 	}
+	st_close(f);
+	debug_timing_end(2);
+	return res;
+}
+
+int network_grep_file(char *name, struct st_options *nof, char *ip)
+{
+	struct st_trie trie;
+	struct subnet subnet1;
+	int res;
+
+	if (name == NULL)
+		return -1;
 	res = get_subnet_or_ip(ip, &subnet1);
 	if (res < 0) {
 		fprintf(stderr, "WTF? \"%s\"  IS  a prefix/mask ?? really?\n", ip);
-		fclose(f);
 		return -3;
 	}
-	debug_timing_start(2);
-	while ((s = fgets(buffer, sizeof(buffer), f))) {
+	if (alloc_trie(&trie, 1) < 0)
+		return -1;
+	trie_insert(&trie, &subnet1, 0);
+	res = grep_scan(name, &subnet1, &trie, nof);
+	free_trie(&trie);
+	return res;
+}
+
+/* load the prefixes of file 'name', one per line, into 'patterns' (max_nr allocated) */
+static int load_grep_patterns(const char *name, struct subnet **patterns,
+		unsigned long *nr_patterns, unsigned long *max_patterns)
+{
+	struct st_file *f;
+	struct subnet *p = NULL, *new_p;
+	char *s, *e;
+	int res, read, discarded;
+	unsigned long line = 0, nr = 0, max_nr = 0;
+
+	f = open_lookup_file(name);
+	if (f == NULL)
+		return -2;
+	while ((s = st_getline(f, 1024, &read, &discarded))) {
 		line++;
-		debug(GREP, 9, "grepping line %lu : %s\n", line, s);
-		strcpy(save_buffer, buffer);
-		s = strtok(s, nof->delim);
-		if (s == NULL)
+		while (*s == ' ' || *s == '\t')
+			s++;
+		if (*s == '\0' || *s == '#')
 			continue;
-		do_compare = 0;
-		find_ip    = 0;
-		reevaluate = 1;
-		if (nof->grep_field > 0) { /** we grep on only one field */
-			res = 0;
-			for (i = 0; i < nof->grep_field - 1; i++) {
-				s = strtok(NULL, nof->delim);
-				if (s == NULL) {
-					debug(GREP, 3, "no token at offset %d line %lu\n",
-							nof->grep_field, line);
-					res = 1;
-					break;
-				}
+		e = s + strlen(s);
+		while (e > s && isspace((unsigned char)e[-1]))
+			e--;
+		*e = '\0';
+		if (nr == max_nr) {
+			new_p = st_realloc(p, max(2 * max_nr, 16UL) * sizeof(struct subnet),
+					max_nr * sizeof(struct subnet), "grep patterns");
+			if (new_p == NULL) {
+				st_free(p, max_nr * sizeof(struct subnet));
+				st_close(f);
+				return -1;
 			}
-			if (res)
-				continue; /* invalid line, continue **/
+			p = new_p;
+			max_nr = max(2 * max_nr, 16UL);
 		}
+		res = get_subnet_or_ip(s, &p[nr]);
+		if (res < 0) {
+			debug(GREP, 1, "invalid prefix %s line %lu\n", s, line);
+			continue;
+		}
+		nr++;
+	}
+	st_close(f);
+	debug(GREP, 3, "%lu patterns loaded from %s\n", nr, name);
+	*patterns     = p;
+	*nr_patterns  = nr;
+	*max_patterns = max_nr;
+	return 1;
+}
 
-		do {
-			if (reevaluate == 0)
-				s = strtok(NULL, nof->delim);
-			reevaluate = 0;
-			if (s == NULL)
-				break;
-			/* previous token was an IP without a mask,
-			 * try to get a mask on this field
-			 */
-			if (find_ip) {
-				int lmask = string2mask(s, 21);
-
-				if (subnet.ip_ver == IPV4_A)
-					subnet.mask = (lmask == BAD_MASK ? 32 : lmask);
-				if (subnet.ip_ver == IPV6_A)
-					subnet.mask = (lmask == BAD_MASK ? 128 : lmask);
-				/* if no mask found, we assume the found IP was a host */
-				find_ip     = 0;
-				do_compare  = 1;
-				if (lmask == BAD_MASK)
-					/* we need to reeavulate s, it could be an IP */
-					reevaluate = 1;
-			} else {
-				res = get_subnet_or_ip(s, &subnet);
-				if (res < 0 && nof->grep_field)  {
-					debug(GREP, 2, "field %s line %lu not an IP\n",
-							s, line);
-					break;
-				} else if (res < 0) {/* c pas une IP */
-					debug(GREP, 5, "field %s line %lu not an IP\n",
-							s, line);
-					continue;
-				} else if (res == IPV4_A) { /* une IP sans masque */
-					find_ip = 1;
-					debug(GREP, 5, "field %s line %lu IS an IP\n",
-							s, line);
-				} else if (res == IPV4_N) { /* IP+masque, time to compare */
-					do_compare = 1;
-					debug(GREP, 5, "field %s line %lu IS a IP/mask\n",
-							s, line);
-				} else if (res == IPV6_N) {
-					do_compare = 1;
-					debug(GREP, 5, "field %s line %lu IS a IPv6/mask\n",
-							s, line);
-				} else if (res == IPV6_A) {
-					find_ip = 1;
-					debug(GREP, 5, "field %s line %lu IS an IPv6\n",
-							s, line);
-				}
-			}
+int network_grep_prefix_file(const char *patterns_name, const char *name,
+		struct st_options *nof)
+{
+	struct st_trie trie;
+	struct subnet *patterns;
+	unsigned long i, nr, max_nr;
+	int res;
 
-			if (do_compare == 1) {
-				switch (subnet_compare(&subnet,  &subnet1)) {
-				case EQUALS:
-					fprintf(nof->output_file, "%s", save_buffer);
-					debug(GREP, 5, "field %s line %lu equals\n",  s, line);
-					do_compare = 2;
-					break;
-				case INCLUDES:
-					fprintf(nof->output_file, "%s", save_buffer);
-					debug(GREP, 5, "field %s line %lu includes\n",  s, line);
-					do_compare = 2;
-					break;
-				case INCLUDED:
-					fprintf(nof->output_file, "%s", save_buffer);
-					debug(GREP, 5, "field %s line %lu included\n",  s, line);
-					do_compare = 2;
-					break;
-				default:
-					do_compare = 0;
-					break;
-				}
-			}
-			if (do_compare == 2) /*  one match found, next line please */
+	res = load_grep_patterns(patterns_name, &patterns, &nr, &max_nr);
+	if (res < 0)
+		return res;
+	res = -1;
+	if (alloc_trie(&trie, max(nr, 1UL)) >= 0) {
+		for (i = 0; i < nr; i++)
+			trie_insert(&trie, &patterns[i], i);
+		res = grep_scan(name, patterns, &trie, nof);
+		free_trie(&trie);
+	}
+	st_free(patterns, max_nr * sizeof(struct subnet));
+	return res;
+}
+
+struct simplify_job {
+	const struct route *routes;
+	unsigned long first, last; /* the partition is [first, last) */
+	char *keep;
+};
+
+/* simplify one partition of a sorted file; routes to drop are only marked
+ * because the file is sorted, we know the only network to consider is the last kept one
+ */
+static void *simplify_thread(void *arg)
+{
+	struct simplify_job *job = arg;
+	unsigned long i, j;
+	int res;
+
+	if (job->first == job->last)
+		return NULL;
+	j = job->first;
+	job->keep[j] = 1;
+	for (i = job->first + 1; i < job->last; i++) {
+		res = subnet_compare(&job->routes[i].subnet, &job->routes[j].subnet);
+		if (res == INCLUDED || res == EQUALS) {
+			job->keep[i] = 0;
+			continue;
+		}
+		job->keep[i] = 1;
+		j = i;
+	}
+	return NULL;
+}
+
+/*
+ * simplify a sorted file, sf->routes[bounds[t]..bounds[t + 1]) are handled by thread t
+ * each thread simplifies its partition without knowing what comes before it;
+ * partition t is then fixed against the last route kept before it: its first routes are
+ * checked like a sequential run would do, until a route is kept by both;
+ * from there, both runs compare against the same route and take the same decisions
+ * on return, bounds[] are updated to the new route indexes
+ */
+static int __subnet_file_simplify(struct subnet_file *sf, int nr_threads, unsigned long *bounds)
+{
+	struct simplify_job jobs[ST_MAX_THREADS];
+	unsigned long i, j, k, n;
+	long last;
+	char *keep, serial_keep;
+	int res, t;
+
+	keep = st_malloc(sf->nr, "simplify flags");
+	if (keep == NULL)
+		return -1;
+	for (t = 0; t < nr_threads; t++) {
+		jobs[t].routes = sf->routes;
+		jobs[t].first  = bounds[t];
+		jobs[t].last   = bounds[t + 1];
+		jobs[t].keep   = keep;
+	}
+	run_threads(nr_threads, simplify_thread, jobs, sizeof(struct simplify_job));
+	/* stitch partitions */
+	last = -1;
+	for (t = 0; t < nr_threads; t++) {
+		for (i = bounds[t]; i < bounds[t + 1] && last != -1; i++) {
+			res = subnet_compare(&sf->routes[i].subnet, &sf->routes[last].subnet);
+			serial_keep = (res != INCLUDED && res != EQUALS);
+			if (serial_keep && keep[i])
 				break;
-			if (nof->grep_field && find_ip == 0)
-				break; /* no match found but we wanted only THIS field */
-		} while (1);
-	} /* for fgets */
-	fclose(f);
-	debug_timing_end(2);
+			keep[i] = serial_keep;
+			if (serial_keep)
+				last = i;
+		}
+		for (i = bounds[t + 1]; i > bounds[t]; i--) {
+			if (keep[i - 1]) {
+				last = i - 1;
+				break;
+			}
+		}
+	}
+	/* compact */
+	j = 0;
+	t = 0;
+	n = sf->nr;
+	for (i = 0; i < n; i++) {
+		while (t <= nr_threads && bounds[t] == i)
+			bounds[t++] = j;
+		if (keep[i] == 0) {
+			st_debug(ADDRCOMP, 3, "%P is included in %P, skipping\n",
+					sf->routes[i].subnet, sf->routes[j - 1].subnet);
+			continue;
+		}
+		if (i != j)
+			copy_route(&sf->routes[j], &sf->routes[i]);
+		j++;
+	}
+	for (k = t; k <= nr_threads; k++)
+		bounds[k] = j;
+	sf->nr = j;
+	st_free(keep, n);
 	return 1;
 }
 
@@ -475,92 +1317,61 @@ int network_grep_file(char *name, struct st_options *nof, char *ip)
  * simplify subnet file (removes redundant entries)
  * GW is not taken into account
  */
-int subnet_file_simplify(struct subnet_file *sf)
+int subnet_file_simplify(struct subnet_file *sf, int nr_threads)
 {
-	unsigned long i;
+	unsigned long bounds[ST_MAX_THREADS + 1];
 	int  res;
-	TAS tas;
-	struct route *new_r, *r;
 
 	if (sf->nr == 0)
 		return 0;
 	debug_timing_start(2);
-	res = alloc_tas(&tas, sf->nr, __heap_subnet_is_superior);
-	if (res < 0)
-		return -1;
-	new_r = st_malloc(sf->nr * sizeof(struct route), "struct route");
-	if (new_r == NULL) {
-		free_tas(&tas);
-		return -1;
+	nr_threads = max(nr_threads, 1);
+	if (nr_threads == 1) {
+		bounds[0] = 0;
+		bounds[1] = sf->nr;
 	}
-	for (i = 0; i < sf->nr; i++)
-		addTAS(&tas, &sf->routes[i]);
-
-	r = popTAS(&tas);
-	copy_route(&new_r[0], r);
-	i = 1;
-	while (1) {
-		r = popTAS(&tas);
-		if (r == NULL)
-			break;
-		/* because the 'new_r' list is sorted,
-		 * we know the only network to consider is i - 1
-		 */
-		res = subnet_compare(&r->subnet, &new_r[i - 1].subnet);
-		if (res == INCLUDED || res == EQUALS) {
-			st_debug(ADDRCOMP, 3, "%P is included in %P, skipping\n",
-					r->subnet, new_r[i - 1].subnet);
-			free_route(r);
-			continue;
-		}
-		copy_route(&new_r[i], r);
-		i++;
+	res = __subnet_sort_by(sf, __route_prefix_key, nr_threads, bounds);
+	if (res < 0) {
+		debug_timing_end(2);
+		return -1;
 	}
-	st_free(sf->routes, sf->max_nr * sizeof(struct route));
-	sf->max_nr = sf->nr;
-	sf->nr = i;
-	free_tas(&tas);
-	sf->routes = new_r;
+	res = __subnet_file_simplify(sf, nr_threads, bounds);
 	debug_timing_end(2);
-	return 1;
+	return res;
 }
 
 /*
  * simply_route_file takes GW into account, must be equal
  */
-int route_file_simplify(struct subnet_file *sf,  int mode)
+int route_file_simplify(struct subnet_file *sf,  int mode, int nr_threads)
 {
-	unsigned long i, j, k, a;
+	unsigned long i, j, a, n;
 	int res, skip;
-	TAS tas;
 	struct route *new_r, *r, *discard;
 
-	res = alloc_tas(&tas, sf->nr, __heap_subnet_is_superior);
+	if (sf->nr == 0)
+		return 0;
+	/*
+	 * a route is checked against the longest kept route including it, wherever
+	 * it is in the file, so unlike subnet_file_simplify the scan is not split
+	 */
+	res = __subnet_sort_by(sf, __route_prefix_key, max(nr_threads, 1), NULL);
 	if (res < 0)
 		return res;
 	new_r = st_malloc(sf->nr * sizeof(struct route), "struct route"); /* common routes */
-	if (new_r == NULL) {
-		free_tas(&tas);
+	if (new_r == NULL)
 		return -1;
-	}
 	discard = st_malloc(sf->nr * sizeof(struct route), "struct route"); /* excluded routes */
 	if (discard == NULL) {
-		free_tas(&tas);
 		st_free(new_r, sf->nr * sizeof(struct route));
 		return -1;
 	}
 
-	for (i = 0; i < sf->nr; i++)
-		addTAS(&tas, &sf->routes[i]);
-
-	r = popTAS(&tas);
-	copy_route(&new_r[0], r);
+	copy_route(&new_r[0], &sf->routes[0]);
 	i = 1; /* index in the 'new_r' struct */
 	j = 0; /* index in the 'discard' struct */
-	while (1) {
-		r = popTAS(&tas);
-		if (r == NULL)
-			break;
+	for (n = 1; n < sf->nr; n++) {
+		r = &sf->routes[n];
 		a = i - 1;
 		skip = 0;
 		while (1) {
@@ -590,21 +1401,116 @@ int route_file_simplify(struct subnet_file *sf,  int mode)
 		else
 			copy_route(&discard[j++], r);
 	}
-	free_tas(&tas);
-	st_free(sf->routes, sf->max_nr * sizeof(struct route));
-	sf->max_nr = sf->nr;
-	if (mode == 0) {
-		sf->nr = i;
-		sf->routes = new_r;
-		for (k = 0; k < j; k++)
-			free_route(&discard[k]);
-		st_free(discard, sf->max_nr * sizeof(struct route));
-	} else {
-		sf->nr = j;
-		sf->routes = discard;
-		for (k = 0; k < i; k++)
-			free_route(&new_r[k]);
-		st_free(new_r, sf->max_nr * sizeof(struct route));
+	st_free(sf->routes, sf->max_nr * sizeof(struct route));
+	sf->max_nr = sf->nr;
+	/* the EA of the dropped routes stay in the arena until the file is freed */
+	if (mode == 0) {
+		sf->nr = i;
+		sf->routes = new_r;
+		st_free(discard, sf->max_nr * sizeof(struct route));
+	} else {
+		sf->nr = j;
+		sf->routes = discard;
+		st_free(new_r, sf->max_nr * sizeof(struct route));
+	}
+	return 1;
+}
+
+/* an aggregate being built: 'subnet' covers routes first..n of the sorted file */
+struct agg_item {
+	struct subnet subnet;
+	unsigned long first; /* the route the aggregate inherits from */
+	int merged;
+};
+
+struct aggregate_job {
+	struct route *routes;
+	struct agg_item *stack; /* one slot per route of the partition */
+	unsigned long first, last; /* the partition is [first, last) */
+	unsigned long nr; /* number of items on the stack */
+	int mode;
+};
+
+/* push 'item' on a stack of aggregates, merging it and rewinding backwards as much as we can;
+ * the aggregate we just created may aggregate with the one below
+ * items on the stack are sorted, don't overlap, and no 2 consecutive items can aggregate
+ */
+static void aggregate_push(struct agg_item *stack, unsigned long *nr, const struct agg_item *item,
+		struct route *routes, int mode)
+{
+	struct agg_item *top;
+	struct subnet s;
+	int res;
+
+	if (*nr == 0) {
+		stack[(*nr)++] = *item;
+		return;
+	}
+	top = &stack[*nr - 1];
+	if (mode == 1 && !is_equal_gw(&routes[top->first], &routes[item->first])) {
+		st_debug(AGGREGATE, 4, "Entry '%P' & '%P' cant aggregate, different GW\n",
+				top->subnet, item->subnet);
+		stack[(*nr)++] = *item;
+		return;
+	}
+	res = aggregate_subnet(&top->subnet, &item->subnet, &s);
+	if (res < 0) {
+		st_debug(AGGREGATE, 4, "Entry '%P' & '%P' cant aggregate\n",
+				top->subnet, item->subnet);
+		stack[(*nr)++] = *item;
+		return;
+	}
+	st_debug(AGGREGATE, 4, "Entry '%P' & '%P' can aggregate\n", top->subnet, item->subnet);
+	copy_subnet(&top->subnet, &s);
+	top->merged = 1;
+	while (*nr > 1) {
+		top = &stack[*nr - 1];
+		if (mode == 1 && !is_equal_gw(&routes[top->first], &routes[top[-1].first]))
+			break;
+		res = aggregate_subnet(&top->subnet, &top[-1].subnet, &s);
+		if (res < 0)
+			break;
+		st_debug(AGGREGATE, 4, "Rewinding, entry '%P' & '%P' can aggregate\n",
+				top[-1].subnet, top->subnet);
+		(*nr)--;
+		copy_subnet(&top[-1].subnet, &s);
+		top[-1].merged = 1;
+	}
+}
+
+static void *aggregate_thread(void *arg)
+{
+	struct aggregate_job *job = arg;
+	struct agg_item item;
+	unsigned long i;
+
+	job->nr = 0;
+	for (i = job->first; i < job->last; i++) {
+		copy_subnet(&item.subnet, &job->routes[i].subnet);
+		item.first  = i;
+		item.merged = 0;
+		aggregate_push(job->stack, &job->nr, &item, job->routes, job->mode);
+	}
+	return NULL;
+}
+
+/* can partitions of 'sf' be aggregated independently?
+ * a sorted, simplified file of network addresses has a single maximal aggregation
+ * (for each GW if mode == 1), so merging the partial results gives the sequential result;
+ * prefixes with host bits set can overlap and then the order of merges matters
+ */
+static int aggregate_can_split(struct subnet_file *sf)
+{
+	unsigned long i;
+	struct subnet s;
+
+	for (i = 0; i < sf->nr; i++) {
+		copy_subnet(&s, &sf->routes[i].subnet);
+		if (s.mask == 0)
+			return 0;
+		first_ip(&s);
+		if (!is_equal_ip(&s.ip_addr, &sf->routes[i].subnet.ip_addr))
+			return 0;
 	}
 	return 1;
 }
@@ -612,95 +1518,95 @@ int route_file_simplify(struct subnet_file *sf,  int mode)
 /*
  * mode == 1 means we take the GW into acoount
  * mode == 0 means we dont take the GW into account
+ * with nr_threads > 1, each thread aggregates a partition of the sorted file,
+ * then the partial aggregates are pushed in order on the final stack
  */
-int aggregate_route_file(struct subnet_file *sf, int mode)
+int aggregate_route_file(struct subnet_file *sf, int mode, int nr_threads)
 {
-	unsigned long i, j;
-	int res;
-	struct subnet s;
-	struct route *new_r;
+	struct aggregate_job jobs[ST_MAX_THREADS];
+	unsigned long bounds[ST_MAX_THREADS + 1];
+	unsigned long i, j, nr;
+	struct agg_item *stack, item;
+	struct route *new_r, *r;
+	int res, t;
 
+	if (sf->nr == 0)
+		return 0;
 	/* first, remove duplicates and sort the crap*/
 	debug_timing_start(2);
-	res = subnet_file_simplify(sf);
+	nr_threads = max(nr_threads, 1);
+	if (nr_threads == 1) {
+		bounds[0] = 0;
+		bounds[1] = sf->nr;
+	}
+	res = __subnet_sort_by(sf, __route_prefix_key, nr_threads, bounds);
+	if (res < 0) {
+		debug_timing_end(2);
+		return res;
+	}
+	res = __subnet_file_simplify(sf, nr_threads, bounds);
 	if (res < 0) {
 		debug_timing_end(2);
 		return res;
 	}
+	if (nr_threads > 1 && !aggregate_can_split(sf)) {
+		debug(AGGREGATE, 2, "prefixes with host bits set, aggregating on 1 thread\n");
+		for (t = 1; t <= nr_threads; t++)
+			bounds[t] = sf->nr;
+	}
+	stack = st_malloc(sf->nr * sizeof(struct agg_item), "aggregate stack");
+	if (stack == NULL) {
+		debug_timing_end(2);
+		return -1;
+	}
 	new_r = st_malloc(sf->nr * sizeof(struct route), "struct route");
 	if (new_r == NULL) {
+		st_free(stack, sf->nr * sizeof(struct agg_item));
 		debug_timing_end(2);
 		return -1;
 	}
-	copy_route(&new_r[0], &sf->routes[0]);
-	j = 0; /* i is the index in the original file, j is the index in the file we are building */
-	for (i = 1; i < sf->nr; i++) {
-		if (mode == 1 && !is_equal_gw(&new_r[j],  &sf->routes[i])) {
-			st_debug(AGGREGATE, 4, "Entry %lu '%P' & %lu '%P' cant aggregate, different GW\n",
-					j, new_r[j].subnet,
-					i, sf->routes[i].subnet);
-			j++;
-			copy_route(&new_r[j], &sf->routes[i]);
-			continue;
+	for (t = 0; t < nr_threads; t++) {
+		jobs[t].routes = sf->routes;
+		jobs[t].stack  = stack + bounds[t];
+		jobs[t].first  = bounds[t];
+		jobs[t].last   = bounds[t + 1];
+		jobs[t].mode   = mode;
+	}
+	run_threads(nr_threads, aggregate_thread, jobs, sizeof(struct aggregate_job));
+	/* stitch; the final stack never grows past the item being pushed, so it is built in place */
+	nr = jobs[0].nr;
+	for (t = 1; t < nr_threads; t++) {
+		for (i = 0; i < jobs[t].nr; i++) {
+			item = jobs[t].stack[i];
+			aggregate_push(stack, &nr, &item, sf->routes, mode);
 		}
-		res = aggregate_subnet(&new_r[j].subnet, &sf->routes[i].subnet, &s);
-		if (res < 0) {
-			st_debug(AGGREGATE, 4, "Entry %lu '%P' & %lu '%P' cant aggregate\n",
-					j, new_r[j].subnet,
-					i, sf->routes[i].subnet);
-			j++;
-			copy_route(&new_r[j], &sf->routes[i]);
+	}
+	/* build the aggregated routes; each aggregate inherits from its first route */
+	j = 0;
+	for (i = 0; i < sf->nr; i++) {
+		r = &sf->routes[i];
+		if (j == nr || stack[j].first != i)
 			continue;
+		copy_route(&new_r[j], r);
+		if (stack[j].merged) {
+			copy_subnet(&new_r[j].subnet, &stack[j].subnet);
+			if (mode == 0)
+				zero_ipaddr(&new_r[j].gw); /* the aggregate route has null gateway */
+			ea_intern(&sf->ea_values, &new_r[j].ea[0], "AGGREGATE");
+			if (new_r[j].ea[0].value == NULL) {
+				st_free(new_r, sizeof(struct route) * sf->nr);
+				st_free(stack, sf->nr * sizeof(struct agg_item));
+				debug_timing_end(2);
+				return -1;
+			}
 		}
-		st_debug(AGGREGATE, 4, "Entry %lu '%P' & %lu '%P' can aggregate\n",
-				j, new_r[j].subnet,
-				i, sf->routes[i].subnet);
-		copy_subnet(&new_r[j].subnet, &s);
-		if (mode == 1)
-			copy_ipaddr(&new_r[j].gw, &sf->routes[i].gw);
-		else
-			zero_ipaddr(&new_r[j].gw); /* the aggregate route has null gateway */
-		free_route(&sf->routes[i]);
-		st_free_string(new_r[j].ea[0].value);
-		ea_strdup(&new_r[j].ea[0], "AGGREGATE");
-		if (new_r[j].ea[0].value == NULL) {
-			st_free(new_r, sizeof(struct route) * sf->nr);
-			debug_timing_end(2);
-			return -1;
-		}
-		/* rewinding and aggregating backwards as much as we can;
-		 * the aggregate we just created may aggregate with j - 1
-		 */
-		while (j > 0) {
-			if (mode == 1 && !is_equal_gw(&new_r[j], &new_r[j - 1]))
-				break;
-			res = aggregate_subnet(&new_r[j].subnet, &new_r[j - 1].subnet, &s);
-			if (res >= 0) {
-				st_debug(AGGREGATE, 4, "Rewinding, entry %lu '%P' & %lu '%P' can aggregate\n",
-						j - 1, new_r[j - 1].subnet,
-						j, new_r[j].subnet);
-				free_route(&new_r[j]);
-				j--;
-				copy_subnet(&new_r[j].subnet, &s);
-				if (mode == 1)
-					copy_ipaddr(&new_r[j].gw, &sf->routes[i].gw);
-				else
-					zero_ipaddr(&new_r[j].gw);
-				st_free_string(new_r[j].ea[0].value);
-				ea_strdup(&new_r[j].ea[0], "AGGREGATE");
-				if (new_r[j].ea[0].value == NULL) {
-					st_free(new_r, sizeof(struct route) * sf->nr);
-					debug_timing_end(2);
-					return -1;
-				}
-			} else
-				break;
-		} /* while j */
-	} /* for i */
+		j++;
+	}
+	st_free(stack, sf->nr * sizeof(struct agg_item));
 	st_free(sf->routes, sizeof(struct route) * sf->max_nr);
 	sf->routes = new_r;
 	sf->max_nr = sf->nr;
-	sf->nr = j + 1;
+	sf->nr = j;
 	debug_timing_end(2);
 	return 1;
 }
@@ -708,9 +1614,10 @@ int aggregate_route_file(struct subnet_file *sf, int mode)
 int subnet_file_merge_common_routes(const struct subnet_file *sf1,  const struct subnet_file *sf2,
 		struct subnet_file *sf3)
 {
-	unsigned long  i, j, can_add;
+	unsigned long  i, j;
 	int res;
 	struct route *r;
+	char *rel1, *rel2;
 	TAS tas;
 
 	debug_timing_start(2);
@@ -725,47 +1632,44 @@ int subnet_file_merge_common_routes(const struct subnet_file *sf1,  const struct
 		debug_timing_end(2);
 		return res;
 	}
+	rel1 = st_malloc(sf1->nr + sf2->nr + 1, "route relations");
+	if (rel1 == NULL) {
+		free_subnet_file(sf3);
+		free_tas(&tas);
+		debug_timing_end(2);
+		return -1;
+	}
+	rel2 = rel1 + sf1->nr;
+	res = subnet_file_relations(sf1, sf2, rel1, rel2);
+	if (res < 0) {
+		st_free(rel1, sf1->nr + sf2->nr + 1);
+		free_subnet_file(sf3);
+		free_tas(&tas);
+		debug_timing_end(2);
+		return res;
+	}
 	/* going through subnet_file1 ; adding to stack only if equals or included */
 	for (i = 0; i < sf1->nr; i++) {
-		for (j = 0; j < sf2->nr; j++) {
-			res = subnet_compare(&sf1->routes[i].subnet, &sf2->routes[j].subnet);
-			if (res == INCLUDED || res == EQUALS) {
-				st_debug(ADDRCOMP, 3, "Loop #1 adding %P (included in : %P)\n",
-						sf1->routes[i].subnet,
-						sf2->routes[j].subnet);
-				addTAS(&tas, &sf1->routes[i]);
-				break;
-			}
+		if (rel1[i] & (REL_EQUALS|REL_INCLUDED)) {
+			st_debug(ADDRCOMP, 3, "Loop #1 adding %P\n", sf1->routes[i].subnet);
+			addTAS(&tas, &sf1->routes[i]);
 		}
 	}
-	/* going through subnet_file2 ; adding to stack only if INCLUDED */
+	/* going through subnet_file2 ; adding to stack only if INCLUDED
+	 * EQUALS routes were already added in loop #1
+	 */
 	for (j = 0; j < sf2->nr; j++) {
-		can_add = 0;
-		for (i = 0; i < sf1->nr; i++) {
-			res = subnet_compare(&sf2->routes[j].subnet, &sf1->routes[i].subnet);
-			if (res == INCLUDED) {
-				st_debug(ADDRCOMP, 3, "Loop #2 may add %P (included in : %P)\n",
-						sf2->routes[j].subnet,
-						sf1->routes[i].subnet);
-				can_add = 1;
-			} else if (res == EQUALS) {/* already added, skipping */
-				can_add = 0;
-				 /* maybe the route we are matching is included in something;
-				  * in that case we wont add it again
-				  */
-				break;
-			}
-		}
-		if (can_add) {
+		if ((rel2[j] & REL_INCLUDED) && !(rel2[j] & REL_EQUALS)) {
 			st_debug(ADDRCOMP, 3, "Loop #2 add %P\n", sf2->routes[j].subnet);
 			addTAS(&tas, &sf2->routes[j]);
 		}
 	}
+	st_free(rel1, sf1->nr + sf2->nr + 1);
 	for (i = 0; ; i++) {
 		r = popTAS(&tas);
 		if (r == NULL)
 			break;
-		clone_route_nofree(&sf3->routes[i], r);
+		clone_route_nofree(&sf3->routes[i], r, &sf3->arena, &sf3->ea_values);
 	}
 	sf3->nr = i;
 	free_tas(&tas);
@@ -781,7 +1685,7 @@ unsigned long long sum_subnet_file(struct subnet_file *sf)
 	int ipver;
 
 	ipver = sf->routes[0].subnet.ip_ver;
-	res = subnet_file_simplify(sf);
+	res = subnet_file_simplify(sf, 1);
 	if (res < 0)
 		return 0;
 	for (i = 0; i < sf->nr; i++) {
@@ -798,6 +1702,25 @@ unsigned long long sum_subnet_file(struct subnet_file *sf)
 	return sum;
 }
 
+/* make room for 'nr' routes in sf */
+static int subnet_file_reserve(struct subnet_file *sf, unsigned long nr)
+{
+	struct route *new_r;
+	unsigned long new_max = max(sf->max_nr, 16UL);
+
+	while (nr > new_max)
+		new_max *= 2;
+	if (new_max == sf->max_nr)
+		return 1;
+	new_r = st_realloc(sf->routes, sizeof(struct route) * new_max,
+			sizeof(struct route) * sf->max_nr, "struct route");
+	if (new_r == NULL)
+		return -3;
+	sf->routes = new_r;
+	sf->max_nr = new_max;
+	return 1;
+}
+
 /*
  * result is stored in *sf2
  */
@@ -806,7 +1729,6 @@ int subnet_file_remove_subnet(const struct subnet_file *sf1, struct subnet_file
 	unsigned long i, j;
 	int res, n;
 	struct subnet *r;
-	struct route *new_r;
 
 	j = 0;
 	res = alloc_subnet_file(sf2, sf1->max_nr);
@@ -815,7 +1737,10 @@ int subnet_file_remove_subnet(const struct subnet_file *sf1, struct subnet_file
 	for (i = 0; i < sf1->nr; i++) {
 		res = subnet_compare(&sf1->routes[i].subnet, subnet);
 		if (res == NOMATCH || res == INCLUDED) {
-			clone_route_nofree(&sf2->routes[j],  &sf1->routes[i]);
+			if (subnet_file_reserve(sf2, j + 1) < 0)
+				return -3;
+			clone_route_nofree(&sf2->routes[j], &sf1->routes[i], &sf2->arena,
+					&sf2->ea_values);
 			j++;
 			st_debug(ADDRREMOVE, 4, "%P is not included in %P\n",
 					*subnet, sf1->routes[i]);
@@ -830,17 +1755,14 @@ int subnet_file_remove_subnet(const struct subnet_file *sf1, struct subnet_file
 			return n;
 		}
 		/* realloc memory if necessary */
-		if (n + sf2->nr >= sf2->max_nr) {
-			new_r = st_realloc(sf2->routes, sizeof(struct route) * sf2->max_nr * 2,
-					sizeof(struct route) * sf2->max_nr, "struct route");
-			if (new_r == NULL)
-				return -3;
-			sf2->routes = new_r;
-			sf2->max_nr *= 2;
+		if (subnet_file_reserve(sf2, j + n) < 0) {
+			st_free(r, sizeof(struct subnet) * n);
+			return -3;
 		}
 		for (res = 0; res < n; res++) {
 			/* copy comment, device ... */
-			clone_route_nofree(&sf2->routes[j], &sf1->routes[i]);
+			clone_route_nofree(&sf2->routes[j], &sf1->routes[i], &sf2->arena,
+					&sf2->ea_values);
 			copy_subnet(&sf2->routes[j].subnet, &r[res]);
 			j++;
 		}
@@ -852,7 +1774,7 @@ int subnet_file_remove_subnet(const struct subnet_file *sf1, struct subnet_file
 
 /*
  * subnets from sf3 are removed from sf1
- * result is stored in *sf2 BUGGED
+ * result is stored in *sf2, sf1 is left untouched
  */
 int subnet_file_remove_file(struct subnet_file *sf1, struct subnet_file *sf2,
 		const struct subnet_file *sf3)
@@ -862,19 +1784,30 @@ int subnet_file_remove_file(struct subnet_file *sf1, struct subnet_file *sf2,
 	struct subnet_file sf;
 
 	debug_timing_start(2);
-	memcpy(&sf, sf1, sizeof(struct subnet_file));
-
+	if (sf3->nr == 0) {
+		res = alloc_subnet_file(sf2, sf1->max_nr);
+		if (res < 0) {
+			debug_timing_end(2);
+			return res;
+		}
+		for (i = 0; i < sf1->nr; i++)
+			clone_route_nofree(&sf2->routes[i], &sf1->routes[i], &sf2->arena,
+					&sf2->ea_values);
+		sf2->nr = sf1->nr;
+	}
 	for (i = 0; i < sf3->nr; i++) {
 		st_debug(ADDRREMOVE, 4, "Loop %d, Removing %P\n", i, sf3->routes[i].subnet);
-		res = subnet_file_remove_subnet(&sf, sf2, &sf3->routes[i].subnet);
+		res = subnet_file_remove_subnet((i ? &sf : sf1), sf2, &sf3->routes[i].subnet);
+		/* the result of the previous loop is not needed anymore */
+		if (i)
+			free_subnet_file(&sf);
 		if (res < 0) {
 			debug_timing_end(2);
 			return res;
 		}
-		st_free(sf.routes, sf.max_nr * sizeof(struct route));
 		memcpy(&sf, sf2, sizeof(struct subnet_file));
 	}
-	subnet_file_simplify(sf2);
+	subnet_file_simplify(sf2, 1);
 	debug_timing_end(2);
 	return 1;
 }
@@ -1096,78 +2029,15 @@ int subnet_split_2(FILE *out, const struct subnet *s, char *string_levels)
 	return 1;
 }
 
-static int __heap_gw_is_superior(void *v1, void *v2)
-{
-	struct subnet *s1 = &((struct route *)v1)->subnet;
-	struct subnet *s2 = &((struct route *)v2)->subnet;
-	struct ip_addr *gw1 = &((struct route *)v1)->gw;
-	struct ip_addr *gw2 = &((struct route *)v2)->gw;
-
-	if (is_equal_ip(gw1, gw2))
-		return subnet_is_superior(s1, s2);
-	else
-		return addr_is_superior(gw1, gw2);
-}
-
-static int __heap_mask_is_superior(void *v1, void *v2)
-{
-	struct subnet *s1 = &((struct route *)v1)->subnet;
-	struct subnet *s2 = &((struct route *)v2)->subnet;
-
-	if (s1->mask == s2->mask)
-		return subnet_is_superior(s1, s2);
-	else
-		return (s1->mask < s2->mask);
-}
-
-/* sort a subnet file 'sf' with a custom cmp function
- *
- */
-static int __subnet_sort_by(struct subnet_file *sf, int cmpfunc(void *v1, void *v2))
-{
-	unsigned long i;
-	int res;
-	TAS tas;
-	struct route *new_r, *r;
-
-	if (sf->nr == 0)
-		return 0;
-	debug_timing_start(2);
-	res = alloc_tas(&tas, sf->nr, cmpfunc);
-	if (res < 0) {
-		debug_timing_end(2);
-		return res;
-	}
-	new_r = st_malloc(sf->max_nr * sizeof(struct route), "struct route");
-	if (new_r == NULL) {
-		free_tas(&tas);
-		debug_timing_end(2);
-		return -1;
-	}
-	tas.print = __heap_print_subnet;
-	/* basic heapsort */
-	for (i = 0 ; i < sf->nr; i++)
-		addTAS(&tas, &(sf->routes[i]));
-	for (i = 0 ; i < sf->nr; i++) {
-		r = popTAS(&tas);
-		copy_route(&new_r[i], r);
-	}
-	free_tas(&tas);
-	st_free(sf->routes, sizeof(struct route) * sf->max_nr);
-	sf->routes = new_r;
-	debug_timing_end(2);
-	return 0;
-}
-
 struct subnetsort {
 	char *name;
-	int (*cmpfunc)(void *v1, void *v2);
+	int (*keyfunc)(unsigned char *key, const struct route *r, int addr_len);
 };
 
 static const struct subnetsort subnetsort[] = {
-	{ "prefix",	&__heap_subnet_is_superior },
-	{ "gw",		&__heap_gw_is_superior },
-	{ "mask",	&__heap_mask_is_superior },
+	{ "prefix",	&__route_prefix_key },
+	{ "gw",		&__route_gw_key },
+	{ "mask",	&__route_mask_key },
 	{NULL,		NULL}
 };
 
@@ -1183,7 +2053,7 @@ void subnet_available_cmpfunc(FILE *out)
 	}
 }
 
-int subnet_sort_by(struct subnet_file *sf, char *name)
+int subnet_sort_by(struct subnet_file *sf, char *name, int nr_threads)
 {
 	int i = 0;
 
@@ -1191,12 +2061,65 @@ int subnet_sort_by(struct subnet_file *sf, char *name)
 		if (subnetsort[i].name == NULL)
 			break;
 		if (!strncasecmp(name, subnetsort[i].name, strlen(name)))
-			return __subnet_sort_by(sf, subnetsort[i].cmpfunc);
+			return __subnet_sort_by(sf, subnetsort[i].keyfunc, nr_threads, NULL);
 		i++;
 	}
 	return -1664;
 }
 
+struct sort_output {
+	struct st_options *nof;
+	struct route_printer *p; /* NULL prints all EA */
+	unsigned long nr;
+};
+
+static int sort_output_ea_used(struct subnet_file *sf, int ea_num, void *data)
+{
+	struct sort_output *so = data;
+
+	return so->p == NULL || route_printer_uses_ea(so->p, ea_num);
+}
+
+static int sort_output_route(const struct route *r, void *data)
+{
+	struct sort_output *so = data;
+
+	if (so->nr++ == 0 && so->nof->print_header)
+		fprint_route_header(so->nof->output_file, r, so->nof->output_fmt);
+	if (so->p)
+		route_printer_print(so->p, NULL, 0, r);
+	else
+		fprint_route(so->nof->output_file, r, 3);
+	return 1;
+}
+
+int subnet_file_extsort(char *name, char *by, int use_fmt, struct st_options *nof)
+{
+	struct sort_output so;
+	int i = 0, res;
+
+	while (1) {
+		if (subnetsort[i].name == NULL)
+			return -1664;
+		if (!strncasecmp(by, subnetsort[i].name, strlen(by)))
+			break;
+		i++;
+	}
+	so.nof = nof;
+	so.nr  = 0;
+	so.p   = NULL;
+	if (use_fmt) {
+		so.p = alloc_route_printer(nof->output_file, nof->output_fmt);
+		if (so.p == NULL)
+			return -1;
+	}
+	res = extsort_routes(name, nof, nof->sort_mem, subnetsort[i].keyfunc,
+			&sort_output_ea_used, &sort_output_route, &so);
+	if (so.p)
+		free_route_printer(so.p);
+	return res;
+}
+
 int fprint_routefilter_help(FILE *out)
 {
 
@@ -1219,80 +2142,133 @@ int fprint_routefilter_help(FILE *out)
 			"- '%%' (st_scanf case insensitive regular expression)\n");
 }
 
-/* filter a route 'object' against 'value' with operator 'op'
+#define RF_PREFIX	1
+#define RF_GW		2
+#define RF_MASK		3
+#define RF_DEVICE	4
+#define RF_EA		5
+#define RF_EA_STR	6 /* EA of a streamed file, its values are not interned */
+
+/* bind a comparison of a route filter: parse its constant once,
+ * and resolve its field name; EA are resolved to their index in sf->ea
+ * (all routes of 'sf' share the same EA layout)
+ */
+static int route_filter_bind(struct expr_node *n, void *ctx)
+{
+	struct subnet_file *sf = ctx;
+	int res;
+
+	if (!strcmp(n->string, "prefix") || !strcmp(n->string, "gw")) {
+		n->field = (n->string[0] == 'p' ? RF_PREFIX : RF_GW);
+		res = get_subnet_or_ip(n->value, &n->subnet);
+		if (res < 0) {
+			debug(FILTER, 1, "Filtering on %s %c '%s',  but it is not an IP\n",
+					n->string, n->op, n->value);
+			n->bad_value = 1;
+		}
+	} else if (!strcmp(n->string, "mask")) {
+		n->field = RF_MASK;
+		n->ival  = string2mask(n->value, 42);
+		if (n->ival < 0) {
+			debug(FILTER, 1, "Filtering on mask %c '%s',  but it is valid\n",
+					n->op, n->value);
+			n->bad_value = 1;
+		}
+	} else if (!strcmp(n->string, "device")) {
+		n->field = RF_DEVICE;
+		/* devices are compared by ID; the routes of a stream are not all read yet,
+		 * the device is registered so that they get the same ID
+		 * a name too long for the table is no device (device_id would truncate it)
+		 */
+		if (strlen(n->value) >= DEVICE_NAME_LEN)
+			n->ival = -1;
+		else
+			n->ival = (sf->sink ? device_id(n->value) : device_find(n->value));
+	} else {
+		n->field = (sf->sink ? RF_EA_STR : RF_EA);
+		n->ea_index = find_ea_index(sf->ea, sf->ea_nr, n->string);
+		if (n->ea_index < 0)
+			debug(FILTER, 1, "Cannot filter on attribute '%s'\n", n->string);
+		/* EA values are interned, they are compared by pointer */
+		if (n->field == RF_EA)
+			n->key = strtab_find(&sf->ea_values, n->value);
+		if (n->op == '<' || n->op == '>') {
+			n->ival = string2int(n->value, &res);
+			if (res < 0) {
+				debug(FILTER, 1, "Cannot interpret Field '%s' as an INT\n", n->value);
+				n->bad_value = 1;
+			}
+		}
+	}
+	return 1;
+}
+
+/* filter a route 'object' against a bound comparison 'n'
  *
- * s      : string to interpret
- * value  : its value
- * op     : the operator
- * object : a struct route; input string 's' will tell which field to test
+ * n      : the comparison, see route_filter_bind
+ * object : a struct route
  */
-static int route_filter(const char *s, const char *value, char op, void *object)
+static int route_filter(const struct expr_node *n, void *object)
 {
 	struct route *route = object;
-	struct subnet subnet;
 	int res;
 
-	debug(FILTER, 8, "Filtering '%s' %c '%s'\n", s, op, value);
-	if (!strcmp(s, "prefix")) {
-		res = get_subnet_or_ip(value, &subnet);
-		if (res < 0) {
-			debug(FILTER, 1, "Filtering on prefix %c '%s',  but it is not an IP\n",
-					op, value);
+	switch (n->field) {
+	case RF_PREFIX:
+		if (n->bad_value)
 			return -1;
-		}
-		return subnet_filter(&route->subnet, &subnet, op);
-	} else if (!strcmp(s, "gw")) {
+		return subnet_filter(&route->subnet, &n->subnet, n->op);
+	case RF_GW:
 		if (route->gw.ip_ver == 0)
 			return 0;
-		res = get_subnet_or_ip(value, &subnet);
-		if (res < 0) {
-			debug(FILTER, 1, "Filtering on gw %c '%s',  but it is not an IP\n",
-					op, value);
+		if (n->bad_value)
 			return -1;
-		}
-		return addr_filter(&route->gw, &subnet, op);
-	} else if (!strcmp(s, "mask")) {
-		res =  string2mask(value, 42);
-		if (res < 0) {
-			debug(FILTER, 1, "Filtering on mask %c '%s',  but it is valid\n",
-					op, value);
+		return addr_filter(&route->gw, &n->subnet, n->op);
+	case RF_MASK:
+		if (n->bad_value)
 			return -1;
-		}
-		switch (op) {
+		switch (n->op) {
 		case '=':
-			return route->subnet.mask == res;
+			return route->subnet.mask == n->ival;
 		case '#':
-			return route->subnet.mask != res;
+			return route->subnet.mask != n->ival;
 		case '<':
-			return route->subnet.mask < res;
+			return route->subnet.mask < n->ival;
 		case '>':
-			return route->subnet.mask > res;
+			return route->subnet.mask > n->ival;
 		default:
-			debug(FILTER, 1, "Unsupported op '%c' for mask\n", op);
+			debug(FILTER, 1, "Unsupported op '%c' for mask\n", n->op);
 			return 0;
 		}
-	} else if (!strcmp(s, "device")) {
-		switch (op) {
+	case RF_DEVICE:
+		switch (n->op) {
 		case '=':
-			return !strcmp(route->device, value);
+			return route->device == n->ival;
 		case '#':
-			return !!strcmp(route->device, value);
+			return route->device != n->ival;
 		case '~':
-			res = st_sscanf(route->device, value);
+			res = st_sscanf(device_name(route->device), n->value);
 			if (res == -1)
 				return 0;
 			return 1;
 		case '%':
-			res = st_sscanf_ci(route->device, value);
+			res = st_sscanf_ci(device_name(route->device), n->value);
 			if (res == -1)
 				return 0;
 			return 1;
 		default:
-			debug(FILTER, 1, "Unsupported op '%c' for device\n", op);
+			debug(FILTER, 1, "Unsupported op '%c' for device\n", n->op);
 			return -1;
 		}
-	} else
-		return filter_ea(route->ea, route->ea_nr, s, value, op);
+	default:
+		if (n->ea_index < 0 || n->ea_index >= route->ea_nr)
+			return 0;
+		if (n->field == RF_EA_STR)
+			return filter_ea_value(route->ea[n->ea_index].value, n->value,
+					n->ival, n->bad_value, n->op);
+		return filter_ea_key(route->ea[n->ea_index].value, n->value, n->key,
+				n->ival, n->bad_value, n->op);
+	}
 }
 
 /*
@@ -1306,29 +2282,32 @@ static int route_filter(const char *s, const char *value, char op, void *object)
 int subnet_file_filter(struct subnet_file *sf, char *expr)
 {
 	unsigned long i, j;
-	int res, len;
+	int res;
 	struct generic_expr e;
 	struct route *new_r;
 
 	if (sf->nr == 0)
 		return 0;
-	init_generic_expr(&e, expr, route_filter);
+	init_generic_expr(&e, expr, NULL);
+	if (compile_generic_expr(&e) < 0)
+		return -1;
+	bind_generic_expr(&e, route_filter_bind, sf, route_filter);
 	debug_timing_start(2);
 
 	new_r = st_malloc(sf->nr * sizeof(struct route), "struct route");
 	if (new_r == NULL) {
+		free_generic_expr(&e);
 		debug_timing_end(2);
 		return -1;
 	}
 	j = 0;
-	len = strlen(expr);
 
 	for (i = 0; i < sf->nr; i++) {
-		e.object = &sf->routes[i];
-		res = run_generic_expr(expr, len, &e);
+		res = eval_generic_expr(&e, &sf->routes[i]);
 		if (res < 0) {
 			fprintf(stderr, "Invalid filter '%s'\n", expr);
 			st_free(new_r, sf->nr * sizeof(struct route));
+			free_generic_expr(&e);
 			debug_timing_end(2);
 			return -1;
 		}
@@ -1337,9 +2316,9 @@ int subnet_file_filter(struct subnet_file *sf, char *expr)
 					expr, sf->routes[i].subnet);
 			copy_route(&new_r[j], &sf->routes[i]);
 			j++;
-		} else
-			free_route(&sf->routes[i]);
+		}
 	}
+	free_generic_expr(&e);
 	st_free(sf->routes, sf->max_nr * sizeof(struct route));
 	sf->routes = new_r;
 	sf->max_nr = sf->nr;
@@ -1347,3 +2326,139 @@ int subnet_file_filter(struct subnet_file *sf, char *expr)
 	debug_timing_end(2);
 	return 0;
 }
+
+struct route_stream {
+	struct st_options *nof;
+	struct route_printer *p;
+	struct generic_expr e;
+	const char *expr; /* filter, or NULL */
+	const struct subnet *remove; /* removed from each route, or NULL */
+	int header;
+	int failed; /* the sink failed and said why */
+};
+
+/* the filter is bound as soon as the EA of the file are known, see route_stream_ea_used */
+static int route_stream_bind(struct subnet_file *sf, void *data)
+{
+	struct route_stream *rs = data;
+
+	if (rs->expr)
+		bind_generic_expr(&rs->e, route_filter_bind, sf, route_filter);
+	return 1;
+}
+
+/* only the EA printed or filtered on are stored */
+static int route_stream_ea_used(struct subnet_file *sf, int ea_num, void *data)
+{
+	struct route_stream *rs = data;
+	int i;
+
+	if (route_printer_uses_ea(rs->p, ea_num))
+		return 1;
+	if (rs->expr == NULL)
+		return 0;
+	for (i = 0; i < rs->e.nr_nodes; i++)
+		if (rs->e.nodes[i].type == EXPR_COMPARE && rs->e.nodes[i].field == RF_EA_STR
+				&& rs->e.nodes[i].ea_index == ea_num)
+			return 1;
+	return 0;
+}
+
+/* sees every valid route, the header is printed even if none matches */
+static int route_stream_filter(struct subnet_file *sf, struct route *r, void *data)
+{
+	struct route_stream *rs = data;
+	int res;
+
+	if (sf->nr_scanned == 1 && rs->header)
+		fprint_route_header(rs->nof->output_file, r, rs->nof->output_fmt);
+	if (rs->expr == NULL)
+		return 1;
+	res = eval_generic_expr(&rs->e, r);
+	if (res < 0) {
+		fprintf(stderr, "Invalid filter '%s'\n", rs->expr);
+		rs->failed = 1;
+		return -1;
+	}
+	if (res)
+		st_debug(FILTER, 5, "Matching filter '%s' on %P\n", rs->expr, r->subnet);
+	return res;
+}
+
+static const struct netcsv_pushdown route_stream_pushdown = {
+	&route_stream_bind, &route_stream_ea_used, &route_stream_filter
+};
+
+static int route_stream_sink(struct subnet_file *sf, struct route *r, void *data)
+{
+	struct route_stream *rs = data;
+	struct route piece;
+	struct subnet *pieces;
+	int i, n, res;
+
+	if (r == NULL) {
+		route_printer_flush(rs->p);
+		return CSV_CONTINUE;
+	}
+	if (rs->remove == NULL) {
+		route_printer_print(rs->p, NULL, 0, r);
+		return CSV_CONTINUE;
+	}
+	/* like subnet_file_remove_subnet */
+	res = subnet_compare(&r->subnet, rs->remove);
+	if (res == NOMATCH || res == INCLUDED) {
+		route_printer_print(rs->p, NULL, 0, r);
+		return CSV_CONTINUE;
+	} else if (res == EQUALS)
+		return CSV_CONTINUE;
+	pieces = subnet_remove(&r->subnet, rs->remove, &n);
+	if (n == -1) {
+		fprintf(stderr, "%s : no memory\n", __func__);
+		rs->failed = 1;
+		return -1;
+	}
+	/* the pieces share the device, GW and EA of 'r' */
+	piece = *r;
+	for (i = 0; i < n; i++) {
+		copy_subnet(&piece.subnet, &pieces[i]);
+		route_printer_print(rs->p, NULL, 0, &piece);
+	}
+	st_free(pieces, sizeof(struct subnet) * n);
+	return CSV_CONTINUE;
+}
+
+int subnet_file_stream(char *name, char *expr, const struct subnet *remove, int header,
+		struct st_options *nof)
+{
+	struct route_stream rs;
+	int res;
+
+	rs.nof	  = nof;
+	rs.expr	  = expr;
+	rs.remove = remove;
+	rs.header = header;
+	rs.failed = 0;
+	if (expr) {
+		init_generic_expr(&rs.e, expr, NULL);
+		if (compile_generic_expr(&rs.e) < 0) {
+			fprintf(stderr, "Invalid filter '%s'\n", expr);
+			return -1;
+		}
+	}
+	rs.p = alloc_route_printer(nof->output_file, nof->output_fmt);
+	if (rs.p == NULL) {
+		if (expr)
+			free_generic_expr(&rs.e);
+		return -1;
+	}
+	res = load_netcsv_stream(name, nof, &route_stream_pushdown, &route_stream_sink, &rs);
+	free_route_printer(rs.p);
+	if (expr)
+		free_generic_expr(&rs.e);
+	if (res < 0) {
+		if (!rs.failed)
+			fprintf(stderr, "Invalid file %s\n", (name ? name : "<stdin>"));
+		return res;
+	}
+	return 1;
+}
@@ -13,24 +13,80 @@ int uniq_routes(const struct subnet_file *sf1, const struct subnet_file *sf2,
 void print_file_against_paip(struct subnet_file *sf1, const struct subnet_file *paip,
 		struct st_options *nof);
 int network_grep_file(char *name, struct st_options *nof, char *ip);
+/* network_grep_prefix_file: print each line of file 'name' (or stdin if "-") holding an IP
+ * or prefix that EQUALS, INCLUDES or is INCLUDED in one of the prefixes of 'patterns_name'
+ * a line is printed once; with nof->grep_tag, it is preceded by the pattern matched by its
+ * first matching IP token and the first char of nof->delim
+ * returns:
+ *	positive on SUCCESS
+ *	negative on error (ENOMEM, cannot open file)
+ */
+int network_grep_prefix_file(const char *patterns_name, const char *name,
+		struct st_options *nof);
+/* network_lookup_file: longest prefix match of each address (or prefix) of file 'name'
+ * against the routes of sf; 'name' is "-" for stdin
+ * prints the address then the best route with nof->output_fmt, or "NOT FOUND"
+ * IPv4 addresses are looked up in a DIR-24-8 table (64 MiB), prefixes and IPv6 in a trie
+ * returns:
+ *	positive on SUCCESS
+ *	negative on error (ENOMEM, cannot open file)
+ */
+int network_lookup_file(const struct subnet_file *sf, const char *name, struct st_options *nof);
+/* network_annotate_file: append to each line of file 'name' (or stdin if "-")
+ * the EA of the route of sf that best matches the address in field 'field' (starting at 1)
+ * fields are separated by nof->delim like with -grep_field, the EA are appended after the
+ * first char of nof->delim
+ * lines without a match get "NOT FOUND"; lines whose field is missing or not an IP
+ * (comments, headers) are printed as is
+ * IPv4 addresses are looked up in a DIR-24-8 table (64 MiB), prefixes and IPv6 in a trie
+ * returns:
+ *	positive on SUCCESS
+ *	negative on error (ENOMEM, cannot open file)
+ */
+int network_annotate_file(const struct subnet_file *sf, const char *name, int field,
+		struct st_options *nof);
 
 int subnet_sort_ascending(struct subnet_file *sf);
-int subnet_sort_by(struct subnet_file *sf, char *name);
+/* sort 'sf' by 'name' (see subnet_available_cmpfunc) on 'nr_threads' threads */
+int subnet_sort_by(struct subnet_file *sf, char *name, int nr_threads);
+/* subnet_file_extsort: sort file 'name' (stdin if NULL) by 'by' with at most nof->sort_mem
+ * bytes of memory (see st_extsort.h) and print it with nof->output_fmt if 'use_fmt' is set,
+ * else with all its EA like fprint_subnet_file
+ * returns:
+ *	positive on SUCCESS
+ *	-1664 if 'by' is unknown
+ *	-3 on I/O error on the temp files (the error is printed)
+ *	other negative values if the file is invalid or on ENOMEM
+ */
+int subnet_file_extsort(char *name, char *by, int use_fmt, struct st_options *nof);
 void subnet_available_cmpfunc(FILE *out);
 int fprint_routefilter_help(FILE *out);
 int subnet_file_filter(struct subnet_file *sf, char *expr);
-/* remove duplicate/included entries, and sort */
-int subnet_file_simplify(struct subnet_file *sf);
+/* subnet_file_stream: print the routes of file 'name' (stdin if NULL) as they are parsed,
+ * with nof->output_fmt, in constant memory:
+ * only those matching filter 'expr' if it is not NULL,
+ * with 'remove' removed from them like subnet_file_remove_subnet if it is not NULL,
+ * after the route header if 'header' is set
+ * returns:
+ *	positive on SUCCESS
+ *	negative on error (invalid filter or file, ENOMEM); the error is printed
+ */
+int subnet_file_stream(char *name, char *expr, const struct subnet *remove, int header,
+		struct st_options *nof);
+/* remove duplicate/included entries, and sort; output doesn't depend on nr_threads */
+int subnet_file_simplify(struct subnet_file *sf, int nr_threads);
 /* same but take GW into account, must be equal
  * if mode == 0, prints the simplified route file
  * if mode == 1, prints the routes that can be removed
+ * the file is sorted on 'nr_threads' threads, the GW check is sequential
  */
-int route_file_simplify(struct subnet_file *sf,  int mode);
+int route_file_simplify(struct subnet_file *sf,  int mode, int nr_threads);
 /* aggregates entries from 'sf' as much as possible
  * mode == 1 means we take the GW into acoount
  * mode == 0 means we dont take the GW into account
+ * output doesn't depend on nr_threads
  */
-int aggregate_route_file(struct subnet_file *sf, int mode);
+int aggregate_route_file(struct subnet_file *sf, int mode, int nr_threads);
 
 int subnet_file_merge_common_routes(const struct subnet_file *sf1,
 		const struct subnet_file *sf2, struct subnet_file *sf3);
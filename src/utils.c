@@ -34,12 +34,9 @@ int isUnsignedInt(const char *s)
 
 	if (*s == '\0')
 		return 0;
-	for (i = 1; ; i++) {
+	for (i = 0; s[i] != '\0'; i++)
 		if (!isdigit(s[i]))
 			return 0;
-		if (s[i] == '\0')
-			break;
-	}
 	return 1;
 }
 
@@ -53,12 +50,9 @@ int isInt(const char *s)
 		return 0;
 	if (s[0] == '-' && s[1] == '\0')
 		return 0;
-	for (i = 1; ; i++) {
+	for (i = (s[0] == '-'); s[i] != '\0'; i++)
 		if (!isdigit(s[i]))
 			return 0;
-		if (s[i] == '\0')
-			break;
-	}
 	return 1;
 }
 